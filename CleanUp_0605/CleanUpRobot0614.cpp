@@ -1,6 +1,10 @@
 #include "ControllerEvent.h"  
 #include "Controller.h"  
 #include "Logger.h"  
+#include "GridPlanner.h"
+#include "DStarLite.h"
+#include "VisibilityPlanner.h"
+#include "EntityCatalog.h"
 #include <algorithm>
 #include <string> 
 #include <math.h> 
@@ -12,8 +16,10 @@ using namespace std;
 #define PI 3.1415926535
 #define ARM_RADIUS 18
 #define TRUCK_RADIUS 60
+#define ROUTE_CELL 10.0		// 経路計画の格子の1升 [cm]
 #define ROTATE_ANG 0
-#define FIND_OBJ_BY_ID_MODE false
+#define OBSTACLE_MOVE_EPS 1.0	// これより小さい障害物の動きは無視する [cm]
+#define CATALOG_FILENAME "CleanUpRobot0614.catalog"	// ゴミ・ゴミ箱・障害物の一覧 (環境変数 CLEANUP_CATALOG で変えられる)
 
 // ロボットの状態
 #define INIT_STATE 0			// 初期状態
@@ -147,7 +153,11 @@ public:
 	int getGrabPositionIndex(Node2D objPos, Obstacle obs);
 	Node2D getGrabPosition(Node2D objPos, Obstacle obs);
 	std::vector<Node2D> calcRoute(Node2D startPos, Node2D goalPos, Obstacle obs);
-	std::vector<Node2D> calcFullRoute(Node2D startPos, Node2D goalPos, std::vector<Obstacle> roomObs);
+	std::vector<Node2D> calcFullRoute(Node2D startPos, Node2D goalPos, Obstacle obs);
+	std::vector<Obstacle> routeObstacles(Obstacle obs);
+	bool updateRoomObstacles();
+	void repairRoute(double x, double z);
+	void shortcutRoute(std::vector<Node2D> &route);
 
 private:
   RobotObj *m_my;
@@ -170,6 +180,9 @@ private:
 
 	int m_trashNum;
   
+	// ゴミ・ゴミ箱・障害物のカタログ (CATALOG_FILENAME)
+	EntityRegistry<MyController> m_entities;
+
 	// ゴミ候補オブジェクト
   std::vector<std::string> m_trashes;
 
@@ -183,6 +196,21 @@ private:
 	//Obstacle m_obstacle(0, 0, 0, 0);
 	std::map<std::string, Obstacle> m_obstacleMap;
 	std::vector<Obstacle> m_roomObs;
+	// m_roomObs の名前とハンドル (getObj は最初に1回だけ)
+	std::vector<std::string> m_obstacleName;
+	// カタログに書いた障害物の占有範囲 (m_obstacleName と同じ順番)
+	std::vector<Obstacle> m_obstacleFootprint;
+	std::vector<SimObj *> m_obstacleObj;
+	// 最初に取った障害物の位置 (ここから動いた分だけ m_obstacleFootprint をずらしたものが m_roomObs)
+	std::vector<Vector3d> m_obstacleStart;
+	// m_roomObs を避ける経路計画 (calcFullRoute)。可視グラフで見つからなければ格子で探す
+	VisibilityPlanner m_visibility;
+	GridPlanner m_planner;
+	// 障害物が動いたら、前の格子の探索を直して今の位置からの経路にする (repairRoute)
+	// この部屋の配置では GridPlanner で最初から探すより速い (Common/DStarLite.h)
+	DStarLite m_repair;
+	// 今の経路 (m_route) を求めたときの目的地の近くの障害物
+	Obstacle m_routeObs;
 
   /* ロボットの状態
    * 0 初期状態
@@ -234,14 +262,6 @@ private:
 	int m_nodeId;	
 
 
-	Obstacle m_table_0;//(0., 0., 105., 60.); // scale 1.5
-	Obstacle m_table_1;//(100., -100., 130., 60.);
-	Obstacle m_table_2;//(-50., -90., 70., 40.);
-	Obstacle m_wagon_0;//(100., 100., 60., 65.);
-	Obstacle m_trashbox_0;//(-150., 0., 40., 20.);
-	Obstacle m_trashbox_1;//(-150., -50., 40., 20.);
-	Obstacle m_trashbox_2;//(-150., -100., 40., 20.);
-	
 	bool m_isOstacleCaculated;
 
 };  
@@ -323,6 +343,13 @@ void MyController::onInit(InitEvent &evt)
   m_radius = 10.0;
   m_distance = 10.0;
 
+  // 経路計画はロボットの半径だけ障害物から離れる
+  m_visibility.setClearance(TRUCK_RADIUS);
+  m_planner.setCellSize(ROUTE_CELL);
+  m_planner.setClearance(TRUCK_RADIUS);
+  m_repair.setCellSize(ROUTE_CELL);
+  m_repair.setClearance(TRUCK_RADIUS);
+
   m_time = 0.0;
 
   // 車輪の半径と車輪間距離設定
@@ -351,48 +378,43 @@ seCannedjuice_350ml_c01 	can_2 	20.000 	54.250 	80.000 	12.5 	カン
 seCannedjuice_350ml_c02 	can_3 	40.000 	54.250 	80.000 	12.5 	カン 		
 */
 
-  // ここではゴミの名前が分かっているとします
-	//m_trashNum = 0;
-  //m_trashes.push_back("petbottle_0"); 
-  //m_trashes.push_back("petbottle_1"); 
-  //m_trashes.push_back("petbottle_2"); 
-  //m_trashes.push_back("petbottle_3"); 
-  //m_trashes.push_back("petbottle_4"); 
-  m_trashes.push_back("banana"); 
-  //m_trashes.push_back("chigarette"); 
-  m_trashes.push_back("chocolate"); 
-  //m_trashes.push_back("mayonaise_0"); 
-  m_trashes.push_back("mayonaise_1"); 
-  //m_trashes.push_back("mugcup"); 
-  m_trashes.push_back("can_0"); 
-  m_trashes.push_back("can_1"); 
-  //m_trashes.push_back("can_2"); 
-  //m_trashes.push_back("can_3"); 
-
-
-	// ゴミ箱の名前を何個か入れる 
-	m_trashBoxes.push_back("trashbox_0");
-	m_trashBoxes.push_back("trashbox_1");
-	m_trashBoxes.push_back("trashbox_2"); 
-	m_trashBoxes.push_back("wagon_0"); 
-
-	// ゴミのタイプ及び入れるべきゴミ箱の設定
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("petbottle_0", "wagon_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("petbottle_1", "trashbox_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("petbottle_2", "trashbox_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("petbottle_3", "wagon_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("petbottle_4", "trashbox_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("banana", "wagon_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("chigarette", "wagon_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("chocolate", "wagon_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("mayonaise_0", "wagon_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("mayonaise_1", "trashbox_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("mugcup", "wagon_0"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("can_0", "trashbox_2"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("can_1", "trashbox_2"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("can_2", "trashbox_2"));
-	m_trashTypeMap.insert(std::pair<std::string, std::string>("can_3", "trashbox_2"));
-	
+  // ゴミ・ゴミ箱・入れるべきゴミ箱・障害物の占有範囲はカタログから読む
+  m_entities.init(this);
+  const char *catalog = getenv("CLEANUP_CATALOG");
+  if (catalog == NULL) catalog = CATALOG_FILENAME;
+  std::string catalogError;
+  if (!loadEntityCatalog(catalog, m_entities, catalogError)) {
+    printf("%s \n", catalogError.c_str());
+  }
+  m_trashes.clear();
+  m_trashBoxes.clear();
+  m_trashTypeMap.clear();
+  m_obstacleName.clear();
+  m_obstacleFootprint.clear();
+  const std::vector<int> &trashIds = m_entities.ids(ENT_TRASH);
+  for(int i = 0; i < trashIds.size(); i++) {
+    m_trashes.push_back(m_entities.name(trashIds[i]));
+    if(m_entities.targetBin(trashIds[i]) >= 0) {
+      m_trashTypeMap.insert(std::pair<std::string, std::string>(m_entities.name(trashIds[i]), m_entities.name(m_entities.targetBin(trashIds[i]))));
+    }
+  }
+  const std::vector<int> &binIds = m_entities.ids(ENT_TRASHBOX);
+  for(int i = 0; i < binIds.size(); i++) {
+    m_trashBoxes.push_back(m_entities.name(binIds[i]));
+  }
+  for(int id = 0; id < m_entities.size(); id++) {
+    if(!m_entities.hasFootprint(id)) continue;
+    m_obstacleName.push_back(m_entities.name(id));
+    m_obstacleFootprint.push_back(Obstacle(m_entities.footprintX(id), m_entities.footprintZ(id),
+                                           m_entities.footprintWidth(id), m_entities.footprintDepth(id)));
+  }
+  // 経路計画はカタログの障害物を避ける (動いた分は calcFullRoute などで updateRoomObstacles がずらす)
+  m_roomObs = m_obstacleFootprint;
+  m_obstacleMap.clear();
+  for(int i = 0; i < m_obstacleName.size(); i++) {
+    m_obstacleMap[m_obstacleName[i]] = m_obstacleFootprint[i];
+  }
+
 	// 障害物の初期化
 	//m_obstacle.x = 0;
 	//m_obstacle.y = 60;
@@ -405,6 +427,8 @@ seCannedjuice_350ml_c02 	can_3 	40.000 	54.250 	80.000 	12.5 	カン
 
   // 車輪の回転速度
   m_vel = 1.0;
+  // calcFullRoute は goToObj (m_vel*4) と rotateTowardObj (m_vel) で進む時間が最短の経路を選ぶ
+  m_visibility.setSpeed(m_radius * m_vel * 4, 2.0 * m_radius * m_vel / m_distance);
 
   // 関節の回転速度
   m_jvel = 0.6;
@@ -838,6 +862,12 @@ double MyController::onAction(ActionEvent &evt)
 
 		// 物体の方向が帰ってきた
 		case 620: {
+			// 次の点に向かう前に、障害物が動いていたら今の位置から経路を直す
+			if(m_nodeId < m_route.size() && updateRoomObstacles()) {
+				Vector3d myPos;
+				m_my->getPosition(myPos);
+				repairRoute(myPos.x(), myPos.z());
+			}
 			if(m_nodeId < m_route.size()) {
 				nextPos.set(m_route[m_nodeId].x, m_tpos.y(), m_route[m_nodeId].y);	
 				// 送られた座標に回転する
@@ -1050,11 +1080,7 @@ double MyController::onAction(ActionEvent &evt)
 							Node2D objPos(m_trashBoxPos.x(), m_trashBoxPos.z());
 							Node2D grabPos = getGrabPosition(objPos, obs);
 							m_route.clear();
-							m_route = calcRoute(robotPos, grabPos, obs);
-							//m_roomObs.clear();
-							//m_roomObs.push_back(obs);calc
-							//m_roomObs.push_back(m_obstacleMap["table_0"]);
-							//m_route = calcFullRoute(robotPos, grabPos, m_roomObs);
+							m_route = calcFullRoute(robotPos, grabPos, obs);
 							printf("calc route ......733............. \n");
 							for(int i=0; i < m_route.size(); i++) {
 									printf("routeIdx %d %lf %lf \n", i, m_route[i].x, m_route[i].y);
@@ -1123,8 +1149,12 @@ double MyController::onAction(ActionEvent &evt)
 
 
 		case 740: {
-			// 送られた座標に回転する
-
+			// 障害物が動いていたら今の位置から経路を直す
+			if(m_nodeId < m_route.size() && updateRoomObstacles()) {
+				Vector3d myPos;
+				m_my->getPosition(myPos);
+				repairRoute(myPos.x(), myPos.z());
+			}
 
 			if(m_nodeId < m_route.size()) {
 				nextPos.set(m_route[m_nodeId].x, m_tpos.y(), m_route[m_nodeId].y);	
@@ -1309,7 +1339,7 @@ double MyController::onAction(ActionEvent &evt)
 					printf("@@@ robotPos %lf %lf objPos %lf %lf GrabPos %lf %lf @@@ \n",
 									robotPos.x, robotPos.y, objPos.x, objPos.y, grabPos.x, grabPos.y);
 					m_route.clear();
-					m_route = calcRoute(robotPos, grabPos, obs);
+					m_route = calcFullRoute(robotPos, grabPos, obs);
 					for(int i=0; i < m_route.size(); i++) {
 							printf("routeIndex %d %lf %lf \n", i, m_route[i].x, m_route[i].y);
 					}
@@ -1418,74 +1448,6 @@ void MyController::onRecvMsg(RecvMsgEvent &evt)
   // 送信者がゴミ認識サービスの場合
   if(sender == "RecogTrash"){
 
-		if(FIND_OBJ_BY_ID_MODE == true)
-		if(m_isOstacleCaculated == false) {
-			std::vector<std::string> m_obstacleName;
-			m_obstacleName.clear();
-			m_obstacleName.push_back("table_0");
-			m_obstacleName.push_back("table_1");
-			m_obstacleName.push_back("table_2");
-			m_obstacleName.push_back("wagon_0");
-			m_obstacleName.push_back("trashbox_0");
-			m_obstacleName.push_back("trashbox_0");
-			m_obstacleName.push_back("trashbox_1");
-			m_obstacleName.push_back("trashbox_2");
-
-			m_table_0.setPosition(0., 0., 105., 60.); // scale 1.5
-			m_table_1.setPosition(100., -100., 130., 60.);
-			m_table_2.setPosition(-50., -90., 70., 40.);
-			m_wagon_0.setPosition(100., 100., 60., 65.);
-			m_trashbox_0.setPosition(-150., 0., 40., 20.);
-			m_trashbox_1.setPosition(-150., -50., 40., 20.);
-			m_trashbox_2.setPosition(-150., -100., 40., 20.);
-
-			m_roomObs.clear();
-			m_roomObs.push_back(m_table_0);
-			m_roomObs.push_back(m_table_1);
-			m_roomObs.push_back(m_table_2);
-			m_roomObs.push_back(m_wagon_0);
-			m_roomObs.push_back(m_trashbox_0);
-			m_roomObs.push_back(m_trashbox_1);
-			m_roomObs.push_back(m_trashbox_2);
-
-			Vector3d obsPos;
-		
-			// 現位置に検出出来るゴミを検索する
-			for(int obsNum = 0; obsNum < m_obstacleName.size(); obsNum++) {
-				std::cout << "obstacle name:" << m_obstacleName[obsNum] << std::endl;
-
-				std::string obsName = m_obstacleName[obsNum];
-				if(getObj(obsName.c_str())) {
-					SimObj *obstacleObj = getObj(obsName.c_str());
-					printf("created SimObj 4 obstacle \n");
-
-					// ゴミの位置取得
-					obstacleObj->getPosition(obsPos);
-					double width = m_roomObs[obsNum].width;
-					double height = m_roomObs[obsNum].height;
-					m_roomObs[obsNum].setPosition(obsPos.x(), obsPos.z(), width, height);
-
-					/*if(m_trashBoxName == "wagon_0") {
-						printf("bring trash to wagon_0 \n");							
-						m_roomObs[obsNum].setPosition(obsPos.x()-5, obsPos.z()-8, 60.0, 40.0);
-					}*/
-				}
-				m_obstacleMap.insert(std::pair<std::string, Obstacle>(obsName, m_roomObs[obsNum]));
-				printf("caculating obstacle \n");
-			}
-
-
-			/*m_obstacleMap.insert(std::pair<std::string, Obstacle>("table_0", m_table_0));
-			m_obstacleMap.insert(std::pair<std::string, Obstacle>("table_1", m_table_1));
-			m_obstacleMap.insert(std::pair<std::string, Obstacle>("table_2", m_table_2));
-			m_obstacleMap.insert(std::pair<std::string, Obstacle>("wagon_0", m_wagon_0));
-			m_obstacleMap.insert(std::pair<std::string, Obstacle>("trashbox_0", m_trashbox_0));
-			m_obstacleMap.insert(std::pair<std::string, Obstacle>("trashbox_1", m_trashbox_1));
-			m_obstacleMap.insert(std::pair<std::string, Obstacle>("trashbox_2", m_trashbox_2));*/
-			
-			m_isOstacleCaculated = true;
-		}
-
 
 
 	  char *all_msg = (char*)evt.getMsg();		
@@ -1582,8 +1544,7 @@ void MyController::onRecvMsg(RecvMsgEvent &evt)
 				printf("@@@ robotPos %lf %lf objPos %lf %lf GrabPos %lf %lf @@@ \n",
 								robotPos.x, robotPos.y, objPos.x, objPos.y, grabPos.x, grabPos.y);
 				m_route.clear();
-				//m_route = calcFullRoute(robotPos, grabPos, m_roomObs);
-				m_route = calcRoute(robotPos, grabPos, obs);
+				m_route = calcFullRoute(robotPos, grabPos, obs);
 				for(int i=0; i < m_route.size(); i++) {
 						printf("routeIndex %d %lf %lf \n", i, m_route[i].x, m_route[i].y);
 				}
@@ -2493,65 +2454,147 @@ std::vector<Node2D> MyController::calcRoute(Node2D startPos, Node2D goalPos, Obs
 
 
 
-std::vector<Node2D> MyController::calcFullRoute(Node2D startPos, Node2D goalPos, std::vector<Obstacle> roomObs) {
+/* @brief  部屋の障害物 (m_roomObs) と目的地の近くの障害物 obs をすべて避ける経路を求める
+ * 膨らませた障害物の角の可視グラフ (Common/VisibilityPlanner.h) で探し、
+ * 見つからなければ (家具の間が狭いなど) 格子上で探す (Common/GridPlanner.h)
+ * @param  startPos 出発点
+ * @param  goalPos  目的地
+ * @param  obs      目的地の近くの障害物 (getGrabPosition に渡したゴミ箱・机)。m_roomObs に同じものがあれば足さない
+ * 求めた経路は shortcutRoute で点を減らす
+ * @return 経路 (最初が出発点、最後が目的地)。どちらでも見つからなければ obs だけを避ける calcRoute の経路
+ */
+std::vector<Node2D> MyController::calcFullRoute(Node2D startPos, Node2D goalPos, Obstacle obs) {
 	std::vector<Node2D> route;
-	route.clear();
-	if(roomObs.size() > 0) {
-		route = calcRoute(startPos, goalPos, roomObs[0]);
+	updateRoomObstacles();
+	std::vector<Obstacle> roomObs = routeObstacles(obs);
+	m_routeObs = obs;
+	// 障害物の位置が変わっていなければグラフ・格子を作り直さない
+	for(int i = 0; i < roomObs.size(); i++) {
+		m_visibility.setObstacle(i, roomObs[i].x, roomObs[i].y, roomObs[i].width, roomObs[i].height);
+		m_planner.setObstacle(i, roomObs[i].x, roomObs[i].y, roomObs[i].width, roomObs[i].height);
 	}
+	m_visibility.resizeObstacles(roomObs.size());
+	m_planner.resizeObstacles(roomObs.size());
 
-	for(int i = 0; i < route.size(); i++) {
-		printf("route %lf %lf", route[i].x, route[i].y);
+	if(!m_visibility.plan(startPos.x, startPos.y, goalPos.x, goalPos.y, route) &&
+	   !m_planner.plan(startPos.x, startPos.y, goalPos.x, goalPos.y, route)) {
+		printf("no route found (%lf %lf) -> (%lf %lf) \n", startPos.x, startPos.y, goalPos.x, goalPos.y);
+		route = calcRoute(startPos, goalPos, obs);
 	}
+	shortcutRoute(route);
 
-	int startIdx;
-	int goalIdx;
+	for(int i=0; i<route.size(); i++) {
+		printf("final... route %lf %lf \n", route[i].x, route[i].y);
+	}
 
+	return route;
+}
 
-	//for(int i = 1; i < roomObs.size(); i++) {
-	for(int i = 1; i < 2; i++) {
-		for(int j = 0; j < route.size() - 1; j++) {			
-			startIdx = getPointPositionIndex(route[j], roomObs[i]);
-			goalIdx = getPointPositionIndex(route[j+1], roomObs[i]);
-			std::vector<Node2D> subRoute = calcRoute(route[j], route[j+1], roomObs[i]);
-				
-			for(int k=0; k<subRoute.size(); k++) {
-				printf("sub route %lf %lf", subRoute[k].x, subRoute[k].y);
-			}
 
-			if(subRoute.size() > 2) {
-				for(int k=1; k<subRoute.size()-1; k++) {
-					printf("added route %lf %lf for (%lf %lf) -> (%lf %lf) because of obstacle %d center(%lf %lf) size(%lf %lf) (x_min %lf y_min %lf x_max %lf y_max %lf)\n", 
-						subRoute[k].x, subRoute[k].y, route[j].x, route[j].y, route[j+1].x, route[j+1].y, 
-						i, roomObs[i].x, roomObs[i].y, roomObs[i].width, roomObs[i].height, roomObs[i].x_min, roomObs[i].y_min, roomObs[i].x_max, roomObs[i].y_max);
-					route.insert(route.begin() + j + 1, subRoute[k]);
-					j++;
-				}
+
+/* @brief  経路計画で避ける障害物 (部屋の障害物 m_roomObs と目的地の近くの障害物 obs)
+ * @param  obs 目的地の近くの障害物。m_roomObs に同じものがあれば足さない
+ */
+std::vector<Obstacle> MyController::routeObstacles(Obstacle obs) {
+	std::vector<Obstacle> roomObs = m_roomObs;
+	bool known = false;
+	for(int i = 0; i < roomObs.size(); i++) {
+		if(roomObs[i].x == obs.x && roomObs[i].y == obs.y && roomObs[i].width == obs.width && roomObs[i].height == obs.height) {
+			known = true;
+		}
+	}
+	if(!known) {
+		roomObs.push_back(obs);
+	}
+	return roomObs;
+}
+
+
+
+/* @brief  部屋の障害物 (m_roomObs) の今の位置を取り直す (経路計画には次の calcFullRoute・repairRoute で伝わる)
+ * カタログの占有範囲を、最初に取ったときから動いた分だけずらす。大きさはカタログに書いたまま
+ * ハンドル (getObj) と最初の位置は最初の1回だけ取る
+ * @return 前に取ったときから OBSTACLE_MOVE_EPS より動いた障害物があれば true
+ */
+bool MyController::updateRoomObstacles() {
+	bool moved = false;
+	Vector3d obsPos;
+	if(m_isOstacleCaculated == false) {
+		m_obstacleObj.clear();
+		m_obstacleStart.clear();
+		for(int obsNum = 0; obsNum < m_obstacleName.size(); obsNum++) {
+			std::cout << "obstacle name:" << m_obstacleName[obsNum] << std::endl;
+			SimObj *obstacleObj = getObj(m_obstacleName[obsNum].c_str());
+			if(obstacleObj != NULL) {
+				obstacleObj->getPosition(obsPos);
 			}
-		
-			if(subRoute.size() > 2) {
-				i = roomObs.size();
-				printf("break here \n");
+			m_obstacleObj.push_back(obstacleObj);
+			m_obstacleStart.push_back(obsPos);
+		}
+		m_isOstacleCaculated = true;
+	}
+	for(int obsNum = 0; obsNum < m_obstacleObj.size() && obsNum < m_roomObs.size(); obsNum++) {
+		Obstacle &obs = m_roomObs[obsNum];
+		if(m_obstacleObj[obsNum] != NULL) {
+			m_obstacleObj[obsNum]->getPosition(obsPos);
+			const Obstacle &base = m_obstacleFootprint[obsNum];
+			double x = base.x + obsPos.x() - m_obstacleStart[obsNum].x();
+			double z = base.y + obsPos.z() - m_obstacleStart[obsNum].z();
+			if(fabs(obs.x - x) > OBSTACLE_MOVE_EPS || fabs(obs.y - z) > OBSTACLE_MOVE_EPS) {
+				obs.setPosition(x, z, obs.width, obs.height);
+				moved = true;
 			}
-			//for(int i=0; i<route.size(); i++) {
-				//printf("refresh route %lf %lf \n", route[i].x, route[i].y);
-			//}
 		}
+		m_obstacleMap[m_obstacleName[obsNum]] = obs;
 	}
+	return moved;
+}
 
-	for(int i=0; i<route.size(); i++) {
-		printf("\ncalculate route %lf %lf \n", route[i].x, route[i].y);
-	}
 
-	if(route.size() > 10) {
-		route = calcRoute(startPos, goalPos, roomObs[0]);
+
+/* @brief  障害物が動いたので、今の位置から経路 (m_route) の最後の点までを直す (Common/DStarLite.h)
+ * 前と同じ目的地なら、格子の前の探索のうち動いた障害物の周りだけを探し直す (目的地ごとに最初の1回は最初から探す)
+ * 目的地の近くの障害物は前に経路を求めたときのもの (m_routeObs)。格子で見つからなければ calcFullRoute で求め直す
+ * @param  x z  ロボットの今の位置
+ */
+void MyController::repairRoute(double x, double z) {
+	if(m_route.empty()) return;
+	Node2D goalPos = m_route.back();
+	std::vector<Obstacle> roomObs = routeObstacles(m_routeObs);
+	for(int i = 0; i < roomObs.size(); i++) {
+		m_repair.setObstacle(i, roomObs[i].x, roomObs[i].y, roomObs[i].width, roomObs[i].height);
 	}
+	m_repair.resizeObstacles(roomObs.size());
 
-	for(int i=0; i<route.size(); i++) {
-		printf("final... route %lf %lf \n", route[i].x, route[i].y);
+	std::vector<Node2D> route;
+	if(!m_repair.plan(x, z, goalPos.x, goalPos.y, route)) {
+		printf("no route found on repair (%lf %lf) -> (%lf %lf) \n", x, z, goalPos.x, goalPos.y);
+		m_route = calcFullRoute(Node2D(x, z), goalPos, m_routeObs);
+		m_nodeId = 1;
+		return;
 	}
+	printf("route %s: %d cells changed, %ld cells expanded \n",
+				 m_repair.repaired() ? "repaired" : "replanned", m_repair.changedCells(), m_repair.expanded());
+	shortcutRoute(route);
+	m_route = route;
+	m_nodeId = 1;
+}
 
-	return route;
+
+
+/* @brief  経路の点を減らす (VisibilityPlanner::shortcut)
+ * 点ごとに止まって回転するので、前後が見通せる点・ほとんど一直線の点を除く
+ * calcRoute の補助点 (障害物の角から TRUCK_RADIUS) や、格子で探した経路の余分な点が減る
+ * @param  route 経路 (書き換える。最初と最後の点は残す)
+ */
+void MyController::shortcutRoute(std::vector<Node2D> &route) {
+	double drive = m_visibility.driveSpeed(), turn = m_visibility.turnSpeed();
+	int before = route.size();
+	double timeBefore = VisibilityPlanner::travelTime(route, drive, turn);
+	if(m_visibility.shortcut(route) > 0) {
+		printf("shortcut route: %d -> %d points, %lf -> %lf s \n",
+					 before, (int)route.size(), timeBefore, VisibilityPlanner::travelTime(route, drive, turn));
+	}
 }
 
 
@@ -6,6 +6,16 @@
 #include <math.h> 
 #include <map>
 #include <string>
+#include "StateProfiler.h"
+#include "StateMachine.h"
+#include "MsgDispatch.h"
+#include "AsyncLog.h"
+#include "TraceRecorder.h"
+#include "EntityRegistry.h"
+#include "EntityCatalog.h"
+#include "SpatialIndex.h"
+#include "RouteTable.h"
+#include "ClearanceMap.h"
 
 using namespace std;
 
@@ -14,19 +24,58 @@ using namespace std;
 #define TRUCK_RADIUS 60
 #define ROTATE_ANG 0
 #define FIND_OBJ_BY_ID_MODE false
-
-// ロボットの状態
-#define INIT_STATE 0			// 初期状態
-#define ROT_TO_OBJ 1			// サービスからの認識結果を待っている状態
-#define GO_TO_OBJ 21			// ゴミがある方向に回転している状態
-#define TURN_JOINT_UP 2		// 関節を曲げてゴミを取りに行っている状態
-#define GRAB_OBJ 3				// ゴミを持ってゴミ箱の方向に回転している状態
-#define GRAB_FAIL 31		  // ゴミを持ってゴミ箱に向かっている状態
-#define GRAB_SUCC 4				// ゴミを捨てて関節角度を元に戻している状態
-#define GO_TO_TRASH_BOX 5 // 元に場所に戻る方向に回転している状態
-#define TURN_JOINT_DOWN 6 // 元の場所に向かっている状態
-#define GO_TO_LAST_POS 7	// 元の向きに回転している状態
-#define STOP_ROBOT 8	
+// onAction の呼び出し間隔
+// 期限(回転・移動・関節の終了時間)を待っている間は期限まで呼ばない。ただし MAX_INTERVAL を超えない
+#define MIN_INTERVAL 0.05		// 閉ループ制御中・メッセージ待ちの間隔
+#define MAX_INTERVAL 1.0		// 期限待ちの最大間隔(この間に来たメッセージへの反応の遅れの上限)
+// 実験の記録 (TraceRecorder.h, OfflineSim/TraceDecode で読む)
+#define TRACE_FILENAME "trace.bin"
+#define TRACE_POSE_INTERVAL 0.5	// 位置を記録する間隔 [s]
+// サービスとの送受信の記録 (OfflineSim -p で再生して、送信メッセージを比べられる)
+#define CONVERSATION_FILENAME "conversation.txt"
+// ゴミ・ゴミ箱・障害物の一覧 (EntityCatalog.h)。環境変数 CLEANUP_CATALOG で別の部屋のものを指定できる
+#define CATALOG_FILENAME "Room0928_ObjDetect.catalog"
+// ゴミ箱への経路をカタログの障害物から自分で決める (AskTrashBoxRoute を送らない)
+// 障害物の無いカタログ・カタログが読めないときは今まで通りサービスに問い合わせる
+#define LOCAL_BOX_ROUTE true
+#define ROUTE_SNAP 60.0				// 表の経路を使うアンカー(初期位置・ゴミ・ゴミ箱)までの距離 [cm]
+#define ROUTE_WAYPOINT_RANGE 5.0	// 経路の途中の点に近づく距離 [cm]
+#define ROUTE_BOX_RANGE 40.0		// ゴミ箱に近づく距離 [cm] (TrashBoxDir の range)
+// 障害物までの距離 (ClearanceMap。障害物はカタログの占有範囲を、動いた分だけずらしたもの)
+#define CLEARANCE_CELL 5.0			// 升目の大きさ [cm]
+#define CLEARANCE_MOVE_EPS 1.0		// これより小さい障害物の動きは距離の表に入れない [cm]
+#define SLOW_CLEARANCE 40.0			// goToObj で進む線分が障害物にこれより近づくときは速さを落とす [cm] (経路の途中の点は TRUCK_RADIUS 離れている)
+#define SLOW_NEAR 10.0				// ここまで近づくときは SLOW_MIN_RATIO 倍 (間はまっすぐ変える) [cm]
+#define SLOW_MIN_RATIO 0.7
+#define APPROACH_CLEARANCE 20.0		// 物体に近づいて止まる位置は障害物からこれだけ離す [cm] (肩幅の半分 16.5cm より広く)
+#define APPROACH_BACKOFF 20.0		// そのために手前で止まる距離の上限 [cm]
+
+// ロボットの状態 (括弧内は以前の m_state の値)
+enum CleanUpState {
+	ST_INIT = 0,			// (0)   サービスへの接続待ち
+	ST_START,				// (5)   腕を上げ終わったら Start を送る
+	ST_WAIT,				// (10)  サービスからのメッセージ待ち
+	ST_TURN_TO_OBJ,			// (20,21) ObjDir: 物体の方向に回転している
+	ST_GO_TO_OBJ,			// (22)  物体に向かって移動している
+	ST_OBJ_FOUND,			// (500) 物体を認識した、grab を待つ
+	ST_TURN_TO_GRAB,		// (30,31) grab: 物体の方向に回転している
+	ST_ALIGN_GRAB,			// (32)  掴むために少し斜めに回転している
+	ST_REACH,				// (33)  関節を曲げて物体を取りに行っている
+	ST_RETRACT,				// (34)  掴めなかったので関節を戻している
+	ST_TURN_TO_BOX,			// (40,41) TrashBoxDir: ゴミ箱の方向に回転している
+	ST_GO_TO_BOX,			// (42)  ゴミ箱に向かって移動している
+	ST_TURN_TO_THROW,		// (50)  ThrowTrash: 捨てるために斜めに向く
+	ST_RELEASE,				// (51)  ゴミを放して落ちるのを待つ
+	ST_ARM_BACK,			// (52)  関節を元に戻している
+	ST_FINISH,				// (100) Finish: 停止
+	ST_ROUTE_ASK,			// (800) 次に行く場所を問い合わせる
+	ST_ROUTE_TURN,			// (805) RandomRoute: 送られた座標の方向に回転する
+	ST_ROUTE_GO,			// (807) 送られた座標に移動する
+	ST_ROUTE_LOOK,			// (810) 見るべき方向に回転する
+	ST_ROUTE_ARRIVED,		// (815) 到着したのでシーン情報を送る
+	ST_VIEWER_TURN,			// (920,921) SIGViewer の RotateDir
+	ST_NUM
+};
 
 //角度からラジアンに変換します
 #define DEG2RAD(DEG) ( (PI) * (DEG) / 180.0 )   
@@ -35,32 +84,50 @@ using namespace std;
 
 class MyController : public Controller {  
 public:  
+  ~MyController();
   void onInit(InitEvent &evt);  
   double onAction(ActionEvent&);  
   void onRecvMsg(RecvMsgEvent &evt); 
   void onCollision(CollisionEvent &evt); 
 
-	char* sendSceneInfo(std::string header = "AskRandomRoute", int CamID = 1);
+	void sendSceneInfo(std::string header = "AskRandomRoute", int CamID = 1);
+	// 指令・送信は記録してから行う
+	void commandWheel(double left, double right);
+	void commandJoint(const char *name, double vel);
+	void sendToSrv(const std::string &msg);
+	void traceTransition(int from, int to, double now);
 	void setCameraPosition(double angle, int camID);
 	void setRobotHeadingAngle(double angle);
 	void setRobotPosition(double x, double z);
-  /* @brief  ゴミを認識しゴミの位置と名前を返す
+  /* @brief  ゴミを認識しゴミの位置と番号(m_entities)を返す
    * @return  pos ゴミの位置
-   * @return  ゴミの名前
+   * @return  id  ゴミの番号
    * @return  ゴミの認識に成功した場合はtrue
    */
-  bool recognizeNearestTrash(Vector3d &pos, std::string &name); 
-	bool recognizeRandomTrash(Vector3d &pos, std::string &name); 
-	bool recognizeNearestTrashBox(Vector3d &pos, std::string &name); 
+  bool recognizeNearestTrash(Vector3d &pos, int &id); 
+	bool recognizeRandomTrash(Vector3d &pos, int &id); 
+	bool recognizeNearestTrashBox(Vector3d &pos, int &id); 
+	bool recognizeNearest(SpatialIndex &index, Vector3d &pos, int &id);
 
   /* @brief  ゴミをどこに置くべきか、置くべき場所見つかったら"true"、見つからなかったら"false"が返す
-	 * @param name ゴミの名前　　
+	 * @param trashId ゴミの番号
    * @return pos 置くべき場所の位置
+   * @return boxId 置くべきゴミ箱の番号
    * @return  置くべき場所をみつかった場合はtrue
    */	
-	bool findPlace2PutObj(Vector3d &pos, std::string name); 
+	bool findPlace2PutObj(Vector3d &pos, int trashId, int &boxId); 
+	// ゴミ箱の今の位置 (EntityRegistry::nearestBin から呼ぶ)。無くなったゴミ箱は索引から外して false
+	bool binPosition(int id, double &x, double &z);
+
+	/* @brief  ゴミ箱までの経路を経路の表(m_routes)から引き、m_boxRoute に入れる
+	 * @param  boxId ゴミ箱の番号 (位置は m_trashBoxPos)
+	 * @return 経路が決まれば true。カタログに障害物が無ければ false (サービスに問い合わせる)
+	 */
+	bool planBoxRoute(int boxId);
+	// m_boxRoute の次の点に向かう。最後まで来たら捨てる (ThrowTrash を受けたときと同じ)
+	void followBoxRoute(double now);
 	
-	void confirmThrewTrashPos(Vector3d &pos, std::string &name);
+	void confirmThrewTrashPos(Vector3d &pos, int id);
 
 
   /* @brief  位置を指定しその方向に回転を開始し、回転終了時間を返します
@@ -73,6 +140,15 @@ public:
 	double rotateTowardGrabPos(Vector3d pos, double vel, double now); 
 	double calcHeadingAngle();
 
+	/* この tick の自分の位置・向き・エンティティの位置
+	 * getPosition / getRotation は tick (onAction・onRecvMsg の1回) ごとに1回だけ呼び、後は覚えた値を返す
+	 * 自分を setPosition などで動かしたときは覚えた値を捨てる
+	 */
+	void beginTick();
+	const Vector3d &myPosition();
+	double myHeading();							// ラジアン
+	bool entityPosition(int id, Vector3d &pos);	// エンティティが無ければ false
+
   /* @brief  位置を指定しその方向に進みます
    * @param  pos   行きたい場所
    * @param  vel   移動速度
@@ -82,6 +158,24 @@ public:
    */
   double goToObj(Vector3d pos, double vel, double range, double now);
 
+	/* @brief  from から to まで進む線分が障害物に近づくときは速さを落とす
+	 * @param  velocity 障害物から離れているときの速さ (goToObj の vel)
+	 * @return 進む速さ (SLOW_MIN_RATIO * velocity 〜 velocity)
+	 */
+	double clearanceSpeed(const Vector3d &from, const Vector3d &to, double velocity);
+
+	/* @brief  床の上の物 pos に range まで近づいて止まる位置が障害物に近すぎるときは、APPROACH_BACKOFF まで手前で止める
+	 * 物が家具の上・すぐそば (APPROACH_CLEARANCE より近い) ならそのまま
+	 * @return goToObj に渡す range
+	 */
+	double approachRange(const Vector3d &pos, double range);
+
+	/* @brief  障害物の今の位置 (この tick の entityPosition) を距離の表に入れる
+	 * 最初の位置から CLEARANCE_MOVE_EPS より動いた障害物だけ、カタログの占有範囲を動いた分だけずらして置き直す
+	 * 表は次に引いたときに動いた範囲だけ直る (ClearanceMap::update)
+	 */
+	void updateClearance();
+
   /* @brief  物体を掴むために向くべき方向
    * @param  pos   掴みたい座標
    * @param  robotShoulderWidth　ロボットの肩幅の半分
@@ -89,6 +183,56 @@ public:
    */
 	bool calcGrabPos(Vector3d pos, double robotShoulderWidth, Vector3d &grabPos);
 
+	// 状態ごとの処理 (s_states から呼ばれる)
+	void initTick(double now);
+	void startTimer(double now);
+	void turnToObjEnter(double now);
+	void turnToObjTimer(double now);
+	void goToObjTimer(double now);
+	void turnToGrabEnter(double now);
+	void turnToGrabTimer(double now);
+	void alignGrabTimer(double now);
+	void reachTimer(double now);
+	void retractTimer(double now);
+	void turnToBoxEnter(double now);
+	void turnToBoxTimer(double now);
+	void goToBoxTimer(double now);
+	void turnToThrowTimer(double now);
+	void releaseEnter(double now);
+	void releaseTimer(double now);
+	void armBackTimer(double now);
+	void finishEnter(double now);
+	void routeAskTimer(double now);
+	void routeTurnTimer(double now);
+	void routeGoTimer(double now);
+	void routeLookTimer(double now);
+	void routeArrivedTimer(double now);
+	void viewerTurnEnter(double now);
+	void viewerTurnTimer(double now);
+
+	// メッセージごとの処理 (s_commands から呼ばれる)
+	void onMsgProfile(const MsgArgs &args);
+	void onMsgProfileReset(const MsgArgs &args);
+	void onMsgActionInterval(const MsgArgs &args);
+	void onMsgReset(const MsgArgs &args);
+	void onMsgWireFormat(const MsgArgs &args);
+	void onMsgObjDir(const MsgArgs &args);
+	void onMsgGrab(const MsgArgs &args);
+	void onMsgTrashBoxDir(const MsgArgs &args);
+	void onMsgThrowTrash(const MsgArgs &args);
+	void onMsgFinish(const MsgArgs &args);
+	void onMsgRouteAsk(const MsgArgs &args);
+	void onMsgRandomRoute(const MsgArgs &args);
+	void onMsgGoForwardVelocity(const MsgArgs &args);
+	void onMsgRotateVelocity(const MsgArgs &args);
+	void onMsgStop(const MsgArgs &args);
+	void onMsgCamID(const MsgArgs &args);
+	void onMsgCaptureData(const MsgArgs &args);
+	void onMsgCameraAngle(const MsgArgs &args);
+	void onMsgRobotAngle(const MsgArgs &args);
+	void onMsgRotateDir(const MsgArgs &args);
+	void onMsgRobotPosition(const MsgArgs &args);
+
 	
 private:
   RobotObj *m_my;
@@ -105,37 +249,53 @@ private:
 	Vector3d m_lookingPos;
 
 
-  // ゴミの名前
-  std::string m_tname;  
-	std::string m_lastFailedTrash;
-  // ゴミ箱の名前
-  std::string m_trashBoxName;  
+  // ゴミの番号 (m_entities)
+  int m_tid;  
+	int m_lastFailedTrash;
+  // ゴミ箱の番号 (m_entities)
+  int m_trashBoxId;  
 
 	int m_trashNum;
   
-	// ゴミ候補オブジェクト
-  std::vector<std::string> m_trashes;
-
-	// ゴミ箱候補オブジェクト
-  std::vector<std::string> m_trashBoxes;
-
-	// ゴミのタイプ及び入れるべきゴミ箱
-	std::map<std::string, std::string> m_trashTypeMap;
-
-
-  /* ロボットの状態
-   * 0 初期状態
-   * 1 サービスからの認識結果を待っている状態
-   * 2 ゴミがある方向に回転している状態
-   * 3 関節を曲げてゴミを取りに行っている状態
-   * 4 ゴミを持ってゴミ箱の方向に回転している状態
-   * 5 ゴミを持ってゴミ箱に向かっている状態
-   * 6 ゴミを捨てて関節角度を元に戻している状態
-   * 7 元に場所に戻る方向に回転している状態
-   * 8 元の場所に向かっている状態
-   * 9 元の向きに回転している状態
-   */
-  int m_state; 
+	// エンティティの番号と、番号ごとの種類・ゴミ箱・占有範囲・位置・SimObj のハンドル
+	EntityRegistry<MyController> m_entities;
+
+	// ゴミ候補オブジェクト (m_entities の番号)
+  std::vector<int> m_trashes;
+
+	// ゴミ箱候補オブジェクト (m_entities の番号)
+  std::vector<int> m_trashBoxes;
+
+	// 候補の x/z 位置の索引 (一番近いゴミ・ゴミ箱を探す)。拾ったゴミは外す
+	SpatialIndex m_trashIndex;
+	SpatialIndex m_trashBoxIndex;
+
+	// 初期位置・ゴミ・ゴミ箱の間の経路と移動時間の表 (障害物はカタログの占有範囲)
+	RouteTable m_routes;
+	std::vector<int> m_anchorOf;		// エンティティの番号 -> アンカーの番号 (無ければ -1)
+	// ゴミ箱への経路と、次に向かう点
+	std::vector<RoutePoint> m_boxRoute;
+	size_t m_boxRouteNext;
+	// 床の上で一番近い障害物までの距離 (障害物は m_routes と同じ。goToObj の速さ・物体に近づいて止まる位置に使う)
+	ClearanceMap m_clearance;
+	// m_clearance の障害物ごとのエンティティの番号 (位置が取れなければ -1)・最初の位置・今ずらしている量
+	std::vector<int> m_clearanceIds;
+	std::vector<Vector3d> m_clearanceStart;
+	std::vector<Vector3d> m_clearanceShift;
+
+
+  // ロボットの状態 (CleanUpState)。移動終了時間は m_sm.setDeadline() で設定する
+  typedef StateMachine<MyController> SM;
+  static const SM::State s_states[ST_NUM];
+  SM m_sm;
+
+  // 受信メッセージの振り分け
+  typedef MsgDispatcher<MyController> Dispatcher;
+  static const Dispatcher::Command s_commands[];
+  static const int s_commandNum;
+  Dispatcher m_dispatcher;
+  // 送信するメッセージの形式 (既定はテキスト)
+  MsgWire m_wire;
 
   // 車輪の角速度
   double m_vel;
@@ -150,12 +310,15 @@ private:
   // 車輪間距離
   double m_distance;
 
-  // 移動終了時間
-  double m_time;
-
   // 初期位置
   Vector3d m_inipos;
 
+  // この tick の自分の位置と向き (myPosition() / myHeading() で取得する)
+  Vector3d m_myPos;
+  double m_myTheta;
+  bool m_myPosFresh;
+  bool m_myThetaFresh;
+
   // grasp中かどうか
   bool m_grasp;
 
@@ -164,39 +327,86 @@ private:
 
   // サービスへのリクエスト複数回送信を防ぐ
   bool m_sended;
-	// 動作を実行したかどうかのフラグ、動作を複数回実行を防ぐ
-	bool m_executed;
 	double m_range;
+
+	// onAction の呼び出し間隔 (ActionInterval メッセージで変更できる)
+	double m_minInterval;
+	double m_maxInterval;
+
+	// onAction の状態別処理時間・状態遷移の計測
+	StateProfiler m_prof;
+
+	// 実験の記録
+	TraceRecorder m_trace;
+	double m_now;				// 最後の onAction の時間 (onRecvMsg など時間の無いところで使う)
+	double m_lastPoseTrace;
 };  
 
 
+MyController::~MyController() {
+	// 終了時に計測結果を出力する (溜まっているログを先に出す)
+	AsyncLog::instance().flush();
+	m_prof.dump(stdout);
+}
+
+
+void MyController::commandWheel(double left, double right) {
+	m_trace.wheel(m_now, left, right);
+	m_my->setWheelVelocity(left, right);
+}
+
+void MyController::commandJoint(const char *name, double vel) {
+	m_trace.joint(m_now, name, vel);
+	m_my->setJointVelocity(name, vel, 0.0);
+}
+
+void MyController::sendToSrv(const std::string &msg) {
+	m_trace.send(m_now, msg.c_str());
+	AsyncLog::instance().print(ALOG_CONVERSATION, "%.3lf > RecogTrash %s\n", m_now, msg.c_str());
+	m_srv->sendMsgToSrv(msg);
+}
+
+void MyController::traceTransition(int from, int to, double now) {
+	m_trace.state(now, from, to, s_states[to].name);
+}
+
 void MyController::setCameraPosition(double angle, int camID) {
 	double xDir = sin(DEG2RAD(angle));
 	double zDir = cos(DEG2RAD(angle));
 	m_my->setCamDir(Vector3d(xDir, 0.0, zDir), camID);
-	printf("camera Dir converted \n");
+	ALOG_DEBUG((ALOG_CONSOLE, "camera Dir converted \n"));
 	return;
 }
 
 void MyController::setRobotHeadingAngle(double angle) {
 	m_my->setAxisAndAngle(0, 1.0, 0, DEG2RAD(angle));
+	m_myThetaFresh = false;
 	return;
 }
 
 void MyController::setRobotPosition(double x, double z) {
-	Vector3d myPos;
-	m_my->getPosition(myPos);
-	double y = myPos.y();
+	double y = myPosition().y();
 
 	m_my->setPosition(x, y, z);
+	m_myPosFresh = false;
 	return;
 }
 
-char* MyController::sendSceneInfo(std::string header, int camID) {
-		m_my->setWheelVelocity(0.0, 0.0);				
+// Start と AskRandomRoute は引数が同じ
+template <class T>
+static T makeSceneMsg(double x, double z, double theta, const Vector3d &campos, const Vector3d &cdir)
+{
+	T msg;
+	msg.x = x; msg.z = z; msg.theta = theta;
+	msg.camX = campos.x(); msg.camY = campos.y(); msg.camZ = campos.z();
+	msg.dirX = cdir.x(); msg.dirY = cdir.y(); msg.dirZ = cdir.z();
+	return msg;
+}
+
+void MyController::sendSceneInfo(std::string header, int camID) {
+		commandWheel(0.0, 0.0);				
 
-		Vector3d myPos;
-		m_my->getPosition(myPos);
+		Vector3d myPos = myPosition();
 		double x = myPos.x();
 		double z = myPos.z();
 		double theta = calcHeadingAngle();			// y方向の回転は無しと考える	
@@ -217,8 +427,8 @@ char* MyController::sendSceneInfo(std::string header, int camID) {
 		m_my->getCamPos(cpos, camID);
 
 		// カメラの位置(絶対座標系, ロボットの回転はないものとする)
-		printf("linkpos: %lf %lf %lf \n", lpos.x(), lpos.y(), lpos.z());
-		printf("camerapos: %lf %lf %lf \n", cpos.x(), cpos.y(), cpos.z());
+		ALOG_DEBUG((ALOG_CONSOLE, "linkpos: %lf %lf %lf \n", lpos.x(), lpos.y(), lpos.z()));
+		ALOG_DEBUG((ALOG_CONSOLE, "camerapos: %lf %lf %lf \n", cpos.x(), cpos.y(), cpos.z()));
 		Vector3d campos(lpos.x() + cpos.z() * sin(DEG2RAD(theta)), 
 										lpos.y() + cpos.y(), 
 										lpos.z() + cpos.z() * cos(DEG2RAD(theta)));
@@ -228,21 +438,35 @@ char* MyController::sendSceneInfo(std::string header, int camID) {
 		Vector3d cdir;
 		m_my->getCamDir(cdir, camID);
 
-		char *replyMsg = new char[1024];
-		sprintf(replyMsg, "%s %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf", 
-																			header.c_str(), x, z, theta, campos.x(), campos.y(), campos.z(), cdir.x(), cdir.y(), cdir.z());
-		printf("%s \n", replyMsg);
-		m_srv->sendMsgToSrv(replyMsg);
+		std::string replyMsg;
+		if (header == StartMsg::header()) {
+			replyMsg = m_wire.encode(makeSceneMsg<StartMsg>(x, z, theta, campos, cdir));
+		} else {
+			replyMsg = m_wire.encode(makeSceneMsg<AskRandomRouteMsg>(x, z, theta, campos, cdir));
+		}
+		ALOG_INFO((ALOG_CONSOLE, "%s \n", replyMsg.c_str()));
+		sendToSrv(replyMsg);
 
-		m_my->setWheelVelocity(0.0, 0.0);				
-	
-	return replyMsg;
+		commandWheel(0.0, 0.0);				
 }
 
 
 void MyController::onInit(InitEvent &evt) 
 {  
   m_my = getRobotObj(myname());
+  // ゴミ・ゴミ箱・入れるべきゴミ箱・障害物はカタログから読む
+  m_entities.init(this);
+  const char *catalog = getenv("CLEANUP_CATALOG");
+  if (catalog == NULL) catalog = CATALOG_FILENAME;
+  std::string catalogError;
+  if (!loadEntityCatalog(catalog, m_entities, catalogError)) {
+    ALOG_ERR((ALOG_CONSOLE, "%s \n", catalogError.c_str()));
+  }
+  m_trashes = m_entities.ids(ENT_TRASH);
+  m_trashBoxes = m_entities.ids(ENT_TRASHBOX);
+  m_tid = -1;
+  m_lastFailedTrash = -1;
+  m_trashBoxId = -1;
 
   // 初期位置取得
   m_my->getPosition(m_inipos);
@@ -256,11 +480,14 @@ void MyController::onInit(InitEvent &evt)
   m_radius = 10.0;
   m_distance = 10.0;
 
-  m_time = 0.0;
-
   // 車輪の半径と車輪間距離設定
   m_my->setWheel(m_radius, m_distance);
-  m_state = 0;
+  m_sm.init(this, s_states, ST_NUM, ST_INIT);
+  m_sm.setOnTransition(&MyController::traceTransition);
+  m_dispatcher.init(this, s_commands, s_commandNum);
+  for (int i = 0; i < ST_NUM; i++) {
+    m_prof.setStateName(i, s_states[i].name);
+  }
   srand((unsigned)time( NULL ));
 
 
@@ -274,466 +501,466 @@ void MyController::onInit(InitEvent &evt)
   m_grasp = false;
   m_srv = NULL;
   m_sended = false;
-	m_executed = false;
+	m_minInterval = MIN_INTERVAL;
+	m_maxInterval = MAX_INTERVAL;
+
+	// 候補のハンドルを先に引いておき (検索のたびに getObj を呼ばない)、位置を索引に入れる
+	m_trashIndex.clear();
+	m_trashBoxIndex.clear();
+	for (int i = 0; i < m_trashes.size(); i++) {
+		Vector3d pos;
+		if (!entityPosition(m_trashes[i], pos)) continue;
+		m_trashIndex.insert(m_trashes[i], pos.x(), pos.z());
+	}
+	for (int i = 0; i < m_trashBoxes.size(); i++) {
+		Vector3d pos;
+		if (!entityPosition(m_trashBoxes[i], pos)) continue;
+		m_trashBoxIndex.insert(m_trashBoxes[i], pos.x(), pos.z());
+	}
 
+	// 経路の表: 障害物はカタログの占有範囲 (斜めに置いた物は向きのある長方形)、アンカーは初期位置 (0 番)・ゴミを掴む位置 (ゴミの位置)・ゴミ箱
+	// 移動時間は goToObj (m_vel*4) と rotateTowardObj (m_rotateVel) の速さで見積もり、表の経路はその時間が最短になるように選ぶ
+	// 同じ障害物で、障害物までの距離の表も作る
+	m_clearance = ClearanceMap(CLEARANCE_CELL);
+	m_clearanceIds.clear();
+	m_clearanceStart.clear();
+	m_clearanceShift.clear();
+	m_routes.setClearance(TRUCK_RADIUS);
+	m_routes.setSpeed(m_radius * m_vel * 4, 2.0 * m_radius * m_rotateVel / m_distance);
+	int obsNum = 0;
+	for (int id = 0; id < m_entities.size(); id++) {
+		if (!m_entities.hasFootprint(id)) continue;
+		m_routes.setObstacle(obsNum, m_entities.footprintX(id), m_entities.footprintZ(id),
+		                     m_entities.footprintWidth(id), m_entities.footprintDepth(id), m_entities.footprintAngle(id));
+		m_clearance.setObstacle(obsNum, m_entities.footprintX(id), m_entities.footprintZ(id),
+		                        m_entities.footprintWidth(id), m_entities.footprintDepth(id), m_entities.footprintAngle(id));
+		Vector3d pos;
+		m_clearanceIds.push_back(entityPosition(id, pos) ? id : -1);
+		m_clearanceStart.push_back(pos);
+		m_clearanceShift.push_back(Vector3d());
+		obsNum++;
+	}
+	m_clearance.update();
+	m_anchorOf.assign(m_entities.size(), -1);
+	m_routes.setAnchor(0, m_inipos.x(), m_inipos.z());
+	for (int i = 0; i < m_trashes.size(); i++) {
+		double x, y, z;
+		if (!m_entities.pose(m_trashes[i], x, y, z)) continue;
+		m_anchorOf[m_trashes[i]] = m_routes.anchorCount();
+		m_routes.setAnchor(m_routes.anchorCount(), x, z);
+	}
+	for (int i = 0; i < m_trashBoxes.size(); i++) {
+		double x, y, z;
+		if (!m_entities.pose(m_trashBoxes[i], x, y, z)) continue;
+		m_anchorOf[m_trashBoxes[i]] = m_routes.anchorCount();
+		m_routes.setAnchor(m_routes.anchorCount(), x, z);
+	}
+	m_routes.update();
+	m_boxRoute.clear();
+	m_boxRouteNext = 0;
+
+	m_now = 0.0;
+	m_myPosFresh = false;
+	m_myThetaFresh = false;
+	m_lastPoseTrace = -TRACE_POSE_INTERVAL;
+	AsyncLog::instance().open(ALOG_CONVERSATION, CONVERSATION_FILENAME, false);
+	if (!m_trace.open(TRACE_FILENAME)) {
+		ALOG_ERR((ALOG_CONSOLE, "cannot open %s \n", TRACE_FILENAME));
+	}
 }  
   
 
 
-double MyController::onAction(ActionEvent &evt)
+/////////////////////////////////////////////
+/////////////// 状態ごとの処理 //////////////
+/////////////////////////////////////////////
+
+// 初期状態: サービスに接続できたら腕を上げ始める
+void MyController::initTick(double now)
 {
-	if(!checkService("RecogTrash")){
-		m_srv == NULL;
+	if(m_srv != NULL) {
+		//rotate toward upper
+		commandJoint("LARM_JOINT4", -m_jvel);
+		commandJoint("RARM_JOINT4", -m_jvel);
+		// 50°回転
+		m_sm.setDeadline(DEG2RAD(ROTATE_ANG) / m_jvel + now);
+		m_sm.go(ST_START, now);
 	}
-	
-	if(m_srv == NULL){
-		// ゴミ認識サービスが利用可能か調べる
-		if(checkService("RecogTrash")){
-			// ゴミ認識サービスに接続
-			m_srv = connectToService("RecogTrash");
-		}
+}
+
+void MyController::startTimer(double now)
+{
+	//commandJoint("LARM_JOINT1", 0.0);
+	commandJoint("LARM_JOINT4", 0.0);
+	commandJoint("RARM_JOINT4", 0.0);
+	sendSceneInfo("Start");				
+	//sendToSrv("Start");
+	ALOG_INFO((ALOG_CONSOLE, "Started! \n"));
+}
+
+// 物体の方向が帰ってきた、送られた座標に回転する
+void MyController::turnToObjEnter(double now)
+{
+	m_sm.setDeadline(rotateTowardObj(nextPos, m_rotateVel, now));
+}
+
+// ロボットが回転中
+void MyController::turnToObjTimer(double now)
+{
+	// 物体のある方向に回転したので、車輪を止め、送られた座標に移動する
+	commandWheel(0.0, 0.0);
+	m_sm.setDeadline(goToObj(nextPos, m_vel*4, approachRange(nextPos, m_range), now));
+	m_sm.go(ST_GO_TO_OBJ, now);
+}
+
+// 送られた座標に移動した
+void MyController::goToObjTimer(double now)
+{
+	commandWheel(0.0, 0.0);
+	ALOG_DEBUG((ALOG_CONSOLE, "止める \n"));
+
+	bool found = recognizeNearestTrash(m_tpos, m_tid);
+	// ロボットのステートを更新
+	if (found == true) {
+		m_sm.go(ST_OBJ_FOUND, now);
+	} else {
+		//printf("Didnot found anything \n");		
+		m_sm.go(ST_WAIT, now);
 	}
+}
 
+// grab: 送られた座標に回転する
+void MyController::turnToGrabEnter(double now)
+{
+	m_sm.setDeadline(rotateTowardObj(nextPos, m_rotateVel, now));
+}
 
-	//if(evt.time() < m_time) printf("state: %d \n", m_state);
-	switch(m_state) {
-		// 初期状態
-		case 0: {
-			if(m_srv == NULL){
-				// ゴミ認識サービスが利用可能か調べる
-				if(checkService("RecogTrash")){
-					// ゴミ認識サービスに接続
-					m_srv = connectToService("RecogTrash");
-				}
-			} else if(m_srv != NULL && m_executed == false){  
-				//rotate toward upper
-				m_my->setJointVelocity("LARM_JOINT4", -m_jvel, 0.0);
-				m_my->setJointVelocity("RARM_JOINT4", -m_jvel, 0.0);
-				// 50°回転
-				m_time = DEG2RAD(ROTATE_ANG) / m_jvel + evt.time();
-				m_state = 5;
-				m_executed = false;			
-			}
-			break;
-		}
+// 物体を掴むために、ロボットの向く角度をズラス
+void MyController::turnToGrabTimer(double now)
+{
+	Vector3d grabPos;
+	if(calcGrabPos(nextPos, 20, grabPos)) {
+		m_sm.setDeadline(rotateTowardObj(grabPos, m_vel / 5, now));
+		ALOG_DEBUG((ALOG_CONSOLE, "斜め grabPos :%lf %lf %lf \n", grabPos.x(), grabPos.y(), grabPos.z()));
+		ALOG_DEBUG((ALOG_CONSOLE, "time: %lf \n", m_sm.deadline()));
+	}
+	m_sm.go(ST_ALIGN_GRAB, now);
+}
 
+void MyController::alignGrabTimer(double now)
+{
+	// 物体のある場所に到着したので、車輪と止め、関節を回転し始め、物体を拾う
+	commandWheel(0.0, 0.0);
+	// 関節の回転を始める
+	commandJoint("RARM_JOINT1", -m_jvel);
+	// 50°回転
+	m_sm.setDeadline(DEG2RAD(ROTATE_ANG) / m_jvel + now);
+	m_sm.go(ST_REACH, now);
+}
 
-		case 5: {
-			if(evt.time() > m_time && m_executed == false) {
-				//m_my->setJointVelocity("LARM_JOINT1", 0.0, 0.0);
-				m_my->setJointVelocity("LARM_JOINT4", 0.0, 0.0);
-				m_my->setJointVelocity("RARM_JOINT4", 0.0, 0.0);
-				sendSceneInfo("Start");				
-				//m_srv->sendMsgToSrv("Start");
-				printf("Started! \n");
-				m_executed = true;
-			}
-			break;
+// 関節回転中
+void MyController::reachTimer(double now)
+{
+	// 関節の回転を止める
+	commandJoint("RARM_JOINT1", 0.0);
+	// 自分の位置の取得
+	Vector3d myPos = myPosition();
+	double x = myPos.x();
+	double z = myPos.z();
+	double theta = 0;									// y方向の回転は無しと考える	
+	//物体を掴めるか掴めないかによって処理を分岐させる
+	if(m_grasp) {											// 物体を掴んだ
+
+		// 捨てたゴミをゴミ候補
+		std::vector<int>::iterator it;
+		// ゴミ候補を得る
+		it = std::find(m_trashes.begin(), m_trashes.end(), m_tid);
+		// 候補から削除する
+		if (it != m_trashes.end()) {
+			m_trashes.erase(it);
+			m_trashIndex.remove(m_tid);
+			m_entities.invalidate(m_tid);
+			ALOG_DEBUG((ALOG_CONSOLE, "erased ... \n"));	
 		}
 
-		// 物体の方向が帰ってきた
-		case 20: {
-			// 送られた座標に回転する
-			m_time = rotateTowardObj(nextPos, m_rotateVel, evt.time());
-			//printf("debug %lf %lf \n", evt.time(), m_time);
-			m_state = 21;
-			m_executed = false;
-			break;
-		}
-		
-		case 21: {
-			// ロボットが回転中
-			//printf("debug %lf %lf \n", evt.time(), m_time);
-			if(evt.time() > m_time && m_executed == false) {
-				// 物体のある場所に到着したので、車輪と止め、関節を回転し始め、物体を拾う
-				m_my->setWheelVelocity(0.0, 0.0);
-				// 物体のある方向に回転した
-				//printf("目的地の近くに移動します %lf %lf %lf \n", nextPos.x(), nextPos.y(), nextPos.z());	
-				// 送られた座標に移動する
-				m_time = goToObj(nextPos, m_vel*4, m_range, evt.time());
-				//m_time = goToObj(nextPos, m_vel*4, 40, evt.time());
-				m_state = 22;
-				m_executed = false;
+		// ゴミ箱への行き方と問い合わせする
+
+		// ゴミを置くべき座標を探す
+		bool found = findPlace2PutObj(m_trashBoxPos, m_tid, m_trashBoxId); 
+		if(found) {
+			// ゴミ箱が検出出来た
+			ALOG_DEBUG((ALOG_CONSOLE, "trashboxName %s \n", m_entities.name(m_trashBoxId).c_str()));
+			if (LOCAL_BOX_ROUTE && planBoxRoute(m_trashBoxId)) {
+				// 経路の表から引けたので、サービスに問い合わせずに向かう
+				followBoxRoute(now);
+			} else {
+				AskTrashBoxRouteMsg msg;
+				msg.x = x; msg.z = z; msg.theta = theta;
+				msg.boxX = m_trashBoxPos.x(); msg.boxY = m_trashBoxPos.y(); msg.boxZ = m_trashBoxPos.z();
+				sendToSrv(m_wire.encode(msg));
 			}
-			break;
+		} else {
+			AskTrashBoxPosMsg msg;
+			msg.x = x; msg.z = z; msg.theta = theta;
+			sendToSrv(m_wire.encode(msg));
 		}
+				
+	} else {					// 物体を掴めなかった、次に探す場所を問い合わせる
+		// 逆方向に関節の回転を始める
+		commandJoint("RARM_JOINT1", m_jvel);
+		// 50°回転
+		m_sm.setDeadline(DEG2RAD(ROTATE_ANG) / m_jvel + now);
+		m_lastFailedTrash = m_tid;
+		m_sm.go(ST_RETRACT, now);
+	}		
+}
 
-		case 22: {
-			// 送られた座標に移動した
-			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);
-				printf("止める \n");
-				Vector3d myPos;
-				m_my->getPosition(myPos);
-				double x = myPos.x();
-				double z = myPos.z();
-				double theta = 0;			// y方向の回転は無しと考える		
-				char replyMsg[256];
-
-				bool found = recognizeNearestTrash(m_tpos, m_tname);
-				// ロボットのステートを更新
-			
-				if (found == true) {
-					m_state = 500;				
-					m_executed = false;		
-					//printf("m_executed = false, state = 500 \n");		
-				} else {
-					//printf("Didnot found anything \n");		
-					m_state = 10;
-					m_executed = false;
-				}
+void MyController::retractTimer(double now)
+{
+	// 関節の回転を止める
+	commandJoint("RARM_JOINT1", 0.0);
 
-			}
-			break;
-		}
+	// 自分の位置の取得
+	Vector3d myPos = myPosition();
+	double x = myPos.x();
+	double z = myPos.z();
+	double theta = 0;			
+	AskObjPosMsg msg;
+	msg.x = x; msg.z = z; msg.theta = theta;
+	ALOG_DEBUG((ALOG_CONSOLE, "case 34 debug %s \n", m_wire.text(msg).c_str()));
+
+	sendToSrv(m_wire.encode(msg));			
+}
 
+// TrashBoxDir: 送られた座標に回転する
+void MyController::turnToBoxEnter(double now)
+{
+	m_sm.setDeadline(rotateTowardObj(nextPos, m_rotateVel, now));
+}
 
-		case 30: {
-			// 送られた座標に回転する
-			m_time = rotateTowardObj(nextPos, m_rotateVel, evt.time());
-			//printf("case 30 time: %lf \n", m_time);
-			m_state = 31;
-			m_executed = false;
-			break;
-		}
+// 送られた座標に回転中
+void MyController::turnToBoxTimer(double now)
+{
+	// 送られた座標に移動する
+	ALOG_DEBUG((ALOG_CONSOLE, "目的地の近くに移動します %lf %lf %lf \n", nextPos.x(), nextPos.y(), nextPos.z()));	
+	m_sm.setDeadline(goToObj(nextPos, m_vel*4, m_range, now));
+	m_sm.go(ST_GO_TO_BOX, now);
+}
 
-		// 物体を掴むために、ロボットの向く角度をズラス
-		case 31: {
-			if(evt.time() > m_time && m_executed == false) {
-				Vector3d grabPos;
-				//printf("斜めにちょっとずれた以前の時間 time: %lf \n", evt.time());
-				if(calcGrabPos(nextPos, 20, grabPos)) {
-					m_time = rotateTowardObj(grabPos, m_vel / 5, evt.time());
-					printf("斜め grabPos :%lf %lf %lf \n", grabPos.x(), grabPos.y(), grabPos.z());
-					printf("time: %lf \n", m_time);
-				}
-				m_state = 32;
-				m_executed = false;				
-			}
-			break;
-		}
+// 送られた座標に移動中
+void MyController::goToBoxTimer(double now)
+{
+	// 自分で決めた経路の途中なら次の点へ
+	if(!m_boxRoute.empty()) {
+		followBoxRoute(now);
+		return;
+	}
 
-		// 物体の方向が帰ってきた
-		case 32: {
-			if(evt.time() > m_time && m_executed == false) {
-				// 物体のある場所に到着したので、車輪と止め、関節を回転し始め、物体を拾う
-				m_my->setWheelVelocity(0.0, 0.0);
-				//printf("回転を止めた evt.time %lf \n", evt.time());
-				// 関節の回転を始める
-				m_my->setJointVelocity("RARM_JOINT1", -m_jvel, 0.0);
-				// 50°回転
-				m_time = DEG2RAD(ROTATE_ANG) / m_jvel + evt.time();
-				m_state = 33;
-				m_executed = false;
-			}
-			break;
-		}
+	// 送られた座標に到着した、 自分の位置の取得
+	Vector3d myPos = myPosition();
+	double x = myPos.x();
+	double z = myPos.z();
+	double theta = 0;			// y方向の回転は無しと考える	
 
-		case 33: {
-			// 関節回転中
-			if(evt.time() > m_time && m_executed == false) {
-				// 関節の回転を止める
-				m_my->setJointVelocity("RARM_JOINT1", 0.0, 0.0);
-				// 自分の位置の取得
-				Vector3d myPos;
-				m_my->getPosition(myPos);
-				double x = myPos.x();
-				double z = myPos.z();
-				double theta = 0;									// y方向の回転は無しと考える	
-				//物体を掴めるか掴めないかによって処理を分岐させる
-				if(m_grasp) {											// 物体を掴んだ
-
-					// 捨てたゴミをゴミ候補
-					std::vector<std::string>::iterator it;
-					// ゴミ候補を得る
-					it = std::find(m_trashes.begin(), m_trashes.end(), m_tname);
-					// 候補から削除する
-					m_trashes.erase(it);		
-					printf("erased ... \n");	
-
-					// ゴミ箱への行き方と問い合わせする
-					char replyMsg[256];
-
-					// もっとも近いゴミ箱を探す
-					//bool found = recognizeNearestTrashBox(m_trashBoxPos, m_trashBoxName);
-
-					// ゴミを置くべき座標を探す
-					bool found = findPlace2PutObj(m_trashBoxPos, m_tname); 
-					if(found) {
-						// ゴミ箱が検出出来た
-						std::cout << "trashboxName " << m_trashBoxName << std::endl;
-						sprintf(replyMsg, "AskTrashBoxRoute %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf", 
-																	x, z, theta, m_trashBoxPos.x(), m_trashBoxPos.y(), m_trashBoxPos.z());
-					} else {
-						sprintf(replyMsg, "AskTrashBoxPos %6.1lf %6.1lf %6.1lf", 
-																	x, z, theta);
-					}
-
-					m_srv->sendMsgToSrv(replyMsg);	
-					m_executed = true;	
-							
-				} else {					// 物体を掴めなかった、次に探す場所を問い合わせる
-					// ゴミを掴めなかったもしくはゴミが無かった、次にゴミのある場所を問い合わせする
-					// 逆方向に関節の回転を始める
-					m_my->setJointVelocity("RARM_JOINT1", m_jvel, 0.0);
-					// 50°回転
-					m_time = DEG2RAD(ROTATE_ANG) / m_jvel + evt.time();
-					m_state = 34;				
-					m_lastFailedTrash = m_tname;
-					m_executed = false;
-				}		
-				
-			}
-			break;
-		}
-		
-		case 34: {
-			if(evt.time() > m_time && m_executed == false) {
-				// 関節の回転を止める
-				m_my->setJointVelocity("RARM_JOINT1", 0.0, 0.0);
-
-				// 自分の位置の取得
-				Vector3d myPos;
-				m_my->getPosition(myPos);
-				double x = myPos.x();
-				double z = myPos.z();
-				double theta = 0;			
-				char replyMsg[256];
-				sprintf(replyMsg, "AskObjPos %6.1lf %6.1lf %6.1lf", x, z, theta);
-				printf("case 34 debug %s \n", replyMsg);
-
-				m_srv->sendMsgToSrv(replyMsg);			
-				m_executed = true;
-			}
-			break;
-		}
+	// もっとも近いゴミ箱を探す
+	bool found = recognizeNearestTrashBox(m_trashBoxPos, m_trashBoxId);
+	if(found) {
+		// ゴミ箱が検出出来た
+		ALOG_DEBUG((ALOG_CONSOLE, "trashboxName %s \n", m_entities.name(m_trashBoxId).c_str()));
+		AskTrashBoxRouteMsg msg;
+		msg.x = x; msg.z = z; msg.theta = theta;
+		msg.boxX = m_trashBoxPos.x(); msg.boxY = m_trashBoxPos.y(); msg.boxZ = m_trashBoxPos.z();
+		sendToSrv(m_wire.encode(msg));
+	} else {
+		AskTrashBoxPosMsg msg;
+		msg.x = x; msg.z = z; msg.theta = theta;
+		sendToSrv(m_wire.encode(msg));
+	}
+}
 
-		case 40: {
-			// 送られた座標に回転する
-			m_time = rotateTowardObj(nextPos, m_rotateVel, evt.time());
-			m_state = 41;
-			m_executed = false;
-			break;
-	  }
-
-		case 41: {
-			// 送られた座標に回転中
-			if(evt.time() > m_time && m_executed == false) {
-				// 送られた座標に移動する
-				printf("目的地の近くに移動します %lf %lf %lf \n", nextPos.x(), nextPos.y(), nextPos.z());	
-				m_time = goToObj(nextPos, m_vel*4, m_range, evt.time());
-				m_state = 42;
-				m_executed = false;
-			}
-			break;
-	  }
-
-		case 42: {
-			// 送られた座標に移動中
-			if(evt.time() > m_time && m_executed == false) {
-				// 送られた座標に到着した、 自分の位置の取得
-				Vector3d myPos;
-				m_my->getPosition(myPos);
-				double x = myPos.x();
-				double z = myPos.z();
-				double theta = 0;			// y方向の回転は無しと考える	
-				char replyMsg[256];
-
-				// もっとも近いゴミ箱を探す
-				bool found = recognizeNearestTrashBox(m_trashBoxPos, m_trashBoxName);
-				if(found) {
-					// ゴミ箱が検出出来た
-					std::cout << "trashboxName " << m_trashBoxName << std::endl;
-					sprintf(replyMsg, "AskTrashBoxRoute %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf", 
-																x, z, theta, m_trashBoxPos.x(), m_trashBoxPos.y(), m_trashBoxPos.z());
-				} else {
-					sprintf(replyMsg, "AskTrashBoxPos %6.1lf %6.1lf %6.1lf", 
-																x, z, theta);
-				}
-
-				m_srv->sendMsgToSrv(replyMsg);
-				m_executed = true;
-			}
-			break;
-		}
+// ThrowTrash: 捨てるために斜めに向く
+void MyController::turnToThrowTimer(double now)
+{
+	Vector3d throwPos;
 
-		case 50: {
-			if(evt.time() > m_time && m_executed == false) {
-				Vector3d throwPos;
-				//printf("斜めにちょっとずれた以前の時間 time: %lf \n", evt.time());
+	// 送られた座標に到着した、 自分の位置 (ログを出すときだけ取る)
+	ALOG_DEBUG((ALOG_CONSOLE, "robot pos %lf %lf \n", myPosition().x(), myPosition().z()));
 
-				// 送られた座標に到着した、 自分の位置の取得
-				Vector3d myPos;
-				m_my->getPosition(myPos);
-				printf("robot pos %lf %lf \n", myPos.x(), myPos.z());
+	// grasp中のパーツを取得します
+	CParts *parts = m_my->getParts("RARM_LINK7");	
+	// grasp中のパーツの座標を取得出来れば、回転する角度を逆算出来る。
+	Vector3d partPos;
+	if (parts->getPosition(partPos)) {
+		ALOG_DEBUG((ALOG_CONSOLE, "parts pos before rotate %lf %lf %lf \n", partPos.x(), partPos.y(), partPos.z()));
+	} 
+
+	if(calcGrabPos(nextPos, 20, throwPos)) {
+		m_sm.setDeadline(rotateTowardObj(throwPos, m_vel / 5, now));
+		ALOG_DEBUG((ALOG_CONSOLE, "斜めに捨てる throwPos :%lf %lf %lf \n", throwPos.x(), throwPos.y(), throwPos.z()));
+	}
+	// 以前の実装と同じく、回転の終了は待たずに次の tick で放す
+	m_sm.request(ST_RELEASE);
+}
 
+// ゴミ箱に到着したので、車輪を停止し、物体をゴミ箱に捨てる
+void MyController::releaseEnter(double now)
+{
+	commandWheel(0.0, 0.0);
+	// grasp中のパーツを取得します
+	CParts *parts = m_my->getParts("RARM_LINK7");		
 
-				// grasp中のパーツを取得します
-				CParts *parts = m_my->getParts("RARM_LINK7");	
-				// grasp中のパーツの座標を取得出来れば、回転する角度を逆算出来る。
-				Vector3d partPos;
-				if (parts->getPosition(partPos)) {
-					printf("parts pos before rotate %lf %lf %lf \n", partPos.x(), partPos.y(), partPos.z());
-				} 
+	// grasp中のパーツの座標を取得出来れば、回転する角度を逆算出来る。
+	Vector3d partPos;
+	if (parts->getPosition(partPos)) {
+		ALOG_DEBUG((ALOG_CONSOLE, "parts pos after rotate %lf %lf %lf \n", partPos.x(), partPos.y(), partPos.z()));
+	} 
 
+	// releaseします
+	parts->releaseObj();		
+	m_trace.grasp(now, false, "");
+	// ゴミが捨てられるまで少し待つ(sleep(1) の代わりに期限で待つ)
+	m_sm.setDeadline(now + 1.0);
+}
 
+void MyController::releaseTimer(double now)
+{
+	// grasp終了
+	m_grasp = false;
 
-				//if(calcGrabPos(nextPos, 20, throwPos)) {				
-				if(calcGrabPos(nextPos, 20, throwPos)) {
-					m_time = rotateTowardObj(throwPos, m_vel / 5, evt.time());
-					printf("斜めに捨てる throwPos :%lf %lf %lf \n", throwPos.x(), throwPos.y(), throwPos.z());
-					//printf("time: %lf \n", m_time);
-				}
-				m_state = 51;
-				m_executed = false;				
-			}
-		
-			break;
-		}
+	// 関節の回転を始める
+	commandJoint("RARM_JOINT1", m_jvel);
+	m_sm.setDeadline(DEG2RAD(ROTATE_ANG) / m_jvel + now + 1.0);
+	m_sm.go(ST_ARM_BACK, now);
+}
 
-		case 51: {
-		  // ゴミ箱に到着したので、車輪を停止し、アームを下ろし、物体をゴミ箱に捨てる準備をする
-			m_my->setWheelVelocity(0.0, 0.0);
-			// grasp中のパーツを取得します
-		  CParts *parts = m_my->getParts("RARM_LINK7");		
-		  
-			// grasp中のパーツの座標を取得出来れば、回転する角度を逆算出来る。
-			Vector3d partPos;
-			if (parts->getPosition(partPos)) {
-				printf("parts pos after rotate %lf %lf %lf \n", partPos.x(), partPos.y(), partPos.z());
-			} 
-
-		  // releaseします
-		  parts->releaseObj();		
-			// ゴミが捨てられるまで少し待つ
-		  sleep(1);
-			// grasp終了
-		  m_grasp = false;
-
-			//confirmThrewTrashPos(m_threwPos, m_tname);
-			//printf("捨てた座標：　%lf %lf %lf \n", m_threwPos.x(), m_threwPos.y(), m_threwPos.z());	
-			
-			// 関節の回転を始める
-		  m_my->setJointVelocity("RARM_JOINT1", m_jvel, 0.0);
-		  m_time = DEG2RAD(ROTATE_ANG) / m_jvel + evt.time() + 1.0;   
-			m_state = 52;
-			m_executed = false;
-			break;
-		}
+// 関節が回転中
+void MyController::armBackTimer(double now)
+{
+	// 関節が元に戻った、関節の回転を止める
+	commandJoint("RARM_JOINT1", 0.0);
+	// 自分の位置の取得
+	Vector3d myPos = myPosition();
+	double x = myPos.x();
+	double z = myPos.z();
+	double theta = 0;										// y方向の回転は無しと考える	
+	
+	// ゴミを捨てたので、次にゴミのある場所を問い合わせする
+	if(recognizeNearestTrash(m_tpos, m_tid)) {
+		// 物体が発見された
+		m_sm.go(ST_OBJ_FOUND, now);
+	} else {
+		AskObjPosMsg msg;
+		msg.x = x; msg.z = z; msg.theta = theta;
+		sendToSrv(m_wire.encode(msg));
+	}
+}
 
-		case 52: {
-			// 関節が回転中
-			if(evt.time() > m_time && m_executed == false) {
-				// 関節が元に戻った、関節の回転を止める
-				m_my->setJointVelocity("RARM_JOINT1", 0.0, 0.0);
-				// 自分の位置の取得
-				Vector3d myPos;
-				m_my->getPosition(myPos);
-				double x = myPos.x();
-				double z = myPos.z();
-				double theta = 0;										// y方向の回転は無しと考える	
-				
-				// ゴミを捨てたので、次にゴミのある場所を問い合わせする
-				char replyMsg[256];
-				
-				if(recognizeNearestTrash(m_tpos, m_tname)) {
-					m_executed = false;
-					// 物体が発見された
-
-					m_state = 500;
-				} else {
-					sprintf(replyMsg, "AskObjPos %6.1lf %6.1lf %6.1lf", x, z, theta);
-					m_srv->sendMsgToSrv(replyMsg);
-					m_executed = true;
-				}
-				
-			}
-			break;
-		}
-		
-		case 100: {
-			m_my->setJointVelocity("RARM_JOINT1", 0.0, 0.0);
-			m_my->setWheelVelocity(0.0, 0.0);
-			break;
-		}
+void MyController::finishEnter(double now)
+{
+	commandJoint("RARM_JOINT1", 0.0);
+	commandWheel(0.0, 0.0);
+}
 
+// 次に行く場所を問い合わせる
+void MyController::routeAskTimer(double now)
+{
+	sendSceneInfo();
+}
 
-		case 800: {
-			if(evt.time() > m_time && m_executed == false) {
-				sendSceneInfo();
-				m_executed = true;
-			}
-			break;
-		}
+// RandomRoute: 送られた座標の方向に回転する
+void MyController::routeTurnTimer(double now)
+{
+	m_sm.setDeadline(rotateTowardObj(nextPos, m_rotateVel, now));
+	m_sm.go(ST_ROUTE_GO, now);
+}
 
-		case 805: {
-			if(evt.time() > m_time && m_executed == false) {
-				// 送られた座標に移動する
-				double range = 0;
-				m_time = rotateTowardObj(nextPos, m_rotateVel, evt.time());
-				m_state = 807;
-				m_executed = false;
-			}
-			break;
-	  }
-
-		case 807: {
-			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);				
-				printf("移動先 x: %lf, z: %lf \n", nextPos.x(), nextPos.z());				
-				m_time = goToObj(nextPos, m_vel*4, m_range, evt.time());
-				m_state = 810;
-				m_executed = false;
-			}
-			break;
-		}
+void MyController::routeGoTimer(double now)
+{
+	commandWheel(0.0, 0.0);				
+	ALOG_DEBUG((ALOG_CONSOLE, "移動先 x: %lf, z: %lf \n", nextPos.x(), nextPos.z()));				
+	m_sm.setDeadline(goToObj(nextPos, m_vel*4, m_range, now));
+	m_sm.go(ST_ROUTE_LOOK, now);
+}
 
-		case 810: {
-			// 送られた座標に移動中
-			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);
-				m_time = rotateTowardObj(m_lookingPos, m_rotateVel, evt.time());
-				m_executed = false;
-				m_state = 815;
-			}
-			break;
-		}
-		
-		case 815: {
-			// 送られた座標に移動中
-			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);				
-				sendSceneInfo();
-				printf("sent data to SIGViewer \n");				
-				m_executed = true;
-			}
-			break;
-		}
+// 送られた座標に移動中
+void MyController::routeLookTimer(double now)
+{
+	commandWheel(0.0, 0.0);
+	m_sm.setDeadline(rotateTowardObj(m_lookingPos, m_rotateVel, now));
+	m_sm.go(ST_ROUTE_ARRIVED, now);
+}
 
-		case 920: {
-			// 送られた座標に回転する
-			m_time = rotateTowardObj(nextPos, m_rotateVel, evt.time());
-			m_state = 921;
-			m_executed = false;
-			break;
-		}
+void MyController::routeArrivedTimer(double now)
+{
+	commandWheel(0.0, 0.0);				
+	sendSceneInfo();
+	ALOG_DEBUG((ALOG_CONSOLE, "sent data to SIGViewer \n"));				
+}
 
-		case 921: {
-			// ロボットが回転中
-			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);
-				m_executed = false;
-			}
-			break;
-		}
+// SIGViewer の RotateDir: 送られた座標に回転する
+void MyController::viewerTurnEnter(double now)
+{
+	m_sm.setDeadline(rotateTowardObj(nextPos, m_rotateVel, now));
+}
 
-		default: {
-			break;
-		}
+void MyController::viewerTurnTimer(double now)
+{
+	commandWheel(0.0, 0.0);
+}
+
+
+// 状態表 (並びは CleanUpState と同じ)
+//   名前, onEnter, onTimer, onTick, onExit
+const MyController::SM::State MyController::s_states[ST_NUM] = {
+	{ ST_INIT,          "INIT",          NULL,                          NULL,                               &MyController::initTick, NULL },
+	{ ST_START,         "START",         NULL,                          &MyController::startTimer,          NULL, NULL },
+	{ ST_WAIT,          "WAIT",          NULL,                          NULL,                               NULL, NULL },
+	{ ST_TURN_TO_OBJ,   "TURN_TO_OBJ",   &MyController::turnToObjEnter,   &MyController::turnToObjTimer,   NULL, NULL },
+	{ ST_GO_TO_OBJ,     "GO_TO_OBJ",     NULL,                          &MyController::goToObjTimer,        NULL, NULL },
+	{ ST_OBJ_FOUND,     "OBJ_FOUND",     NULL,                          NULL,                               NULL, NULL },
+	{ ST_TURN_TO_GRAB,  "TURN_TO_GRAB",  &MyController::turnToGrabEnter,  &MyController::turnToGrabTimer,  NULL, NULL },
+	{ ST_ALIGN_GRAB,    "ALIGN_GRAB",    NULL,                          &MyController::alignGrabTimer,      NULL, NULL },
+	{ ST_REACH,         "REACH",         NULL,                          &MyController::reachTimer,          NULL, NULL },
+	{ ST_RETRACT,       "RETRACT",       NULL,                          &MyController::retractTimer,        NULL, NULL },
+	{ ST_TURN_TO_BOX,   "TURN_TO_BOX",   &MyController::turnToBoxEnter,   &MyController::turnToBoxTimer,   NULL, NULL },
+	{ ST_GO_TO_BOX,     "GO_TO_BOX",     NULL,                          &MyController::goToBoxTimer,        NULL, NULL },
+	{ ST_TURN_TO_THROW, "TURN_TO_THROW", NULL,                          &MyController::turnToThrowTimer,    NULL, NULL },
+	{ ST_RELEASE,       "RELEASE",       &MyController::releaseEnter,     &MyController::releaseTimer,     NULL, NULL },
+	{ ST_ARM_BACK,      "ARM_BACK",      NULL,                          &MyController::armBackTimer,        NULL, NULL },
+	{ ST_FINISH,        "FINISH",        &MyController::finishEnter,      NULL,                            NULL, NULL },
+	{ ST_ROUTE_ASK,     "ROUTE_ASK",     NULL,                          &MyController::routeAskTimer,       NULL, NULL },
+	{ ST_ROUTE_TURN,    "ROUTE_TURN",    NULL,                          &MyController::routeTurnTimer,      NULL, NULL },
+	{ ST_ROUTE_GO,      "ROUTE_GO",      NULL,                          &MyController::routeGoTimer,        NULL, NULL },
+	{ ST_ROUTE_LOOK,    "ROUTE_LOOK",    NULL,                          &MyController::routeLookTimer,      NULL, NULL },
+	{ ST_ROUTE_ARRIVED, "ROUTE_ARRIVED", NULL,                          &MyController::routeArrivedTimer,   NULL, NULL },
+	{ ST_VIEWER_TURN,   "VIEWER_TURN",   &MyController::viewerTurnEnter,  &MyController::viewerTurnTimer,  NULL, NULL },
+};
 
+
+double MyController::onAction(ActionEvent &evt)
+{
+	m_prof.begin(m_sm.next(), evt.time());
+	m_now = evt.time();
+	beginTick();
+	if (m_trace.isOpen() && m_now - m_lastPoseTrace >= TRACE_POSE_INTERVAL) {
+		const Vector3d &myPos = myPosition();
+		m_trace.pose(m_now, myPos.x(), myPos.z(), calcHeadingAngle());
+		m_lastPoseTrace = m_now;
 	}
 
-  return 0.05;      
+	if(m_srv == NULL){
+		// ゴミ認識サービスが利用可能か調べる
+		if(checkService("RecogTrash")){
+			// ゴミ認識サービスに接続
+			m_srv = connectToService("RecogTrash");
+		}
+	}
+
+	m_sm.tick(evt.time());
+
+	m_prof.end(m_sm.state());
+	// 次の期限まで起こさない
+  return m_sm.nextInterval(evt.time(), m_minInterval, m_maxInterval);      
 }  
 
 
@@ -744,217 +971,269 @@ double MyController::onAction(ActionEvent &evt)
 
 void MyController::onRecvMsg(RecvMsgEvent &evt)
 {  
+  beginTick();
   // 送信者取得
   std::string sender = evt.getSender();
-  std::cout << "sender: " << sender << std::endl;
-
-	char *all_msg = (char*)evt.getMsg();		
-	printf("all_msg: %s \n", all_msg);
-	char *delim = (char *)(" ");
-	char *ctx;
-	char *header = strtok_r(all_msg, delim, &ctx);
-
-	if (strcmp(header, "RESET") == 0) {
-		printf("Received RESET \n");
-		setRobotPosition(0, -50);	
-		setRobotHeadingAngle(0);
-		setCameraPosition(0, 3);
-		printf("Reseted RobotPosition \n");
-		//char* replyMsg = sendSceneInfo();
-		sendSceneInfo("Start");
-		m_executed = true;
-		return;
+  ALOG_DEBUG((ALOG_CONSOLE, "sender: %s \n", sender.c_str()));
+
+	const char *all_msg = evt.getMsg();		
+	ALOG_DEBUG((ALOG_CONSOLE, "all_msg: %s \n", all_msg));
+	m_trace.recv(m_now, sender.c_str(), all_msg);
+	AsyncLog::instance().print(ALOG_CONVERSATION, "%.3lf < %s %s\n", m_now, sender.c_str(), all_msg);
+
+	// ヘッダでハンドラを引いて呼ぶ (送信者が違うものは無視する)
+	Dispatcher::Result result = m_dispatcher.dispatch(sender.c_str(), all_msg);
+	if (result == Dispatcher::MSG_UNKNOWN) {
+		ALOG_ERR((ALOG_CONSOLE, "unknown message: %s \n", all_msg));
 	}
+}  
 
 
+/////////////////////////////////////////////
+/////////// メッセージごとの処理 ////////////
+/////////////////////////////////////////////
 
-  // 送信者がゴミ認識サービスの場合
-  if(sender == "RecogTrash") {
+// 計測結果の出力 "Profile [hist]"
+void MyController::onMsgProfile(const MsgArgs &args)
+{
+	m_prof.dump(stdout, args.is(0, "hist"));
+}
 
-	  /*char *all_msg = (char*)evt.getMsg();		
-		//printf("all_msg: %s \n", all_msg);
-		char *delim = (char *)(" ");
-		char *ctx;
-		char *header = strtok_r(all_msg, delim, &ctx);*/
+// 計測結果のリセット "ProfileReset"
+void MyController::onMsgProfileReset(const MsgArgs &args)
+{
+	m_prof.reset();
+}
 
-		double x = 0, y = 0, z = 0; // range = 0;
-	
-			
-		if(strcmp(header, "ObjDir") == 0) {
-			// 次に移動する座標を位置を取り出す			
-			x = atof(strtok_r(NULL, delim, &ctx));
-			y = atof(strtok_r(NULL, delim, &ctx));
-			z = atof(strtok_r(NULL, delim, &ctx));
-			m_range = atof(strtok_r(NULL, delim, &ctx));
-			nextPos.set(x, y, z);
-			//printf("m_range = %lf \n", m_range);
-			printf("[ClientMess] ObjDir %lf %lf %lf range: %lf\n", nextPos.x(), nextPos.y(), nextPos.z(), m_range);		
-			// ロボットのステートを更新
-
-			m_state = 20;
-			m_executed = false;
-			return;
-		}
+// onAction の呼び出し間隔の変更 "ActionInterval min [max]"
+void MyController::onMsgActionInterval(const MsgArgs &args)
+{
+	m_minInterval = args.d(0);
+	if (args.has(1)) m_maxInterval = args.d(1);
+	if (m_maxInterval < m_minInterval) m_maxInterval = m_minInterval;
+	ALOG_INFO((ALOG_CONSOLE, "ActionInterval min: %lf max: %lf \n", m_minInterval, m_maxInterval));
+}
 
-		// 物体のある場所に到着し、アームを伸ばし、物体を掴む
-		if(strcmp(header, "grab") == 0) {		
-			printf("grab \n");	
-			// 回転を止める
-			m_my->setWheelVelocity(0.0, 0.0);
-			m_state = 30;
-			m_executed = false;
-			return;
-		}
+void MyController::onMsgReset(const MsgArgs &args)
+{
+	ALOG_DEBUG((ALOG_CONSOLE, "Received RESET \n"));
+	setRobotPosition(0, -50);	
+	setRobotHeadingAngle(0);
+	setCameraPosition(0, 3);
+	ALOG_DEBUG((ALOG_CONSOLE, "Reseted RobotPosition \n"));
+	sendSceneInfo("Start");
+	m_sm.disarm();
+}
 
-	 if(strcmp(header, "TrashBoxDir") == 0) {
-			printf("TrashBoxDir \n");
-			// 次に移動する座標を位置を取り出す			
-			x = atof(strtok_r(NULL, delim, &ctx));
-			y = atof(strtok_r(NULL, delim, &ctx));
-			z = atof(strtok_r(NULL, delim, &ctx));
-			m_range = atof(strtok_r(NULL, delim, &ctx));
-			//printf("range = %lf \n", m_range);
-			nextPos.set(x, y, z);
-			printf("[ClientMess] TrashBoxDir %lf %lf %lf range: %lf\n", nextPos.x(), nextPos.y(), nextPos.z(), m_range);
-		  m_state = 40;
-			m_executed = false;
-			return;
-	 }
-
-	 if(strcmp(header, "ThrowTrash") == 0) {			
-			m_state = 50;
-			m_executed = false;
-			return;
-		}
+// 送信する形式の切り替え "WireFormat text|binary" (知らない形式ならテキストのまま)
+void MyController::onMsgWireFormat(const MsgArgs &args)
+{
+	WireFormatMsg in;
+	msgRead(args, in);
+	if (!m_wire.setFormat(in.format)) {
+		ALOG_ERR((ALOG_CONSOLE, "unknown wire format: %s \n", in.format.c_str()));
+	}
+	// 返事はどちらの形式でも読めるようにテキストで送る
+	WireFormatMsg msg;
+	msg.format = m_wire.formatName();
+	ALOG_INFO((ALOG_CONSOLE, "%s \n", m_wire.text(msg).c_str()));
+	if (m_srv != NULL) sendToSrv(m_wire.text(msg));
+}
 
-		if(strcmp(header, "Finish") == 0) {	
-			m_state = 100;
-			m_executed = false;
-			return;	
-		}
+// "ObjDir x y z range" 物体のある方向
+void MyController::onMsgObjDir(const MsgArgs &args)
+{
+	ObjDirMsg in;
+	msgRead(args, in);
+	// 次に移動する座標を位置を取り出す			
+	nextPos.set(in.x, in.y, in.z);
+	m_range = in.range;
+	ALOG_DEBUG((ALOG_CONSOLE, "[ClientMess] ObjDir %lf %lf %lf range: %lf\n", nextPos.x(), nextPos.y(), nextPos.z(), m_range));		
+	// ロボットのステートを更新
+	m_sm.request(ST_TURN_TO_OBJ);
+}
 
-		if(strcmp(header, "RandomRouteStart") == 0) {
-			m_state = 800;
-			m_executed = false;
-			return;
-		}
+// 物体のある場所に到着し、アームを伸ばし、物体を掴む
+void MyController::onMsgGrab(const MsgArgs &args)
+{
+	ALOG_DEBUG((ALOG_CONSOLE, "grab \n"));	
+	// 回転を止める
+	commandWheel(0.0, 0.0);
+	m_sm.request(ST_TURN_TO_GRAB);
+}
 
-		if(strcmp(header, "RandomRouteArrived") == 0) {
-			//printf("onRecv RandomRouteArrived \n");
-			m_state = 800;
-			m_executed = false;
-			return;
-		}
+// "TrashBoxDir x y z range" ゴミ箱のある方向
+void MyController::onMsgTrashBoxDir(const MsgArgs &args)
+{
+	TrashBoxDirMsg in;
+	msgRead(args, in);
+	ALOG_DEBUG((ALOG_CONSOLE, "TrashBoxDir \n"));
+	// 次に移動する座標を位置を取り出す			
+	nextPos.set(in.x, in.y, in.z);
+	m_range = in.range;
+	ALOG_DEBUG((ALOG_CONSOLE, "[ClientMess] TrashBoxDir %lf %lf %lf range: %lf\n", nextPos.x(), nextPos.y(), nextPos.z(), m_range));
+	// サービスの指示に従う (自分で決めた経路は捨てる)
+	m_boxRoute.clear();
+	m_sm.request(ST_TURN_TO_BOX);
+}
 
-		if(strcmp(header, "RandomRoute") == 0) {
-			x = atof(strtok_r(NULL, delim, &ctx));			
-			z = atof(strtok_r(NULL, delim, &ctx));	
-			m_range = atof(strtok_r(NULL, delim, &ctx));			
-			nextPos.set(x, y, z);
-
-			double lookingX = atof(strtok_r(NULL, delim, &ctx));
-			double lookingZ = atof(strtok_r(NULL, delim, &ctx));
-			m_lookingPos.set(lookingX, 0, lookingZ);
-
-			m_state = 805;
-			m_executed = false;
-			return;
-		} 
-
-		if(strcmp(header, "GoForwardVelocity") == 0) {
-			double wheelVel = atof(strtok_r(NULL, delim, &ctx));
-			printf("GoForwardVelocity coef: %lf \n", wheelVel);
-			wheelVel *= m_vel;
-			m_my->setWheelVelocity(wheelVel * 10., wheelVel * 10.);				
-			//sendSceneInfo();				
-			return;
-		}
+void MyController::onMsgThrowTrash(const MsgArgs &args)
+{
+	m_sm.request(ST_TURN_TO_THROW);
+}
 
-		if(strcmp(header, "RotateVelocity") == 0) {
-			double wheelVel = atof(strtok_r(NULL, delim, &ctx));
-			printf("RotateVelocity coef: %lf \n", wheelVel);
-			wheelVel *= m_vel;
-			m_my->setWheelVelocity(-wheelVel, wheelVel);				
-			//sendSceneInfo();				
-			return;
-		}
+void MyController::onMsgFinish(const MsgArgs &args)
+{
+	m_sm.request(ST_FINISH);
+}
 
-		if(strcmp(header, "Stop") == 0) {
-			printf("Stop joyStick \n");
-			m_my->setWheelVelocity(0.0, 0.0);				
-			sendSceneInfo();			
-			return;
-		}
+// RandomRouteStart / RandomRouteArrived 次に行く場所を問い合わせる
+void MyController::onMsgRouteAsk(const MsgArgs &args)
+{
+	m_sm.request(ST_ROUTE_ASK);
+}
 
-		if (strcmp(header, "CamID") == 0) {
-			printf("Setting CameraID \n");
-			m_CamID = atoi(strtok_r(NULL, delim, &ctx));
-			return;
-		}
+// "RandomRoute x z range lookX lookZ" (後ろに付く値は使わない)
+void MyController::onMsgRandomRoute(const MsgArgs &args)
+{
+	RandomRouteMsg in;
+	msgRead(args, in);
+	nextPos.set(in.x, 0, in.z);
+	m_range = in.range;
+	m_lookingPos.set(in.lookX, 0, in.lookZ);
 
-		if (strcmp(header, "CaptureData") == 0) {
-			printf("SetRobotPosition \n");
-			double x = atof(strtok_r(NULL, delim, &ctx));		
-			double z = atof(strtok_r(NULL, delim, &ctx));
-			setRobotPosition(x, z);
-			double angle = atof(strtok_r(NULL, delim, &ctx));
-			printf("setRobotHeadingAngle: %lf \n", angle);
-			setRobotHeadingAngle(angle);
-			char* replyMsg = sendSceneInfo();
-			//m_srv->sendMsgToSrv(replyMsg);
-			m_executed = true;
-			return;			
-		} 
-
-	} else if (sender == "SIGViewer") {
-		printf("mess from SIGViewer \n");
-
-		if(strcmp(header, "CameraAngle") == 0) {
-			double angle = atof(strtok_r(NULL, delim, &ctx));
-			printf("CameraAngle: %lf \n", angle);
-			setCameraPosition(angle, 3);
-			char* replyMsg = sendSceneInfo();
-			m_executed = true;
-			return;
-		} else if (strcmp(header, "RobotAngle") == 0) {
-			printf("rorate robor start \n");
-			double angle = atof(strtok_r(NULL, delim, &ctx));
-			printf("RobotHeadingAngle: %lf \n", angle);
-			setRobotHeadingAngle(angle);
-			char* replyMsg = sendSceneInfo();
-			//m_srv->sendMsgToSrv(replyMsg);
-			m_executed = true;
-			return;			
-		} else if (strcmp(header, "RotateDir") == 0) {
-			// 次に移動する座標を位置を取り出す			
-			double x = atof(strtok_r(NULL, delim, &ctx));
-			double z = atof(strtok_r(NULL, delim, &ctx));
-			nextPos.set(x, 0, z);
-	
-			printf("RotateDir %lf %lf \n", nextPos.x(), nextPos.z());		
-			// ロボットのステートを更新
-			m_state = 920;
-			m_executed = false;
-			return;
-		} else if(strcmp(header, "RobotPosition") == 0) {
-			double x = atof(strtok_r(NULL, delim, &ctx));		
-			double z = atof(strtok_r(NULL, delim, &ctx));
-			setRobotPosition(x, z);
-			return;
-		}
-	}
+	m_sm.request(ST_ROUTE_TURN);
+}
 
-}  
+void MyController::onMsgGoForwardVelocity(const MsgArgs &args)
+{
+	GoForwardVelocityMsg in;
+	msgRead(args, in);
+	double wheelVel = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "GoForwardVelocity coef: %lf \n", wheelVel));
+	wheelVel *= m_vel;
+	commandWheel(wheelVel * 10., wheelVel * 10.);				
+}
+
+void MyController::onMsgRotateVelocity(const MsgArgs &args)
+{
+	RotateVelocityMsg in;
+	msgRead(args, in);
+	double wheelVel = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "RotateVelocity coef: %lf \n", wheelVel));
+	wheelVel *= m_vel;
+	commandWheel(-wheelVel, wheelVel);				
+}
+
+void MyController::onMsgStop(const MsgArgs &args)
+{
+	ALOG_DEBUG((ALOG_CONSOLE, "Stop joyStick \n"));
+	commandWheel(0.0, 0.0);				
+	sendSceneInfo();			
+}
 
+void MyController::onMsgCamID(const MsgArgs &args)
+{
+	CamIDMsg in;
+	msgRead(args, in);
+	ALOG_DEBUG((ALOG_CONSOLE, "Setting CameraID \n"));
+	m_CamID = in.camID;
+}
 
+// "CaptureData x z angle"
+void MyController::onMsgCaptureData(const MsgArgs &args)
+{
+	CaptureDataMsg in;
+	msgRead(args, in);
+	ALOG_DEBUG((ALOG_CONSOLE, "SetRobotPosition \n"));
+	setRobotPosition(in.x, in.z);
+	double angle = in.angle;
+	ALOG_DEBUG((ALOG_CONSOLE, "setRobotHeadingAngle: %lf \n", angle));
+	setRobotHeadingAngle(angle);
+	sendSceneInfo();
+	m_sm.disarm();
+}
 
-void MyController::confirmThrewTrashPos(Vector3d &pos, std::string &name) {
-	if(getObj(name.c_str())) {
-		SimObj *trash = getObj(name.c_str());
-		//printf("created SimObj Trash \n");
+// SIGViewer から
+void MyController::onMsgCameraAngle(const MsgArgs &args)
+{
+	CameraAngleMsg in;
+	msgRead(args, in);
+	double angle = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "CameraAngle: %lf \n", angle));
+	setCameraPosition(angle, 3);
+	sendSceneInfo();
+	m_sm.disarm();
+}
 
-		// ゴミの位置取得
-		trash->getPosition(pos);
+void MyController::onMsgRobotAngle(const MsgArgs &args)
+{
+	RobotAngleMsg in;
+	msgRead(args, in);
+	ALOG_DEBUG((ALOG_CONSOLE, "rorate robor start \n"));
+	double angle = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "RobotHeadingAngle: %lf \n", angle));
+	setRobotHeadingAngle(angle);
+	sendSceneInfo();
+	m_sm.disarm();
+}
+
+// "RotateDir x z"
+void MyController::onMsgRotateDir(const MsgArgs &args)
+{
+	RotateDirMsg in;
+	msgRead(args, in);
+	// 次に移動する座標を位置を取り出す			
+	nextPos.set(in.x, 0, in.z);
+	ALOG_DEBUG((ALOG_CONSOLE, "RotateDir %lf %lf \n", nextPos.x(), nextPos.z()));		
+	// ロボットのステートを更新
+	m_sm.request(ST_VIEWER_TURN);
+}
+
+// "RobotPosition x z"
+void MyController::onMsgRobotPosition(const MsgArgs &args)
+{
+	RobotPositionMsg in;
+	msgRead(args, in);
+	setRobotPosition(in.x, in.z);
+}
+
+
+// メッセージの表
+//   ヘッダ, 送信者(NULL は誰でも), 引数のスキーマ, ハンドラ (MSG_COMMAND はヘッダと引数のスキーマを MsgSchema.h から取る)
+const MyController::Dispatcher::Command MyController::s_commands[] = {
+	{ "Profile",            NULL,         "|s",     &MyController::onMsgProfile },
+	{ "ProfileReset",       NULL,         "",       &MyController::onMsgProfileReset },
+	{ "ActionInterval",     NULL,         "d|d",    &MyController::onMsgActionInterval },
+	MSG_COMMAND(Reset,              NULL,         &MyController::onMsgReset),
+	MSG_COMMAND(WireFormat,         NULL,         &MyController::onMsgWireFormat),
+
+	MSG_COMMAND(ObjDir,             "RecogTrash", &MyController::onMsgObjDir),
+	MSG_COMMAND(Grab,               "RecogTrash", &MyController::onMsgGrab),
+	MSG_COMMAND(TrashBoxDir,        "RecogTrash", &MyController::onMsgTrashBoxDir),
+	MSG_COMMAND(ThrowTrash,         "RecogTrash", &MyController::onMsgThrowTrash),
+	MSG_COMMAND(Finish,             "RecogTrash", &MyController::onMsgFinish),
+	MSG_COMMAND(RandomRouteStart,   "RecogTrash", &MyController::onMsgRouteAsk),
+	MSG_COMMAND(RandomRouteArrived, "RecogTrash", &MyController::onMsgRouteAsk),
+	MSG_COMMAND(RandomRoute,        "RecogTrash", &MyController::onMsgRandomRoute),
+	MSG_COMMAND(GoForwardVelocity,  "RecogTrash", &MyController::onMsgGoForwardVelocity),
+	MSG_COMMAND(RotateVelocity,     "RecogTrash", &MyController::onMsgRotateVelocity),
+	MSG_COMMAND(Stop,               "RecogTrash", &MyController::onMsgStop),
+	MSG_COMMAND(CamID,              "RecogTrash", &MyController::onMsgCamID),
+	MSG_COMMAND(CaptureData,        "RecogTrash", &MyController::onMsgCaptureData),
+
+	MSG_COMMAND(CameraAngle,        "SIGViewer",  &MyController::onMsgCameraAngle),
+	MSG_COMMAND(RobotAngle,         "SIGViewer",  &MyController::onMsgRobotAngle),
+	MSG_COMMAND(RotateDir,          "SIGViewer",  &MyController::onMsgRotateDir),
+	MSG_COMMAND(RobotPosition,      "SIGViewer",  &MyController::onMsgRobotPosition),
+};
+const int MyController::s_commandNum = sizeof(MyController::s_commands) / sizeof(MyController::s_commands[0]);
+
+
+
+void MyController::confirmThrewTrashPos(Vector3d &pos, int id) {
+	// ゴミの位置取得
+	if(entityPosition(id, pos)) {
 		//printf("捨てた座標：　%lf %lf %lf \n", pos.x(), pos.y(), pos.z());	 
 	}	else {
 		//printf("cannot find trashbox with such name \n");
@@ -963,54 +1242,141 @@ void MyController::confirmThrewTrashPos(Vector3d &pos, std::string &name) {
 }
 
 
-/* ゴミの名前から、捨てるべきゴミ箱の名前を検索し、そのゴミ箱の位置を探す
+/* ゴミの番号から、入れてよいゴミ箱のうち今ある一番近いものを選ぶ
+ * (カタログに無いゴミや、入れてよいゴミ箱がすべて無いときは fallback のゴミ箱から選ぶ)
+ * 選べればサービスに問い合わせずに AskTrashBoxRoute を送れる
  * @return pos 捨てるべきの位置
- * @param trashName ゴミの名前
+ * @return boxId 捨てるべきゴミ箱の番号
+ * @param trashId ゴミの番号 (-1 でもよい)
  */
-bool MyController::findPlace2PutObj(Vector3d &pos, std::string trashName)
+bool MyController::findPlace2PutObj(Vector3d &pos, int trashId, int &boxId)
 {
-  /////////////////////////////////////////////
-  ///////////ここでゴミを認識します////////////
-  /////////////////////////////////////////////
-
-  // 候補のゴミが無い場合
+  // 候補のゴミ箱が無い場合
   if(m_trashBoxes.empty()){
     return false;
-  } else {
-		//printf("m_trashBoxes.size(): %d \n", m_trashBoxes.size());
+  }
+
+	Vector3d myPos = myPosition();
+	bool fallback;
+	int bin = m_entities.nearestBin(trashId, myPos.x(), myPos.z(), &MyController::binPosition, &fallback);
+	ALOG_DEBUG((ALOG_CONSOLE, "%s => %s%s \n", m_entities.name(trashId).c_str(), m_entities.name(bin).c_str(), fallback ? " (fallback)" : ""));
+	if(bin < 0) {
+		return false;
 	}
 
-	std::string trashBoxName = "";
-	std::map<std::string, std::string>::iterator it = m_trashTypeMap.begin();
-	trashBoxName = m_trashTypeMap.find(trashName)->second;
-	std::cout << trashName << " => " << trashBoxName << '\n';
-	bool trashBoxExist = false;
+	double x, y, z;
+	m_entities.pose(bin, x, y, z);
+	pos.set(x, y, z);
+	boxId = bin;
+	//printf("ゴミ箱の位置：　%lf %lf %lf \n", pos.x(), pos.y(), pos.z());	 
+  return true;
+}
 
-	for(int i = 0; i < m_trashBoxes.size(); i++) {
-		if(m_trashBoxes[i] == trashBoxName) {
-			trashBoxExist = true;			
-		}
-	}	
+bool MyController::binPosition(int id, double &x, double &z)
+{
+	if(!m_trashBoxIndex.contains(id)) {
+		return false;
+	}
+	Vector3d pos;
+	if(!entityPosition(id, pos)) {
+		m_trashBoxIndex.remove(id);
+		return false;
+	}
+	m_trashBoxIndex.update(id, pos.x(), pos.z());
+	x = pos.x();
+	z = pos.z();
+	return true;
+}
+
+
+bool MyController::planBoxRoute(int boxId)
+{
+	m_boxRoute.clear();
+	if(m_routes.obstacleCount() == 0 || boxId < 0 || boxId >= (int)m_anchorOf.size() || m_anchorOf[boxId] < 0) {
+		return false;
+	}
+	// ゴミ箱が動いていれば表を作り直す (動いていなければ表を引くだけ)
+	int anchor = m_anchorOf[boxId];
+	m_routes.setAnchor(anchor, m_trashBoxPos.x(), m_trashBoxPos.z());
+
+	Vector3d myPos = myPosition();
+	// 最初の回転も移動時間に含める (myHeading は z 軸から x 軸の方へ測るので、経路の (x, z) の atan2 に直す)
+	double heading = PI / 2 - myHeading();
+	if(!m_routes.lookup(myPos.x(), myPos.z(), heading, anchor, ROUTE_SNAP, m_boxRoute)) {
+		ALOG_ERR((ALOG_CONSOLE, "no route to %s \n", m_entities.name(boxId).c_str()));
+		m_boxRoute.clear();
+		return false;
+	}
+	ALOG_DEBUG((ALOG_CONSOLE, "route to %s: %d points %.1lf cm %.1lf s (table hits %ld misses %ld) \n",
+		m_entities.name(boxId).c_str(), (int)m_boxRoute.size(), RouteTable::length(m_boxRoute),
+		m_routes.travelTime(m_boxRoute, heading), m_routes.hits(), m_routes.misses()));
+	// 最初の点は今の位置
+	m_boxRouteNext = 1;
+	return true;
+}
 
-	if(trashBoxExist) {
-		if(getObj(trashBoxName.c_str())) {
-			SimObj *place = getObj(trashBoxName.c_str());
-			// ゴミの位置取得
-			place->getPosition(pos);
-			//printf("ゴミ箱の位置：　%lf %lf %lf \n", pos.x(), pos.y(), pos.z());	 
-			return true;
+void MyController::followBoxRoute(double now)
+{
+	commandWheel(0.0, 0.0);
+	if(m_boxRouteNext < m_boxRoute.size()) {
+		const RoutePoint &p = m_boxRoute[m_boxRouteNext++];
+		if(m_boxRouteNext == m_boxRoute.size()) {
+			// 最後の点はゴミ箱
+			nextPos = m_trashBoxPos;
+			m_range = ROUTE_BOX_RANGE;
 		} else {
-			printf("can not get obj with such name \n");
-		}	
+			nextPos.set(p.x, 0.0, p.y);
+			m_range = ROUTE_WAYPOINT_RANGE;
+		}
+		ALOG_DEBUG((ALOG_CONSOLE, "route point %lf %lf range: %lf \n", nextPos.x(), nextPos.z(), m_range));
+		m_sm.go(ST_TURN_TO_BOX, now);
 	} else {
-		return false;
+		m_boxRoute.clear();
+		nextPos = m_trashBoxPos;
+		m_sm.setDeadline(now);
+		m_sm.go(ST_TURN_TO_THROW, now);
 	}
+}
+
 
-  return false;
+/* @brief  索引から一番近いエンティティを探す。見つけたエンティティだけ位置を取得する
+ * 索引の位置は登録したときのものなので、取得した位置と違えば (押されて動いたゴミ)
+ * 索引を直して探し直す。索引の位置と今の位置が同じエンティティが選ばれたら終わり
+ * (直したエンティティは次からは同じ位置になるので、多くても候補の数だけ回る)
+ * @param  index 候補の索引
+ * @return pos  見つかったエンティティの位置
+ * @return id   見つかったエンティティの番号
+ * @return 見つかった場合は true
+ */
+bool MyController::recognizeNearest(SpatialIndex &index, Vector3d &pos, int &id)
+{
+  // 自分の位置の取得
+  Vector3d myPos = myPosition();
+
+	for (;;) {
+		int nearest = index.nearest(myPos.x(), myPos.z());
+		if (nearest < 0) {
+			return false;
+		}
+		if (!entityPosition(nearest, pos)) {
+			// 消えたエンティティは索引から外す
+			index.remove(nearest);
+			continue;
+		}
+		double x, z;
+		index.position(nearest, x, z);
+		if (x != pos.x() || z != pos.z()) {
+			// 動いていた。今の位置で登録し直して、もっと近いものが無いか探し直す
+			index.update(nearest, pos.x(), pos.z());
+			continue;
+		}
+		id = nearest;
+		return true;
+	}
 }
 
 
-bool MyController::recognizeNearestTrashBox(Vector3d &pos, std::string &name)
+bool MyController::recognizeNearestTrashBox(Vector3d &pos, int &id)
 {
 	// とりあえずランダムに探させる
   /////////////////////////////////////////////
@@ -1024,56 +1390,15 @@ bool MyController::recognizeNearestTrashBox(Vector3d &pos, std::string &name)
 		//printf("m_trashBoxes.size(): %d \n", m_trashBoxes.size());
 	}
 
-	bool found = false;
-
-  // 自分の位置の取得
-  Vector3d myPos;
-  m_my->getPosition(myPos);
-	
-	// もっと近いゴミを検索する	
-  double dis_min = 10000000000000.0;
-	double distance;
-	double min_idx;
-
-	//int trashNum = rand() % m_trashes.size();
-	// 現位置に検出出来るゴミを検索する
-	for(int trashNum = 0; trashNum < m_trashBoxes.size(); trashNum++) {
-		name = m_trashBoxes[trashNum];
-		if(getObj(name.c_str())) {
-			SimObj *trash = getObj(name.c_str());
-			//printf("created SimObj Trash \n");
-
-			// ゴミの位置取得
-			trash->getPosition(pos);
-			//printf("ゴミ箱の位置：　%lf %lf %lf \n", pos.x(), pos.y(), pos.z());	 
-
-			distance = (myPos.x() - pos.x()) * (myPos.x() - pos.x()) + 
-								 (myPos.z() - pos.z()) * (myPos.z() - pos.z()); 
-			if (distance < dis_min) {
-				min_idx = trashNum;
-				dis_min = distance;
-			}				
-			found = true;
-		}	else {
-			//printf("cannot find trashbox with such name \n");
-		}
-	}
-
-	if (found == true) {
-			name = m_trashBoxes[min_idx];
-			printf("nearestTrashBox .... : %s \n", name.c_str());
-			SimObj *trash = getObj(name.c_str());
-			// ゴミの位置取得
-			trash->getPosition(pos);
-	} else {
-		return false;
+	bool found = recognizeNearest(m_trashBoxIndex, pos, id);
+	if (found) {
+		ALOG_DEBUG((ALOG_CONSOLE, "nearestTrashBox .... : %s \n", m_entities.name(id).c_str()));
 	}
-
   return found;
 }
 
 
-bool MyController::recognizeNearestTrash(Vector3d &pos, std::string &name)
+bool MyController::recognizeNearestTrash(Vector3d &pos, int &id)
 {
   /////////////////////////////////////////////
   ///////////ここでゴミを認識します////////////
@@ -1083,53 +1408,13 @@ bool MyController::recognizeNearestTrash(Vector3d &pos, std::string &name)
   if(m_trashes.empty()){
     return false;
   } /*else {
-		printf("m_trashes.size(): %d \n", m_trashes.size());
+		ALOG_DEBUG((ALOG_CONSOLE, "m_trashes.size(): %d \n", m_trashes.size()));
 	}*/
 
-	bool found = false;
-
-  // 自分の位置の取得
-  Vector3d myPos;
-  m_my->getPosition(myPos);
-	
-	// もっと近いゴミを検索する	
-  double dis_min = 10000000000000.0;
-	double distance;
-	double min_idx;
-
-	// 現位置に検出出来るゴミを検索する
-	for(int trashNum = 0; trashNum < m_trashes.size(); trashNum++) {
-		name = m_trashes[trashNum];
-		if(getObj(name.c_str())) {
-			SimObj *trash = getObj(name.c_str());
-			//printf("created SimObj Trash \n");
-
-			// ゴミの位置取得
-			trash->getPosition(pos);
-			//printf("ゴミの位置：　%lf %lf %lf \n", pos.x(), pos.y(), pos.z());	 
-
-			distance = (myPos.x() - pos.x()) * (myPos.x() - pos.x()) + 
-								 (myPos.z() - pos.z()) * (myPos.z() - pos.z()); 
-			if (distance < dis_min) {
-				min_idx = trashNum;
-				dis_min = distance;
-			}				
-			found = true;
-		}	else {
-			//printf("cannot find obj with such name \n");
-		}
-	}
-
-	if (found == true) {
-			name = m_trashes[min_idx];
-			printf("nearestObj trash ^^^: %s \n", name.c_str());
-			SimObj *trash = getObj(name.c_str());
-			// ゴミの位置取得
-			trash->getPosition(pos);
-	} else {
-		return false;
+	bool found = recognizeNearest(m_trashIndex, pos, id);
+	if (found) {
+		ALOG_DEBUG((ALOG_CONSOLE, "nearestObj trash ^^^: %s \n", m_entities.name(id).c_str()));
 	}
-
   return found;
 }
 
@@ -1137,7 +1422,7 @@ bool MyController::recognizeNearestTrash(Vector3d &pos, std::string &name)
 
 
 
-bool MyController::recognizeRandomTrash(Vector3d &pos, std::string &name)
+bool MyController::recognizeRandomTrash(Vector3d &pos, int &id)
 {
   /////////////////////////////////////////////
   ///////////ここでゴミを認識します////////////
@@ -1148,70 +1433,39 @@ bool MyController::recognizeRandomTrash(Vector3d &pos, std::string &name)
 		broadcastMsgToSrv("Found all known trashes");
     return false;
   } /*else {
-		printf("m_trashes.size(): %d \n", m_trashes.size());
+		ALOG_DEBUG((ALOG_CONSOLE, "m_trashes.size(): %d \n", m_trashes.size()));
 	}*/
 
-	bool found = false;
-
-  // 自分の位置の取得
-  Vector3d myPos;
-  m_my->getPosition(myPos);
-	
 	// 現位置に検出出来るゴミを検索する
 
   // ここでは乱数を使ってゴミを決定します
   int trashNum = rand() % m_trashes.size();
-	name = m_trashes[trashNum];
+	SimObj *trash = m_entities.get(m_trashes[trashNum]);
 	
 	// robot stop if it cannot grab nearest object, so i didnt use find nearest obj function
 	// when use while() loop, robot freeze when all object found
 	// donot use while() loop xxx
 
-	/*while(!getObj(name.c_str())) {
-	//for(int trashNum = 0; trashNum < m_trashes.size(); trashNum++) {
-		trashNum = rand() % m_trashes.size();
-		name = m_trashes[trashNum];
-	}*/
-
 	// if cannot find object by random(), iteratate through all the name of trash.
 	int objFindTry = 0;	
-	if(!getObj(name.c_str())) {
-		while(objFindTry < m_trashes.size()) {
-			name = m_trashes[objFindTry];
-			if(getObj(name.c_str())) {
-				found = true;
-				break;
-			}
-			objFindTry++;
-		}
-	} else if(getObj(name.c_str())) {
-		found = true;
+	while(trash == NULL && objFindTry < m_trashes.size()) {
+		trashNum = objFindTry;
+		trash = m_entities.get(m_trashes[trashNum]);
+		objFindTry++;
 	}
 
-	if(!found) {
+	if(trash == NULL) {
 		//broadcastMsgToSrv("remain known obj not found");
 		return false;
 	}
 
+	id = m_trashes[trashNum];
+	// ゴミの位置取得
+	entityPosition(id, pos);
+	ALOG_DEBUG((ALOG_CONSOLE, "ゴミの位置：　%lf %lf %lf \n", pos.x(), pos.y(), pos.z()));	 
+	ALOG_DEBUG((ALOG_CONSOLE, "random Obj: %s \n", m_entities.name(id).c_str()));
 
-	if(found) {
-		SimObj *trash = getObj(name.c_str());
-		//printf("created SimObj Trash \n");
-
-		// ゴミの位置取得
-		trash->getPosition(pos);
-		printf("ゴミの位置：　%lf %lf %lf \n", pos.x(), pos.y(), pos.z());	 
-	}	
-
-	if (found) {
-			//name = m_trashes[min_idx];
-			printf("random Obj: %s \n", name.c_str());
-			SimObj *trash = getObj(name.c_str());
-			// ゴミの位置取得
-			trash->getPosition(pos);
-	} 
-
-  return found;
+  return true;
 }
 
 
@@ -1238,12 +1492,10 @@ void MyController::onCollision(CollisionEvent &evt)
       //右手に衝突した場合  
       if(mparts[i] == "RARM_LINK7"){  
   
-				//自分を取得  
-				SimObj *my = getObj(myname());  
-				
 				//自分の手のパーツを得ます  
-				CParts * parts = my->getParts("RARM_LINK7");  
+				CParts * parts = m_my->getParts("RARM_LINK7");  
 				parts->graspObj(with[i]);  
+				m_trace.grasp(m_now, true, with[i].c_str());
 	
         m_grasp = true;  
       }  
@@ -1254,42 +1506,70 @@ void MyController::onCollision(CollisionEvent &evt)
 
 double MyController::calcHeadingAngle()
 {
-	// 自分の回転を得る
-  Rotation myRot;
-  m_my->getRotation(myRot);
-      
-  // y軸の回転角度を得る(x,z方向の回転は無いと仮定)
-  double qw = myRot.qw();
-  double qy = myRot.qy();      
-  double theta = 2*acos(fabs(qw));
-
-  if (qw * qy < 0) {   
-	 theta = -1 * theta;
+	return myHeading() * 180.0 / PI;
+}
+
+
+void MyController::beginTick()
+{
+	m_myPosFresh = false;
+	m_myThetaFresh = false;
+	m_entities.beginTick();
+}
+
+const Vector3d &MyController::myPosition()
+{
+	if (!m_myPosFresh) {
+		m_my->getPosition(m_myPos);
+		m_myPosFresh = true;
+	}
+	return m_myPos;
+}
+
+double MyController::myHeading()
+{
+	if (!m_myThetaFresh) {
+		// 自分の回転を得る
+		Rotation myRot;
+		m_my->getRotation(myRot);
+		// y軸の回転角度を得る(x,z方向の回転は無いと仮定)
+		double qw = myRot.qw();
+		double qy = myRot.qy();
+		m_myTheta = 2 * acos(fabs(qw));
+		if (qw * qy < 0) {
+			m_myTheta = -1 * m_myTheta;
+		}
+		m_myThetaFresh = true;
 	}
+	return m_myTheta;
+}
 
-	return theta * 180.0 / PI;
+bool MyController::entityPosition(int id, Vector3d &pos)
+{
+	double x, y, z;
+	if (m_entities.poseFresh(id) && m_entities.pose(id, x, y, z)) {
+		pos.set(x, y, z);
+		return true;
+	}
+	SimObj *obj = m_entities.get(id);
+	if (obj == NULL) {
+		return false;
+	}
+	obj->getPosition(pos);
+	m_entities.setPose(id, pos.x(), pos.y(), pos.z());
+	return true;
 }
 
   
 double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
 {  	
-  	// 自分の回転を得る
-  	Rotation myRot;
-  	m_my->getRotation(myRot);
-      
-	// y軸の回転角度を得る(x,z方向の回転は無いと仮定)
-	double qw = myRot.qw();
-	double qy = myRot.qy();
-	double theta = 2 * acos(fabs(qw));
-	if (qw * qy < 0) {
-    theta = -1 * theta;
-	}
-	printf("ロボットが向いている角度 current theta: %lf(deg) \n",  theta * 180 / PI);
+  	// 自分の回転を得る (y軸の回転角度。x,z方向の回転は無いと仮定)
+	double theta = myHeading();
+	ALOG_DEBUG((ALOG_CONSOLE, "ロボットが向いている角度 current theta: %lf(deg) \n",  theta * 180 / PI));
 
 	// 自分の位置の取得
-  	Vector3d myPos;
-  	m_my->getPosition(myPos);
-	printf("ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z());
+  	Vector3d myPos = myPosition();
+	ALOG_DEBUG((ALOG_CONSOLE, "ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z()));
 
   	// 自分の位置からターゲットを結ぶベクトル
   	Vector3d tmpPos = pos;  
@@ -1307,17 +1587,17 @@ double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
 	if (tmpPos.z() < 0) {
 		targetAngle += PI;
 	}
-	printf("回転する角度 targetAngle: %lf(deg) 結ぶベクトル tmpPos.x: %lf, tmpPos.z: %lf, rate: %lf \n", targetAngle*180.0/PI, tmpPos.x(), tmpPos.z(), rate);
+	ALOG_DEBUG((ALOG_CONSOLE, "回転する角度 targetAngle: %lf(deg) 結ぶベクトル tmpPos.x: %lf, tmpPos.z: %lf, rate: %lf \n", targetAngle*180.0/PI, tmpPos.x(), tmpPos.z(), rate));
 
   targetAngle -= theta;
 	if (targetAngle > PI) {
 		targetAngle = targetAngle - 2 * PI;
 	}
-	printf("targetAngle: %lf(deg) currentAngle: %lf(deg) \n", targetAngle*180.0/PI, theta * 180.0 / PI);
+	ALOG_DEBUG((ALOG_CONSOLE, "targetAngle: %lf(deg) currentAngle: %lf(deg) \n", targetAngle*180.0/PI, theta * 180.0 / PI));
 	
 
   if (targetAngle == 0.0) {
-	printf("donot need to rotate \n");
+	ALOG_DEBUG((ALOG_CONSOLE, "donot need to rotate \n"));
     return 0.0;
   } else {
     // 回転すべき円周距離
@@ -1326,13 +1606,13 @@ double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
     double vel = m_radius * velocity;
     // 回転時間(u秒)
     double time = distance / vel;
-	printf("rotateTime: %lf \n", time);	    
+	ALOG_DEBUG((ALOG_CONSOLE, "rotateTime: %lf \n", time));	    
     
 	// 車輪回転開始
     if (targetAngle > 0.0) {
-      m_my->setWheelVelocity(-velocity, velocity);
+      commandWheel(-velocity, velocity);
     } else {
-      m_my->setWheelVelocity(velocity, -velocity);
+      commandWheel(velocity, -velocity);
     }
 
 	return now + time;
@@ -1345,19 +1625,13 @@ double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
 double MyController::rotateTowardGrabPos(Vector3d pos, double velocity, double now)
 {
 
-	printf("start rotate %lf \n", now);
-	//自分を取得  
-	SimObj *my = getObj(myname());  
-	
+	ALOG_DEBUG((ALOG_CONSOLE, "start rotate %lf \n", now));
 	//printf("向く座標 %lf %lf %lf \n", pos.x(), pos.y(), pos.z());
-  // 自分の位置の取得
-  Vector3d myPos;
-  m_my->getPosition(myPos);
 
 
 
 	//自分の手のパーツを得ます  
-	CParts * parts = my->getParts("RARM_LINK7");  
+	CParts * parts = m_my->getParts("RARM_LINK7");  
 
 	Vector3d partPos;
 	parts->getPosition(partPos);
@@ -1371,24 +1645,8 @@ double MyController::rotateTowardGrabPos(Vector3d pos, double velocity, double n
   // y方向は考えない
   tmpp.y(0);
   
-  // 自分の回転を得る
-  Rotation myRot;
-  m_my->getRotation(myRot);
-
-  // エンティティの初期方向
-  Vector3d iniVec(0.0, 0.0, 1.0);
-      
-  // y軸の回転角度を得る(x,z方向の回転は無いと仮定)
-  double qw = myRot.qw();
-  double qy = myRot.qy();
-      
-  double theta = 2*acos(fabs(qw));
-	//printf("qw: %lf theta: %lf \n", qw, theta);
-
-  if(qw*qy < 0) {
-		//printf("qw * qy < 0 \n");
-    theta = -1*theta;		
-	}
+  // 自分の回転を得る (y軸の回転角度。x,z方向の回転は無いと仮定)
+  double theta = myHeading();
 
   // z方向からの角度
  	//printf("結ぶベクトル　座標 %lf %lf %lf \n", tmpp.x(), tmpp.y(), tmpp.z());
@@ -1425,15 +1683,15 @@ double MyController::rotateTowardGrabPos(Vector3d pos, double velocity, double n
     
     // 車輪回転開始
     if(targetAngle > 0.0){
-      m_my->setWheelVelocity(velocity, -velocity);
+      commandWheel(velocity, -velocity);
     }
     else
 		{
-      m_my->setWheelVelocity(-velocity, velocity);
+      commandWheel(-velocity, velocity);
     }
 
 		//printf("distance: %lf vel: %lf time: %lf \n", distance, vel, time);
-		printf("rotate time: %lf, time to stop: %lf \n", time, now + time);
+		ALOG_DEBUG((ALOG_CONSOLE, "rotate time: %lf, time to stop: %lf \n", time, now + time));
     return now + time;
   }
 		
@@ -1453,11 +1711,10 @@ double MyController::rotateTowardGrabPos(Vector3d pos, double velocity, double n
 // object まで移動
 double MyController::goToObj(Vector3d nextPos, double velocity, double range, double now)
 {
-	printf("goToObj関数内　goToObj %lf %lf %lf \n", nextPos.x(), nextPos.y(), nextPos.z());	
+	ALOG_DEBUG((ALOG_CONSOLE, "goToObj関数内　goToObj %lf %lf %lf \n", nextPos.x(), nextPos.y(), nextPos.z()));	
   	// 自分の位置の取得
-  	Vector3d myPos;
- 	m_my->getPosition(myPos);
-	printf("goToObj関数内 ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z()); 
+  	Vector3d myPos = myPosition();
+	ALOG_DEBUG((ALOG_CONSOLE, "goToObj関数内 ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z())); 
 
 	// 自分の位置からターゲットを結ぶベクトル
 	Vector3d pos = nextPos;
@@ -1471,11 +1728,19 @@ double MyController::goToObj(Vector3d nextPos, double velocity, double range, do
 	//printf("distance: %lf \n", distance);
 	//printf("range = %lf \n", range);
 
+	// 止まる位置までの間が障害物に近ければ遅く進む
+	if (distance > 0.0) {
+		Vector3d stop = pos;
+		stop *= distance / pos.length();
+		stop += myPos;
+		velocity = clearanceSpeed(myPos, stop, velocity);
+	}
+
 	// 車輪の半径から移動速度を得る
 	double vel = m_radius*velocity;
 
 	// 移動開始
-	m_my->setWheelVelocity(velocity, velocity);
+	commandWheel(velocity, velocity);
 
 	// 到着時間取得
 	double time = distance / vel;
@@ -1485,6 +1750,56 @@ double MyController::goToObj(Vector3d nextPos, double velocity, double range, do
 
 
 
+double MyController::clearanceSpeed(const Vector3d &from, const Vector3d &to, double velocity)
+{
+	// 出発点の近くは今いる所なので見ない (家具の前から離れるときまで遅くしない)
+	updateClearance();
+	double dx = to.x() - from.x(), dz = to.z() - from.z();
+	double len = sqrt(dx * dx + dz * dz);
+	double skip = std::min(SLOW_CLEARANCE / len, 1.0);
+	double c = m_clearance.segmentClearance(from.x() + dx * skip, from.z() + dz * skip, to.x(), to.z());
+	if (c >= SLOW_CLEARANCE) return velocity;
+	double t = std::max(0.0, (c - SLOW_NEAR) / (SLOW_CLEARANCE - SLOW_NEAR));
+	double ratio = SLOW_MIN_RATIO + (1.0 - SLOW_MIN_RATIO) * t;
+	ALOG_DEBUG((ALOG_CONSOLE, "障害物まで %lf cm なので %lf 倍の速さで進む \n", c, ratio));
+	return velocity * ratio;
+}
+
+double MyController::approachRange(const Vector3d &pos, double range)
+{
+	updateClearance();
+	Vector3d myPos = myPosition();
+	double dx = myPos.x() - pos.x(), dz = myPos.z() - pos.z();
+	double len = sqrt(dx * dx + dz * dz);
+	if (len <= range) return range;
+	// 家具の上・すぐそばの物は家具の縁まで行かないと届かないので、ずらさない
+	if (!m_clearance.clear(pos.x(), pos.z(), APPROACH_CLEARANCE)) return range;
+	// 物体から自分の方へ range 離れた位置から、升目ずつ手前にずらす
+	double r = range;
+	while (r - range < APPROACH_BACKOFF && r + CLEARANCE_CELL < len &&
+	       !m_clearance.clear(pos.x() + dx / len * r, pos.z() + dz / len * r, APPROACH_CLEARANCE)) {
+		r += CLEARANCE_CELL;
+	}
+	if (r != range) ALOG_DEBUG((ALOG_CONSOLE, "止まる位置が障害物に近いので %lf cm 手前で止まる \n", r - range));
+	return r;
+}
+
+void MyController::updateClearance()
+{
+	for (int obsNum = 0; obsNum < m_clearanceIds.size(); obsNum++) {
+		int id = m_clearanceIds[obsNum];
+		Vector3d pos;
+		if (id < 0 || !entityPosition(id, pos)) continue;
+		double dx = pos.x() - m_clearanceStart[obsNum].x(), dz = pos.z() - m_clearanceStart[obsNum].z();
+		Vector3d &shift = m_clearanceShift[obsNum];
+		if (fabs(dx - shift.x()) <= CLEARANCE_MOVE_EPS && fabs(dz - shift.z()) <= CLEARANCE_MOVE_EPS) continue;
+		shift.set(dx, 0.0, dz);
+		m_clearance.setObstacle(obsNum, m_entities.footprintX(id) + dx, m_entities.footprintZ(id) + dz,
+		                        m_entities.footprintWidth(id), m_entities.footprintDepth(id), m_entities.footprintAngle(id));
+		ALOG_DEBUG((ALOG_CONSOLE, "障害物 %s が動いたので距離の表を直す (%lf, %lf) \n", m_entities.name(id).c_str(), dx, dz));
+	}
+}
+
 bool MyController::calcGrabPos(Vector3d pos, double robotShoulderWidth, Vector3d &grabPos) 
 {
 	// ロボットの幅の半分 16.5cm
@@ -1494,8 +1809,7 @@ bool MyController::calcGrabPos(Vector3d pos, double robotShoulderWidth, Vector3d
 	double grabX = 0, grabY = pos.y(), grabZ = 0;
 
 	// 自分の位置の取得
-	Vector3d myPos;
-	m_my->getPosition(myPos);
+	Vector3d myPos = myPosition();
 	//printf("ロボットの位置 %lf %lf %lf \n", myPos.x(), myPos.y(), myPos.z());
 	// 自分の位置からターゲットを結ぶベクトル
  	pos -= myPos;
@@ -1517,7 +1831,7 @@ bool MyController::calcGrabPos(Vector3d pos, double robotShoulderWidth, Vector3d
 
 		grabPos.set(grabX, grabY, grabZ);
 	
-		printf("向くべき座標 %lf %lf %lf \n", grabPos.x(), grabPos.y(), grabPos.z());
+		ALOG_DEBUG((ALOG_CONSOLE, "向くべき座標 %lf %lf %lf \n", grabPos.x(), grabPos.y(), grabPos.z()));
 		return true;
 	} else {
 		return false;
@@ -0,0 +1,263 @@
+// 非同期ログ
+// ・onAction/onRecvMsg の中ではリングバッファに書くだけにし、ファイル・端末への書き込みは別スレッドでまとめて行う
+//   (1行ごとに fopen/fprintf/fclose していた Utility::AppendString2File の代わり)
+// ・リングバッファはロックを使わない (スロットごとの番号を CAS で進める、書き手は複数・読み手は1つ)
+//   満杯のときは待たずに捨てて数える (制御ループを止めない)
+// ・出力先(シンク)は番号で指定する
+//     ALOG_CONSOLE  標準出力 (開かなくても使える)
+//     ALOG_REPLY    送信メッセージの記録 (reply_msg.txt)
+//     ALOG_RECV     受信メッセージの記録 (recv_msg.txt)
+//     ALOG_LOG      その他の記録 (log.txt)
+//     ALOG_CONVERSATION  サービスとの送受信の記録 (OfflineSim -p で再生できる形式)
+//   開いていないシンクへの書き込みは捨てる
+// ・レベルはコンパイル時に ALOG_LEVEL で決める (-DALOG_LEVEL=ALOG_LEVEL_DEBUG など)
+//   ALOG_LEVEL より詳しいレベルのマクロは空になり、引数も評価されない
+//
+// 使い方
+//   AsyncLog::instance().open(ALOG_REPLY, "reply_msg.txt");
+//   asyncLogLine(ALOG_REPLY, replyMsg);                    // 1行そのまま記録する (レベルに関係なく書く)
+//   ALOG_DEBUG((ALOG_CONSOLE, "rotateTime: %lf \n", time)); // printf と同じ書式。改行は付けない
+#ifndef _ASYNC_LOG_H_
+#define _ASYNC_LOG_H_
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <string>
+
+#define ALOG_LEVEL_NONE		0
+#define ALOG_LEVEL_ERR		1
+#define ALOG_LEVEL_INFO		2
+#define ALOG_LEVEL_DEBUG	3
+
+#ifndef ALOG_LEVEL
+#define ALOG_LEVEL ALOG_LEVEL_INFO
+#endif
+
+enum AsyncLogSink {
+	ALOG_CONSOLE = 0,
+	ALOG_REPLY,
+	ALOG_RECV,
+	ALOG_LOG,
+	ALOG_CONVERSATION,
+	ALOG_SINK_NUM
+};
+
+#define ALOG_SLOT_SIZE	128			// スロット1つの文字数 (長い行は連続した複数のスロットに入れる)
+#define ALOG_SLOTS		8192		// スロットの数 (2のべき乗)
+#define ALOG_LINE_MAX	8192		// 1回に書ける最大の文字数
+#define ALOG_FLUSH_MS	20			// 書き込みスレッドがバッファを見に行く間隔
+
+class AsyncLog {
+public:
+	static AsyncLog &instance() {
+		static AsyncLog log;
+		return log;
+	}
+
+	/* @brief  シンクにファイルを割り当てる。書き込みスレッドが動いていなければ起動する
+	 * @param  append false なら作り直す
+	 * @return 開けたら true
+	 */
+	bool open(int sink, const char *filename, bool append = true) {
+		if (sink <= ALOG_CONSOLE || sink >= ALOG_SINK_NUM) return false;
+		FILE *fp = fopen(filename, append ? "a" : "w");
+		if (fp == NULL) return false;
+		pthread_mutex_lock(&m_fileLock);
+		if (m_file[sink] != NULL) fclose(m_file[sink]);
+		m_file[sink] = fp;
+		pthread_mutex_unlock(&m_fileLock);
+		start();
+		return true;
+	}
+
+	/* @brief  文字列をそのまま書く
+	 * @return バッファが満杯で書けなかったら false
+	 */
+	bool write(int sink, const char *str, int len) {
+		if (sink < 0 || sink >= ALOG_SINK_NUM || len <= 0) return true;
+		if (len > ALOG_LINE_MAX) len = ALOG_LINE_MAX;
+		start();
+		int n = (len + ALOG_SLOT_SIZE - 1) / ALOG_SLOT_SIZE;
+		unsigned long pos;
+		if (!claim(n, pos)) {
+			__sync_fetch_and_add(&m_dropped, 1);
+			return false;
+		}
+		for (int i = 0; i < n; i++) {
+			Slot &s = m_slot[(pos + i) & (ALOG_SLOTS - 1)];
+			int l = len - i * ALOG_SLOT_SIZE;
+			if (l > ALOG_SLOT_SIZE) l = ALOG_SLOT_SIZE;
+			memcpy(s.text, str + i * ALOG_SLOT_SIZE, l);
+			s.sink = (unsigned char)sink;
+			s.len = (unsigned short)l;
+		}
+		// 後ろのスロットから公開する (読み手は先頭から順に読むので、先頭が見えた時点で全部揃っている)
+		for (int i = n - 1; i >= 0; i--) {
+			Slot &s = m_slot[(pos + i) & (ALOG_SLOTS - 1)];
+			__sync_synchronize();
+			s.seq = pos + i + 1;
+		}
+		return true;
+	}
+
+	bool print(int sink, const char *format, ...) __attribute__((format(printf, 3, 4))) {
+		char buf[ALOG_LINE_MAX];
+		va_list ap;
+		va_start(ap, format);
+		int len = vsnprintf(buf, sizeof(buf), format, ap);
+		va_end(ap);
+		if (len < 0) return false;
+		if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+		return write(sink, buf, len);
+	}
+
+	/* @brief  バッファに溜まっている分をすべて書き出す (呼んだスレッドで書く)
+	 */
+	void flush() {
+		pthread_mutex_lock(&m_drainLock);
+		drain();
+		pthread_mutex_unlock(&m_drainLock);
+	}
+
+	// 満杯で捨てた回数
+	unsigned long dropped() const { return m_dropped; }
+
+	~AsyncLog() {
+		if (m_running) {
+			m_stop = 1;
+			pthread_join(m_thread, NULL);
+			m_running = false;
+		}
+		flush();
+		if (m_dropped > 0) fprintf(stderr, "AsyncLog: dropped %lu lines \n", m_dropped);
+		for (int i = 1; i < ALOG_SINK_NUM; i++) {
+			if (m_file[i] != NULL) fclose(m_file[i]);
+		}
+		pthread_mutex_destroy(&m_fileLock);
+		pthread_mutex_destroy(&m_drainLock);
+		pthread_mutex_destroy(&m_startLock);
+	}
+
+private:
+	struct Slot {
+		volatile unsigned long seq;		// pos + 1 なら書き込み済み、pos なら空き (pos はスロットの通し番号)
+		unsigned char sink;
+		unsigned short len;
+		char text[ALOG_SLOT_SIZE];
+	};
+
+	AsyncLog() : m_head(0), m_tail(0), m_dropped(0), m_stop(0), m_running(false) {
+		for (unsigned long i = 0; i < ALOG_SLOTS; i++) m_slot[i].seq = i;
+		for (int i = 0; i < ALOG_SINK_NUM; i++) m_file[i] = NULL;
+		pthread_mutex_init(&m_fileLock, NULL);
+		pthread_mutex_init(&m_drainLock, NULL);
+		pthread_mutex_init(&m_startLock, NULL);
+	}
+	AsyncLog(const AsyncLog &);
+	AsyncLog &operator=(const AsyncLog &);
+
+	// 連続した n 個のスロットを確保する
+	bool claim(int n, unsigned long &pos) {
+		for (;;) {
+			unsigned long head = m_head;
+			// 読み手は順に空けるので、最後のスロットが空いていれば途中も空いている
+			const Slot &last = m_slot[(head + n - 1) & (ALOG_SLOTS - 1)];
+			if (last.seq != head + n - 1) return false;
+			if (__sync_bool_compare_and_swap(&m_head, head, head + n)) {
+				pos = head;
+				return true;
+			}
+		}
+	}
+
+	void start() {
+		if (m_running) return;
+		pthread_mutex_lock(&m_startLock);
+		if (!m_running) {
+			m_stop = 0;
+			if (pthread_create(&m_thread, NULL, &AsyncLog::threadMain, this) == 0) m_running = true;
+		}
+		pthread_mutex_unlock(&m_startLock);
+	}
+
+	static void *threadMain(void *arg) {
+		AsyncLog *self = (AsyncLog *)arg;
+		struct timespec ts;
+		ts.tv_sec = 0;
+		ts.tv_nsec = ALOG_FLUSH_MS * 1000000L;
+		while (!self->m_stop) {
+			nanosleep(&ts, NULL);
+			self->flush();
+		}
+		return NULL;
+	}
+
+	// m_drainLock を取ってから呼ぶ
+	void drain() {
+		bool touched[ALOG_SINK_NUM] = { false };
+		pthread_mutex_lock(&m_fileLock);
+		for (;;) {
+			Slot &s = m_slot[m_tail & (ALOG_SLOTS - 1)];
+			if (s.seq != m_tail + 1) break;
+			__sync_synchronize();
+			FILE *fp = (s.sink == ALOG_CONSOLE) ? stdout : m_file[s.sink];
+			if (fp != NULL) {
+				fwrite(s.text, 1, s.len, fp);
+				touched[s.sink] = true;
+			}
+			__sync_synchronize();
+			s.seq = m_tail + ALOG_SLOTS;
+			m_tail++;
+		}
+		for (int i = 0; i < ALOG_SINK_NUM; i++) {
+			if (!touched[i]) continue;
+			fflush(i == ALOG_CONSOLE ? stdout : m_file[i]);
+		}
+		pthread_mutex_unlock(&m_fileLock);
+	}
+
+	Slot m_slot[ALOG_SLOTS];
+	volatile unsigned long m_head;
+	unsigned long m_tail;
+	volatile unsigned long m_dropped;
+	FILE *m_file[ALOG_SINK_NUM];
+	pthread_mutex_t m_fileLock;		// open() と書き込みスレッドの間だけ (書き手は取らない)
+	pthread_mutex_t m_drainLock;
+	pthread_mutex_t m_startLock;
+	pthread_t m_thread;
+	volatile int m_stop;
+	volatile bool m_running;
+};
+
+/* @brief  1行そのまま記録する (改行を付ける)。レベルに関係なく書く
+ */
+inline void asyncLogLine(int sink, const std::string &line)
+{
+	std::string s = line;
+	s += '\n';
+	AsyncLog::instance().write(sink, s.c_str(), (int)s.size());
+}
+
+// ARGS は (シンク, 書式, ...) をかっこで囲んで渡す
+#if ALOG_LEVEL >= ALOG_LEVEL_ERR
+#define ALOG_ERR(ARGS)		AsyncLog::instance().print ARGS
+#else
+#define ALOG_ERR(ARGS)		do { } while (0)
+#endif
+
+#if ALOG_LEVEL >= ALOG_LEVEL_INFO
+#define ALOG_INFO(ARGS)		AsyncLog::instance().print ARGS
+#else
+#define ALOG_INFO(ARGS)		do { } while (0)
+#endif
+
+#if ALOG_LEVEL >= ALOG_LEVEL_DEBUG
+#define ALOG_DEBUG(ARGS)	AsyncLog::instance().print ARGS
+#else
+#define ALOG_DEBUG(ARGS)	do { } while (0)
+#endif
+
+#endif
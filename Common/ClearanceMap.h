@@ -0,0 +1,432 @@
+// 部屋の升目ごとの「一番近い障害物までの距離」の表 (距離変換)
+// ・経路計画は「膨らませた長方形の内側か外側か」しか知らないので、広い通路を選んだり、家具の近くで速さを落としたりできない
+//   ここでは障害物 (ObstacleSet と同じ向きのある長方形・凸多角形) を升目に塗り、升目ごとに一番近い塗った升目までの
+//   ユークリッド距離を求めておく。distance(x, y) は表を引くだけなので O(1)
+// ・距離変換は Felzenszwalb-Huttenlocher の方法 (升目の数に比例する時間)
+//     列ごと: 同じ列で一番近い塗った升目までの距離 g (上から・下からの2回なめる)
+//     行ごと: min_q ((x - q)^2 + g(q)^2) を放物線の下側の包絡線で求める
+// ・障害物が動いたときは、動く前と後の範囲に掛かる列だけ列ごとの計算をやり直し、g が変わった行のうち、
+//   今の距離がその範囲までの距離以上の升目がある行だけ行ごとの計算をやり直す (全部作り直したときと同じ値になる)。範囲を自動で決めているときに格子からはみ出したら全部作り直す
+// ・升目は中心が障害物から半升以内なら塗る。距離は升目の中心どうしなので、本当の距離との差は升目1つ分くらい
+//   障害物の内側 (塗った升目) は 0、障害物が1つも無ければ HUGE_VAL。格子の外の点は一番近い端の升目の値
+//
+// 使い方
+//   ClearanceMap map(5.0);
+//   map.setObstacle(i, x, z, width, depth, angle);	// 障害物ごと (変わらなければ何もしない)
+//   double d = map.distance(x, z);					// 変わっていたら作り直してから引く
+//   double c = map.segmentClearance(ax, az, bx, bz);	// 線分の上で一番狭いところ
+// 作り直しと動いたときの更新の速さは OfflineSim/RouteBench.cpp で比べられる
+#ifndef _CLEARANCE_MAP_H_
+#define _CLEARANCE_MAP_H_
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "ObstacleSet.h"
+
+class ClearanceMap {
+public:
+	/* @brief  升目の大きさと、範囲を自動で決めるときに障害物の外側に取る幅
+	 */
+	explicit ClearanceMap(double cellSize = 5.0, double margin = 200.0)
+		: m_cell(cellSize > 0.0 ? cellSize : 5.0), m_margin(margin), m_fixed(false), m_full(true),
+		  m_x0(0.0), m_y0(0.0), m_nx(0), m_ny(0), m_none(0),
+		  m_builds(0), m_updates(0), m_cellsUpdated(0) {
+		m_dirty.clear();
+	}
+
+	double cellSize() const { return m_cell; }
+
+	// 格子の範囲を決める (決めなければ障害物が入るように自動で決める)
+	void setBounds(double xmin, double ymin, double xmax, double ymax) {
+		if (xmax <= xmin || ymax <= ymin) return;
+		m_fixed = true;
+		m_bx0 = xmin;
+		m_by0 = ymin;
+		m_bx1 = xmax;
+		m_by1 = ymax;
+		m_full = true;
+	}
+
+	/* @brief  i 番目の障害物を置き直す (足りなければ足す。幅が負なら無い)。変わらなければ表はそのまま
+	 * @param  angle 長方形の向き [rad] (x 軸から y 軸の方へ回した角度)
+	 */
+	void setObstacle(int i, double x, double y, double width, double height, double angle = 0.0) {
+		if (i < 0) return;
+		grow(i + 1);
+		Rect &r = m_obs[i];
+		if (r.x == x && r.y == y && r.w == width && r.h == height && r.a == angle) return;
+		r.x = x;
+		r.y = y;
+		r.w = width;
+		r.h = height;
+		r.a = angle;
+		if (width < 0.0 || height < 0.0) m_set.remove(i);
+		else m_set.setBox(i, x, y, width, height, angle);
+		moved(i);
+	}
+	// i 番目の障害物を凸多角形にする (いつも変わったとみなす)
+	bool setPolygon(int i, const double *xs, const double *ys, int n) {
+		if (i < 0) return false;
+		grow(i + 1);
+		Rect poly = { 0.0, 0.0, 0.0, 0.0, HUGE_VAL };
+		m_obs[i] = poly;
+		bool ok = m_set.setPolygon(i, xs, ys, n);
+		if (!ok) m_set.remove(i);
+		moved(i);
+		return ok;
+	}
+	// 障害物の数を n にする (後ろを捨てる)
+	void resizeObstacles(int n) {
+		if (n < 0 || n >= (int)m_obs.size()) return;
+		for (int i = n; i < (int)m_obs.size(); i++) {
+			if (!m_set.empty(i)) {
+				m_set.remove(i);
+				moved(i);
+			}
+		}
+		m_obs.resize(n);
+		m_area.resize(n);
+		m_set.resize(n);
+	}
+	int obstacleCount() const { return (int)m_obs.size(); }
+	const ObstacleSet &obstacles() const { return m_set; }
+
+	// 障害物が変わっていたら表を作り直す (distance() などは自分で呼ぶ)
+	void update() {
+		if (m_full) {
+			rebuild();
+			return;
+		}
+		if (m_dirty.empty()) return;
+		CellRect d = m_dirty;
+		m_dirty.clear();
+		d.clip(m_nx, m_ny);
+		if (d.empty()) return;
+
+		// 範囲の升目を塗り直す (範囲に掛かる障害物だけ)
+		for (int cy = d.y0; cy <= d.y1; cy++) {
+			std::fill(m_occ.begin() + cy * m_nx + d.x0, m_occ.begin() + cy * m_nx + d.x1 + 1, 0);
+		}
+		for (int i = 0; i < m_set.size(); i++) paint(i, d);
+
+		// 範囲に掛かる列をやり直し、g が変わった行をやり直す
+		int w = d.x1 - d.x0 + 1;
+		m_rowDirty.assign(m_ny, 0);
+		m_col.resize(w * m_ny);
+		columnPass(&m_occ[0], m_nx, m_ny, d.x0, d.x1, &m_col[0]);
+		for (int cy = 0; cy < m_ny; cy++) {
+			int *g = &m_g[cy * m_nx + d.x0];
+			const int *col = &m_col[cy * w];
+			if (std::equal(col, col + w, g)) continue;
+			std::copy(col, col + w, g);
+			m_rowDirty[cy] = 1;
+		}
+		int rows = 0;
+		for (int cy = 0; cy < m_ny; cy++) {
+			if (!m_rowDirty[cy] || !reaches(d, cy)) continue;
+			rowPass(&m_g[0] + cy * m_nx, m_nx, &m_d2[0] + cy * m_nx, m_v, m_z);
+			rows++;
+		}
+		m_updates++;
+		m_cellsUpdated += (long)(d.x1 - d.x0 + 1) * m_ny + (long)rows * m_nx;
+	}
+
+	/* @brief  (x, y) から一番近い障害物までの距離
+	 * @return 障害物の内側なら 0、障害物が無ければ HUGE_VAL
+	 */
+	double distance(double x, double y) {
+		update();
+		if (m_nx == 0) return HUGE_VAL;
+		double d2 = m_d2[cellIndex(x, y)];
+		return (d2 >= m_none) ? HUGE_VAL : sqrt(d2) * m_cell;
+	}
+	// (x, y) が障害物から r 以上離れているか
+	bool clear(double x, double y, double r) { return distance(x, y) >= r; }
+
+	// 線分 a-b の上で一番近い障害物までの距離 (半升ごとに調べる)
+	double segmentClearance(double ax, double ay, double bx, double by) {
+		double dx = bx - ax, dy = by - ay;
+		int n = (int)ceil(sqrt(dx * dx + dy * dy) / (m_cell * 0.5));
+		double best = distance(ax, ay);
+		for (int i = 1; i <= n; i++) {
+			double t = (double)i / n;
+			best = std::min(best, distance(ax + dx * t, ay + dy * t));
+		}
+		return best;
+	}
+	// 経路の上で一番近い障害物までの距離
+	template <class Node>
+	double routeClearance(const std::vector<Node> &route) {
+		if (route.empty()) return HUGE_VAL;
+		double best = distance(route[0].x, route[0].y);
+		for (size_t i = 1; i < route.size(); i++) {
+			best = std::min(best, segmentClearance(route[i - 1].x, route[i - 1].y, route[i].x, route[i].y));
+		}
+		return best;
+	}
+
+	/* @brief  占有格子の距離変換 (塗った升目は 0)
+	 * @param  occ 升目ごとに 0 以外なら塗ってある (nx * ny 個。行ごとに並ぶ)
+	 * @param  d2  一番近い塗った升目までの距離の2乗 [升目^2] (nx * ny 個にする)。塗った升目が無ければ (nx + ny)^2 以上
+	 */
+	static void transform(const std::vector<char> &occ, int nx, int ny, std::vector<double> &d2) {
+		d2.assign(nx * ny, 0.0);
+		if (nx <= 0 || ny <= 0) return;
+		std::vector<int> g(nx * ny), v;
+		std::vector<double> z;
+		columnPass(&occ[0], nx, ny, 0, nx - 1, &g[0]);
+		for (int cy = 0; cy < ny; cy++) rowPass(&g[0] + cy * nx, nx, &d2[0] + cy * nx, v, z);
+	}
+
+	int gridWidth() const { return m_nx; }
+	int gridHeight() const { return m_ny; }
+	// 全部作り直した回数、動いた範囲だけ直した回数、直すときに計算し直した升目の数 (列と行の合計)
+	long builds() const { return m_builds; }
+	long updates() const { return m_updates; }
+	long cellsUpdated() const { return m_cellsUpdated; }
+
+private:
+	struct Rect {
+		double x, y, w, h, a;
+	};
+	// 升目の範囲 (両端を含む。x0 > x1 なら空)
+	struct CellRect {
+		int x0, y0, x1, y1;
+		void clear() { x0 = y0 = 0; x1 = y1 = -1; }
+		bool empty() const { return x0 > x1 || y0 > y1; }
+		void merge(const CellRect &o) {
+			if (o.empty()) return;
+			if (empty()) {
+				*this = o;
+				return;
+			}
+			x0 = std::min(x0, o.x0);
+			y0 = std::min(y0, o.y0);
+			x1 = std::max(x1, o.x1);
+			y1 = std::max(y1, o.y1);
+		}
+		void clip(int nx, int ny) {
+			x0 = std::max(x0, 0);
+			y0 = std::max(y0, 0);
+			x1 = std::min(x1, nx - 1);
+			y1 = std::min(y1, ny - 1);
+		}
+	};
+
+	void grow(int n) {
+		if (n <= (int)m_obs.size()) return;
+		Rect none = { 0.0, 0.0, -1.0, -1.0, 0.0 };
+		CellRect area;
+		area.clear();
+		m_obs.resize(n, none);
+		m_area.resize(n, area);
+		m_set.resize(n);
+	}
+
+	// i 番目が変わった: 前に塗った範囲と新しく塗る範囲を直す
+	void moved(int i) {
+		if (m_full) return;
+		CellRect now = footprint(i);
+		if (!m_fixed && !now.empty() && (now.x0 < 0 || now.y0 < 0 || now.x1 >= m_nx || now.y1 >= m_ny)) {
+			m_full = true;
+			return;
+		}
+		m_dirty.merge(m_area[i]);
+		m_dirty.merge(now);
+		m_area[i] = now;
+	}
+
+	// i 番目を半升膨らませた多角形に掛かる升目の範囲 (格子の外にはみ出すこともある)
+	CellRect footprint(int i) const {
+		CellRect c;
+		c.clear();
+		int n = m_set.vertexCount(i);
+		if (n == 0) return c;
+		double xmin = HUGE_VAL, ymin = HUGE_VAL, xmax = -HUGE_VAL, ymax = -HUGE_VAL;
+		for (int j = 0; j < n; j++) {
+			double x, y;
+			m_set.offsetVertex(i, j, m_cell * 0.5, x, y);
+			xmin = std::min(xmin, x);
+			ymin = std::min(ymin, y);
+			xmax = std::max(xmax, x);
+			ymax = std::max(ymax, y);
+		}
+		c.x0 = (int)floor((xmin - m_x0) / m_cell);
+		c.y0 = (int)floor((ymin - m_y0) / m_cell);
+		c.x1 = (int)floor((xmax - m_x0) / m_cell);
+		c.y1 = (int)floor((ymax - m_y0) / m_cell);
+		return c;
+	}
+
+	// i 番目を範囲 d の中だけ塗る (中心が半升膨らませた内側にある升目)
+	void paint(int i, const CellRect &d) {
+		CellRect c = footprint(i);
+		c.x0 = std::max(c.x0, d.x0);
+		c.y0 = std::max(c.y0, d.y0);
+		c.x1 = std::min(c.x1, d.x1);
+		c.y1 = std::min(c.y1, d.y1);
+		for (int cy = c.y0; cy <= c.y1; cy++) {
+			double y = m_y0 + (cy + 0.5) * m_cell;
+			for (int cx = c.x0; cx <= c.x1; cx++) {
+				if (m_set.contains(i, m_x0 + (cx + 0.5) * m_cell, y, m_cell * 0.5)) m_occ[cy * m_nx + cx] = 1;
+			}
+		}
+	}
+
+	// 範囲を決め直して、すべて塗って距離変換する
+	void rebuild() {
+		m_full = false;
+		m_dirty.clear();
+		double xmin = HUGE_VAL, ymin = HUGE_VAL, xmax = -HUGE_VAL, ymax = -HUGE_VAL;
+		if (m_fixed) {
+			xmin = m_bx0;
+			ymin = m_by0;
+			xmax = m_bx1;
+			ymax = m_by1;
+		} else {
+			for (int i = 0; i < m_set.size(); i++) {
+				for (int j = 0; j < m_set.vertexCount(i); j++) {
+					xmin = std::min(xmin, m_set.vertexX(i, j));
+					ymin = std::min(ymin, m_set.vertexY(i, j));
+					xmax = std::max(xmax, m_set.vertexX(i, j));
+					ymax = std::max(ymax, m_set.vertexY(i, j));
+				}
+			}
+			if (xmin > xmax) {
+				// 障害物が無い
+				m_nx = m_ny = 0;
+				m_builds++;
+				return;
+			}
+			xmin -= m_margin;
+			ymin -= m_margin;
+			xmax += m_margin;
+			ymax += m_margin;
+		}
+		m_x0 = floor(xmin / m_cell) * m_cell;
+		m_y0 = floor(ymin / m_cell) * m_cell;
+		m_nx = std::max((int)ceil((xmax - m_x0) / m_cell), 1);
+		m_ny = std::max((int)ceil((ymax - m_y0) / m_cell), 1);
+		double big = (double)(m_nx + m_ny);
+		m_none = big * big;
+
+		m_occ.assign(m_nx * m_ny, 0);
+		CellRect all = { 0, 0, m_nx - 1, m_ny - 1 };
+		for (int i = 0; i < m_set.size(); i++) {
+			m_area[i] = footprint(i);
+			paint(i, all);
+		}
+		m_g.resize(m_nx * m_ny);
+		m_d2.resize(m_nx * m_ny);
+		columnPass(&m_occ[0], m_nx, m_ny, 0, m_nx - 1, &m_g[0]);
+		for (int cy = 0; cy < m_ny; cy++) rowPass(&m_g[0] + cy * m_nx, m_nx, &m_d2[0] + cy * m_nx, m_v, m_z);
+		m_builds++;
+		m_cellsUpdated += 2L * m_nx * m_ny;
+	}
+
+	/* @brief  行 cy に、塗り直した範囲 d の変化で値が変わりうる升目があるか
+	 * 今の一番近い升目が d までの距離より近ければ、それは d の外にあって残っているし、d に足した升目はそれより遠いので変わらない
+	 */
+	bool reaches(const CellRect &d, int cy) const {
+		double dy = (cy < d.y0) ? d.y0 - cy : (cy > d.y1 ? cy - d.y1 : 0);
+		const double *d2 = &m_d2[cy * m_nx];
+		for (int cx = 0; cx < m_nx; cx++) {
+			double dx = (cx < d.x0) ? d.x0 - cx : (cx > d.x1 ? cx - d.x1 : 0);
+			if (d2[cx] >= dx * dx + dy * dy) return true;
+		}
+		return false;
+	}
+
+	int cellIndex(double x, double y) const {
+		int cx = (int)floor((x - m_x0) / m_cell), cy = (int)floor((y - m_y0) / m_cell);
+		if (cx < 0) cx = 0;
+		if (cy < 0) cy = 0;
+		if (cx >= m_nx) cx = m_nx - 1;
+		if (cy >= m_ny) cy = m_ny - 1;
+		return cy * m_nx + cx;
+	}
+
+	/* @brief  列 x0〜x1 の g (同じ列で一番近い塗った升目までの升目の数。無ければ nx + ny)
+	 * 1行ずつ上から・下からなめる (列ごとになめるより、メモリを順に読む)
+	 * @param  out 列 x0〜x1 の g を入れる先 (行ごとに w 個ずつ、ny 行)
+	 */
+	static void columnPass(const char *occ, int nx, int ny, int x0, int x1, int *out) {
+		int none = nx + ny, w = x1 - x0 + 1;
+		for (int i = 0; i < w; i++) out[i] = occ[x0 + i] ? 0 : none;
+		for (int cy = 1; cy < ny; cy++) {
+			const char *o = occ + cy * nx + x0;
+			int *g = out + cy * w;
+			const int *up = g - w;
+			for (int i = 0; i < w; i++) {
+				int v = std::min(up[i] + 1, none);
+				g[i] = o[i] ? 0 : v;
+			}
+		}
+		for (int cy = ny - 2; cy >= 0; cy--) {
+			int *g = out + cy * w;
+			const int *down = g + w;
+			for (int i = 0; i < w; i++) g[i] = std::min(g[i], down[i] + 1);
+		}
+	}
+
+	/* @brief  1行の d2[x] = min_q ((x - q)^2 + g[q]^2) (放物線の下側の包絡線)
+	 * @param  v z 作業用 (包絡線に残る放物線の頂点と、その放物線が一番下になる区間の左端)
+	 */
+	static void rowPass(const int *g, int n, double *d2, std::vector<int> &v, std::vector<double> &z) {
+		v.resize(n);
+		z.resize(n + 1);
+		int k = 0;
+		v[0] = 0;
+		z[0] = -HUGE_VAL;
+		z[1] = HUGE_VAL;
+		for (int q = 1; q < n; q++) {
+			double fq = (double)g[q] * g[q] + (double)q * q;
+			double s = intersect(g, v[k], fq, q);
+			while (s <= z[k]) {
+				k--;
+				s = intersect(g, v[k], fq, q);
+			}
+			k++;
+			v[k] = q;
+			z[k] = s;
+			z[k + 1] = HUGE_VAL;
+		}
+		k = 0;
+		for (int q = 0; q < n; q++) {
+			while (z[k + 1] < q) k++;
+			double dx = q - v[k];
+			d2[q] = dx * dx + (double)g[v[k]] * g[v[k]];
+		}
+	}
+	// p と q (fq = g[q]^2 + q^2) の放物線が交わる x
+	static double intersect(const int *g, int p, double fq, int q) {
+		return (fq - ((double)g[p] * g[p] + (double)p * p)) / (2.0 * (q - p));
+	}
+
+	double m_cell;
+	double m_margin;
+	bool m_fixed;						// setBounds() で範囲を決めた
+	double m_bx0, m_by0, m_bx1, m_by1;
+	bool m_full;						// 範囲から決め直して全部作り直す
+	CellRect m_dirty;					// 塗り直す升目の範囲
+
+	std::vector<Rect> m_obs;			// 変わったかを調べるための写し (多角形は a が HUGE_VAL)
+	std::vector<CellRect> m_area;		// 障害物ごとに塗った升目の範囲
+	ObstacleSet m_set;
+
+	double m_x0, m_y0;					// 格子の左下
+	int m_nx, m_ny;
+	double m_none;						// 塗った升目が無いときの d2 ((nx + ny)^2)
+	std::vector<char> m_occ;			// 塗った升目は 1
+	std::vector<int> m_g;				// 列ごとの距離 [升目]
+	std::vector<double> m_d2;			// 距離の2乗 [升目^2]
+	// 作り直しの作業用 (毎回確保しない)
+	std::vector<char> m_rowDirty;
+	std::vector<int> m_col, m_v;		// m_col は直す列の g
+	std::vector<double> m_z;
+
+	long m_builds, m_updates, m_cellsUpdated;
+};
+
+#endif
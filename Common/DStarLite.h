@@ -0,0 +1,415 @@
+// 障害物が動いたときに経路を直す格子上の経路計画 (D* Lite)
+// ・格子と升目の種類は GridPlanner.h と同じ (OccupancyGrid.h を共有する。FREE / MARGIN / OBSTACLE。MARGIN は通れるが費用が MARGIN_COST 倍)
+//   ただし費用は向きによらないように、どちらかの升目が MARGIN なら MARGIN_COST 倍にする
+// ・目的地から出発点に向かって探し、各升目の目的地までの費用(g)を覚えておく
+//   次の plan() で目的地が同じなら、動いた障害物の前後の範囲の升目だけ塗り直し、種類が変わった升目の周りだけ探し直す
+//   (出発点が動いても探し直さない。km で優先度のずれを補う)
+//   目的地が変わった・格子の外に出た・直した結果見つからないときは、最初から探す
+// ・升目の列は GridPlanner と同じく、見通しの良い点まで飛ばして間引く (OccupancyGrid::thin)
+//
+// 使い方
+//   DStarLite planner(10.0, TRUCK_RADIUS);
+//   for (...) planner.setObstacle(i, obs.x, obs.y, obs.width, obs.height);	// 変わった障害物だけ覚える
+//   std::vector<Node2D> route;
+//   if (planner.plan(robot.x, robot.y, goal.x, goal.y, route)) { ... }		// 2回目からは直すだけ
+// Node は Node(double x, double y) で作れる型 (各コントローラの Node2D)
+// 直す時間と最初から探す時間は OfflineSim/RouteBench.cpp で比べられる ("moved" の行)
+//   直すと取り出す升目は最初から探すときの 1/3 (CleanUpRobot0614) 〜 2/3 (Room0928) になるが、
+//   種類の変わった升目の隣を8個ずつ調べ直すので、取り出す升目1つあたりの時間は最初から探すときの2倍くらいかかる
+//   手元の計測 (plan [us]。直す / D* で最初から / GridPlanner で最初から)
+//     CleanUpRobot0614  440〜480 /  710〜760 / 560〜600   直す方が速い
+//     Room0928          990〜1050 / 660〜700 / 440〜470   大きな机が動くと直す方が GridPlanner の2倍以上遅い
+//   どちらが速いかは配置によるので、使う前に RouteBench で比べること (CleanUpRobot0614 の repairRoute は直す方を使う)
+#ifndef _DSTAR_LITE_H_
+#define _DSTAR_LITE_H_
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "OccupancyGrid.h"
+
+class DStarLite : public OccupancyGrid {
+public:
+	explicit DStarLite(double cellSize = 5.0, double clearance = 0.0, double pad = 100.0)
+		: OccupancyGrid(cellSize), m_clearance(clearance), m_pad(pad), m_reset(true), m_start(-1), m_goal(-1), m_gx(0.0), m_gy(0.0), m_km(0.0), m_stamp(0),
+		  m_expanded(0), m_changed(0), m_repaired(false), m_searches(0), m_repairs(0) {}
+
+	void setCellSize(double cellSize) {
+		if (cellSize > 0.0 && cellSize != m_cell) {
+			m_cell = cellSize;
+			m_reset = true;
+		}
+	}
+
+	// 障害物から離れていたい距離 (ロボットの半径)
+	void setClearance(double clearance) {
+		if (clearance != m_clearance) {
+			m_clearance = clearance;
+			m_reset = true;
+		}
+	}
+	double clearance() const { return m_clearance; }
+
+	void clearObstacles() {
+		m_obs.clear();
+		m_reset = true;
+	}
+	// i 番目の障害物を置き直す (足りなければ足す)。動いた前後の範囲を覚えて、次の plan() で塗り直す
+	void setObstacle(int i, double x, double y, double width, double height) {
+		if (i < 0) return;
+		if (i >= (int)m_obs.size()) {
+			Rect none = { 0.0, 0.0, -1.0, -1.0 };
+			m_obs.resize(i + 1, none);
+		}
+		Rect &r = m_obs[i];
+		if (r.x == x && r.y == y && r.w == width && r.h == height) return;
+		if (r.w >= 0.0) m_moved.push_back(r);
+		r.x = x;
+		r.y = y;
+		r.w = width;
+		r.h = height;
+		if (r.w >= 0.0) m_moved.push_back(r);
+	}
+	// 障害物の数を n にする (後ろを捨てる)
+	void resizeObstacles(int n) {
+		while (n >= 0 && n < (int)m_obs.size()) {
+			if (m_obs.back().w >= 0.0) m_moved.push_back(m_obs.back());
+			m_obs.pop_back();
+		}
+	}
+	int obstacleCount() const { return (int)m_obs.size(); }
+	// 次の plan() は前の探索を使わずに最初から探す
+	void reset() { m_reset = true; }
+
+	/* @brief  経路を探す (前と同じ目的地なら、前の探索を直す)
+	 * @param  sx sy 出発点 (ロボットの今の位置)
+	 * @param  gx gy 目的地
+	 * @param  route 出発点から目的地までの点 (前の中身は消す)。見つからなければ空
+	 * @return 見つかったら true
+	 */
+	template <class Node>
+	bool plan(double sx, double sy, double gx, double gy, std::vector<Node> &route) {
+		route.clear();
+		m_expanded = 0;
+		m_changed = 0;
+		m_repaired = false;
+		bool fresh = m_reset || m_nx == 0 || gx != m_gx || gy != m_gy ||
+		             !inside(sx, sy) || !inside(gx, gy) || !movedInside();
+		if (!fresh) {
+			int s = nearestPassable(cellIndex(sx, sy));
+			if (s < 0) return false;
+			repair(s);
+			if (m_g[m_start] < DBL_MAX) {
+				m_repaired = true;
+				m_repairs++;
+			} else {
+				fresh = true;
+			}
+		}
+		if (fresh) {
+			if (!restart(sx, sy, gx, gy)) return false;
+			m_searches++;
+		}
+		if (m_g[m_start] >= DBL_MAX) return false;
+		extract(sx, sy, gx, gy);
+		thin(sx, sy, gx, gy, route);
+		return true;
+	}
+
+	// 最後の plan() で直しただけなら true (最初から探したら false)
+	bool repaired() const { return m_repaired; }
+	// 最後の plan() で取り出した升目・種類が変わった升目の数
+	long expanded() const { return m_expanded; }
+	int changedCells() const { return m_changed; }
+	// 最初から探した回数・直した回数
+	long searches() const { return m_searches; }
+	long repairs() const { return m_repairs; }
+	// 最後の plan() の出発点の升目から目的地までの費用 (升目の列の費用。見つからなければ DBL_MAX)
+	double pathCost() const { return (m_start >= 0) ? m_g[m_start] : DBL_MAX; }
+
+private:
+	// open リストの要素 (升目の優先度が変わったら入れ直し、古いものは取り出したときに捨てる)
+	struct Entry {
+		double k1, k2;
+		int c;
+		bool operator>(const Entry &o) const { return k1 > o.k1 || (k1 == o.k1 && k2 > o.k2); }
+	};
+
+	// 格子の端から障害物の影響が届く幅より内側か
+	bool inside(double x, double y) const {
+		return OccupancyGrid::inside(x, y, std::max(m_clearance, m_cell) + m_cell);
+	}
+	bool movedInside() const {
+		for (size_t i = 0; i < m_moved.size(); i++) {
+			const Rect &r = m_moved[i];
+			if (!inside(r.x - r.w / 2, r.y - r.h / 2) || !inside(r.x + r.w / 2, r.y + r.h / 2)) return false;
+		}
+		return true;
+	}
+
+	// 升目の種類 (near の障害物だけで調べる)
+	int classify(int c, const std::vector<int> &near) const {
+		double x = centerX(c), y = centerY(c);
+		int cls = FREE;
+		for (size_t i = 0; i < near.size(); i++) {
+			const Rect &r = m_obs[near[i]];
+			if (within(r, x, y, m_cell)) return OBSTACLE;
+			if (within(r, x, y, m_clearance)) cls = MARGIN;
+		}
+		return cls;
+	}
+
+	// 影響が届く範囲が r の影響が届く範囲と重なる障害物 (r の周りの升目の種類はこれだけで決まる)
+	void nearObstacles(const Rect &r, std::vector<int> &near) const {
+		double d = 2 * std::max(m_clearance, m_cell) + m_cell;	// 両方の届く幅と、升目の中心のずれ
+		near.clear();
+		for (size_t i = 0; i < m_obs.size(); i++) {
+			const Rect &o = m_obs[i];
+			if (o.w < 0.0) continue;
+			if (fabs(o.x - r.x) < (o.w + r.w) / 2 + d && fabs(o.y - r.y) < (o.h + r.h) / 2 + d) near.push_back((int)i);
+		}
+	}
+
+	// 長方形の影響が届く升目の範囲を、その周りの障害物だけで塗り直す。@return 種類が変わった升目を changed に足す
+	void reclassify(const Rect &r, std::vector<int> &changed) {
+		std::vector<int> &near = m_near;
+		nearObstacles(r, near);
+		int c0, c1;
+		reach(r, m_clearance, c0, c1);
+		for (int cy = c0 / m_nx; cy <= c1 / m_nx; cy++) {
+			for (int cx = c0 % m_nx; cx <= c1 % m_nx; cx++) {
+				int c = cy * m_nx + cx;
+				if (m_mark[c] == m_stamp) continue;	// 前と後の範囲が重なるところは1回だけ
+				m_mark[c] = m_stamp;
+				int cls = classify(c, near);
+				if (cls == m_occ[c]) continue;
+				m_occ[c] = (char)cls;
+				changed.push_back(c);
+			}
+		}
+	}
+
+	// 格子を作り直して、目的地から探す
+	bool restart(double sx, double sy, double gx, double gy) {
+		double pad = std::max(m_clearance, m_cell) + m_cell + m_pad;
+		double xmin = std::min(sx, gx), xmax = std::max(sx, gx);
+		double ymin = std::min(sy, gy), ymax = std::max(sy, gy);
+		obstacleBounds(m_obs, xmin, ymin, xmax, ymax);
+		int n = layout(xmin, ymin, xmax, ymax, pad);
+		m_mark.assign(n, 0);
+		m_stamp = 0;
+		paint(m_obs, m_clearance);
+		m_moved.clear();
+		m_reset = false;
+		m_gx = gx;
+		m_gy = gy;
+
+		m_start = nearestPassable(cellIndex(sx, sy));
+		m_goal = nearestPassable(cellIndex(gx, gy));
+		if (m_start < 0 || m_goal < 0) {
+			m_start = -1;
+			m_nx = 0;
+			return false;
+		}
+		m_g.assign(n, DBL_MAX);
+		m_rhs.assign(n, DBL_MAX);
+		m_k1.assign(n, 0.0);
+		m_k2.assign(n, 0.0);
+		m_open.assign(n, 0);
+		m_heap.clear();
+		m_km = 0.0;
+		m_rhs[m_goal] = 0.0;
+		push(m_goal);
+		computeShortestPath();
+		return true;
+	}
+
+	// 動いた障害物の範囲を塗り直し、出発点を s にして探し直す
+	void repair(int s) {
+		m_km += octile(m_start, s);
+		m_start = s;
+		std::vector<int> &changed = m_changedCells;
+		changed.clear();
+		m_stamp++;
+		for (size_t i = 0; i < m_moved.size(); i++) reclassify(m_moved[i], changed);
+		m_moved.clear();
+		m_changed = (int)changed.size();
+		// 種類が変わった升目と、その升目を通る・かすめる辺を持つ升目 (8近傍)。同じ升目は1回だけ
+		m_stamp++;
+		for (size_t i = 0; i < changed.size(); i++) {
+			int c = changed[i], cx = c % m_nx, cy = c / m_nx;
+			for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, m_ny - 1); y++) {
+				for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, m_nx - 1); x++) {
+					int v = y * m_nx + x;
+					if (m_mark[v] == m_stamp) continue;
+					m_mark[v] = m_stamp;
+					updateVertex(v);
+				}
+			}
+		}
+		computeShortestPath();
+	}
+
+	// u (升目 ux, uy) から k 番目の隣への費用 (通れなければ DBL_MAX)。向きによらない
+	double cost(int u, int ux, int uy, int k, int &v) const {
+		static const int DX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+		static const int DY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+		int x = ux + DX[k], y = uy + DY[k];
+		v = -1;
+		if (x < 0 || y < 0 || x >= m_nx || y >= m_ny) return DBL_MAX;
+		v = y * m_nx + x;
+		if (m_occ[u] == OBSTACLE || m_occ[v] == OBSTACLE) return DBL_MAX;
+		// 斜めは両隣が通れるときだけ
+		if (k >= 4 && (m_occ[uy * m_nx + x] == OBSTACLE || m_occ[y * m_nx + ux] == OBSTACLE)) return DBL_MAX;
+		double step = (k >= 4 ? M_SQRT2 * m_cell : m_cell);
+		if (m_occ[u] == MARGIN || m_occ[v] == MARGIN) step *= MARGIN_COST;
+		return step;
+	}
+
+	void push(int c) {
+		double m = std::min(m_g[c], m_rhs[c]);
+		Entry e;
+		e.k1 = m + octile(m_start, c) + m_km;
+		e.k2 = m;
+		e.c = c;
+		m_k1[c] = e.k1;
+		m_k2[c] = e.k2;
+		m_open[c] = 1;
+		m_heap.push_back(e);
+		std::push_heap(m_heap.begin(), m_heap.end(), std::greater<Entry>());
+	}
+
+	// 古くなった要素を捨てて、先頭を今の優先度の要素にする。@return 空なら false
+	bool top(Entry &e) {
+		while (!m_heap.empty()) {
+			e = m_heap.front();
+			if (m_open[e.c] && m_k1[e.c] == e.k1 && m_k2[e.c] == e.k2) return true;
+			std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Entry>());
+			m_heap.pop_back();
+		}
+		return false;
+	}
+
+	// g と rhs が違えば open リストに入れ直す
+	void requeue(int u) {
+		m_open[u] = 0;
+		if (m_g[u] != m_rhs[u]) push(u);
+	}
+
+	// rhs を隣から求め直す
+	void updateVertex(int u) {
+		if (u != m_goal) {
+			int ux = u % m_nx, uy = u / m_nx;
+			double best = DBL_MAX;
+			for (int k = 0; k < 8; k++) {
+				int v;
+				double c = cost(u, ux, uy, k, v);
+				if (c == DBL_MAX || m_g[v] == DBL_MAX) continue;
+				best = std::min(best, c + m_g[v]);
+			}
+			m_rhs[u] = best;
+		}
+		requeue(u);
+	}
+
+	// 優先度 a < b か。k1 は h と km を足した値で、足す順によって同じはずの値が丸めでずれるので、ずれの分は等しいとみなす
+	// (出発点と等しい優先度の升目を取り出さずに止めると、経路の費用が低く出たままになる)
+	bool keyLess(double a1, double a2, double b1, double b2) const {
+		double eps = 1e-9 * m_cell * (m_nx + m_ny);
+		return a1 < b1 - eps || (a1 <= b1 + eps && a2 < b2);
+	}
+
+	void computeShortestPath() {
+		Entry e;
+		while (top(e)) {
+			double m = std::min(m_g[m_start], m_rhs[m_start]);
+			double s1 = m + m_km, s2 = m;	// 出発点の優先度 (octile(m_start, m_start) は 0)
+			if (!keyLess(e.k1, e.k2, s1, s2) && m_rhs[m_start] == m_g[m_start]) break;
+			std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Entry>());
+			m_heap.pop_back();
+			int u = e.c, ux = u % m_nx, uy = u / m_nx;
+			m_open[u] = 0;
+			m_expanded++;
+			double um = std::min(m_g[u], m_rhs[u]);
+			double n1 = um + octile(m_start, u) + m_km;
+			if (e.k1 < n1 || (e.k1 == n1 && e.k2 < um)) {
+				push(u);
+			} else if (m_g[u] > m_rhs[u]) {
+				// u の費用が下がった。u を通る方が安ければ隣の rhs を下げる
+				m_g[u] = m_rhs[u];
+				for (int k = 0; k < 8; k++) {
+					int v;
+					double c = cost(u, ux, uy, k, v);
+					if (c == DBL_MAX || v == m_goal || c + m_g[u] >= m_rhs[v]) continue;
+					m_rhs[v] = c + m_g[u];
+					requeue(v);
+				}
+			} else {
+				// u の費用が上がった。u を通っていた隣 (と u) の rhs を求め直す
+				double old = m_g[u];
+				m_g[u] = DBL_MAX;
+				for (int k = 0; k < 8; k++) {
+					int v;
+					double c = cost(u, ux, uy, k, v);
+					if (c == DBL_MAX || v == m_goal || m_rhs[v] != c + old) continue;
+					updateVertex(v);
+				}
+				updateVertex(u);
+			}
+		}
+	}
+
+	// 出発点から、費用 + g が一番小さい隣へ辿った升目の列を m_pts に入れる
+	void extract(double sx, double sy, double gx, double gy) {
+		m_pts.clear();
+		pushEndpoint(sx, sy);
+		int u = m_start;
+		for (int n = 0; n <= m_nx * m_ny; n++) {
+			pushPoint(centerX(u), centerY(u), m_occ[u]);
+			if (u == m_goal) break;
+			int ux = u % m_nx, uy = u / m_nx, next = -1;
+			double best = DBL_MAX;
+			for (int k = 0; k < 8; k++) {
+				int v;
+				double c = cost(u, ux, uy, k, v);
+				if (c == DBL_MAX || m_g[v] == DBL_MAX) continue;
+				if (c + m_g[v] < best) {
+					best = c + m_g[v];
+					next = v;
+				}
+			}
+			if (next < 0) break;
+			u = next;
+		}
+		pushEndpoint(gx, gy);
+	}
+
+	double m_clearance;
+	double m_pad;				// 障害物が動いても作り直さないように、格子を外側に広げる幅
+	std::vector<Rect> m_obs;
+	std::vector<Rect> m_moved;	// 前の plan() から動いた障害物の、前と後の長方形
+	bool m_reset;				// 升目の大きさ・半径が変わった (最初から探す)
+
+	// 探索の状態 (次の plan() で直すために残す)
+	int m_start, m_goal;
+	double m_gx, m_gy;			// 目的地 (変わったら最初から探す)
+	double m_km;
+	std::vector<double> m_g, m_rhs;
+	std::vector<double> m_k1, m_k2;	// open リストに入っている升目の今の優先度
+	std::vector<char> m_open;
+	std::vector<Entry> m_heap;
+
+	std::vector<int> m_changedCells;
+	std::vector<int> m_near;	// reclassify() の作業用
+	std::vector<int> m_mark;	// 同じ升目を2回調べないための印 (m_stamp と同じなら調べた)
+	int m_stamp;
+	long m_expanded;
+	int m_changed;
+	bool m_repaired;
+	long m_searches, m_repairs;
+};
+
+#endif
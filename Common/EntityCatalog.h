@@ -0,0 +1,287 @@
+// 物体の一覧(カタログ)を読み込んで EntityRegistry に登録する
+// onInit に push_back / m_trashTypeMap.insert / Obstacle::setPosition を並べる代わりに、部屋ごとのファイルに書く
+// (部屋を変えても再コンパイルしない)
+//
+// カタログファイルの書き方 (1行1項目、# 以降はコメント)
+//   world    Room0928_ObjDetect.xml           ワールドファイル (カタログからの相対パス)。エンティティの名前・クラス・位置を読む
+//   trash    名前またはクラス  ゴミ箱名 ...    ゴミと、入れてよいゴミ箱 (今ある一番近いものに入れる。同じ距離なら前に書いた方)
+//   bin      名前またはクラス                  ゴミ箱
+//   fallback ゴミ箱名 ...                      trash に書いていない物や、入れてよいゴミ箱がすべて無いときに入れるゴミ箱
+//   obstacle 名前またはクラス  幅 奥行き [x z [角度]] 障害物と床の上の占有範囲 (x z を省くとワールドファイルの位置を中心にする)
+//                                              ゴミ箱にも書ける (種類はゴミ箱のまま、占有範囲だけ付く)
+//                                              角度は y 軸まわりの回転 [度]。省くとワールドファイルの qw qy の回転にする
+//                                              (幅・奥行きは回す前の x・z 方向の長さ)
+// ・名前またはクラスは、ワールドファイルのエンティティ名か instanciate のクラス名 (seCannedjuice_200ml_c01.xml など)
+//   最後の * は前方一致 (seCannedjuice_* ならすべての缶)。ワールドファイルに無い名前もそのまま登録する
+// ・登録する順番はワールドファイルの順 (その後にワールドファイルに無い名前を書いた順)
+// ・1回読むだけで、以降は EntityRegistry の配列を引く
+//
+// 使い方
+//   std::string err;
+//   if (!loadEntityCatalog("Room0928.catalog", m_entities, err)) ALOG_ERR((ALOG_CONSOLE, "%s \n", err.c_str()));
+#ifndef _ENTITY_CATALOG_H_
+#define _ENTITY_CATALOG_H_
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "EntityRegistry.h"
+
+// ワールドファイルのエンティティ
+struct CatalogEntity {
+	std::string name;
+	std::string cls;
+	double x, z;
+	double angle;		// 床の上の向き [rad] (x 軸から z 軸の方へ。EntityRegistry::setFootprint と同じ向き)
+};
+
+// y 軸まわりの回転 [度] (ワールドファイルの qy と同じ向き) を床の上の向きにする
+inline double catalogYawToAngle(double degree)
+{
+	return -degree * M_PI / 180.0;
+}
+
+// "name="value"" 形式の属性値を取り出す
+inline bool catalogXmlAttr(const std::string &tag, const char *attr, std::string &value)
+{
+	std::string key = std::string(attr) + "=\"";
+	size_t p = tag.find(key);
+	while (p != std::string::npos && p > 0 && !isspace((unsigned char)tag[p - 1])) {
+		p = tag.find(key, p + 1);
+	}
+	if (p == std::string::npos) return false;
+	p += key.size();
+	size_t e = tag.find('"', p);
+	if (e == std::string::npos) return false;
+	value = tag.substr(p, e - p);
+	return true;
+}
+
+/* @brief  ワールドファイルから instanciate されたエンティティの名前・クラス・位置・向きを読む (ロボットは除く)
+ * 向きは y 軸まわりの回転だけ読む (qw qy。机や棚を床の上で回したもの)
+ * @return 開けたら true
+ */
+inline bool loadCatalogWorld(const std::string &path, std::vector<CatalogEntity> &entities)
+{
+	std::ifstream ifs(path.c_str());
+	if (!ifs) return false;
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	std::string xml = ss.str();
+
+	size_t c;
+	while ((c = xml.find("<!--")) != std::string::npos) {
+		size_t e = xml.find("-->", c);
+		xml.erase(c, e == std::string::npos ? std::string::npos : e + 3 - c);
+	}
+
+	size_t p = 0;
+	while ((p = xml.find("<instanciate", p)) != std::string::npos) {
+		size_t e = xml.find("</instanciate>", p);
+		if (e == std::string::npos) break;
+		std::string block = xml.substr(p, e - p);
+		p = e;
+
+		std::string head = block.substr(0, block.find('>'));
+		std::string type;
+		if (catalogXmlAttr(head, "type", type) && type == "Robot") continue;
+		CatalogEntity ent;
+		ent.x = ent.z = 0.0;
+		double qw = 1.0, qy = 0.0;
+		catalogXmlAttr(head, "class", ent.cls);
+
+		size_t a = 0;
+		while ((a = block.find("<set-attr-value", a)) != std::string::npos) {
+			std::string tag = block.substr(a, block.find('>', a) - a);
+			std::string name, value;
+			if (catalogXmlAttr(tag, "name", name) && catalogXmlAttr(tag, "value", value)) {
+				if (name == "name") ent.name = value;
+				else if (name == "x") ent.x = atof(value.c_str());
+				else if (name == "z") ent.z = atof(value.c_str());
+				else if (name == "qw") qw = atof(value.c_str());
+				else if (name == "qy") qy = atof(value.c_str());
+			}
+			a += tag.size();
+		}
+		ent.angle = catalogYawToAngle(2.0 * atan2(qy, qw) * 180.0 / M_PI);
+		if (!ent.name.empty()) entities.push_back(ent);
+	}
+	return true;
+}
+
+// カタログファイルの trash / bin / obstacle の1行
+struct CatalogRule {
+	int category;
+	std::string pattern;
+	std::vector<std::string> bins;
+	double width, depth;
+	double x, z;
+	bool hasCenter;
+	double angle;		// [rad]
+	bool hasAngle;
+};
+
+// 名前またはクラスがパターンに合うか (最後の * は前方一致)
+inline bool catalogMatch(const std::string &pattern, const CatalogEntity &ent)
+{
+	if (!pattern.empty() && pattern[pattern.size() - 1] == '*') {
+		std::string prefix = pattern.substr(0, pattern.size() - 1);
+		return ent.name.compare(0, prefix.size(), prefix) == 0 || ent.cls.compare(0, prefix.size(), prefix) == 0;
+	}
+	return ent.name == pattern || ent.cls == pattern;
+}
+
+// 種類を決める。障害物は種類が決まっていないときだけ (ゴミ箱・ゴミの占有範囲として書ける)
+template <class Owner>
+void catalogApply(EntityRegistry<Owner> &registry, int id, const CatalogRule &r)
+{
+	if (r.category == ENT_OBSTACLE) {
+		if (registry.category(id) == ENT_UNKNOWN) registry.setCategory(id, ENT_OBSTACLE);
+		return;
+	}
+	registry.setCategory(id, r.category);
+	if (r.category == ENT_TRASH) {
+		registry.setTargetBin(id, registry.intern(r.bins[0]));
+		for (size_t i = 1; i < r.bins.size(); i++) registry.addTargetBin(id, registry.intern(r.bins[i]));
+	}
+}
+
+/* @brief  カタログファイルを読み、エンティティを登録する
+ * @param  path     カタログファイル
+ * @param  registry 登録先 (init() してから渡す)
+ * @return error    読めなかった理由
+ * @return 読めたら true。途中の行が壊れていたら、そこまでを登録して false
+ */
+template <class Owner>
+bool loadEntityCatalog(const char *path, EntityRegistry<Owner> &registry, std::string &error)
+{
+	std::ifstream ifs(path);
+	if (!ifs) {
+		error = std::string("cannot open catalog ") + path;
+		return false;
+	}
+	std::string dir = path;
+	dir = (dir.rfind('/') != std::string::npos) ? dir.substr(0, dir.rfind('/') + 1) : "";
+
+	std::vector<CatalogRule> rules;
+	std::vector<CatalogEntity> world;
+
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(ifs, line)) {
+		lineNo++;
+		if (line.find('#') != std::string::npos) line.erase(line.find('#'));
+		std::istringstream is(line);
+		std::string cmd;
+		if (!(is >> cmd)) continue;
+
+		char buf[256];
+		snprintf(buf, sizeof(buf), "%s:%d: ", path, lineNo);
+		if (cmd == "world") {
+			std::string xml;
+			if (!(is >> xml)) {
+				error = std::string(buf) + "usage: world <xml>";
+				return false;
+			}
+			if (!loadCatalogWorld(xml[0] == '/' ? xml : dir + xml, world)) {
+				error = std::string(buf) + "cannot open world file " + xml;
+				return false;
+			}
+			continue;
+		}
+		if (cmd == "fallback") {
+			std::string bin;
+			int n = 0;
+			for (; is >> bin; n++) registry.addFallbackBin(registry.intern(bin));
+			if (n == 0) {
+				error = std::string(buf) + "usage: fallback <bin> ...";
+				return false;
+			}
+			continue;
+		}
+		CatalogRule r;
+		r.width = r.depth = r.x = r.z = 0.0;
+		r.hasCenter = false;
+		r.angle = 0.0;
+		r.hasAngle = false;
+		if (cmd == "trash") {
+			r.category = ENT_TRASH;
+			std::string bin;
+			is >> r.pattern;
+			while (is >> bin) r.bins.push_back(bin);
+			if (r.bins.empty()) {
+				error = std::string(buf) + "usage: trash <name|class> <bin> ...";
+				return false;
+			}
+		} else if (cmd == "bin") {
+			r.category = ENT_TRASHBOX;
+			if (!(is >> r.pattern)) {
+				error = std::string(buf) + "usage: bin <name|class>";
+				return false;
+			}
+		} else if (cmd == "obstacle") {
+			r.category = ENT_OBSTACLE;
+			if (!(is >> r.pattern >> r.width >> r.depth)) {
+				error = std::string(buf) + "usage: obstacle <name|class> <width> <depth> [x z [degree]]";
+				return false;
+			}
+			r.hasCenter = (bool)(is >> r.x >> r.z);
+			double degree;
+			if (r.hasCenter && (is >> degree)) {
+				r.angle = catalogYawToAngle(degree);
+				r.hasAngle = true;
+			}
+		} else {
+			error = std::string(buf) + "unknown command " + cmd;
+			return false;
+		}
+		rules.push_back(r);
+	}
+
+	// ワールドファイルのエンティティに規則を当てはめる (trash と bin は後に書いた方が勝つ)
+	std::vector<char> used(rules.size(), 0);
+	for (size_t i = 0; i < world.size(); i++) {
+		const CatalogEntity &ent = world[i];
+		int id = -1;
+		for (size_t j = 0; j < rules.size(); j++) {
+			const CatalogRule &r = rules[j];
+			if (!catalogMatch(r.pattern, ent)) continue;
+			used[j] = 1;
+			if (id < 0) id = registry.intern(ent.name);
+			catalogApply(registry, id, r);
+			if (r.category == ENT_OBSTACLE) {
+				registry.setFootprint(id, r.hasCenter ? r.x : ent.x, r.hasCenter ? r.z : ent.z, r.width, r.depth,
+				                      r.hasAngle ? r.angle : ent.angle);
+			}
+		}
+	}
+	// ワールドファイルに無い名前 (ワールドファイルを書かなかったとき)
+	for (size_t j = 0; j < rules.size(); j++) {
+		const CatalogRule &r = rules[j];
+		if (used[j] || r.pattern.empty() || r.pattern[r.pattern.size() - 1] == '*') continue;
+		int id = registry.intern(r.pattern);
+		catalogApply(registry, id, r);
+		if (r.category == ENT_OBSTACLE && r.hasCenter) {
+			registry.setFootprint(id, r.x, r.z, r.width, r.depth, r.angle);
+		}
+	}
+	// 入れ先に書いたゴミ箱は、bin で書いていなくてもゴミ箱にする
+	for (int id = 0; id < registry.size(); id++) {
+		const std::vector<int> &bins = registry.targetBins(id);
+		for (size_t i = 0; i < bins.size(); i++) {
+			if (registry.category(bins[i]) == ENT_UNKNOWN) registry.setCategory(bins[i], ENT_TRASHBOX);
+		}
+	}
+	const std::vector<int> &fallback = registry.fallbackBins();
+	for (size_t i = 0; i < fallback.size(); i++) {
+		if (registry.category(fallback[i]) == ENT_UNKNOWN) registry.setCategory(fallback[i], ENT_TRASHBOX);
+	}
+	return true;
+}
+
+#endif
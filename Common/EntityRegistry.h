@@ -0,0 +1,295 @@
+// エンティティの登録簿
+// ・名前は intern() で 0, 1, 2 ... の番号にする。以降の検索・ゴミ箱の決定・障害物の更新は番号で配列を引く
+//   (文字列をキーにした std::map を引いたり、名前を比べたりしない)
+// ・番号ごとの情報は種類ごとの配列に持つ (構造体の配列ではなく、配列の構造体)
+//     category   種類 (ゴミ・ゴミ箱・障害物)
+//     targetBins ゴミを入れてよいゴミ箱の番号 (同じ距離なら前の方を選ぶ)。どのゴミ箱にも決まっていないゴミは fallbackBins に入れる
+//     footprint  床の上の占有範囲 (中心 x z と 幅 奥行き。Obstacle::setPosition と同じ並び。斜めに置いた物は向きも)
+//     pose       最後に取得した位置 (取得した tick も覚える。同じ tick の中では poseFresh() が true になり、取得し直さなくてよい)
+//     handle     SimObj のハンドル
+// ・getObj(name) はシミュレータ側で名前を引く呼び出しなので、エンティティごとに1回だけ呼んで結果を覚える
+//   見つからなかった(getObj が NULL を返した)ことも覚える
+//   ゴミを拾って候補から外したとき・エンティティが消えたときは invalidate() で忘れる (次の get() で引き直す)
+//
+// 使い方
+//   onInit で  m_entities.init(this);
+//              int can = m_entities.add("can_0", ENT_TRASH);  m_entities.setTargetBin(can, m_entities.add("trashbox_2", ENT_TRASHBOX));
+//              m_entities.resolveAll();
+//   検索で     SimObj *obj = m_entities.get(id);  if (obj != NULL) { obj->getPosition(pos); m_entities.setPose(id, pos.x(), pos.y(), pos.z()); }
+//   ゴミ箱を   int bin = m_entities.nearestBin(trashId, myPos.x(), myPos.z(), &MyController::binPosition);
+// Owner は getObj(const char *) を持つクラス (各コントローラ)
+#ifndef _ENTITY_REGISTRY_H_
+#define _ENTITY_REGISTRY_H_
+
+#include <float.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+class SimObj;
+
+enum EntityCategory {
+	ENT_UNKNOWN = 0,
+	ENT_TRASH,			// 拾うもの
+	ENT_TRASHBOX,		// ゴミを入れるもの
+	ENT_OBSTACLE,		// 避けるもの (机など)
+	ENT_CATEGORY_NUM
+};
+
+template <class Owner>
+class EntityRegistry {
+public:
+	EntityRegistry() : m_owner(NULL), m_lookups(0), m_tick(0) {}
+
+	void init(Owner *owner) {
+		m_owner = owner;
+		m_ids.clear();
+		m_names.clear();
+		m_category.clear();
+		m_targetBins.clear();
+		m_fallbackBins.clear();
+		m_fpX.clear();
+		m_fpZ.clear();
+		m_fpW.clear();
+		m_fpD.clear();
+		m_fpA.clear();
+		m_hasFootprint.clear();
+		m_x.clear();
+		m_y.clear();
+		m_z.clear();
+		m_hasPose.clear();
+		m_poseTick.clear();
+		m_handles.clear();
+		m_state.clear();
+		for (int c = 0; c < ENT_CATEGORY_NUM; c++) m_byCategory[c].clear();
+		m_lookups = 0;
+	}
+
+	/* @brief  名前に番号を付ける (既にあれば同じ番号を返す)
+	 * @return 番号 (0 から順に詰めて付ける)
+	 */
+	int intern(const std::string &name) {
+		std::map<std::string, int>::iterator it = m_ids.find(name);
+		if (it != m_ids.end()) return it->second;
+		int id = (int)m_names.size();
+		m_ids.insert(std::make_pair(name, id));
+		m_names.push_back(name);
+		m_category.push_back(ENT_UNKNOWN);
+		m_targetBins.push_back(std::vector<int>());
+		m_fpX.push_back(0.0);
+		m_fpZ.push_back(0.0);
+		m_fpW.push_back(0.0);
+		m_fpD.push_back(0.0);
+		m_fpA.push_back(0.0);
+		m_hasFootprint.push_back(0);
+		m_x.push_back(0.0);
+		m_y.push_back(0.0);
+		m_z.push_back(0.0);
+		m_hasPose.push_back(0);
+		m_poseTick.push_back(0);
+		m_handles.push_back(NULL);
+		m_state.push_back(UNKNOWN);
+		m_byCategory[ENT_UNKNOWN].push_back(id);
+		return id;
+	}
+
+	// 番号を付けて種類を決める
+	int add(const std::string &name, int category) {
+		int id = intern(name);
+		setCategory(id, category);
+		return id;
+	}
+
+	/* @return 名前の番号。intern() していなければ -1
+	 */
+	int find(const std::string &name) const {
+		std::map<std::string, int>::const_iterator it = m_ids.find(name);
+		return it == m_ids.end() ? -1 : it->second;
+	}
+
+	bool valid(int id) const { return id >= 0 && id < (int)m_names.size(); }
+	int size() const { return (int)m_names.size(); }
+
+	// 名前 (番号が範囲外なら空文字列)
+	const std::string &name(int id) const {
+		static const std::string none;
+		return valid(id) ? m_names[id] : none;
+	}
+
+	int category(int id) const { return valid(id) ? m_category[id] : ENT_UNKNOWN; }
+	void setCategory(int id, int category) {
+		if (!valid(id) || category < 0 || category >= ENT_CATEGORY_NUM || m_category[id] == category) return;
+		std::vector<int> &from = m_byCategory[(int)m_category[id]];
+		for (size_t i = 0; i < from.size(); i++) {
+			if (from[i] == id) {
+				from.erase(from.begin() + i);
+				break;
+			}
+		}
+		m_category[id] = (char)category;
+		m_byCategory[category].push_back(id);
+	}
+	// 種類ごとの番号の一覧 (登録した順)
+	const std::vector<int> &ids(int category) const { return m_byCategory[category]; }
+
+	// 一番優先するゴミ箱 (決まっていなければ -1)
+	int targetBin(int id) const { return (valid(id) && !m_targetBins[id].empty()) ? m_targetBins[id][0] : -1; }
+	// 入れてよいゴミ箱を bin だけにする
+	void setTargetBin(int id, int bin) {
+		if (!valid(id)) return;
+		m_targetBins[id].clear();
+		addTargetBin(id, bin);
+	}
+	// 入れてよいゴミ箱を後ろに足す (同じゴミ箱は1回だけ)
+	void addTargetBin(int id, int bin) {
+		if (!valid(id) || !valid(bin)) return;
+		if (std::find(m_targetBins[id].begin(), m_targetBins[id].end(), bin) == m_targetBins[id].end()) {
+			m_targetBins[id].push_back(bin);
+		}
+	}
+	// 入れてよいゴミ箱 (優先する順。番号が範囲外なら空)
+	const std::vector<int> &targetBins(int id) const {
+		static const std::vector<int> none;
+		return valid(id) ? m_targetBins[id] : none;
+	}
+
+	// 入れるゴミ箱が決まっていないもの (カタログに無い物・入れてよいゴミ箱がすべて無い) を入れるゴミ箱
+	void addFallbackBin(int bin) {
+		if (valid(bin) && std::find(m_fallbackBins.begin(), m_fallbackBins.end(), bin) == m_fallbackBins.end()) {
+			m_fallbackBins.push_back(bin);
+		}
+	}
+	const std::vector<int> &fallbackBins() const { return m_fallbackBins; }
+
+	/* @brief  ゴミを入れるゴミ箱を決める
+	 * 入れてよいゴミ箱のうち、今ある一番近いものを選ぶ (同じ距離なら優先する方)
+	 * 1つも無ければ fallbackBins から同じように選ぶ
+	 * @param  trashId  ゴミの番号 (-1 や登録していない番号なら fallbackBins から選ぶ)
+	 * @param  x z      距離を測る位置 (ロボットの位置)
+	 * @param  position ゴミ箱の今の位置を返す Owner のメンバ関数。ゴミ箱が無ければ false を返す
+	 * @param  fallback fallbackBins から選んだら true を返す (NULL なら返さない)
+	 * @return ゴミ箱の番号。入れられるゴミ箱が無ければ -1
+	 */
+	int nearestBin(int trashId, double x, double z, bool (Owner::*position)(int, double &, double &),
+	               bool *fallback = NULL) const {
+		if (fallback != NULL) *fallback = false;
+		int bin = nearestOf(targetBins(trashId), x, z, position);
+		if (bin < 0) {
+			bin = nearestOf(m_fallbackBins, x, z, position);
+			if (bin >= 0 && fallback != NULL) *fallback = true;
+		}
+		return bin;
+	}
+
+	bool hasFootprint(int id) const { return valid(id) && m_hasFootprint[id]; }
+	// angle は幅の方向を x 軸から z 軸の方へ回した角度 [rad] (VisibilityPlanner::setObstacle と同じ向き)
+	void setFootprint(int id, double x, double z, double width, double depth, double angle = 0.0) {
+		if (!valid(id)) return;
+		m_fpX[id] = x;
+		m_fpZ[id] = z;
+		m_fpW[id] = width;
+		m_fpD[id] = depth;
+		m_fpA[id] = angle;
+		m_hasFootprint[id] = 1;
+	}
+	double footprintX(int id) const { return m_fpX[id]; }
+	double footprintZ(int id) const { return m_fpZ[id]; }
+	double footprintWidth(int id) const { return m_fpW[id]; }
+	double footprintDepth(int id) const { return m_fpD[id]; }
+	double footprintAngle(int id) const { return m_fpA[id]; }
+
+	/* @brief  最後に取得した位置
+	 * @return まだ取得していなければ false
+	 */
+	bool pose(int id, double &x, double &y, double &z) const {
+		if (!valid(id) || !m_hasPose[id]) return false;
+		x = m_x[id];
+		y = m_y[id];
+		z = m_z[id];
+		return true;
+	}
+	void setPose(int id, double x, double y, double z) {
+		if (!valid(id)) return;
+		m_x[id] = x;
+		m_y[id] = y;
+		m_z[id] = z;
+		m_hasPose[id] = 1;
+		m_poseTick[id] = m_tick;
+	}
+
+	// tick (onAction・onRecvMsg の1回) の始めに呼ぶ。それまでに取得した位置は古くなる
+	void beginTick() { m_tick++; }
+	// この tick で取得した位置があるか
+	bool poseFresh(int id) const { return valid(id) && m_hasPose[id] && m_poseTick[id] == m_tick; }
+
+	/* @brief  ハンドルを返す。覚えていなければ getObj で引いて覚える
+	 * @return ハンドル。エンティティが無ければ NULL
+	 */
+	SimObj *get(int id) {
+		if (!valid(id)) return NULL;
+		if (m_state[id] == UNKNOWN) {
+			m_handles[id] = m_owner->getObj(m_names[id].c_str());
+			m_state[id] = (m_handles[id] != NULL) ? PRESENT : ABSENT;
+			m_lookups++;
+		}
+		return m_handles[id];
+	}
+
+	// 番号を付けたすべてのエンティティを引いておく (onInit で呼ぶ)
+	void resolveAll() {
+		for (int i = 0; i < (int)m_names.size(); i++) get(i);
+	}
+
+	// ハンドルと位置を忘れる (番号と種類・ゴミ箱・占有範囲はそのまま)
+	void invalidate(int id) {
+		if (!valid(id)) return;
+		m_handles[id] = NULL;
+		m_state[id] = UNKNOWN;
+		m_hasPose[id] = 0;
+	}
+
+	void invalidateAll() {
+		for (int i = 0; i < (int)m_names.size(); i++) invalidate(i);
+	}
+
+	// これまでに getObj を呼んだ回数
+	long lookups() const { return m_lookups; }
+
+private:
+	enum { UNKNOWN = 0, PRESENT, ABSENT };
+
+	int nearestOf(const std::vector<int> &bins, double x, double z, bool (Owner::*position)(int, double &, double &)) const {
+		int best = -1;
+		double bestD = DBL_MAX;
+		for (size_t i = 0; i < bins.size(); i++) {
+			double bx, bz;
+			if (!(m_owner->*position)(bins[i], bx, bz)) continue;
+			double d = (bx - x) * (bx - x) + (bz - z) * (bz - z);
+			if (d < bestD) {
+				best = bins[i];
+				bestD = d;
+			}
+		}
+		return best;
+	}
+
+	Owner *m_owner;
+	std::map<std::string, int> m_ids;		// 名前 -> 番号 (intern / find だけで使う)
+	std::vector<std::string> m_names;
+	std::vector<char> m_category;
+	std::vector<std::vector<int> > m_targetBins;
+	std::vector<int> m_fallbackBins;
+	std::vector<double> m_fpX, m_fpZ, m_fpW, m_fpD, m_fpA;
+	std::vector<char> m_hasFootprint;
+	std::vector<double> m_x, m_y, m_z;
+	std::vector<char> m_hasPose;
+	std::vector<int> m_poseTick;
+	std::vector<SimObj *> m_handles;
+	std::vector<char> m_state;
+	std::vector<int> m_byCategory[ENT_CATEGORY_NUM];
+	long m_lookups;
+	int m_tick;
+};
+
+#endif
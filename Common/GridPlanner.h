@@ -0,0 +1,257 @@
+// 占有格子上の A* による経路計画 (calcRoute / calcFullRoute の代わり)
+// ・障害物は床の上の長方形 (中心 x y と 幅 奥行き。Obstacle::setPosition と同じ並び。y はワールドの z)
+// ・升目は3種類
+//     FREE     障害物からロボットの半径(TRUCK_RADIUS)以上離れている
+//     MARGIN   半径より近い (角は丸める)。通れるが、1升目の費用を MARGIN_COST 倍にする
+//     OBSTACLE 障害物 (升目1つ分だけ膨らませる)。通れない
+//   物を掴む位置・ゴミ箱の前は MARGIN の中にあるので、そこへは MARGIN を通って出入りし、
+//   それ以外はなるべく FREE だけを通る (家具の間が狭くて FREE だけでは行けないときも MARGIN を通る)
+// ・8近傍 (斜めは √2 倍。障害物の角をかすめる斜め移動はしない)、ヒューリスティックは octile 距離
+//   open リストは二分ヒープ (同じ升目が何度入っても、取り出したときに閉じていれば捨てる)
+// ・setCorridor() すると、OBSTACLE の升目から width より近い升目の費用を近いほど高くする (最大 1 + weight 倍)
+//   距離は ClearanceMap::transform の距離変換で塗り直すときに求める。費用は 1 倍以上なので octile 距離のままでよい
+//   広い通路を選ぶようになる (既定は使わない)
+// ・見つけた升目の列は、見通しの良い点まで飛ばして間引く (経路の点は曲がり角だけになる)
+//   飛ばした線分は、飛ばされた升目より悪い種類の升目を通らない
+// ・出発点・目的地が障害物の中にあるときは、一番近い通れる升目からまっすぐ出入りする
+// ・格子の範囲は障害物・出発点・目的地が入るように自動で決める (はみ出したら作り直す)
+// ・格子の作り方・升目の塗り方・間引き方は DStarLite.h と共有する (OccupancyGrid.h)
+//
+// 使い方
+//   GridPlanner planner(5.0, TRUCK_RADIUS);
+//   for (...) planner.addObstacle(obs.x, obs.y, obs.width, obs.height);
+//   std::vector<Node2D> route;
+//   if (planner.plan(start.x, start.y, goal.x, goal.y, route)) { ... route[0] が出発点、最後が目的地 }
+// Node は Node(double x, double y) で作れる型 (各コントローラの Node2D)
+// 速さと経路の長さは OfflineSim/RouteBench.cpp で calcFullRoute と比べられる
+#ifndef _GRID_PLANNER_H_
+#define _GRID_PLANNER_H_
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "ClearanceMap.h"
+#include "OccupancyGrid.h"
+
+class GridPlanner : public OccupancyGrid {
+public:
+	explicit GridPlanner(double cellSize = 5.0, double clearance = 0.0)
+		: OccupancyGrid(cellSize), m_clearance(clearance), m_corridor(0.0), m_corridorWeight(0.0), m_dirty(true),
+		  m_gen(0), m_expanded(0) {}
+
+	void setCellSize(double cellSize) {
+		if (cellSize > 0.0 && cellSize != m_cell) {
+			m_cell = cellSize;
+			m_dirty = true;
+		}
+	}
+
+	// 障害物から離れていたい距離 (ロボットの半径)
+	void setClearance(double clearance) {
+		if (clearance != m_clearance) {
+			m_clearance = clearance;
+			m_dirty = true;
+		}
+	}
+	double clearance() const { return m_clearance; }
+
+	/* @brief  狭いところを避ける費用
+	 * @param  width  OBSTACLE の升目からこれより近い升目は費用を高くする
+	 * @param  weight 一番近い升目の費用を 1 + weight 倍にする (0 なら使わない)
+	 */
+	void setCorridor(double width, double weight) {
+		if (width <= 0.0 || weight <= 0.0) width = weight = 0.0;
+		if (width != m_corridor || weight != m_corridorWeight) {
+			m_corridor = width;
+			m_corridorWeight = weight;
+			m_dirty = true;
+		}
+	}
+
+	void clearObstacles() {
+		m_obs.clear();
+		m_dirty = true;
+	}
+	// 障害物を足す (中心 x y、幅 奥行き)。@return 障害物の番号
+	int addObstacle(double x, double y, double width, double height) {
+		Rect r = { x, y, width, height };
+		m_obs.push_back(r);
+		m_dirty = true;
+		return (int)m_obs.size() - 1;
+	}
+	// i 番目の障害物を置き直す (足りなければ足す)。変わらなければ格子は作り直さない
+	void setObstacle(int i, double x, double y, double width, double height) {
+		if (i < 0) return;
+		if (i >= (int)m_obs.size()) {
+			Rect none = { 0.0, 0.0, -1.0, -1.0 };
+			m_obs.resize(i + 1, none);
+		}
+		Rect &r = m_obs[i];
+		if (r.x == x && r.y == y && r.w == width && r.h == height) return;
+		r.x = x;
+		r.y = y;
+		r.w = width;
+		r.h = height;
+		m_dirty = true;
+	}
+	// 障害物の数を n にする (後ろを捨てる)
+	void resizeObstacles(int n) {
+		if (n >= 0 && n < (int)m_obs.size()) {
+			m_obs.resize(n);
+			m_dirty = true;
+		}
+	}
+	int obstacleCount() const { return (int)m_obs.size(); }
+
+	/* @brief  経路を探す
+	 * @param  sx sy 出発点
+	 * @param  gx gy 目的地
+	 * @param  route 出発点から目的地までの点 (前の中身は消す)。見つからなければ空
+	 * @return 見つかったら true
+	 */
+	template <class Node>
+	bool plan(double sx, double sy, double gx, double gy, std::vector<Node> &route) {
+		route.clear();
+		m_expanded = 0;
+		ensureGrid(sx, sy, gx, gy);
+
+		// 出発点・目的地が障害物の中なら、一番近い通れる升目から出入りする
+		int s = nearestPassable(cellIndex(sx, sy));
+		int g = nearestPassable(cellIndex(gx, gy));
+		if (s < 0 || g < 0) return false;
+		if (!search(s, g)) return false;
+
+		// 出発点・升目の中心の列・目的地 (種類は出発点・目的地の升目のもの) を、見通しの良い点まで飛ばす
+		m_pts.clear();
+		pushEndpoint(gx, gy);
+		for (int c = g; ; c = m_parent[c]) {
+			pushPoint(centerX(c), centerY(c), m_occ[c]);
+			if (c == s) break;
+		}
+		pushEndpoint(sx, sy);
+		std::reverse(m_pts.begin(), m_pts.end());
+		thin(sx, sy, gx, gy, route);
+		return true;
+	}
+
+	// 最後の plan() で open リストから取り出した升目の数
+	long expanded() const { return m_expanded; }
+
+	// 点の列の長さ
+	template <class Node>
+	static double routeLength(const std::vector<Node> &route) {
+		double len = 0.0;
+		for (size_t i = 1; i < route.size(); i++) {
+			double dx = route[i].x - route[i - 1].x, dy = route[i].y - route[i - 1].y;
+			len += sqrt(dx * dx + dy * dy);
+		}
+		return len;
+	}
+
+private:
+	// 格子の範囲に点が入っていなければ (または障害物が変わったら) 作り直す
+	void ensureGrid(double sx, double sy, double gx, double gy) {
+		double margin = m_clearance + 2 * m_cell;
+		if (!m_dirty && inside(sx, sy, margin) && inside(gx, gy, margin)) return;
+
+		double xmin = std::min(sx, gx), xmax = std::max(sx, gx);
+		double ymin = std::min(sy, gy), ymax = std::max(sy, gy);
+		if (!m_dirty && m_nx > 0) {
+			// 今の範囲も含める (範囲が行ったり来たりしないように)
+			xmin = std::min(xmin, m_x0 + margin);
+			ymin = std::min(ymin, m_y0 + margin);
+			xmax = std::max(xmax, m_x0 + m_nx * m_cell - margin);
+			ymax = std::max(ymax, m_y0 + m_ny * m_cell - margin);
+		}
+		obstacleBounds(m_obs, xmin, ymin, xmax, ymax);
+		int n = layout(xmin, ymin, xmax, ymax, margin);
+		m_g.assign(n, 0.0);
+		m_parent.assign(n, -1);
+		m_seen.assign(n, 0);
+		m_closed.assign(n, 0);
+		m_gen = 0;
+		paint(m_obs, m_clearance);
+		corridorCost();
+		m_dirty = false;
+	}
+
+	// OBSTACLE の升目からの距離で、升目ごとの費用の倍率を決める
+	void corridorCost() {
+		m_cost.clear();
+		if (m_corridorWeight <= 0.0) return;
+		int n = m_nx * m_ny;
+		std::vector<char> occ(n);
+		for (int c = 0; c < n; c++) occ[c] = (m_occ[c] == OBSTACLE);
+		ClearanceMap::transform(occ, m_nx, m_ny, m_cost);
+		for (int c = 0; c < n; c++) {
+			double d = sqrt(m_cost[c]) * m_cell;
+			m_cost[c] = 1.0 + m_corridorWeight * std::max(0.0, (m_corridor - d) / m_corridor);
+		}
+	}
+
+	bool search(int s, int g) {
+		// 前の探索の値は世代番号で無かったことにする (配列を毎回消さない)
+		if (++m_gen == 0) {
+			std::fill(m_seen.begin(), m_seen.end(), 0);
+			std::fill(m_closed.begin(), m_closed.end(), 0);
+			m_gen = 1;
+		}
+		static const int DX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+		static const int DY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+		std::vector<std::pair<double, int> > &open = m_open;
+		open.clear();
+		m_g[s] = 0.0;
+		m_parent[s] = s;
+		m_seen[s] = m_gen;
+		open.push_back(std::make_pair(octile(s, g), s));
+		while (!open.empty()) {
+			std::pop_heap(open.begin(), open.end(), std::greater<std::pair<double, int> >());
+			int c = open.back().second;
+			open.pop_back();
+			if (m_closed[c] == m_gen) continue;
+			m_closed[c] = m_gen;
+			m_expanded++;
+			if (c == g) return true;
+			int cx = c % m_nx, cy = c / m_nx;
+			for (int k = 0; k < 8; k++) {
+				int x = cx + DX[k], y = cy + DY[k];
+				if (x < 0 || y < 0 || x >= m_nx || y >= m_ny) continue;
+				int n = y * m_nx + x;
+				if (m_occ[n] == OBSTACLE || m_closed[n] == m_gen) continue;
+				// 斜めは両隣が通れるときだけ
+				if (k >= 4 && (m_occ[cy * m_nx + x] == OBSTACLE || m_occ[y * m_nx + cx] == OBSTACLE)) continue;
+				double step = (k >= 4 ? M_SQRT2 * m_cell : m_cell);
+				if (m_occ[n] == MARGIN) step *= MARGIN_COST;
+				if (!m_cost.empty()) step *= m_cost[n];
+				double ng = m_g[c] + step;
+				if (m_seen[n] == m_gen && ng >= m_g[n]) continue;
+				m_g[n] = ng;
+				m_parent[n] = c;
+				m_seen[n] = m_gen;
+				open.push_back(std::make_pair(ng + octile(n, g), n));
+				std::push_heap(open.begin(), open.end(), std::greater<std::pair<double, int> >());
+			}
+		}
+		return false;
+	}
+
+	double m_clearance;
+	double m_corridor, m_corridorWeight;
+	std::vector<Rect> m_obs;
+	bool m_dirty;				// 障害物が変わった (格子を塗り直す)
+
+	std::vector<double> m_cost;	// 升目ごとの費用の倍率 (setCorridor() しなければ空)
+
+	// 探索の作業用 (毎回確保しない)
+	std::vector<double> m_g;
+	std::vector<int> m_parent;
+	std::vector<unsigned int> m_seen, m_closed;
+	unsigned int m_gen;
+	std::vector<std::pair<double, int> > m_open;
+	long m_expanded;
+};
+
+#endif
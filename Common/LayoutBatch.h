@@ -0,0 +1,91 @@
+// LayoutManager のエンティティ位置のまとめ送り
+// 1エンティティごとに1往復していた AskEntityPosition / SetEntityPosition を、1メッセージで複数送れるようにする
+// (1個ずつのメッセージもそのまま使える)
+//
+// 位置の取得
+//   サービス -> ロボット  AskEntityPositions [first]
+//   ロボット -> サービス  AnswerEntityPositions total first n  type id name x y z  type id name x y z ...
+//   first + n < total なら、サービスは "AskEntityPositions first+n" で続きを問い合わせる
+// 位置の設定
+//   サービス -> ロボット  StartSetPosition
+//   ロボット -> サービス  RequestEntityPosition
+//   サービス -> ロボット  SetEntityPositions n  type id name x y z ...
+//   ロボット -> サービス  RequestEntityPosition   (1個ずつのときと同じ。続きを送るか FinishSetPosition で終える)
+//   SetEntityPositions が壊れていたら1個も動かさず、RequestEntityPosition も返さない
+//
+// ・1メッセージに入れるのは LAYOUT_BATCH_MAX 個まで
+// ・E は type id name x y z をメンバに持つクラス (各コントローラの Entity)
+// ・長さが決まっていないので MsgSchema.h のバイナリ形式には載せず、テキストだけで送る
+#ifndef _LAYOUT_BATCH_H_
+#define _LAYOUT_BATCH_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "Parameter.h"
+
+#define LAYOUT_BATCH_MAX 32
+
+/* @brief  AnswerEntityPositions のメッセージを作る
+ * @param  entities 全エンティティ
+ * @param  first    何番目から送るか
+ * @return メッセージ
+ */
+template <class E>
+std::string layoutAnswerMsg(const std::vector<E> &entities, int first)
+{
+	int total = (int)entities.size();
+	if (first < 0) first = 0;
+	if (first > total) first = total;
+	int num = total - first;
+	if (num > LAYOUT_BATCH_MAX) num = LAYOUT_BATCH_MAX;
+
+	// type・name は長さが決まっていないので文字列のまま足し、buf には数1個ずつだけ書く (%lf 1個は 320 文字くらいまで)
+	char buf[512];
+	std::string msg(ANS_ENTITIES_POS_MSG);
+	snprintf(buf, sizeof(buf), " %d %d %d", total, first, num);
+	msg += buf;
+	for (int i = first; i < first + num; i++) {
+		const E &e = entities[i];
+		msg += ' ';
+		msg += e.type;
+		snprintf(buf, sizeof(buf), " %d ", e.id);
+		msg += buf;
+		msg += e.name;
+		const double v[3] = { e.x, e.y, e.z };
+		for (int k = 0; k < 3; k++) {
+			snprintf(buf, sizeof(buf), " %lf", v[k]);
+			msg += buf;
+		}
+	}
+	return msg;
+}
+
+/* @brief  "type id name x y z" を num 個読み込む (SetEntityPositions / AnswerEntityPositions の引数部分)
+ * @param  str      読み込む文字列
+ * @param  num      エンティティの数
+ * @param  entities 読み込んだエンティティを追加する (途中で壊れていれば何も追加しない)
+ * @return 読み込めた数。途中で壊れていれば -1
+ */
+template <class E>
+int layoutParseEntities(const char *str, int num, std::vector<E> &entities)
+{
+	if (num < 0 || num > LAYOUT_BATCH_MAX) return -1;
+	const char *p = str;
+	std::vector<E> parsed;
+	for (int i = 0; i < num; i++) {
+		char type[256];
+		char name[256];
+		E e;
+		int used = 0;
+		if (sscanf(p, "%255s %d %255s %lf %lf %lf%n", type, &e.id, name, &e.x, &e.y, &e.z, &used) != 6) return -1;
+		e.type = type;
+		e.name = name;
+		parsed.push_back(e);
+		p += used;
+	}
+	entities.insert(entities.end(), parsed.begin(), parsed.end());
+	return num;
+}
+
+#endif
@@ -0,0 +1,172 @@
+// 受信メッセージの引数
+// ・テキストのメッセージは書き換えず、コピーもせずに1回だけ走査して単語に区切る
+// ・バイナリのメッセージ(MsgSchema.h)は decode した値・文字列をこのクラスの中に持つ
+#ifndef _MSG_ARGS_H_
+#define _MSG_ARGS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define MSG_MAX_ARGS 16
+#define MSG_MAX_STRING 1024		// バイナリのメッセージに含まれる文字列の合計の長さ
+
+// 区切られたメッセージの引数 (元のメッセージを指すだけでコピーしない)
+class MsgArgs {
+public:
+	MsgArgs() : m_num(0), m_sender(""), m_msg(""), m_header(""), m_headerLen(0), m_binary(false), m_overflow(false), m_strUsed(0) {}
+
+	int size() const { return m_num; }
+	bool has(int i) const { return i >= 0 && i < m_num; }
+
+	// スキーマで d / f / i と宣言した引数は、dispatch() の時点で変換済み
+	double d(int i) const { return has(i) ? m_value[i] : 0.0; }
+	int i(int i) const { return has(i) ? (int)m_value[i] : 0; }
+	// 単語 (ヌル終端されていないので長さと一緒に使う)
+	const char *str(int i) const { return has(i) ? m_tok[i] : ""; }
+	int len(int i) const { return has(i) ? m_len[i] : 0; }
+	std::string s(int i) const { return std::string(str(i), len(i)); }
+	bool is(int i, const char *word) const {
+		return has(i) && (int)strlen(word) == m_len[i] && strncmp(m_tok[i], word, m_len[i]) == 0;
+	}
+	// i 番目の引数から最後までの文字列
+	const char *rest(int i) const { return has(i) ? m_tok[i] : m_msg + strlen(m_msg); }
+
+	const char *sender() const { return m_sender; }
+	const char *msg() const { return m_msg; }
+	std::string header() const { return std::string(m_header, m_headerLen); }
+
+	/* @brief  メッセージを単語に区切る
+	 * 引数が MSG_MAX_ARGS を超えた分は区切らない (rest() で読む。スキーマが * で終わらなければ parse() で不正になる)
+	 */
+	void split(const char *sender, const char *msg) {
+		m_sender = sender;
+		m_msg = msg;
+		m_num = 0;
+		m_header = "";
+		m_headerLen = 0;
+		m_binary = false;
+		m_overflow = false;
+		const char *p = msg;
+		bool first = true;
+		while (*p != '\0') {
+			while (isDelim(*p)) p++;
+			if (*p == '\0') break;
+			const char *b = p;
+			while (*p != '\0' && !isDelim(*p)) p++;
+			if (first) {
+				m_header = b;
+				m_headerLen = (int)(p - b);
+				first = false;
+			} else {
+				if (m_num >= MSG_MAX_ARGS) {
+					m_overflow = true;
+					return;
+				}
+				m_tok[m_num] = b;
+				m_len[m_num] = (int)(p - b);
+				m_num++;
+			}
+		}
+	}
+
+	/* @brief  スキーマに従って引数を確認・変換する
+	 * @return 引数が足りない、数値でない、余分な引数がある場合は false
+	 */
+	bool parse(const char *schema) {
+		// バイナリは decode の時点で型が決まっているので、数だけ確認する
+		if (m_binary) return checkCount(schema);
+		int n = 0;
+		bool optional = false;
+		bool extra = false;
+		for (const char *c = schema; *c != '\0'; c++) {
+			if (*c == '|') { optional = true; continue; }
+			if (*c == '*') { extra = true; continue; }
+			if (n >= m_num) {
+				if (optional) return true;
+				return false;
+			}
+			if (*c == 'd' || *c == 'f') {
+				char *end;
+				m_value[n] = strtod(m_tok[n], &end);
+				if (end != m_tok[n] + m_len[n]) return false;
+			} else if (*c == 'i') {
+				char *end;
+				m_value[n] = (double)strtol(m_tok[n], &end, 10);
+				if (end != m_tok[n] + m_len[n]) return false;
+			}
+			n++;
+		}
+		if ((n < m_num || m_overflow) && !extra) return false;
+		return true;
+	}
+
+	const char *headerPtr() const { return m_header; }
+	int headerLen() const { return m_headerLen; }
+	bool binary() const { return m_binary; }
+
+	// バイナリのメッセージを decode するときに使う (MsgSchema.h の msgDecodeBinary)
+	void beginBinary(const char *sender, const char *msg, const char *header) {
+		m_sender = sender;
+		m_msg = msg;
+		m_num = 0;
+		m_header = header;
+		m_headerLen = (int)strlen(header);
+		m_binary = true;
+		m_overflow = false;
+		m_strUsed = 0;
+	}
+	bool addValue(double v) {
+		if (m_num >= MSG_MAX_ARGS) return false;
+		m_tok[m_num] = "";
+		m_len[m_num] = 0;
+		m_value[m_num] = v;
+		m_num++;
+		return true;
+	}
+	bool addString(const char *str, int len) {
+		if (m_num >= MSG_MAX_ARGS || m_strUsed + len + 1 > MSG_MAX_STRING) return false;
+		char *p = m_str + m_strUsed;
+		memcpy(p, str, len);
+		p[len] = '\0';
+		m_strUsed += len + 1;
+		m_tok[m_num] = p;
+		m_len[m_num] = len;
+		m_value[m_num] = 0.0;
+		m_num++;
+		return true;
+	}
+
+private:
+	bool checkCount(const char *schema) const {
+		int required = 0, total = 0;
+		bool optional = false, extra = false;
+		for (const char *c = schema; *c != '\0'; c++) {
+			if (*c == '|') { optional = true; continue; }
+			if (*c == '*') { extra = true; continue; }
+			total++;
+			if (!optional) required++;
+		}
+		if (m_num < required) return false;
+		if (m_num > total && !extra) return false;
+		return true;
+	}
+
+	static bool isDelim(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+	const char *m_tok[MSG_MAX_ARGS];
+	int m_len[MSG_MAX_ARGS];
+	double m_value[MSG_MAX_ARGS];
+	int m_num;
+	const char *m_sender;
+	const char *m_msg;
+	const char *m_header;
+	int m_headerLen;
+	bool m_binary;
+	bool m_overflow;		// MSG_MAX_ARGS を超える引数があった
+	char m_str[MSG_MAX_STRING];
+	int m_strUsed;
+};
+
+#endif
@@ -0,0 +1,145 @@
+// onRecvMsg のメッセージ振り分け
+// ・メッセージは書き換えず、コピーもせずに1回だけ走査して単語に区切る (strtok_r / sprintf を使わない)
+// ・'#' で始まるメッセージは MsgSchema.h のバイナリ形式として decode する
+// ・ヘッダ(先頭の単語)は完全ハッシュ表で O(1) に引き、コマンド表のハンドラを呼ぶ
+// ・コマンドごとに引数の型(スキーマ)を宣言し、足りない・数値でない引数のメッセージは呼ばずに捨てる
+//
+// スキーマの書き方 (MsgSchema.h と同じ)
+//   d f 実数      i  整数      s  単語
+//   |  以降は省略可能
+//   *  最後に書くと、余分な引数を許す (無いときは余分な引数があると不正なメッセージ)
+//      MSG_MAX_ARGS を超える長いメッセージ (SetEntityPositions など) は、* を付けて args.rest() で読む
+//   例: "dddd"    ObjDir x y z range
+//       "ddd|dd"  3つ必須、2つ省略可
+//
+// ・MsgSchema.h の MSG_SCHEMA にあるメッセージは MSG_COMMAND で書き、ヘッダと引数の型をスキーマから取る
+//   (送る側と受ける側で型が食い違わない。ハンドラは msgRead() で構造体に読む)
+//   スキーマに無いメッセージ (Profile などの調整用・長さの決まらない SetEntityPositions) だけ型を直接書く
+//
+// 使い方
+//   const MyController::Dispatcher::Command MyController::s_commands[] = {
+//     MSG_COMMAND(ObjDir, "RecogTrash", &MyController::onObjDir),
+//     { "Profile", NULL, "|s", &MyController::onProfile },
+//     ...
+//   };
+//   onInit で m_dispatcher.init(this, s_commands, sizeof(s_commands) / sizeof(s_commands[0]));
+//   onRecvMsg で m_dispatcher.dispatch(evt.getSender(), evt.getMsg());
+//
+// C++98 では constexpr が使えないため、ハッシュの種は init() で衝突しないものを探して決める(表は固定長の配列)
+#ifndef _MSG_DISPATCH_H_
+#define _MSG_DISPATCH_H_
+
+#include "MsgArgs.h"
+#include "MsgSchema.h"
+
+// スキーマにあるメッセージのコマンド表の1行 (Name は MSG_SCHEMA の名前。ObjDir なら ObjDirMsg)
+#define MSG_COMMAND(Name, sender, handler)	{ Name##Msg::header(), sender, Name##Msg::schema(), handler }
+
+template <class Owner>
+class MsgDispatcher {
+public:
+	typedef void (Owner::*Handler)(const MsgArgs &args);
+
+	struct Command {
+		const char *header;
+		const char *sender;		// NULL なら送信者を問わない
+		const char *schema;
+		Handler handler;
+	};
+
+	enum Result {
+		MSG_OK = 0,
+		MSG_UNKNOWN,			// 知らないヘッダ
+		MSG_WRONG_SENDER,		// 送信者が違う
+		MSG_MALFORMED			// 引数がスキーマに合わない
+	};
+
+	enum { TABLE_SIZE = 128 };
+
+	MsgDispatcher() : m_owner(NULL), m_table(NULL), m_num(0), m_seed(0) {
+		for (int i = 0; i < TABLE_SIZE; i++) m_slot[i] = -1;
+	}
+
+	/* @brief  コマンド表を設定し、衝突しないハッシュの種を探す
+	 * @return 完全ハッシュが作れたら true
+	 */
+	bool init(Owner *owner, const Command *table, int num) {
+		m_owner = owner;
+		m_table = table;
+		m_num = num;
+		for (unsigned int seed = 1; seed < 10000; seed++) {
+			if (build(seed)) {
+				m_seed = seed;
+				return true;
+			}
+		}
+		printf("MsgDispatcher: cannot build perfect hash for %d commands \n", num);
+		m_seed = 0;
+		return false;
+	}
+
+	/* @brief  メッセージを振り分ける
+	 * @param  sender 送信者
+	 * @param  msg    メッセージ (書き換えない)
+	 */
+	Result dispatch(const char *sender, const char *msg) {
+		if (msg[0] == MSG_BINARY_MARK) {
+			if (!msgDecodeBinary(sender, msg, m_args)) {
+				printf("MsgDispatcher: broken binary message: %s \n", msg);
+				return MSG_MALFORMED;
+			}
+		} else {
+			m_args.split(sender, msg);
+		}
+		int idx = find(m_args.headerPtr(), m_args.headerLen());
+		if (idx < 0) return MSG_UNKNOWN;
+		const Command &cmd = m_table[idx];
+		if (cmd.sender != NULL && strcmp(cmd.sender, sender) != 0) return MSG_WRONG_SENDER;
+		if (!m_args.parse(cmd.schema)) {
+			printf("MsgDispatcher: malformed %s (expected \"%s\"): %s \n", cmd.header, cmd.schema, msg);
+			return MSG_MALFORMED;
+		}
+		(m_owner->*cmd.handler)(m_args);
+		return MSG_OK;
+	}
+
+	// 直前に dispatch() したメッセージ (MSG_UNKNOWN のときに呼び出し側で使う)
+	const MsgArgs &args() const { return m_args; }
+
+private:
+	unsigned int hash(const char *s, int len, unsigned int seed) const {
+		unsigned int h = seed * 2166136261u;
+		for (int i = 0; i < len; i++) {
+			h = (h ^ (unsigned char)s[i]) * 16777619u;
+		}
+		return (h ^ (h >> 15)) & (TABLE_SIZE - 1);
+	}
+
+	bool build(unsigned int seed) {
+		for (int i = 0; i < TABLE_SIZE; i++) m_slot[i] = -1;
+		for (int i = 0; i < m_num; i++) {
+			unsigned int h = hash(m_table[i].header, (int)strlen(m_table[i].header), seed);
+			if (m_slot[h] >= 0) return false;
+			m_slot[h] = i;
+		}
+		return true;
+	}
+
+	int find(const char *header, int len) const {
+		if (m_seed == 0 || len == 0) return -1;
+		int idx = m_slot[hash(header, len, m_seed)];
+		if (idx < 0) return -1;
+		const char *name = m_table[idx].header;
+		if (strncmp(name, header, len) != 0 || name[len] != '\0') return -1;
+		return idx;
+	}
+
+	Owner *m_owner;
+	const Command *m_table;
+	int m_num;
+	unsigned int m_seed;
+	short m_slot[TABLE_SIZE];
+	MsgArgs m_args;
+};
+
+#endif
@@ -0,0 +1,411 @@
+// サービスとやり取りするメッセージのスキーマ
+// ・MSG_SCHEMA にメッセージの番号・名前・ヘッダ・引数を1行ずつ書くと、
+//   引数をメンバに持つ構造体 (例: AskRandomRouteMsg) と encode/decode が作られる
+// ・形式は2種類
+//     テキスト  "AskRandomRoute  125.5  124.3 ..." (これまでと同じ。d は %6.1lf、f は %lf)
+//     バイナリ  '#' + base64(番号1バイト + 引数)。実数は float (4バイト) なので 0.1cm に丸められない
+//   どちらで送るかは MsgWire で切り替える。受信はどちらでも MsgDispatcher が受け付ける
+// ・引数の型
+//     d  実数 (テキストは %6.1lf)   f  実数 (テキストは %lf)   i  整数   s  単語
+//     F(opt, _) 以降の引数は省略できる (読まなければ 0)   F(rest, _) 余分な引数を許す (MsgDispatch.h の | と *)
+// ・受信するメッセージもこのスキーマで読む。コマンド表は MSG_COMMAND で schema() を使い、ハンドラは msgRead() で構造体に読む
+//   (バイナリ形式はすべての引数を送るので、opt も省略しない)
+//
+// 使い方
+//   AskObjPosMsg m;
+//   m.x = x; m.z = z; m.theta = theta;
+//   m_srv->sendMsgToSrv(m_wire.encode(m));
+//
+//   ObjDirMsg dir;
+//   if (msgRead(args, dir)) { ... dir.x dir.range ... }
+#ifndef _MSG_SCHEMA_H_
+#define _MSG_SCHEMA_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "Parameter.h"
+#include "MsgArgs.h"
+
+#define MSG_BINARY_MARK '#'
+
+// 引数の並び
+#define MSG_FIELDS_NONE(F)		F(rest, _)
+#define MSG_FIELDS_SCENE(F)		F(d, x) F(d, z) F(d, theta) F(d, camX) F(d, camY) F(d, camZ) F(d, dirX) F(d, dirY) F(d, dirZ)
+#define MSG_FIELDS_POSE(F)		F(d, x) F(d, z) F(d, theta)
+#define MSG_FIELDS_BOX_ROUTE(F)	F(d, x) F(d, z) F(d, theta) F(d, boxX) F(d, boxY) F(d, boxZ)
+#define MSG_FIELDS_DIR(F)		F(d, x) F(d, y) F(d, z) F(d, range)
+#define MSG_FIELDS_ROUTE(F)		F(d, x) F(d, z) F(d, range) F(d, lookX) F(d, lookZ) F(opt, _) F(d, lookFlg)
+#define MSG_FIELDS_CAPTURE(F)	F(d, x) F(d, z) F(d, angle)
+#define MSG_FIELDS_VALUE(F)		F(d, value)
+#define MSG_FIELDS_XZ(F)		F(d, x) F(d, z)
+#define MSG_FIELDS_CAM_ID(F)	F(i, camID)
+#define MSG_FIELDS_ENTITY(F)	F(s, type) F(i, id) F(s, name) F(f, x) F(f, y) F(f, z)
+#define MSG_FIELDS_FORMAT(F)	F(s, format)
+
+// メッセージの一覧 (番号はバイナリ形式で使う。変えないこと)
+#define MSG_SCHEMA(M) \
+	/* ロボット -> サービス */ \
+	M( 1, Start,                 "Start",              MSG_FIELDS_SCENE) \
+	M( 2, AskRandomRoute,        "AskRandomRoute",     MSG_FIELDS_SCENE) \
+	M( 3, AskObjPos,             "AskObjPos",          MSG_FIELDS_POSE) \
+	M( 4, AskTrashBoxPos,        "AskTrashBoxPos",     MSG_FIELDS_POSE) \
+	M( 5, AskTrashBoxRoute,      "AskTrashBoxRoute",   MSG_FIELDS_BOX_ROUTE) \
+	/* サービス -> ロボット */ \
+	M(10, RandomRouteStart,      "RandomRouteStart",   MSG_FIELDS_NONE) \
+	M(11, RandomRouteArrived,    "RandomRouteArrived", MSG_FIELDS_NONE) \
+	M(12, RandomRoute,           "RandomRoute",        MSG_FIELDS_ROUTE) \
+	M(13, ObjDir,                "ObjDir",             MSG_FIELDS_DIR) \
+	M(14, TrashBoxDir,           "TrashBoxDir",        MSG_FIELDS_DIR) \
+	M(15, Grab,                  "grab",               MSG_FIELDS_NONE) \
+	M(16, ThrowTrash,            "ThrowTrash",         MSG_FIELDS_NONE) \
+	M(17, Finish,                "Finish",             MSG_FIELDS_NONE) \
+	M(18, Reset,                 "RESET",              MSG_FIELDS_NONE) \
+	M(19, Stop,                  "Stop",               MSG_FIELDS_NONE) \
+	M(20, GoForwardVelocity,     "GoForwardVelocity",  MSG_FIELDS_VALUE) \
+	M(21, RotateVelocity,        "RotateVelocity",     MSG_FIELDS_VALUE) \
+	M(22, CamID,                 "CamID",              MSG_FIELDS_CAM_ID) \
+	M(23, CaptureData,           "CaptureData",        MSG_FIELDS_CAPTURE) \
+	/* SIGViewer -> ロボット */ \
+	M(30, CameraAngle,           "CameraAngle",        MSG_FIELDS_VALUE) \
+	M(31, RobotAngle,            "RobotAngle",         MSG_FIELDS_VALUE) \
+	M(32, RotateDir,             "RotateDir",          MSG_FIELDS_XZ) \
+	M(33, RobotPosition,         "RobotPosition",      MSG_FIELDS_XZ) \
+	/* レイアウト (Parameter.h) */ \
+	M(40, StartSetPosition,      START_SET_POS_MSG,    MSG_FIELDS_NONE) \
+	M(41, SetEntityPosition,     SET_ENTITY_POS_MSG,   MSG_FIELDS_ENTITY) \
+	M(42, RequestEntityPosition, REQ_ENTITY_POS_MSG,   MSG_FIELDS_NONE) \
+	M(43, FinishSetPosition,     FIN_SET_POS_MSG,      MSG_FIELDS_NONE) \
+	M(44, StartAskPosition,      START_ASK_POS_MSG,    MSG_FIELDS_NONE) \
+	M(45, AskEntityPosition,     ASK_ENTITY_POS_MSG,   MSG_FIELDS_NONE) \
+	M(46, AnswerEntityPosition,  ANS_ENTITY_POS_MSG,   MSG_FIELDS_ENTITY) \
+	M(47, FinishAskPosition,     FIN_ASK_POS_MSG,      MSG_FIELDS_NONE) \
+	/* 形式の切り替え "WireFormat text|binary" */ \
+	M(60, WireFormat,            "WireFormat",         MSG_FIELDS_FORMAT)
+
+
+/////////////////////////////////////////////
+//////////////// base64 /////////////////////
+/////////////////////////////////////////////
+
+inline void msgBase64Encode(const unsigned char *in, int len, std::string &out)
+{
+	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	for (int i = 0; i < len; i += 3) {
+		unsigned int v = in[i] << 16;
+		if (i + 1 < len) v |= in[i + 1] << 8;
+		if (i + 2 < len) v |= in[i + 2];
+		out += table[(v >> 18) & 63];
+		out += table[(v >> 12) & 63];
+		out += (i + 1 < len) ? table[(v >> 6) & 63] : '=';
+		out += (i + 2 < len) ? table[v & 63] : '=';
+	}
+}
+
+inline int msgBase64Value(char c)
+{
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '+') return 62;
+	if (c == '/') return 63;
+	return -1;
+}
+
+/* @brief  base64 を decode する
+ * @return decode したバイト数。壊れていれば -1
+ */
+inline int msgBase64Decode(const char *in, unsigned char *out, int max)
+{
+	int n = 0;
+	unsigned int v = 0;
+	int bits = 0;
+	for (const char *p = in; *p != '\0' && *p != '='; p++) {
+		if (*p == ' ' || *p == '\r' || *p == '\n') break;
+		int c = msgBase64Value(*p);
+		if (c < 0) return -1;
+		v = (v << 6) | c;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (n >= max) return -1;
+			out[n++] = (unsigned char)((v >> bits) & 0xff);
+		}
+	}
+	return n;
+}
+
+
+/////////////////////////////////////////////
+/////////////// 書き込み・読み込み ///////////
+/////////////////////////////////////////////
+
+enum MsgFormat {
+	MSG_TEXT = 0,
+	MSG_BINARY
+};
+
+class MsgWriter {
+public:
+	MsgWriter(MsgFormat format) : m_format(format), m_len(0), m_overflow(false) {}
+
+	void begin(int id, const char *header) {
+		m_len = 0;
+		m_overflow = false;
+		m_text.clear();
+		if (m_format == MSG_TEXT) {
+			m_text = header;
+		} else {
+			m_buf[m_len++] = (unsigned char)id;
+		}
+	}
+
+	// d: テキストは %6.1lf
+	void put(char type, double v) {
+		if (m_format == MSG_TEXT) {
+			char tmp[64];
+			sprintf(tmp, type == 'f' ? " %lf" : " %6.1lf", v);
+			m_text += tmp;
+		} else {
+			float f = (float)v;
+			putBytes(&f, 4);
+		}
+	}
+	void put(char type, int v) {
+		if (m_format == MSG_TEXT) {
+			char tmp[32];
+			sprintf(tmp, " %d", v);
+			m_text += tmp;
+		} else {
+			int i = v;
+			putBytes(&i, 4);
+		}
+	}
+	void put(char type, const std::string &v) {
+		if (m_format == MSG_TEXT) {
+			m_text += ' ';
+			m_text += v;
+		} else {
+			int len = v.size() < 255 ? (int)v.size() : 255;
+			unsigned char l = (unsigned char)len;
+			putBytes(&l, 1);
+			putBytes(v.c_str(), len);
+		}
+	}
+
+	// バイナリが m_buf に入りきらなかった (end() は空を返す)
+	bool overflow() const { return m_overflow; }
+
+	std::string end() {
+		if (m_format == MSG_TEXT) return m_text;
+		if (m_overflow) return std::string();
+		std::string out(1, MSG_BINARY_MARK);
+		msgBase64Encode(m_buf, m_len, out);
+		return out;
+	}
+
+private:
+	void putBytes(const void *p, int len) {
+		if (m_len + len > (int)sizeof(m_buf)) {
+			m_overflow = true;
+			return;
+		}
+		memcpy(m_buf + m_len, p, len);
+		m_len += len;
+	}
+
+	MsgFormat m_format;
+	std::string m_text;
+	unsigned char m_buf[1024];
+	int m_len;
+	bool m_overflow;
+};
+
+// 受信した MsgArgs (テキスト・バイナリどちらでも) から構造体に読み込む
+class MsgReader {
+public:
+	MsgReader(const MsgArgs &args) : m_args(args), m_pos(0), m_ok(true), m_optional(false) {}
+
+	void get(char type, double &v) { if (check()) v = m_args.d(m_pos++); }
+	void get(char type, int &v) { if (check()) v = m_args.i(m_pos++); }
+	void get(char type, std::string &v) { if (check()) v = m_args.s(m_pos++); }
+	// これより後の引数は無くてもよい
+	void optional() { m_optional = true; }
+	bool ok() const { return m_ok; }
+
+private:
+	bool check() {
+		if (!m_args.has(m_pos)) {
+			if (!m_optional) m_ok = false;
+			return false;
+		}
+		return m_ok;
+	}
+
+	const MsgArgs &m_args;
+	int m_pos;
+	bool m_ok;
+	bool m_optional;
+};
+
+
+/////////////////////////////////////////////
+////////// スキーマから作られるもの /////////
+/////////////////////////////////////////////
+
+#define MSG_TYPE_d double
+#define MSG_TYPE_f double
+#define MSG_TYPE_i int
+#define MSG_TYPE_s std::string
+
+// 引数の型のときだけ x を残す (opt・rest は引数ではない)
+#define MSG_VALUE_d(x)		x
+#define MSG_VALUE_f(x)		x
+#define MSG_VALUE_i(x)		x
+#define MSG_VALUE_s(x)		x
+#define MSG_VALUE_opt(x)
+#define MSG_VALUE_rest(x)
+// スキーマの文字 (MsgDispatch.h と同じ)
+#define MSG_CODE_d		"d"
+#define MSG_CODE_f		"f"
+#define MSG_CODE_i		"i"
+#define MSG_CODE_s		"s"
+#define MSG_CODE_opt	"|"
+#define MSG_CODE_rest	"*"
+#define MSG_OPTIONAL_d
+#define MSG_OPTIONAL_f
+#define MSG_OPTIONAL_i
+#define MSG_OPTIONAL_s
+#define MSG_OPTIONAL_opt	r.optional();
+#define MSG_OPTIONAL_rest
+
+#define MSG_FIELD_DECL(t, n)	MSG_VALUE_##t(MSG_TYPE_##t n;)
+#define MSG_FIELD_INIT(t, n)	MSG_VALUE_##t(n = MSG_TYPE_##t();)
+#define MSG_FIELD_SCHEMA(t, n)	MSG_CODE_##t
+#define MSG_FIELD_WRITE(t, n)	MSG_VALUE_##t(w.put((#t)[0], n);)
+#define MSG_FIELD_READ(t, n)	MSG_VALUE_##t(r.get((#t)[0], n);) MSG_OPTIONAL_##t
+
+#define MSG_STRUCT(ID_, Name, Header, FIELDS) \
+	struct Name##Msg { \
+		enum { ID = ID_ }; \
+		FIELDS(MSG_FIELD_DECL) \
+		Name##Msg() { FIELDS(MSG_FIELD_INIT) } \
+		static const char *header() { return Header; } \
+		static const char *schema() { return "" FIELDS(MSG_FIELD_SCHEMA); } \
+		void write(MsgWriter &w) const { (void)w; FIELDS(MSG_FIELD_WRITE) } \
+		bool read(MsgReader &r) { FIELDS(MSG_FIELD_READ) return r.ok(); } \
+	};
+
+MSG_SCHEMA(MSG_STRUCT)
+
+/* @brief  受信した引数 (MsgDispatcher がスキーマで確かめたもの) を構造体に読む
+ * @return 必須の引数が足りなければ false
+ */
+template <class T>
+inline bool msgRead(const MsgArgs &args, T &m)
+{
+	MsgReader r(args);
+	return m.read(r);
+}
+
+#define MSG_CASE_HEADER(ID_, Name, Header, FIELDS)	case ID_: return Header;
+#define MSG_CASE_SCHEMA(ID_, Name, Header, FIELDS)	case ID_: return Name##Msg::schema();
+
+// 番号からヘッダ・引数の型を引く (知らない番号は NULL)
+inline const char *msgHeader(int id)
+{
+	switch (id) {
+		MSG_SCHEMA(MSG_CASE_HEADER)
+		default: return NULL;
+	}
+}
+
+inline const char *msgSchema(int id)
+{
+	switch (id) {
+		MSG_SCHEMA(MSG_CASE_SCHEMA)
+		default: return NULL;
+	}
+}
+
+/* @brief  バイナリのメッセージ ('#' + base64) を MsgArgs に decode する
+ * @return 壊れている・知らない番号なら false
+ */
+inline bool msgDecodeBinary(const char *sender, const char *msg, MsgArgs &args)
+{
+	unsigned char buf[1024];
+	int len = msgBase64Decode(msg + 1, buf, sizeof(buf));
+	if (len < 1) return false;
+	const char *header = msgHeader(buf[0]);
+	const char *schema = msgSchema(buf[0]);
+	if (header == NULL) return false;
+	args.beginBinary(sender, msg, header);
+	int pos = 1;
+	for (const char *c = schema; *c != '\0'; c++) {
+		if (*c == 'd' || *c == 'f') {
+			float f;
+			if (pos + 4 > len) return false;
+			memcpy(&f, buf + pos, 4);
+			pos += 4;
+			if (!args.addValue(f)) return false;
+		} else if (*c == 'i') {
+			int v;
+			if (pos + 4 > len) return false;
+			memcpy(&v, buf + pos, 4);
+			pos += 4;
+			if (!args.addValue(v)) return false;
+		} else if (*c == 's') {
+			if (pos + 1 > len) return false;
+			int l = buf[pos++];
+			if (pos + l > len) return false;
+			if (!args.addString((const char *)buf + pos, l)) return false;
+			pos += l;
+		}
+	}
+	return pos == len;
+}
+
+// 送信するメッセージの形式 (サービスから "WireFormat binary" が来たらバイナリに切り替える)
+class MsgWire {
+public:
+	MsgWire() : m_format(MSG_TEXT) {}
+
+	// バイナリに入りきらないメッセージはテキストで送る
+	template <class T>
+	std::string encode(const T &m) const {
+		MsgWriter w(m_format);
+		w.begin(T::ID, T::header());
+		m.write(w);
+		if (w.overflow()) {
+			printf("MsgWire: %s is too long for binary, sent as text \n", T::header());
+			return text(m);
+		}
+		return w.end();
+	}
+
+	// テキストで encode する (ログ・形式の切り替えの返事用)
+	template <class T>
+	std::string text(const T &m) const {
+		MsgWriter w(MSG_TEXT);
+		w.begin(T::ID, T::header());
+		m.write(w);
+		return w.end();
+	}
+
+	/* @brief  形式を切り替える
+	 * @param  name "text" か "binary"
+	 * @return 知らない形式なら false
+	 */
+	bool setFormat(const std::string &name) {
+		if (name == "text") { m_format = MSG_TEXT; return true; }
+		if (name == "binary") { m_format = MSG_BINARY; return true; }
+		return false;
+	}
+	MsgFormat format() const { return m_format; }
+	const char *formatName() const { return m_format == MSG_BINARY ? "binary" : "text"; }
+
+private:
+	MsgFormat m_format;
+};
+
+#endif
@@ -0,0 +1,357 @@
+// 床の上の障害物 (向きのある長方形・凸多角形) と、線分がその内側を通るかの判定
+// ・Obstacle / VisibilityPlanner の長方形は軸に平行なので、斜めに置いた机やソファは外接する長方形になって膨らみすぎる
+//   ここでは障害物を凸多角形 (向きのある長方形は4角形) として持ち、辺ごとの半平面 n・p <= d の共通部分で表す
+//   ロボットの半径 r だけ膨らませるのは d に r を足すだけ (角は丸めない。膨らませた長方形の角と同じ)
+// ・辺と頂点は配列の構造体 (SoA) に並べる。k 番目の辺の法線・距離、k 番目の頂点が、障害物の番号の順に連続する
+//     m_nx[k * m_stride + i], m_ny[...], m_d[...], m_vx[...] ...  (辺が少ない障害物・空いている番号は、判定に効かない値で埋める)
+//   判定は分離軸 (辺の法線と線分の法線に射影して、重ならない軸があれば通らない)。割り算が無く、
+//   LANES 個の障害物を分岐なしでまとめて調べるので、コンパイラが SIMD 命令にできる (組み込み関数は使わない)
+//   その前に、線分と障害物を囲む長方形が重ならない LANES 個の組は飛ばす
+// ・segmentMask() は1本の線分とすべての障害物、routeHits() は経路のすべての線分とすべての障害物を1回で調べる
+// ・内側は開いた集合 (辺の上をなぞるだけ・角に触れるだけなら通らない。VisibilityPlanner がこれまで長方形で調べていたのと同じ)
+// 速さは OfflineSim/SegmentBench.cpp で障害物ごとに調べる場合と比べられる
+//
+// 使い方
+//   ObstacleSet obs;
+//   obs.setBox(i, x, z, width, depth, angle);		// angle は x 軸から z 軸の方へ回した角度 [rad]
+//   obs.setPolygon(j, xs, zs, n);					// 凸多角形 (向きはどちらでもよい)
+//   if (obs.routeHits(route, TRUCK_RADIUS) < 0) { ... 経路はどの障害物も通らない }
+#ifndef _OBSTACLE_SET_H_
+#define _OBSTACLE_SET_H_
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+class ObstacleSet {
+public:
+	enum {
+		MAX_EDGES = 8,		// 多角形の辺の数の上限
+		LANES = 4			// まとめて調べる障害物の数 (m_stride はこの倍数)
+	};
+
+	ObstacleSet() : m_slots(0), m_stride(0) {}
+
+	int size() const { return (int)m_shapes.size(); }
+	void clear() {
+		m_shapes.clear();
+		relayout();
+	}
+	// 障害物の数を n にする (足した番号は空)
+	void resize(int n) {
+		if (n < 0 || n == size()) return;
+		int old = size();
+		m_shapes.resize(n, Shape());
+		// 1つずつ足していくときは、LANES の倍数を超えるまで並べ直さない
+		if (n > old && n <= m_stride) {
+			for (int i = old; i < n; i++) store(i);
+		} else {
+			relayout();
+		}
+	}
+	// i 番目を空にする (番号はそのまま)
+	void remove(int i) {
+		if (i < 0 || i >= size()) return;
+		m_shapes[i] = Shape();
+		store(i);
+	}
+	bool empty(int i) const { return m_shapes[i].n == 0; }
+
+	/* @brief  i 番目を向きのある長方形にする (足りなければ足す)
+	 * @param  x y    中心 (y はワールドの z)
+	 * @param  width height 幅 奥行き (回す前の x, y 方向の長さ。負なら空にする)
+	 * @param  angle  x 軸から y 軸の方へ回した角度 [rad]
+	 */
+	void setBox(int i, double x, double y, double width, double height, double angle = 0.0) {
+		if (i < 0) return;
+		if (width < 0.0 || height < 0.0) {
+			if (i < size()) remove(i);
+			return;
+		}
+		double c = cos(angle), s = sin(angle);
+		double hx = width / 2, hy = height / 2;
+		double xs[4], ys[4];
+		for (int k = 0; k < 4; k++) {
+			// (-,-) (+,-) (+,+) (-,+) の順 (左回り)
+			double u = (k == 1 || k == 2) ? hx : -hx;
+			double v = (k >= 2) ? hy : -hy;
+			xs[k] = x + c * u - s * v;
+			ys[k] = y + s * u + c * v;
+		}
+		setPolygon(i, xs, ys, 4);
+	}
+
+	/* @brief  i 番目を凸多角形にする (足りなければ足す)
+	 * @param  xs ys 頂点 (右回り・左回りどちらでもよい。続けて同じ点は1つにする)
+	 * @param  n     頂点の数 (3 〜 MAX_EDGES)
+	 * @return 凸多角形でなければ何もせず false
+	 */
+	bool setPolygon(int i, const double *xs, const double *ys, int n) {
+		if (i < 0 || n < 3 || n > MAX_EDGES) return false;
+		Shape sh;
+		for (int k = 0; k < n; k++) {
+			if (sh.n > 0 && xs[k] == sh.vx[sh.n - 1] && ys[k] == sh.vy[sh.n - 1]) continue;
+			sh.vx[sh.n] = xs[k];
+			sh.vy[sh.n] = ys[k];
+			sh.n++;
+		}
+		if (sh.n > 1 && sh.vx[0] == sh.vx[sh.n - 1] && sh.vy[0] == sh.vy[sh.n - 1]) sh.n--;
+		if (sh.n < 3) return false;
+		double area = 0.0;
+		for (int k = 0; k < sh.n; k++) {
+			int l = (k + 1) % sh.n;
+			area += sh.vx[k] * sh.vy[l] - sh.vx[l] * sh.vy[k];
+		}
+		if (area == 0.0) return false;
+		if (area < 0.0) {
+			std::reverse(sh.vx, sh.vx + sh.n);
+			std::reverse(sh.vy, sh.vy + sh.n);
+		}
+		for (int k = 0; k < sh.n; k++) {
+			int l = (k + 1) % sh.n, m = (k + 2) % sh.n;
+			double ex = sh.vx[l] - sh.vx[k], ey = sh.vy[l] - sh.vy[k];
+			double fx = sh.vx[m] - sh.vx[l], fy = sh.vy[m] - sh.vy[l];
+			if (ex * fy - ey * fx < -1e-9 * (fabs(area) + 1.0)) return false;	// 凹んでいる
+			// 左回りなので外向きの法線は辺を右に 90 度回した向き
+			double len = sqrt(ex * ex + ey * ey);
+			sh.nx[k] = ey / len;
+			sh.ny[k] = -ex / len;
+			sh.d[k] = sh.nx[k] * sh.vx[k] + sh.ny[k] * sh.vy[k];
+		}
+		for (int j = 0; j < sh.n; j++) {
+			int p = (j + sh.n - 1) % sh.n;
+			double k = 1.0 / (1.0 + sh.nx[p] * sh.nx[j] + sh.ny[p] * sh.ny[j]);
+			sh.mx[j] = (sh.nx[p] + sh.nx[j]) * k;
+			sh.my[j] = (sh.ny[p] + sh.ny[j]) * k;
+		}
+		// 膨らませても一番下になる頂点は同じ (辺の向きは変わらない)
+		for (int k = 0; k < sh.n; k++) {
+			int low = 0;
+			for (int j = 1; j < sh.n; j++) {
+				if (sh.nx[k] * sh.vx[j] + sh.ny[k] * sh.vy[j] < sh.nx[k] * sh.vx[low] + sh.ny[k] * sh.vy[low]) low = j;
+			}
+			sh.lo[k] = sh.nx[k] * sh.vx[low] + sh.ny[k] * sh.vy[low];
+			sh.c[k] = sh.nx[k] * sh.mx[low] + sh.ny[k] * sh.my[low];
+		}
+		if (i >= size()) resize(i + 1);
+		m_shapes[i] = sh;
+		if (sh.n > m_slots) relayout();
+		else store(i);
+		return true;
+	}
+
+	// i 番目の頂点 (左回り)
+	int vertexCount(int i) const { return m_shapes[i].n; }
+	double vertexX(int i, int j) const { return m_shapes[i].vx[j]; }
+	double vertexY(int i, int j) const { return m_shapes[i].vy[j]; }
+	/* @brief  r だけ膨らませた多角形の j 番目の頂点 (両側の辺を r だけ外に出した直線の交点)
+	 */
+	void offsetVertex(int i, int j, double r, double &x, double &y) const {
+		const Shape &sh = m_shapes[i];
+		x = sh.vx[j] + sh.mx[j] * r;
+		y = sh.vy[j] + sh.my[j] * r;
+	}
+
+	// 点が i 番目を r だけ膨らませた内側にあるか (辺の上は外)
+	bool contains(int i, double x, double y, double r) const {
+		const Shape &sh = m_shapes[i];
+		if (sh.n == 0) return false;
+		for (int k = 0; k < sh.n; k++) {
+			if (sh.nx[k] * x + sh.ny[k] * y >= sh.d[k] + r) return false;
+		}
+		return true;
+	}
+
+	/* @brief  線分 a-b が障害物ごとに内側を通るか (すべての障害物を1回で調べる)
+	 * @param  inflate 障害物ごとに膨らませる距離 (stride() 個。0 以上。-HUGE_VAL ならその障害物は調べない)
+	 * @param  hit     障害物ごとに、通れば 1 (stride() 個。size() より後ろは 0)
+	 */
+	void segmentMask(double ax, double ay, double bx, double by, const double *inflate, char *hit) const {
+		for (int b = 0; b < m_stride; b += LANES) satBlock(ax, ay, bx, by, inflate, b, hit + b);
+	}
+	// 線分 a-b がどれかの障害物の内側を通るか (通る障害物があった LANES 個の組で止める)
+	bool segmentHits(double ax, double ay, double bx, double by, const double *inflate) const {
+		char hit[LANES];
+		for (int b = 0; b < m_stride; b += LANES) {
+			satBlock(ax, ay, bx, by, inflate, b, hit);
+			char any = 0;
+			for (int l = 0; l < LANES; l++) any |= hit[l];
+			if (any) return true;
+		}
+		return false;
+	}
+	// すべての障害物を同じ r だけ膨らませて調べる
+	bool segmentHits(double ax, double ay, double bx, double by, double r) const {
+		return segmentHits(ax, ay, bx, by, inflation(r));
+	}
+
+	/* @brief  経路のすべての線分を、すべての障害物を r だけ膨らませて調べる
+	 * @return 最初に障害物の内側を通る線分の番号 (route[k] から route[k + 1])。どれも通らなければ -1
+	 */
+	template <class Node>
+	int routeHits(const std::vector<Node> &route, double r) const {
+		const double *inf = inflation(r);
+		for (size_t k = 0; k + 1 < route.size(); k++) {
+			if (segmentHits(route[k].x, route[k].y, route[k + 1].x, route[k + 1].y, inf)) return (int)k;
+		}
+		return -1;
+	}
+
+	// segmentMask() に渡す配列の長さ (size() を LANES の倍数に切り上げた数)
+	int stride() const { return m_stride; }
+	// 辺・頂点の並びの段数 (一番辺の多い障害物の辺の数)
+	int slots() const { return m_slots; }
+	// すべての障害物を r だけ膨らませる inflate (stride() 個。次に呼ぶまで使える)
+	const double *inflation(double r) const {
+		if (m_uniform.size() != (size_t)m_stride || (m_stride > 0 && m_uniform[0] != r)) m_uniform.assign(m_stride, r);
+		return m_stride > 0 ? &m_uniform[0] : NULL;
+	}
+
+private:
+	struct Shape {
+		int n;		// 辺の数 (0 なら空)
+		double vx[MAX_EDGES], vy[MAX_EDGES];
+		double nx[MAX_EDGES], ny[MAX_EDGES], d[MAX_EDGES];	// k 番目の辺 (頂点 k から k + 1) の外向きの単位法線と n・p の上限
+		double lo[MAX_EDGES], c[MAX_EDGES];					// n・p の下限 (膨らませると lo + r * c)
+		double mx[MAX_EDGES], my[MAX_EDGES];				// 膨らませたときに頂点が動く向き (r = 1 のとき)
+		Shape() : n(0) {}
+	};
+
+	/* @brief  b 番目から LANES 個の障害物と線分を分離軸で調べる
+	 * まず線分を囲む長方形と、膨らませた障害物を囲む長方形が重なるかを調べ、どれも重ならなければそこで止める
+	 * 重なれば、辺の法線 n に射影した線分の両端が両方 d + r 以上か lo + r * c 以下 (触れるだけも含む。隙間 gap が 0 以上)、
+	 * または線分の法線に射影した頂点がすべて線分の片側にあれば、通らない
+	 * 辺の数を揃えるための辺は d = +HUGE_VAL, lo = -HUGE_VAL で頂点 0 を繰り返し、空の障害物は d = -HUGE_VAL (必ず離れている)
+	 * にしてあるので、分岐なしで同じ式で扱える。長さ 0 の線分は点として、辺の法線だけで調べる
+	 */
+	void satBlock(double ax, double ay, double bx, double by, const double *inflate, int b, char *hit) const {
+		double sxlo = std::min(ax, bx), sxhi = std::max(ax, bx);
+		double sylo = std::min(ay, by), syhi = std::max(ay, by);
+		double r[LANES];
+		char box[LANES], any = 0;
+		for (int l = 0; l < LANES; l++) {
+			r[l] = inflate[b + l];
+			// 膨らませた多角形の頂点は r * m_grow までしか外に出ない
+			double e = (r[l] > 0.0) ? r[l] * m_grow[b + l] : 0.0;
+			box[l] = (sxhi > m_xlo[b + l] - e) & (sxlo < m_xhi[b + l] + e) & (syhi > m_ylo[b + l] - e) & (sylo < m_yhi[b + l] + e);
+			any |= box[l];
+		}
+		if (!any) {
+			for (int l = 0; l < LANES; l++) hit[l] = 0;
+			return;
+		}
+
+		// 線分の法線 (ux, uy) と、そこに射影した線分 (1点になる)
+		double ux = ay - by, uy = bx - ax;
+		double sa = ux * ax + uy * ay;
+		char line = (ux != 0.0 || uy != 0.0);
+		// gap は辺の法線に射影したときの線分と多角形の隙間の最大 (0 以上なら離れている)
+		double gap[LANES], qlo[LANES], qhi[LANES];
+		for (int l = 0; l < LANES; l++) {
+			gap[l] = -HUGE_VAL;
+			qlo[l] = HUGE_VAL;
+			qhi[l] = -HUGE_VAL;
+		}
+		int slots = m_blockSlots[b / LANES];
+		for (int k = 0; k < slots; k++) {
+			int at = k * m_stride + b;
+			const double *nx = &m_nx[at], *ny = &m_ny[at], *d = &m_d[at], *lo = &m_lo[at], *c = &m_c[at];
+			for (int l = 0; l < LANES; l++) {
+				double pa = nx[l] * ax + ny[l] * ay, pb = nx[l] * bx + ny[l] * by;
+				double hi = d[l] + r[l], low = lo[l] + r[l] * c[l];
+				double g = std::max(std::min(pa, pb) - hi, low - std::max(pa, pb));
+				gap[l] = (g > gap[l]) ? g : gap[l];
+			}
+		}
+		// 辺の法線で全部離れていれば、線分の法線は調べない
+		char open = 0;
+		for (int l = 0; l < LANES; l++) open |= box[l] & (gap[l] < 0.0);
+		if (open && line) {
+			for (int k = 0; k < slots; k++) {
+				int at = k * m_stride + b;
+				const double *vx = &m_vx[at], *vy = &m_vy[at], *mx = &m_mx[at], *my = &m_my[at];
+				for (int l = 0; l < LANES; l++) {
+					double q = ux * (vx[l] + r[l] * mx[l]) + uy * (vy[l] + r[l] * my[l]);
+					qlo[l] = (q < qlo[l]) ? q : qlo[l];
+					qhi[l] = (q > qhi[l]) ? q : qhi[l];
+				}
+			}
+		}
+		for (int l = 0; l < LANES; l++) {
+			char sep = (gap[l] >= 0.0) | (line & ((qhi[l] <= sa) | (qlo[l] >= sa)));
+			hit[l] = box[l] & !sep;
+		}
+	}
+
+	// i 番目の辺・頂点・囲む長方形を SoA の並びに書く
+	void store(int i) {
+		const Shape &sh = m_shapes[i];
+		for (int k = 0; k < m_slots; k++) {
+			int at = k * m_stride + i;
+			int v = (k < sh.n) ? k : 0;		// 足りない頂点は頂点 0 を繰り返す
+			if (k < sh.n) {
+				m_nx[at] = sh.nx[k];
+				m_ny[at] = sh.ny[k];
+				m_d[at] = sh.d[k];
+				m_lo[at] = sh.lo[k];
+				m_c[at] = sh.c[k];
+			} else {
+				m_nx[at] = m_ny[at] = 0.0;
+				m_d[at] = (sh.n == 0) ? -HUGE_VAL : HUGE_VAL;
+				m_lo[at] = -HUGE_VAL;
+				m_c[at] = 0.0;
+			}
+			m_vx[at] = (sh.n > 0) ? sh.vx[v] : 0.0;
+			m_vy[at] = (sh.n > 0) ? sh.vy[v] : 0.0;
+			m_mx[at] = (sh.n > 0) ? sh.mx[v] : 0.0;
+			m_my[at] = (sh.n > 0) ? sh.my[v] : 0.0;
+		}
+		m_xlo[i] = m_ylo[i] = HUGE_VAL;
+		m_xhi[i] = m_yhi[i] = -HUGE_VAL;
+		m_grow[i] = 1.0;
+		for (int j = 0; j < sh.n; j++) {
+			m_xlo[i] = std::min(m_xlo[i], sh.vx[j]);
+			m_xhi[i] = std::max(m_xhi[i], sh.vx[j]);
+			m_ylo[i] = std::min(m_ylo[i], sh.vy[j]);
+			m_yhi[i] = std::max(m_yhi[i], sh.vy[j]);
+			m_grow[i] = std::max(m_grow[i], std::max(fabs(sh.mx[j]), fabs(sh.my[j])));
+		}
+		// LANES 個の組ごとに、一番辺の多い障害物の辺の数だけ調べる
+		int b = i / LANES, slots = 1;
+		for (int j = b * LANES; j < (b + 1) * LANES && j < size(); j++) slots = std::max(slots, m_shapes[j].n);
+		m_blockSlots[b] = slots;
+	}
+	// 障害物の数・辺の数が変わったら並べ直す
+	void relayout() {
+		int n = size();
+		m_stride = (n + LANES - 1) / LANES * LANES;
+		m_slots = (n > 0) ? 1 : 0;		// すべて空でも1段は並べる (空は d = -HUGE_VAL で外にする)
+		for (int i = 0; i < n; i++) m_slots = std::max(m_slots, m_shapes[i].n);
+		m_nx.assign(m_slots * m_stride, 0.0);
+		m_ny.assign(m_slots * m_stride, 0.0);
+		m_d.assign(m_slots * m_stride, -HUGE_VAL);	// 番号の空き (size() より後ろ) は空
+		m_lo.assign(m_slots * m_stride, -HUGE_VAL);
+		m_c.assign(m_slots * m_stride, 0.0);
+		m_vx.assign(m_slots * m_stride, 0.0);
+		m_vy.assign(m_slots * m_stride, 0.0);
+		m_mx.assign(m_slots * m_stride, 0.0);
+		m_my.assign(m_slots * m_stride, 0.0);
+		m_xlo.assign(m_stride, HUGE_VAL);
+		m_xhi.assign(m_stride, -HUGE_VAL);
+		m_ylo.assign(m_stride, HUGE_VAL);
+		m_yhi.assign(m_stride, -HUGE_VAL);
+		m_grow.assign(m_stride, 1.0);
+		m_blockSlots.assign(m_stride / LANES, 1);
+		for (int i = 0; i < n; i++) store(i);
+	}
+
+	std::vector<Shape> m_shapes;
+	int m_slots, m_stride;
+	std::vector<double> m_nx, m_ny, m_d, m_lo, m_c;		// 辺 (段 k、障害物 i の順)
+	std::vector<double> m_vx, m_vy, m_mx, m_my;			// 頂点と膨らませたときに動く向き
+	std::vector<double> m_xlo, m_xhi, m_ylo, m_yhi, m_grow;	// 障害物を囲む長方形と、膨らませたときに広がる割合
+	std::vector<int> m_blockSlots;								// LANES 個の組ごとの辺の数
+	mutable std::vector<double> m_uniform;		// inflation() の作業用
+};
+
+#endif
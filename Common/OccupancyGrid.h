@@ -0,0 +1,207 @@
+// GridPlanner と DStarLite が共有する占有格子
+// ・障害物は床の上の長方形 (中心 x y と 幅 奥行き。Obstacle::setPosition と同じ並び。y はワールドの z)
+// ・升目は3種類 (説明は GridPlanner.h)
+//     FREE     障害物からロボットの半径以上離れている
+//     MARGIN   半径より近い (角は丸める)。通れるが費用を MARGIN_COST 倍にする
+//     OBSTACLE 障害物 (升目1つ分だけ膨らませる)。通れない
+// ・ここにあるのは格子の範囲の決め方・升目の番号・障害物の塗り方・障害物の中からの出方・升目の列の間引き方
+//   探し方 (A* / D* Lite) と費用の付け方は各プランナーが持つ
+#ifndef _OCCUPANCY_GRID_H_
+#define _OCCUPANCY_GRID_H_
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+class OccupancyGrid {
+public:
+	enum { FREE = 0, MARGIN, OBSTACLE };
+	enum { MARGIN_COST = 8 };
+
+	explicit OccupancyGrid(double cellSize) : m_cell(cellSize > 0.0 ? cellSize : 5.0), m_x0(0.0), m_y0(0.0), m_nx(0), m_ny(0) {}
+
+	double cellSize() const { return m_cell; }
+	int gridWidth() const { return m_nx; }
+	int gridHeight() const { return m_ny; }
+	// (x, y) の升目の種類 (FREE / MARGIN / OBSTACLE)。plan() の後で使う
+	int cellClass(double x, double y) const { return m_nx > 0 ? m_occ[cellIndex(x, y)] : FREE; }
+
+protected:
+	struct Rect {
+		double x, y, w, h;		// w が負なら置いていない
+	};
+	struct Point {
+		double x, y;
+		char cls;
+	};
+
+	// 長方形から r 以内か (角は丸める)
+	static bool within(const Rect &o, double x, double y, double r) {
+		double dx = fabs(x - o.x) - o.w / 2, dy = fabs(y - o.y) - o.h / 2;
+		if (dx <= 0.0 && dy <= 0.0) return true;
+		if (dx < 0.0) dx = 0.0;
+		if (dy < 0.0) dy = 0.0;
+		return dx * dx + dy * dy < r * r;
+	}
+
+	// 置いてある障害物を含むように範囲を広げる
+	static void obstacleBounds(const std::vector<Rect> &obs, double &xmin, double &ymin, double &xmax, double &ymax) {
+		for (size_t i = 0; i < obs.size(); i++) {
+			const Rect &r = obs[i];
+			if (r.w < 0.0) continue;
+			xmin = std::min(xmin, r.x - r.w / 2);
+			xmax = std::max(xmax, r.x + r.w / 2);
+			ymin = std::min(ymin, r.y - r.h / 2);
+			ymax = std::max(ymax, r.y + r.h / 2);
+		}
+	}
+
+	double centerX(int c) const { return m_x0 + (c % m_nx + 0.5) * m_cell; }
+	double centerY(int c) const { return m_y0 + (c / m_nx + 0.5) * m_cell; }
+
+	int cellIndex(double x, double y) const {
+		int cx = (int)floor((x - m_x0) / m_cell), cy = (int)floor((y - m_y0) / m_cell);
+		if (cx < 0) cx = 0;
+		if (cy < 0) cy = 0;
+		if (cx >= m_nx) cx = m_nx - 1;
+		if (cy >= m_ny) cy = m_ny - 1;
+		return cy * m_nx + cx;
+	}
+
+	// 格子の端から margin より内側か
+	bool inside(double x, double y, double margin) const {
+		return m_nx > 0 && x >= m_x0 + margin && y >= m_y0 + margin &&
+		       x <= m_x0 + m_nx * m_cell - margin && y <= m_y0 + m_ny * m_cell - margin;
+	}
+
+	// 範囲を margin だけ広げて升目の境目に合わせた格子にし、すべて FREE にする。@return 升目の数
+	int layout(double xmin, double ymin, double xmax, double ymax, double margin) {
+		m_x0 = floor((xmin - margin) / m_cell) * m_cell;
+		m_y0 = floor((ymin - margin) / m_cell) * m_cell;
+		m_nx = (int)ceil((xmax + margin - m_x0) / m_cell);
+		m_ny = (int)ceil((ymax + margin - m_y0) / m_cell);
+		m_occ.assign(m_nx * m_ny, FREE);
+		return m_nx * m_ny;
+	}
+
+	// 長方形の影響 (半径 clearance と升目1つ分の大きい方) が届く升目の範囲 (左下 c0、右上 c1)
+	void reach(const Rect &r, double clearance, int &c0, int &c1) const {
+		double d = std::max(clearance, m_cell);
+		double ex = r.w / 2 + d, ey = r.h / 2 + d;
+		c0 = cellIndex(r.x - ex, r.y - ey);
+		c1 = cellIndex(r.x + ex, r.y + ey);
+	}
+
+	// 障害物を塗る (障害物ごとに外接する升目だけ見る)
+	void paint(const std::vector<Rect> &obs, double clearance) {
+		for (size_t i = 0; i < obs.size(); i++) {
+			const Rect &r = obs[i];
+			if (r.w < 0.0) continue;
+			int c0, c1;
+			reach(r, clearance, c0, c1);
+			for (int cy = c0 / m_nx; cy <= c1 / m_nx; cy++) {
+				for (int cx = c0 % m_nx; cx <= c1 % m_nx; cx++) {
+					int c = cy * m_nx + cx;
+					if (m_occ[c] == OBSTACLE) continue;
+					double x = centerX(c), y = centerY(c);
+					if (within(r, x, y, m_cell)) m_occ[c] = OBSTACLE;
+					else if (within(r, x, y, clearance)) m_occ[c] = MARGIN;
+				}
+			}
+		}
+	}
+
+	// c から一番近い通れる升目 (四角く1周ずつ広げる)。無ければ -1
+	int nearestPassable(int c) const {
+		if (m_occ[c] != OBSTACLE) return c;
+		int cx = c % m_nx, cy = c / m_nx;
+		int maxR = std::max(m_nx, m_ny);
+		for (int r = 1; r <= maxR; r++) {
+			int best = -1;
+			double bestD = 0.0;
+			for (int y = cy - r; y <= cy + r; y++) {
+				if (y < 0 || y >= m_ny) continue;
+				int step = (y == cy - r || y == cy + r) ? 1 : 2 * r;
+				for (int x = cx - r; x <= cx + r; x += step) {
+					if (x < 0 || x >= m_nx || m_occ[y * m_nx + x] == OBSTACLE) continue;
+					double d = (double)(x - cx) * (x - cx) + (double)(y - cy) * (y - cy);
+					if (best < 0 || d < bestD) {
+						best = y * m_nx + x;
+						bestD = d;
+					}
+				}
+			}
+			if (best >= 0) return best;
+		}
+		return -1;
+	}
+
+	// 升目 a から b までの octile 距離
+	double octile(int a, int b) const {
+		double dx = abs(a % m_nx - b % m_nx), dy = abs(a / m_nx - b / m_nx);
+		return m_cell * ((dx + dy) + (M_SQRT2 - 2.0) * std::min(dx, dy));
+	}
+
+	// 2点を結ぶ線分が worst より悪い種類の升目を通らないか (升目の 1/4 ごとに調べる)
+	bool visible(double x0, double y0, double x1, double y1, int worst) const {
+		double dx = x1 - x0, dy = y1 - y0;
+		int n = (int)ceil(sqrt(dx * dx + dy * dy) / (m_cell * 0.25));
+		for (int i = 0; i <= n; i++) {
+			double t = (n == 0) ? 0.0 : (double)i / n;
+			if (m_occ[cellIndex(x0 + dx * t, y0 + dy * t)] > worst) return false;
+		}
+		return true;
+	}
+
+	void pushPoint(double x, double y, int cls) {
+		Point p;
+		p.x = x;
+		p.y = y;
+		p.cls = (char)cls;
+		m_pts.push_back(p);
+	}
+	// 出発点・目的地の点 (障害物の中でも MARGIN として扱う)
+	void pushEndpoint(double x, double y) { pushPoint(x, y, std::min((int)m_occ[cellIndex(x, y)], (int)MARGIN)); }
+
+	/* @brief  m_pts (出発点・升目の中心の列・目的地) を見通しの良い点まで飛ばして経路にする
+	 * 飛ばした線分は、飛ばされた升目より悪い種類の升目を通らない
+	 * 障害物の中の出発点・目的地は、一番近い升目との間を必ず通る
+	 * @param  route 出発点から目的地までの点 (後ろに足す)
+	 */
+	template <class Node>
+	void thin(double sx, double sy, double gx, double gy, std::vector<Node> &route) const {
+		const std::vector<Point> &pts = m_pts;
+		size_t i = (m_occ[cellIndex(sx, sy)] == OBSTACLE) ? 1 : 0;
+		size_t last = (m_occ[cellIndex(gx, gy)] == OBSTACLE) ? pts.size() - 2 : pts.size() - 1;
+		route.push_back(Node(sx, sy));
+		if (i == 1) route.push_back(Node(pts[1].x, pts[1].y));
+		while (i < last) {
+			size_t j = i + 1;
+			int worst = std::max(pts[i].cls, pts[j].cls);
+			while (j < last) {
+				int w = std::max(worst, (int)pts[j + 1].cls);
+				if (!visible(pts[i].x, pts[i].y, pts[j + 1].x, pts[j + 1].y, w)) break;
+				worst = w;
+				j++;
+			}
+			route.push_back(Node(pts[j].x, pts[j].y));
+			i = j;
+		}
+		if (last + 1 < pts.size()) route.push_back(Node(gx, gy));
+		// 出発点と目的地が同じ升目などで重なった点を除く
+		for (size_t k = 1; k < route.size();) {
+			if (route[k].x == route[k - 1].x && route[k].y == route[k - 1].y) route.erase(route.begin() + k);
+			else k++;
+		}
+		if (route.size() == 1) route.push_back(Node(gx, gy));
+	}
+
+	double m_cell;
+	double m_x0, m_y0;			// 格子の左下
+	int m_nx, m_ny;
+	std::vector<char> m_occ;	// 升目の種類 (FREE / MARGIN / OBSTACLE)
+	std::vector<Point> m_pts;	// 間引く前の点の列 (毎回確保しない)
+};
+
+#endif
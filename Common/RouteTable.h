@@ -0,0 +1,248 @@
+// 決まった場所(アンカー)どうしの経路と移動時間の表
+// ・掃除の間、ロボットは同じ場所の間を何度も行き来する (初期位置・ゴミを掴む位置・ゴミ箱の前)
+//   その場所をアンカーとして登録しておくと、すべての組の経路を VisibilityPlanner で求めて覚えておく
+// ・障害物・アンカーが変わったときだけ表を作り直す (setObstacle / setAnchor は変わらなければ何もしない)
+//   表を引くのは route(from, to) / travelTime(from, to) で O(1)
+// ・移動時間は 直線の長さ / 進む速さ + 曲がり角で向きを変える角度 / 回転の速さ (出発するときの回転は、向いている方向を与えたときだけ含める)
+//   setSpeed() すると、表の経路はこの移動時間が最短の経路になる (VisibilityPlanner::setSpeed)
+// ・アンカーの近く(snap 以内)からの経路は lookup() で引く。表の経路の途中の点のうち、まっすぐ行けて乗った後の移動時間が一番短い点から表の経路に乗る
+//   近くにアンカーが無い・まっすぐ行けないときはその場で計画する (サービスには問い合わせない)
+//
+// 使い方
+//   RouteTable routes(TRUCK_RADIUS);
+//   routes.setSpeed(40.0, 2.0);
+//   routes.setObstacle(i, x, z, width, depth, angle);  routes.setAnchor(a, x, z);	// 障害物・アンカーごと
+//   routes.update();															// 変わっていたら表を作り直す
+//   std::vector<RoutePoint> route;
+//   if (routes.lookup(myX, myZ, a, 50.0, route)) { ... route[0] が今の位置、最後がアンカー a }
+#ifndef _ROUTE_TABLE_H_
+#define _ROUTE_TABLE_H_
+
+#include <math.h>
+#include <vector>
+#include "VisibilityPlanner.h"
+
+// 経路の点 (x, y。y はワールドの z)
+struct RoutePoint {
+	double x, y;
+	RoutePoint(double x = 0.0, double y = 0.0) : x(x), y(y) {}
+};
+
+class RouteTable {
+public:
+	explicit RouteTable(double clearance = 0.0)
+		: m_planner(clearance), m_drive(1.0), m_turn(1.0), m_dirty(true), m_builds(0), m_hits(0), m_misses(0) {}
+
+	void setClearance(double clearance) {
+		if (clearance != m_planner.clearance()) {
+			m_planner.setClearance(clearance);
+			m_dirty = true;
+		}
+	}
+	/* @brief  移動時間の計算に使う速さ
+	 * @param  drive 進む速さ [cm/s]
+	 * @param  turn  その場で回転する速さ [rad/s]
+	 */
+	void setSpeed(double drive, double turn) {
+		if (drive > 0.0 && turn > 0.0 && (drive != m_drive || turn != m_turn)) {
+			m_drive = drive;
+			m_turn = turn;
+			m_planner.setSpeed(drive, turn);
+			m_dirty = true;
+		}
+	}
+
+	// i 番目の障害物を置き直す (足りなければ足す。幅が負なら無い。angle は長方形の向き [rad])。変わらなければ表はそのまま
+	void setObstacle(int i, double x, double y, double width, double height, double angle = 0.0) {
+		if (i < 0) return;
+		if (i >= (int)m_obs.size()) {
+			Rect none = { 0.0, 0.0, -1.0, -1.0, 0.0 };
+			m_obs.resize(i + 1, none);
+		}
+		Rect &r = m_obs[i];
+		if (r.x == x && r.y == y && r.w == width && r.h == height && r.a == angle) return;
+		r.x = x;
+		r.y = y;
+		r.w = width;
+		r.h = height;
+		r.a = angle;
+		m_planner.setObstacle(i, x, y, width, height, angle);
+		m_dirty = true;
+	}
+	void resizeObstacles(int n) {
+		if (n >= 0 && n < (int)m_obs.size()) {
+			m_obs.resize(n);
+			m_planner.resizeObstacles(n);
+			m_dirty = true;
+		}
+	}
+	int obstacleCount() const { return (int)m_obs.size(); }
+
+	// a 番目のアンカーを置き直す (足りなければ足す)。変わらなければ表はそのまま
+	void setAnchor(int a, double x, double y) {
+		if (a < 0) return;
+		if (a >= (int)m_anchors.size()) {
+			m_anchors.resize(a + 1, RoutePoint(HUGE_VAL, HUGE_VAL));
+		}
+		if (m_anchors[a].x == x && m_anchors[a].y == y) return;
+		m_anchors[a] = RoutePoint(x, y);
+		m_dirty = true;
+	}
+	void resizeAnchors(int n) {
+		if (n >= 0 && n < (int)m_anchors.size()) {
+			m_anchors.resize(n);
+			m_dirty = true;
+		}
+	}
+	int anchorCount() const { return (int)m_anchors.size(); }
+	const RoutePoint &anchor(int a) const { return m_anchors[a]; }
+
+	// 障害物・アンカーが変わっていたら、すべての組の経路を求め直す
+	void update() {
+		if (!m_dirty) return;
+		int n = (int)m_anchors.size();
+		m_routes.assign(n * n, std::vector<RoutePoint>());
+		m_length.assign(n * n, -1.0);
+		m_time.assign(n * n, -1.0);
+		for (int i = 0; i < n; i++) {
+			m_length[i * n + i] = 0.0;
+			m_time[i * n + i] = 0.0;
+			m_routes[i * n + i].push_back(m_anchors[i]);
+			if (!placed(i)) continue;
+			for (int j = i + 1; j < n; j++) {
+				if (!placed(j)) continue;
+				std::vector<RoutePoint> &r = m_routes[i * n + j];
+				if (!m_planner.plan(m_anchors[i].x, m_anchors[i].y, m_anchors[j].x, m_anchors[j].y, r)) continue;
+				// 逆向きは同じ点を逆に辿る
+				m_routes[j * n + i].assign(r.rbegin(), r.rend());
+				m_length[i * n + j] = m_length[j * n + i] = length(r);
+				m_time[i * n + j] = travelTime(r);
+				m_time[j * n + i] = travelTime(m_routes[j * n + i]);
+			}
+		}
+		m_builds++;
+		m_dirty = false;
+	}
+
+	// from から to への経路があるか (update() の後で使う)
+	bool has(int from, int to) const { return valid(from) && valid(to) && m_length[from * m_anchors.size() + to] >= 0.0; }
+	// from から to への経路 (最初が from、最後が to。無ければ空)
+	const std::vector<RoutePoint> &route(int from, int to) const {
+		static const std::vector<RoutePoint> none;
+		return (valid(from) && valid(to)) ? m_routes[from * m_anchors.size() + to] : none;
+	}
+	// 経路の長さと移動時間 (無ければ -1)
+	double length(int from, int to) const { return (valid(from) && valid(to)) ? m_length[from * m_anchors.size() + to] : -1.0; }
+	double travelTime(int from, int to) const { return (valid(from) && valid(to)) ? m_time[from * m_anchors.size() + to] : -1.0; }
+
+	// (x, y) から r 以内で一番近いアンカー。無ければ -1
+	int nearestAnchor(double x, double y, double r) const {
+		int best = -1;
+		double bestD = r * r;
+		for (size_t a = 0; a < m_anchors.size(); a++) {
+			double dx = m_anchors[a].x - x, dy = m_anchors[a].y - y;
+			if (dx * dx + dy * dy <= bestD) {
+				best = (int)a;
+				bestD = dx * dx + dy * dy;
+			}
+		}
+		return best;
+	}
+
+	/* @brief  (x, y) からアンカー to への経路
+	 * snap 以内にアンカーがあれば、表の経路の点のうち (x, y) からまっすぐ行けて、乗った後の移動時間が一番短い点から乗る
+	 * @param  x y     今の位置
+	 * @param  heading 今向いている方向 [rad] (atan2(dy, dx))。HUGE_VAL なら最初の回転は考えない
+	 * @param  to      行き先のアンカー
+	 * @param  snap    表を使うアンカーまでの距離
+	 * @param  out     今の位置から to までの点 (前の中身は消す)
+	 * @return 経路が見つかったら true
+	 */
+	template <class Node>
+	bool lookup(double x, double y, double heading, int to, double snap, std::vector<Node> &out) {
+		out.clear();
+		update();
+		if (!valid(to) || !placed(to)) return false;
+		int from = nearestAnchor(x, y, snap);
+		if (from >= 0 && has(from, to)) {
+			const std::vector<RoutePoint> &r = route(from, to);
+			int best = -1;
+			double bestTime = HUGE_VAL, rest = 0.0;		// rest は r[k] から最後までの時間
+			for (int k = (int)r.size() - 1; k >= 1; k--) {
+				if (k + 1 < (int)r.size()) {
+					rest += hypot(r[k + 1].x - r[k].x, r[k + 1].y - r[k].y) / m_drive;
+					if (k + 2 < (int)r.size()) rest += turnTime(r[k], r[k + 1], r[k + 2]);
+				}
+				if (!m_planner.visible(x, y, r[k].x, r[k].y)) continue;
+				double in = atan2(r[k].y - y, r[k].x - x);
+				double t = hypot(r[k].x - x, r[k].y - y) / m_drive + rest;
+				if (heading != HUGE_VAL) t += VisibilityPlanner::turnAngle(heading, in) / m_turn;
+				if (k + 1 < (int)r.size()) t += turnTime(RoutePoint(x, y), r[k], r[k + 1]);
+				if (t < bestTime) {
+					best = k;
+					bestTime = t;
+				}
+			}
+			if (best >= 1) {
+				out.push_back(Node(x, y));
+				for (size_t i = best; i < r.size(); i++) out.push_back(Node(r[i].x, r[i].y));
+				m_hits++;
+				return true;
+			}
+		}
+		m_misses++;
+		return m_planner.plan(x, y, heading, m_anchors[to].x, m_anchors[to].y, out);
+	}
+	template <class Node>
+	bool lookup(double x, double y, int to, double snap, std::vector<Node> &out) {
+		return lookup(x, y, HUGE_VAL, to, snap, out);
+	}
+
+	// 経路の長さ・移動時間 (この表の速さで)
+	template <class Node>
+	static double length(const std::vector<Node> &route) {
+		double len = 0.0;
+		for (size_t i = 1; i < route.size(); i++) {
+			len += hypot(route[i].x - route[i - 1].x, route[i].y - route[i - 1].y);
+		}
+		return len;
+	}
+	// heading は出発点で向いている方向 [rad] (HUGE_VAL なら最初の回転は含めない)
+	template <class Node>
+	double travelTime(const std::vector<Node> &route, double heading = HUGE_VAL) const {
+		return VisibilityPlanner::travelTime(route, m_drive, m_turn, heading);
+	}
+
+	VisibilityPlanner &planner() { return m_planner; }
+	// 表を作った回数、lookup() で表を使えた回数・その場で計画した回数
+	long builds() const { return m_builds; }
+	long hits() const { return m_hits; }
+	long misses() const { return m_misses; }
+
+private:
+	struct Rect {
+		double x, y, w, h, a;
+	};
+
+	bool valid(int a) const { return !m_dirty && a >= 0 && a < (int)m_anchors.size(); }
+	// a から b に来て c に向きを変える時間
+	double turnTime(const RoutePoint &a, const RoutePoint &b, const RoutePoint &c) const {
+		return VisibilityPlanner::turnAngle(atan2(b.y - a.y, b.x - a.x), atan2(c.y - b.y, c.x - b.x)) / m_turn;
+	}
+	// 間を飛ばして setAnchor したときの、まだ置いていないアンカーでないか
+	bool placed(int a) const { return m_anchors[a].x != HUGE_VAL; }
+
+	VisibilityPlanner m_planner;
+	std::vector<Rect> m_obs;				// 変わったかを調べるための写し
+	std::vector<RoutePoint> m_anchors;
+	double m_drive, m_turn;
+	bool m_dirty;
+
+	// アンカーの組 (from * アンカーの数 + to) ごとの経路・長さ・移動時間
+	std::vector<std::vector<RoutePoint> > m_routes;
+	std::vector<double> m_length;
+	std::vector<double> m_time;
+	long m_builds, m_hits, m_misses;
+};
+
+#endif
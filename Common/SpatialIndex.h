@@ -0,0 +1,277 @@
+// x/z 平面上の点(ゴミ・ゴミ箱など)の空間索引 (一様格子)
+// ・点は番号(EntityRegistry の番号など、0 以上の整数)で登録する。拾ったゴミは remove() で外す
+// ・格子の升目はハッシュ表に入れるので、部屋の広さを先に決めなくてよい
+// ・問い合わせ
+//     nearest   一番近い点 (升目を内側から1周ずつ広げ、残りの周にそれより近い点が無くなったら止める)
+//     nearestK  近い順に k 個
+//     radius    半径 r 以内の点 (近い順)
+// ・升目の大きさは、1升目に点が数個入るくらいにする (cellSizeFor() で決められる)
+//
+// 使い方
+//   SpatialIndex index(100.0);
+//   index.insert(id, pos.x(), pos.z());
+//   int nearestId = index.nearest(myPos.x(), myPos.z());   // 無ければ -1
+//   index.remove(nearestId);
+// 速さは OfflineSim/SpatialBench.cpp で線形探索と比べられる
+#ifndef _SPATIAL_INDEX_H_
+#define _SPATIAL_INDEX_H_
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+class SpatialIndex {
+public:
+	explicit SpatialIndex(double cellSize = 100.0) : m_cell(cellSize), m_mask(0), m_size(0) {
+		if (m_cell <= 0.0) m_cell = 100.0;
+		m_buckets.resize(16);
+		m_mask = 15;
+	}
+
+	/* @brief  w × h の範囲に n 個の点を置くときの升目の大きさ (1升目に2個くらい)
+	 */
+	static double cellSizeFor(double w, double h, int n) {
+		if (n < 1) n = 1;
+		double c = sqrt(w * h * 2.0 / n);
+		return c < 1.0 ? 1.0 : c;
+	}
+
+	void clear() {
+		for (size_t i = 0; i < m_buckets.size(); i++) m_buckets[i].clear();
+		m_slot.clear();
+		m_size = 0;
+	}
+
+	// 升目の大きさを変えて登録し直す
+	void setCellSize(double cellSize) {
+		if (cellSize <= 0.0) return;
+		m_cell = cellSize;
+		rehash(m_buckets.size());
+	}
+	double cellSize() const { return m_cell; }
+
+	int size() const { return m_size; }
+	bool contains(int id) const { return id >= 0 && id < (int)m_slot.size() && m_slot[id].bucket >= 0; }
+
+	/* @brief  点を登録する。既にあれば位置を変える
+	 */
+	void insert(int id, double x, double z) {
+		if (id < 0) return;
+		if (contains(id)) remove(id);
+		if (id >= (int)m_slot.size()) m_slot.resize(id + 1);
+		if (m_size + 1 > (int)m_buckets.size()) rehash(m_buckets.size() * 2);
+		Point p;
+		p.id = id;
+		p.x = x;
+		p.z = z;
+		p.cx = cellOf(x);
+		p.cz = cellOf(z);
+		put(p);
+		m_size++;
+	}
+
+	void update(int id, double x, double z) { insert(id, x, z); }
+
+	void remove(int id) {
+		if (!contains(id)) return;
+		std::vector<Point> &b = m_buckets[m_slot[id].bucket];
+		int i = m_slot[id].index;
+		if (i != (int)b.size() - 1) {
+			b[i] = b.back();
+			m_slot[b[i].id].index = i;
+		}
+		b.pop_back();
+		m_slot[id].bucket = -1;
+		m_size--;
+	}
+
+	/* @brief  登録した位置を返す
+	 * @return 登録されていなければ false
+	 */
+	bool position(int id, double &x, double &z) const {
+		if (!contains(id)) return false;
+		const Point &p = m_buckets[m_slot[id].bucket][m_slot[id].index];
+		x = p.x;
+		z = p.z;
+		return true;
+	}
+
+	/* @brief  一番近い点
+	 * @param  dist2 距離の2乗を返す (NULL なら返さない)
+	 * @return 番号。点が無ければ -1
+	 */
+	int nearest(double x, double z, double *dist2 = NULL) const {
+		std::vector<std::pair<double, int> > &found = m_work;
+		if (search(x, z, 1, found) == 0) return -1;
+		if (dist2 != NULL) *dist2 = found[0].first;
+		return found[0].second;
+	}
+
+	/* @brief  近い順に k 個
+	 * @param  ids 番号を近い順に入れる (前の中身は消す)
+	 * @return 見つかった数
+	 */
+	int nearestK(double x, double z, int k, std::vector<int> &ids) const {
+		std::vector<std::pair<double, int> > &found = m_work;
+		search(x, z, k, found);
+		ids.clear();
+		for (size_t i = 0; i < found.size(); i++) ids.push_back(found[i].second);
+		return (int)ids.size();
+	}
+
+	/* @brief  半径 r 以内の点
+	 * @param  ids 番号を近い順に入れる (前の中身は消す)
+	 * @return 見つかった数
+	 */
+	int radius(double x, double z, double r, std::vector<int> &ids) const {
+		std::vector<std::pair<double, int> > &found = m_work;
+		found.clear();
+		ids.clear();
+		if (m_size == 0 || r < 0.0) return 0;
+		int x0 = cellOf(x - r), x1 = cellOf(x + r);
+		int z0 = cellOf(z - r), z1 = cellOf(z + r);
+		double r2 = r * r;
+		// 範囲が点の数より広いときは升目を回らずに全部見る
+		if ((double)(x1 - x0 + 1) * (z1 - z0 + 1) > (double)m_buckets.size()) {
+			for (size_t b = 0; b < m_buckets.size(); b++) {
+				for (size_t i = 0; i < m_buckets[b].size(); i++) {
+					const Point &p = m_buckets[b][i];
+					double d = dist2(p, x, z);
+					if (d <= r2) found.push_back(std::make_pair(d, p.id));
+				}
+			}
+		} else {
+			for (int cx = x0; cx <= x1; cx++) {
+				for (int cz = z0; cz <= z1; cz++) {
+					const std::vector<Point> &b = m_buckets[hash(cx, cz)];
+					for (size_t i = 0; i < b.size(); i++) {
+						const Point &p = b[i];
+						if (p.cx != cx || p.cz != cz) continue;
+						double d = dist2(p, x, z);
+						if (d <= r2) found.push_back(std::make_pair(d, p.id));
+					}
+				}
+			}
+		}
+		std::sort(found.begin(), found.end());
+		for (size_t i = 0; i < found.size(); i++) ids.push_back(found[i].second);
+		return (int)ids.size();
+	}
+
+private:
+	enum { SMALL_SIZE = 32 };	// これ以下の点の数なら升目を回らずに全部見る
+
+	struct Point {
+		int id;
+		int cx, cz;
+		double x, z;
+	};
+	struct Slot {
+		int bucket;		// -1 なら登録されていない
+		int index;
+		Slot() : bucket(-1), index(0) {}
+	};
+
+	int cellOf(double v) const { return (int)floor(v / m_cell); }
+
+	int hash(int cx, int cz) const {
+		unsigned int h = (unsigned int)cx * 73856093u ^ (unsigned int)cz * 19349663u;
+		return (int)(h & m_mask);
+	}
+
+	static double dist2(const Point &p, double x, double z) {
+		return (p.x - x) * (p.x - x) + (p.z - z) * (p.z - z);
+	}
+
+	void put(const Point &p) {
+		int b = hash(p.cx, p.cz);
+		m_slot[p.id].bucket = b;
+		m_slot[p.id].index = (int)m_buckets[b].size();
+		m_buckets[b].push_back(p);
+	}
+
+	// バケットの数を n (2のべき乗) にして、升目を計算し直して入れ直す
+	void rehash(size_t n) {
+		std::vector<Point> all;
+		all.reserve(m_size);
+		for (size_t b = 0; b < m_buckets.size(); b++) {
+			all.insert(all.end(), m_buckets[b].begin(), m_buckets[b].end());
+		}
+		size_t size = 16;
+		while (size < n) size *= 2;
+		m_buckets.assign(size, std::vector<Point>());
+		m_mask = (unsigned int)(size - 1);
+		for (size_t i = 0; i < all.size(); i++) {
+			Point p = all[i];
+			p.cx = cellOf(p.x);
+			p.cz = cellOf(p.z);
+			put(p);
+		}
+	}
+
+	// (距離の2乗, 番号) を k 個までの最大ヒープ(先頭が一番遠い)に入れる
+	static void consider(const Point &p, double x, double z, int k, std::vector<std::pair<double, int> > &heap) {
+		std::pair<double, int> c(dist2(p, x, z), p.id);
+		if ((int)heap.size() < k) {
+			heap.push_back(c);
+			std::push_heap(heap.begin(), heap.end());
+		} else if (c < heap.front()) {
+			std::pop_heap(heap.begin(), heap.end());
+			heap.back() = c;
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+
+	// 近い順に k 個探す。found は (距離の2乗, 番号) を近い順に並べる
+	int search(double x, double z, int k, std::vector<std::pair<double, int> > &found) const {
+		found.clear();
+		if (m_size == 0 || k <= 0) return 0;
+		if (k > m_size) k = m_size;
+		int qx = cellOf(x), qz = cellOf(z);
+		int seen = 0;
+		// 点から遠い所を問い合わせると空の升目ばかり回ることになるので、
+		// 見た升目が点の数を超えたら全部の点を見る (線形探索より遅くならない)。点が少ないときは初めから全部見る
+		long cells = 0;
+		long budget = (m_size <= SMALL_SIZE) ? -1 : 2L * m_size + 64;
+		for (int r = 0; budget >= 0; r++) {
+			for (int cx = qx - r; cx <= qx + r; cx++) {
+				// 周 r の升目だけを見る (内側は見終わっている)
+				int step = (cx == qx - r || cx == qx + r) ? 1 : 2 * r;
+				for (int cz = qz - r; cz <= qz + r; cz += step) {
+					cells++;
+					const std::vector<Point> &b = m_buckets[hash(cx, cz)];
+					for (size_t i = 0; i < b.size(); i++) {
+						if (b[i].cx != cx || b[i].cz != cz) continue;
+						seen++;
+						consider(b[i], x, z, k, found);
+					}
+				}
+			}
+			if (seen >= m_size) break;
+			// 周 r+1 より外の点は r * 升目 より遠い
+			double bound = r * m_cell;
+			if ((int)found.size() == k && found.front().first <= bound * bound) break;
+			if (cells > budget) {
+				found.clear();
+				budget = -1;
+			}
+		}
+		if (budget < 0) {
+			for (size_t b = 0; b < m_buckets.size(); b++) {
+				for (size_t i = 0; i < m_buckets[b].size(); i++) consider(m_buckets[b][i], x, z, k, found);
+			}
+		}
+		std::sort_heap(found.begin(), found.end());
+		return (int)found.size();
+	}
+
+	double m_cell;
+	unsigned int m_mask;
+	int m_size;
+	std::vector<std::vector<Point> > m_buckets;
+	std::vector<Slot> m_slot;	// 番号 -> 入っているバケットと位置
+	mutable std::vector<std::pair<double, int> > m_work;	// 問い合わせの作業用 (毎回確保しない)
+};
+
+#endif
@@ -0,0 +1,168 @@
+// 表駆動の状態機械
+// onAction の switch(m_state) と、各 case で繰り返していた
+//   if(evt.time() > m_time && m_executed == false) { ... }
+// を、状態表(State の配列)と期限タイマーで置き換える
+//
+// ・状態は 0 から始まる連番の enum とし、表の添字と一致させる(遷移・呼び出しは O(1))
+// ・各状態は4つのハンドラを持てる (不要なものは NULL)
+//     onEnter  状態に入ったとき
+//     onTimer  期限(setDeadline)を過ぎた最初の tick に1回だけ呼ばれる (旧 m_executed == false の判定)
+//     onTick   毎 tick 呼ばれる
+//     onExit   状態を出るとき
+// ・onRecvMsg から状態を変える場合は request() を使う。遷移は次の tick の先頭で行う(旧 m_state = X と同じ)
+// ・ハンドラの中から状態を変える場合は go() を使う。すぐに onExit/onEnter が呼ばれ、onTimer の判定は次の tick から
+// ・期限を待っているだけの tick ではハンドラを呼ばない
+// ・nextInterval() で、次に onAction を呼んでほしい間隔(期限まで)を求められる
+#ifndef _STATE_MACHINE_H_
+#define _STATE_MACHINE_H_
+
+#include <stdio.h>
+
+// 期限ちょうどに起きると now > deadline にならないので、少しだけ後に起きる
+#define STATE_MACHINE_WAKE_MARGIN 0.001
+
+template <class Owner>
+class StateMachine {
+public:
+	typedef void (Owner::*Action)(double now);
+	typedef void (Owner::*Transition)(int from, int to, double now);
+
+	struct State {
+		int id;				// enum の値 (表の添字と同じ)
+		const char *name;
+		Action onEnter;
+		Action onTimer;
+		Action onTick;
+		Action onExit;
+	};
+
+	StateMachine() : m_owner(NULL), m_table(NULL), m_num(0), m_state(0), m_pending(-1),
+					 m_deadline(0.0), m_fired(false), m_started(false), m_trace(false), m_onTransition(NULL) {}
+
+	/* @brief  状態表を設定する
+	 * @param  owner   ハンドラを呼ぶオブジェクト
+	 * @param  table   状態表 (table[i].id == i であること)
+	 * @param  num     状態の数
+	 * @param  initial 最初の状態 (最初の tick で onEnter が呼ばれる)
+	 * @return 表が正しければ true
+	 */
+	bool init(Owner *owner, const State *table, int num, int initial) {
+		m_owner = owner;
+		m_table = table;
+		m_num = num;
+		for (int i = 0; i < num; i++) {
+			if (table[i].id != i) {
+				printf("StateMachine: table[%d] has id %d (%s) \n", i, table[i].id, table[i].name);
+				return false;
+			}
+		}
+		m_state = initial;
+		m_pending = initial;
+		m_deadline = 0.0;
+		m_fired = false;
+		m_started = false;
+		return true;
+	}
+
+	/* @brief  次の tick で状態を遷移させる (onRecvMsg から使う)
+	 */
+	void request(int state) {
+		m_pending = state;
+	}
+
+	/* @brief  すぐに状態を遷移させる (ハンドラの中から使う)
+	 */
+	void go(int state, double now) {
+		m_pending = -1;
+		enter(state, now);
+	}
+
+	/* @brief  onAction から毎回呼ぶ
+	 */
+	void tick(double now) {
+		if (m_pending >= 0) {
+			int next = m_pending;
+			m_pending = -1;
+			enter(next, now);
+		}
+		int cur = m_state;
+		const State &s = m_table[cur];
+		if (s.onTimer != NULL && !m_fired && now > m_deadline) {
+			m_fired = true;
+			(m_owner->*s.onTimer)(now);
+		}
+		// onTimer の中で遷移した場合は、新しい状態の onTick は次の tick から
+		if (s.onTick != NULL && m_state == cur && m_pending < 0) {
+			(m_owner->*s.onTick)(now);
+		}
+	}
+
+	// 期限の設定 (期限を過ぎると onTimer が1回呼ばれる)
+	void setDeadline(double t) { m_deadline = t; }
+	double deadline() const { return m_deadline; }
+	// 今の状態の onTimer を呼ばないようにする (旧 m_executed = true)
+	void disarm() { m_fired = true; }
+	// onTimer がまだ呼ばれていなければ true
+	bool armed() const { return !m_fired && m_table[m_state].onTimer != NULL; }
+
+	int state() const { return m_state; }
+	int pending() const { return m_pending; }
+	// 次の tick で処理される状態 (遷移待ちがあればその状態)
+	int next() const { return m_pending >= 0 ? m_pending : m_state; }
+	bool hasTick() const { return m_table[m_state].onTick != NULL; }
+	int size() const { return m_num; }
+	const char *name(int state) const {
+		if (state < 0 || state >= m_num) return "?";
+		return m_table[state].name;
+	}
+
+	/* @brief  onAction の戻り値(次に呼ばれるまでの間隔)を求める
+	 * @param  now          現在時間
+	 * @param  minInterval  最小間隔。遷移待ち・onTick のある状態(閉ループ制御中)・メッセージ待ちのときはこの間隔
+	 * @param  maxInterval  最大間隔。期限を待っている間も、onRecvMsg からの遷移にはこの間隔以内で気付く
+	 * @return 間隔
+	 */
+	double nextInterval(double now, double minInterval, double maxInterval) const {
+		if (m_pending >= 0 || hasTick() || !armed()) return minInterval;
+		double t = m_deadline - now + STATE_MACHINE_WAKE_MARGIN;
+		if (t < minInterval) t = minInterval;
+		if (t > maxInterval) t = maxInterval;
+		return t;
+	}
+
+	// 遷移を printf で表示する
+	void setTrace(bool trace) { m_trace = trace; }
+	// 遷移のたびに呼ぶ関数 (onExit の後、onEnter の前。記録用)
+	void setOnTransition(Transition t) { m_onTransition = t; }
+
+private:
+	void enter(int next, double now) {
+		if (next < 0 || next >= m_num) {
+			printf("StateMachine: invalid state %d \n", next);
+			return;
+		}
+		const State &cur = m_table[m_state];
+		if (m_started && cur.onExit != NULL) (m_owner->*cur.onExit)(now);
+		m_started = true;
+		if (m_trace) printf("[%8.2lf] %s -> %s \n", now, cur.name, m_table[next].name);
+		int prev = m_state;
+		m_state = next;
+		if (m_onTransition != NULL) (m_owner->*m_onTransition)(prev, next, now);
+		m_fired = false;
+		const State &s = m_table[next];
+		if (s.onEnter != NULL) (m_owner->*s.onEnter)(now);
+	}
+
+	Owner *m_owner;
+	const State *m_table;
+	int m_num;
+	int m_state;
+	int m_pending;
+	double m_deadline;
+	bool m_fired;
+	bool m_started;
+	bool m_trace;
+	Transition m_onTransition;
+};
+
+#endif
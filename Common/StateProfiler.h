@@ -0,0 +1,221 @@
+// onAction の処理時間を状態(m_state)ごとに計測する
+// ・onAction 1回ごとの実時間(wall time)を状態別のヒストグラムに積む
+// ・状態遷移の回数と、各状態に留まったシミュレーション時間(dwell)を数える
+// ・dump() で HDR 形式(2のべき乗ごとに16分割)のヒストグラムを出力する
+//
+// 使い方
+//   double MyController::onAction(ActionEvent &evt) {
+//     m_prof.begin(m_state, evt.time());
+//     ...
+//     m_prof.end();
+//     return 0.05;
+//   }
+// 状態遷移は begin() で前回の状態と比べて検出するので、onRecvMsg 側で m_state を書き換えても数えられる
+#ifndef _STATE_PROFILER_H_
+#define _STATE_PROFILER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <string>
+
+class LatencyHistogram {
+public:
+	// 16 未満はそのまま、それ以上は 2^k ごとに 16 分割する (相対誤差 1/16 以下)
+	enum { SUB_BITS = 4, SUB_COUNT = 1 << SUB_BITS, MAX_BITS = 40, BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT };
+
+	LatencyHistogram() { reset(); }
+
+	void reset() {
+		memset(m_bucket, 0, sizeof(m_bucket));
+		m_count = 0;
+		m_total = 0;
+		m_min = 0;
+		m_max = 0;
+	}
+
+	/* @brief  値を1つ記録する
+	 * @param  v 記録する値(ナノ秒)
+	 */
+	void record(unsigned long long v) {
+		m_bucket[index(v)]++;
+		if (m_count == 0 || v < m_min) m_min = v;
+		if (v > m_max) m_max = v;
+		m_count++;
+		m_total += v;
+	}
+
+	/* @brief  パーセンタイル値を返す(バケットの下限値)
+	 * @param  p 0-100
+	 */
+	unsigned long long percentile(double p) const {
+		if (m_count == 0) return 0;
+		unsigned long long target = (unsigned long long)(p / 100.0 * m_count + 0.5);
+		if (target < 1) target = 1;
+		if (target > m_count) target = m_count;
+		unsigned long long acc = 0;
+		for (int i = 0; i < BUCKETS; i++) {
+			acc += m_bucket[i];
+			if (acc >= target) return lowerBound(i);
+		}
+		return m_max;
+	}
+
+	unsigned long long count() const { return m_count; }
+	unsigned long long total() const { return m_total; }
+	unsigned long long min() const { return m_min; }
+	unsigned long long max() const { return m_max; }
+	double mean() const { return m_count ? (double)m_total / m_count : 0.0; }
+
+	// 0 でないバケットを "下限値 件数" の形で出力する
+	void dumpBuckets(FILE *fp, const char *indent) const {
+		for (int i = 0; i < BUCKETS; i++) {
+			if (m_bucket[i] == 0) continue;
+			fprintf(fp, "%s%12llu ns %8llu \n", indent, lowerBound(i), m_bucket[i]);
+		}
+	}
+
+private:
+	static int index(unsigned long long v) {
+		if (v < SUB_COUNT) return (int)v;
+		int msb = 63 - __builtin_clzll(v);
+		if (msb >= MAX_BITS) return BUCKETS - 1;	// 2^MAX_BITS 以上は最後のバケットにまとめる
+		int sub = (int)((v >> (msb - SUB_BITS)) & (SUB_COUNT - 1));
+		return (msb - SUB_BITS + 1) * SUB_COUNT + sub;
+	}
+
+	static unsigned long long lowerBound(int i) {
+		if (i < SUB_COUNT) return i;
+		int msb = i / SUB_COUNT + SUB_BITS - 1;
+		int sub = i % SUB_COUNT;
+		return ((unsigned long long)(SUB_COUNT + sub)) << (msb - SUB_BITS);
+	}
+
+	unsigned long long m_bucket[BUCKETS];
+	unsigned long long m_count;
+	unsigned long long m_total;
+	unsigned long long m_min;
+	unsigned long long m_max;
+};
+
+
+class StateProfiler {
+public:
+	StateProfiler() : m_inTick(false), m_lastState(0), m_tickState(0), m_enterTime(0.0), m_lastTime(0.0), m_started(false) {}
+
+	/* @brief  onAction の先頭で呼ぶ
+	 * @param  state 現在の状態
+	 * @param  now   シミュレーション時間(evt.time())
+	 */
+	void begin(int state, double now) {
+		if (!m_started) {
+			m_started = true;
+			m_lastState = state;
+			m_enterTime = now;
+			m_stats[state].entries++;
+		} else if (state != m_lastState) {
+			transition(state, now);
+		}
+		m_lastTime = now;
+		m_tickState = state;
+		m_inTick = true;
+		clock_gettime(CLOCK_MONOTONIC, &m_start);
+	}
+
+	/* @brief  onAction の最後(return の直前)で呼ぶ
+	 * @param  state onAction の中で遷移した後の状態 (省略時は次の begin() で遷移を検出する)
+	 *               onAction の間隔が長いときは、これを渡さないと遷移後の待ち時間が前の状態の dwell に入る
+	 */
+	void end(int state = -1) {
+		if (!m_inTick) return;
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		long long ns = (long long)(ts.tv_sec - m_start.tv_sec) * 1000000000LL + (ts.tv_nsec - m_start.tv_nsec);
+		if (ns < 0) ns = 0;
+		m_stats[m_tickState].wall.record((unsigned long long)ns);
+		m_all.record((unsigned long long)ns);
+		m_inTick = false;
+		if (state >= 0 && state != m_lastState) transition(state, m_lastTime);
+	}
+
+	// dump() で状態番号の代わりに表示する名前
+	void setStateName(int state, const char *name) {
+		m_names[state] = name;
+	}
+
+	void reset() {
+		m_stats.clear();
+		m_transitions.clear();
+		m_all.reset();
+		m_started = false;
+		m_inTick = false;
+	}
+
+	/* @brief  計測結果を出力する
+	 * @param  fp       出力先
+	 * @param  buckets  true のときヒストグラムのバケットも出力する
+	 */
+	void dump(FILE *fp, bool buckets = false) const {
+		fprintf(fp, "==== onAction profile (wall time per tick, dwell in sim sec) ==== \n");
+		fprintf(fp, "%-16s %8s %10s %10s %10s %10s %10s %8s %10s \n",
+				"state", "ticks", "mean[us]", "p50[us]", "p99[us]", "max[us]", "total[ms]", "enter", "dwell[s]");
+		for (std::map<int, Stat>::const_iterator it = m_stats.begin(); it != m_stats.end(); it++) {
+			const LatencyHistogram &h = it->second.wall;
+			double dwell = it->second.dwell;
+			// 現在の状態はまだ抜けていないので、最後の onAction までの分を足しておく
+			if (m_started && it->first == m_lastState) dwell += m_lastTime - m_enterTime;
+			fprintf(fp, "%-16s %8llu %10.1lf %10.1lf %10.1lf %10.1lf %10.2lf %8d %10.2lf \n",
+					name(it->first).c_str(), h.count(), h.mean() / 1000.0, h.percentile(50) / 1000.0, h.percentile(99) / 1000.0,
+					h.max() / 1000.0, h.total() / 1000000.0, it->second.entries, dwell);
+			if (buckets) h.dumpBuckets(fp, "         ");
+		}
+		fprintf(fp, "%-16s %8llu %10.1lf %10.1lf %10.1lf %10.1lf %10.2lf \n",
+				"all", m_all.count(), m_all.mean() / 1000.0, m_all.percentile(50) / 1000.0, m_all.percentile(99) / 1000.0,
+				m_all.max() / 1000.0, m_all.total() / 1000000.0);
+
+		fprintf(fp, "---- transitions ---- \n");
+		for (std::map<std::pair<int, int>, int>::const_iterator it = m_transitions.begin(); it != m_transitions.end(); it++) {
+			fprintf(fp, "%16s -> %-16s %8d \n", name(it->first.first).c_str(), name(it->first.second).c_str(), it->second);
+		}
+	}
+
+private:
+	std::string name(int state) const {
+		std::map<int, std::string>::const_iterator it = m_names.find(state);
+		if (it != m_names.end()) return it->second;
+		char buf[16];
+		sprintf(buf, "%d", state);
+		return buf;
+	}
+
+	void transition(int state, double now) {
+		m_stats[m_lastState].dwell += now - m_enterTime;
+		m_transitions[std::make_pair(m_lastState, state)]++;
+		m_stats[state].entries++;
+		m_lastState = state;
+		m_enterTime = now;
+	}
+
+	struct Stat {
+		Stat() : entries(0), dwell(0.0) {}
+		LatencyHistogram wall;
+		int entries;
+		double dwell;
+	};
+
+	std::map<int, Stat> m_stats;
+	std::map<std::pair<int, int>, int> m_transitions;
+	std::map<int, std::string> m_names;
+	LatencyHistogram m_all;
+
+	bool m_inTick;
+	int m_lastState;
+	int m_tickState;
+	double m_enterTime;
+	double m_lastTime;
+	bool m_started;
+	struct timespec m_start;
+};
+
+#endif
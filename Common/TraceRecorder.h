@@ -0,0 +1,210 @@
+// 実験の記録 (バイナリのトレース)
+// ・状態遷移、位置、送受信メッセージ、車輪・関節の指令、把持/解放を、シミュレーション時間と実時間付きで記録する
+// ・ファイルを mmap したリングバッファに固定長(128バイト)のレコードを書くだけなので、書き込みでシステムコールを呼ばない
+//   満杯になったら古いものから上書きする (最後の capacity 件が残る)
+// ・読み出し・CSV 出力・メッセージの往復時間の集計は OfflineSim/TraceDecode.cpp
+//
+// ファイルの形式 (リトルエンディアン)
+//   TraceFileHeader (64バイト) + TraceRecord × capacity
+//   head は書いたレコードの総数。レコード i は (i % capacity) 番目に入る
+//
+// 使い方
+//   m_trace.open("trace.bin");
+//   m_trace.state(now, from, to, "GO_TO_OBJ");
+//   m_trace.send(now, "AskObjPos 10.0 20.0 0.0");
+#ifndef _TRACE_RECORDER_H_
+#define _TRACE_RECORDER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC			"SIGTRC01"
+#define TRACE_TEXT_MAX		88
+#define TRACE_DEFAULT_CAPACITY	65536	// 8MB
+
+enum TraceType {
+	TRACE_STATE = 1,	// id: 遷移先, v[0]: 遷移元, text: 遷移先の名前
+	TRACE_POSE,			// v: x z 向き(deg)
+	TRACE_SEND,			// text: メッセージ
+	TRACE_RECV,			// text: メッセージ, id: 送信者 (TRACE_PEER_*)
+	TRACE_WHEEL,		// v: 左 右
+	TRACE_JOINT,		// v[0]: 角速度, text: 関節名
+	TRACE_GRASP,		// id: 1 掴んだ 0 離した, text: 物体名 (離したときは空)
+	TRACE_TYPE_NUM
+};
+
+enum TracePeer {
+	TRACE_PEER_OTHER = 0,
+	TRACE_PEER_RECOG_TRASH,
+	TRACE_PEER_VIEWER
+};
+
+struct TraceFileHeader {
+	char magic[8];
+	uint32_t recordSize;
+	uint32_t capacity;
+	volatile uint64_t head;
+	char reserved[40];
+};
+
+struct TraceRecord {
+	uint8_t type;
+	uint8_t textLen;		// text の長さ (切り詰めた後)
+	uint16_t id;
+	uint32_t fullLen;		// 切り詰める前の text の長さ
+	double sim;				// シミュレーション時間 [s]
+	uint64_t wall;			// 実時間 (CLOCK_MONOTONIC) [ns]
+	float v[4];
+	char text[TRACE_TEXT_MAX];
+};
+
+class TraceRecorder {
+public:
+	TraceRecorder() : m_fd(-1), m_map(NULL), m_size(0), m_header(NULL), m_records(NULL) {}
+	~TraceRecorder() { close(); }
+
+	/* @brief  トレースファイルを作る (既にあれば作り直す)
+	 * @param  filename ファイル名
+	 * @param  capacity 残すレコードの数 (1以上)
+	 * @return 作れたら true。失敗したときは何も記録しない
+	 */
+	bool open(const char *filename, uint32_t capacity = TRACE_DEFAULT_CAPACITY) {
+		close();
+		if (capacity == 0) return false;	// 0件のリングには書けない
+		m_fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0) return false;
+		m_size = sizeof(TraceFileHeader) + (size_t)capacity * sizeof(TraceRecord);
+		if (ftruncate(m_fd, m_size) != 0) {
+			close();
+			return false;
+		}
+		void *p = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (p == MAP_FAILED) {
+			close();
+			return false;
+		}
+		m_map = (char *)p;
+		m_header = (TraceFileHeader *)m_map;
+		m_records = (TraceRecord *)(m_map + sizeof(TraceFileHeader));
+		memcpy(m_header->magic, TRACE_MAGIC, 8);
+		m_header->recordSize = sizeof(TraceRecord);
+		m_header->capacity = capacity;
+		m_header->head = 0;
+		return true;
+	}
+
+	void close() {
+		if (m_map != NULL) {
+			msync(m_map, m_size, MS_ASYNC);
+			munmap(m_map, m_size);
+		}
+		if (m_fd >= 0) ::close(m_fd);
+		m_fd = -1;
+		m_map = NULL;
+		m_header = NULL;
+		m_records = NULL;
+	}
+
+	bool isOpen() const { return m_map != NULL; }
+
+	void state(double sim, int from, int to, const char *name) {
+		TraceRecord *r = begin(TRACE_STATE, sim);
+		if (r == NULL) return;
+		r->id = (uint16_t)to;
+		r->v[0] = (float)from;
+		setText(r, name);
+		commit();
+	}
+	void pose(double sim, double x, double z, double heading) {
+		TraceRecord *r = begin(TRACE_POSE, sim);
+		if (r == NULL) return;
+		r->v[0] = (float)x;
+		r->v[1] = (float)z;
+		r->v[2] = (float)heading;
+		commit();
+	}
+	void send(double sim, const char *msg) {
+		TraceRecord *r = begin(TRACE_SEND, sim);
+		if (r == NULL) return;
+		setText(r, msg);
+		commit();
+	}
+	void recv(double sim, const char *sender, const char *msg) {
+		TraceRecord *r = begin(TRACE_RECV, sim);
+		if (r == NULL) return;
+		r->id = peer(sender);
+		setText(r, msg);
+		commit();
+	}
+	void wheel(double sim, double left, double right) {
+		TraceRecord *r = begin(TRACE_WHEEL, sim);
+		if (r == NULL) return;
+		r->v[0] = (float)left;
+		r->v[1] = (float)right;
+		commit();
+	}
+	void joint(double sim, const char *name, double vel) {
+		TraceRecord *r = begin(TRACE_JOINT, sim);
+		if (r == NULL) return;
+		r->v[0] = (float)vel;
+		setText(r, name);
+		commit();
+	}
+	void grasp(double sim, bool grasped, const char *name) {
+		TraceRecord *r = begin(TRACE_GRASP, sim);
+		if (r == NULL) return;
+		r->id = grasped ? 1 : 0;
+		setText(r, name);
+		commit();
+	}
+
+	static uint64_t wallNow() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+
+private:
+	TraceRecord *begin(int type, double sim) {
+		if (m_map == NULL) return NULL;
+		TraceRecord *r = &m_records[m_header->head % m_header->capacity];
+		memset(r, 0, sizeof(TraceRecord));
+		r->type = (uint8_t)type;
+		r->sim = sim;
+		r->wall = wallNow();
+		return r;
+	}
+	// レコードを書き終えてから head を進める (読み手は head までを読む)
+	void commit() {
+		__sync_synchronize();
+		m_header->head++;
+	}
+
+	static void setText(TraceRecord *r, const char *text) {
+		if (text == NULL) return;
+		size_t len = strlen(text);
+		r->fullLen = (uint32_t)len;
+		if (len > TRACE_TEXT_MAX) len = TRACE_TEXT_MAX;
+		memcpy(r->text, text, len);
+		r->textLen = (uint8_t)len;
+	}
+
+	static uint16_t peer(const char *sender) {
+		if (strcmp(sender, "RecogTrash") == 0) return TRACE_PEER_RECOG_TRASH;
+		if (strcmp(sender, "SIGViewer") == 0) return TRACE_PEER_VIEWER;
+		return TRACE_PEER_OTHER;
+	}
+
+	int m_fd;
+	char *m_map;
+	size_t m_size;
+	TraceFileHeader *m_header;
+	TraceRecord *m_records;
+};
+
+#endif
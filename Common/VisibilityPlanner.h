@@ -0,0 +1,466 @@
+// 可視グラフによる経路計画 (calcRoute / calcFullRoute の代わり)
+// ・障害物は床の上の長方形 (中心 x y と 幅 奥行き。Obstacle::setPosition と同じ並び。y はワールドの z)
+//   斜めに置いた家具は向き (angle) を与えた長方形、または凸多角形 (setPolygon) にできる (ObstacleSet.h)
+//   ロボットの半径(TRUCK_RADIUS)だけ膨らませた多角形の角を頂点にする (角は丸めない)
+// ・角どうしの見通し(膨らませた長方形の内側を通らない)を調べたグラフは、障害物が変わったときだけ作り直す
+//   問い合わせでは出発点・目的地と角の見通しだけを調べ、A* (ヒューリスティックは直線距離) で探す
+//   見通しはすべての障害物を ObstacleSet::segmentHits で1回に調べる。角の数は長方形の4倍なので、部屋の家具くらいなら1回数マイクロ秒で、最短の経路になる
+// ・物を掴む位置・ゴミ箱の前は膨らませた長方形の中にあるので、出発点・目的地から出る線分だけは、
+//   その点を含む障害物を膨らませる前の長方形で調べる (点が長方形そのものの中にあれば、その障害物は調べない)
+//
+// 使い方
+//   VisibilityPlanner planner(TRUCK_RADIUS);
+//   for (...) planner.setObstacle(i, obs.x, obs.y, obs.width, obs.height);	// 変わらなければグラフはそのまま
+//   std::vector<Node2D> route;
+//   if (planner.plan(start.x, start.y, goal.x, goal.y, route)) { ... route[0] が出発点、最後が目的地 }
+// Node は Node(double x, double y) で作れる型 (各コントローラの Node2D)
+// ・setSpeed() で進む速さと回転の速さを与えると、長さではなく移動時間が最短の経路を探す
+//   ロボットは角ごとにその場で回転 (rotateTowardObj) してからまっすぐ進む (goToObj) ので、
+//   時間は 線分の長さ / 進む速さ + 曲がる角度 / 回転の速さ。曲がる角度は来た向きで決まるので、(角, 来た角) の組で探す
+//   出発点で向いている方向 (heading) を与えると、最初の回転も含める
+// ・shortcut() は他の方法で求めた経路 (calcFullRoute など) の点を減らす。見通せる点を飛ばし、ほとんど一直線の点を除く
+//   点ごとにロボットは止まって回転するので、減らした分だけ早く着く (travelTime で見積もれる)
+// 速さと経路の長さ・移動時間は OfflineSim/RouteBench.cpp で calcFullRoute・GridPlanner と比べられる
+#ifndef _VISIBILITY_PLANNER_H_
+#define _VISIBILITY_PLANNER_H_
+
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "ObstacleSet.h"
+
+class VisibilityPlanner {
+public:
+	explicit VisibilityPlanner(double clearance = 0.0)
+		: m_clearance(clearance), m_drive(0.0), m_turn(0.0), m_dirty(true), m_builds(0), m_edges(0), m_expanded(0) {}
+
+	// 障害物から離れていたい距離 (ロボットの半径)
+	void setClearance(double clearance) {
+		if (clearance != m_clearance) {
+			m_clearance = clearance;
+			m_dirty = true;
+		}
+	}
+	double clearance() const { return m_clearance; }
+
+	void clearObstacles() {
+		m_obs.clear();
+		m_set.clear();
+		m_dirty = true;
+	}
+	// 障害物を足す (中心 x y、幅 奥行き、向き)。@return 障害物の番号
+	int addObstacle(double x, double y, double width, double height, double angle = 0.0) {
+		int i = (int)m_obs.size();
+		setObstacle(i, x, y, width, height, angle);
+		return i;
+	}
+	/* @brief  i 番目の障害物を置き直す (足りなければ足す)。変わらなければグラフは作り直さない
+	 * @param  width height 幅 奥行き (負なら無い)
+	 * @param  angle 長方形の向き [rad] (x 軸から y 軸の方へ回した角度。0 なら軸に平行)
+	 */
+	void setObstacle(int i, double x, double y, double width, double height, double angle = 0.0) {
+		if (i < 0) return;
+		if (i >= (int)m_obs.size()) {
+			Rect none = { 0.0, 0.0, -1.0, -1.0, 0.0 };
+			m_obs.resize(i + 1, none);
+			m_set.resize(i + 1);
+		}
+		Rect &r = m_obs[i];
+		if (r.x == x && r.y == y && r.w == width && r.h == height && r.a == angle) return;
+		r.x = x;
+		r.y = y;
+		r.w = width;
+		r.h = height;
+		r.a = angle;
+		m_set.setBox(i, x, y, width, height, angle);
+		m_dirty = true;
+	}
+	/* @brief  i 番目の障害物を凸多角形にする (足りなければ足す)
+	 * @return 凸多角形でなければ何もせず false
+	 */
+	bool setPolygon(int i, const double *xs, const double *ys, int n) {
+		if (i < 0 || !m_set.setPolygon(i, xs, ys, n)) return false;
+		// 長方形の写しは、次の setObstacle() で必ず置き直すようにしておく
+		Rect poly = { 0.0, 0.0, -1.0, -1.0, HUGE_VAL };
+		if (i >= (int)m_obs.size()) m_obs.resize(i + 1, poly);
+		m_obs[i] = poly;
+		m_dirty = true;
+		return true;
+	}
+	// 障害物の数を n にする (後ろを捨てる)
+	void resizeObstacles(int n) {
+		if (n >= 0 && n < (int)m_obs.size()) {
+			m_obs.resize(n);
+			m_set.resize(n);
+			m_dirty = true;
+		}
+	}
+	int obstacleCount() const { return (int)m_obs.size(); }
+	const ObstacleSet &obstacles() const { return m_set; }
+
+	/* @brief  移動時間が最短の経路を探すときの速さ (どちらかが 0 以下なら長さが最短の経路を探す)
+	 * グラフは作り直さない (辺の長さはそのまま使う)
+	 * @param  drive 進む速さ [cm/s]
+	 * @param  turn  その場で回転する速さ [rad/s]
+	 */
+	void setSpeed(double drive, double turn) {
+		m_drive = drive;
+		m_turn = turn;
+	}
+	bool timed() const { return m_drive > 0.0 && m_turn > 0.0; }
+	double driveSpeed() const { return m_drive; }
+	double turnSpeed() const { return m_turn; }
+
+	/* @brief  経路を探す
+	 * @param  sx sy 出発点
+	 * @param  gx gy 目的地
+	 * @param  route 出発点から目的地までの点 (前の中身は消す)。見つからなければ空
+	 * @return 見つかったら true
+	 */
+	template <class Node>
+	bool plan(double sx, double sy, double gx, double gy, std::vector<Node> &route) {
+		return plan(sx, sy, HUGE_VAL, gx, gy, route);
+	}
+
+	/* @brief  出発点で向いている方向を与えて経路を探す (setSpeed() したときは最初の回転の時間も含めて最短にする)
+	 * @param  heading 出発点で向いている方向 [rad] (atan2(dy, dx)。HUGE_VAL なら考えない)
+	 */
+	template <class Node>
+	bool plan(double sx, double sy, double heading, double gx, double gy, std::vector<Node> &route) {
+		route.clear();
+		m_expanded = 0;
+		ensureGraph();
+
+		int n = (int)m_nodes.size();
+		endpointModes(sx, sy, m_startMode);
+		endpointModes(gx, gy, m_goalMode);
+		bool direct = clear(sx, sy, gx, gy, &m_startMode, &m_goalMode);
+		// まっすぐ行ければ一番短い。向いている方向を考えるときだけ、回り道の方が早いことがある
+		if (direct && (!timed() || heading == HUGE_VAL)) {
+			route.push_back(Node(sx, sy));
+			route.push_back(Node(gx, gy));
+			return true;
+		}
+
+		// 出発点 (n) と目的地 (n + 1) から見える角
+		m_startEdges.clear();
+		m_goalCost.assign(n, -1.0);
+		for (int i = 0; i < n; i++) {
+			const Point &p = m_nodes[i];
+			if (clear(sx, sy, p.x, p.y, &m_startMode, NULL)) m_startEdges.push_back(Edge(i, dist(sx, sy, p.x, p.y)));
+			if (clear(p.x, p.y, gx, gy, NULL, &m_goalMode)) m_goalCost[i] = dist(p.x, p.y, gx, gy);
+		}
+		if (timed()) {
+			if (direct) m_startEdges.push_back(Edge(n + 1, dist(sx, sy, gx, gy)));
+			return planTime(sx, sy, heading, gx, gy, route);
+		}
+
+		int s = n, g = n + 1;
+		m_g.assign(n + 2, 0.0);
+		m_parent.assign(n + 2, -1);
+		m_closed.assign(n + 2, 0);
+		std::vector<std::pair<double, int> > &open = m_open;
+		open.clear();
+		m_parent[s] = s;
+		open.push_back(std::make_pair(dist(sx, sy, gx, gy), s));
+		while (!open.empty()) {
+			std::pop_heap(open.begin(), open.end(), std::greater<std::pair<double, int> >());
+			int u = open.back().second;
+			open.pop_back();
+			if (m_closed[u]) continue;
+			m_closed[u] = 1;
+			m_expanded++;
+			if (u == g) break;
+			const std::vector<Edge> &adj = (u == s) ? m_startEdges : m_adj[u];
+			for (size_t k = 0; k < adj.size(); k++) relax(u, adj[k].to, adj[k].cost, gx, gy);
+			if (u != s && m_goalCost[u] >= 0.0) relax(u, g, m_goalCost[u], gx, gy);
+		}
+		if (!m_closed[g]) return false;
+
+		for (int u = g; ; u = m_parent[u]) {
+			if (u == s) route.push_back(Node(sx, sy));
+			else if (u == g) route.push_back(Node(gx, gy));
+			else route.push_back(Node(m_nodes[u].x, m_nodes[u].y));
+			if (u == s) break;
+		}
+		std::reverse(route.begin(), route.end());
+		return true;
+	}
+
+	/* @brief  2点の間をまっすぐ通れるか
+	 * plan() の出発点・目的地と同じく、点を含む障害物は膨らませる前の長方形で調べる
+	 */
+	bool visible(double ax, double ay, double bx, double by) {
+		endpointModes(ax, ay, m_startMode);
+		endpointModes(bx, by, m_goalMode);
+		return clear(ax, ay, bx, by, &m_startMode, &m_goalMode);
+	}
+
+	/* @brief  経路の点を減らす (出発点と目的地は残す)
+	 * 出発点から、まっすぐ見通せる一番先の点へ進む (間の点を飛ばす)。
+	 * 見通しは plan() と同じく、出発点・目的地から出る線分だけ点を含む障害物を膨らませずに調べ、間の点どうしは膨らませて調べる
+	 * その後、前後の点を結ぶ線分から tolerance 以内にある点 (ほとんど一直線の点) を除く
+	 * @param  route     経路 (書き換える)
+	 * @param  tolerance 一直線とみなす線分からのずれ [cm]
+	 * @return 除いた点の数
+	 */
+	template <class Node>
+	int shortcut(std::vector<Node> &route, double tolerance = 1.0) {
+		int before = (int)route.size();
+		if (before < 3) return 0;
+		size_t last = route.size() - 1;
+		endpointModes(route[0].x, route[0].y, m_startMode);
+		endpointModes(route[last].x, route[last].y, m_goalMode);
+		std::vector<Node> out;
+		out.push_back(route[0]);
+		for (size_t i = 0; i < last;) {
+			size_t j = last;
+			while (j > i + 1 && !clear(route[i].x, route[i].y, route[j].x, route[j].y,
+			                           i == 0 ? &m_startMode : NULL, j == last ? &m_goalMode : NULL)) j--;
+			out.push_back(route[j]);
+			i = j;
+		}
+		for (size_t k = 1; k + 1 < out.size();) {
+			if (deviation(out[k - 1].x, out[k - 1].y, out[k].x, out[k].y, out[k + 1].x, out[k + 1].y) < tolerance) {
+				out.erase(out.begin() + k);
+			} else {
+				k++;
+			}
+		}
+		route.swap(out);
+		return before - (int)route.size();
+	}
+
+	/* @brief  経路を進む時間の見積もり (点ごとにその場で回転してから、まっすぐ進む)
+	 * @param  drive   進む速さ [cm/s]
+	 * @param  turn    回転の速さ [rad/s]
+	 * @param  heading 出発点で向いている方向 [rad] (HUGE_VAL なら最初の回転は含めない)
+	 */
+	template <class Node>
+	static double travelTime(const std::vector<Node> &route, double drive, double turn, double heading = HUGE_VAL) {
+		double len = 0.0, angle = 0.0, in = heading;
+		for (size_t i = 1; i < route.size(); i++) {
+			double dx = route[i].x - route[i - 1].x, dy = route[i].y - route[i - 1].y;
+			if (dx == 0.0 && dy == 0.0) continue;
+			double out = atan2(dy, dx);
+			if (in != HUGE_VAL) angle += turnAngle(in, out);
+			in = out;
+			len += sqrt(dx * dx + dy * dy);
+		}
+		return len / drive + angle / turn;
+	}
+
+	// 向き a0 から a1 に回る角度 (小さい方。0〜π)
+	static double turnAngle(double a0, double a1) {
+		double d = fabs(a1 - a0);
+		while (d > 2 * M_PI) d -= 2 * M_PI;
+		return (d > M_PI) ? 2 * M_PI - d : d;
+	}
+
+	// グラフの頂点 (使える角) と辺の数。plan() の後で使う
+	int nodeCount() const { return (int)m_nodes.size(); }
+	int edgeCount() const { return m_edges; }
+	// グラフを作った回数
+	long builds() const { return m_builds; }
+	// 最後の plan() で取り出した頂点の数
+	long expanded() const { return m_expanded; }
+
+private:
+	struct Rect {
+		double x, y, w, h, a;
+	};
+	struct Point {
+		double x, y;
+	};
+	struct Edge {
+		int to;
+		double cost;
+		Edge(int to, double cost) : to(to), cost(cost) {}
+	};
+
+	static double dist(double x0, double y0, double x1, double y1) {
+		return sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+	}
+
+	// 点 (bx, by) から a と c を結ぶ線分までの距離
+	static double deviation(double ax, double ay, double bx, double by, double cx, double cy) {
+		double len = dist(ax, ay, cx, cy);
+		if (len == 0.0) return dist(ax, ay, bx, by);
+		double t = ((bx - ax) * (cx - ax) + (by - ay) * (cy - ay)) / (len * len);
+		t = std::max(0.0, std::min(1.0, t));
+		return dist(ax + (cx - ax) * t, ay + (cy - ay) * t, bx, by);
+	}
+
+	/* @brief  出発点・目的地から出る線分で、障害物ごとに膨らませる距離 (ObstacleSet::segmentMask の inflate)
+	 * 点が障害物そのものの中にあれば調べない (-HUGE_VAL)、膨らませた中にあれば膨らませない (0)、外なら m_clearance
+	 */
+	void endpointModes(double x, double y, std::vector<double> &inflate) const {
+		inflate.assign(m_set.stride(), m_clearance);
+		for (int k = 0; k < m_set.size(); k++) {
+			if (m_set.empty(k)) continue;
+			if (m_set.contains(k, x, y, 0.0)) inflate[k] = -HUGE_VAL;
+			else if (m_set.contains(k, x, y, m_clearance)) inflate[k] = 0.0;
+		}
+	}
+
+	/* @brief  2点の間に障害物が無いか
+	 * @param  modeA modeB 端が出発点・目的地なら、その点から見た障害物の調べ方 (角なら NULL)
+	 */
+	bool clear(double ax, double ay, double bx, double by,
+	           const std::vector<double> *modeA, const std::vector<double> *modeB) {
+		if (m_set.stride() == 0) return true;
+		const double *inflate;
+		if (modeA != NULL && modeB != NULL) {
+			// 両端とも出発点・目的地なら、調べ方の緩い方 (膨らませる距離の小さい方)
+			m_pairMode.resize(m_set.stride());
+			for (int k = 0; k < m_set.stride(); k++) m_pairMode[k] = std::min((*modeA)[k], (*modeB)[k]);
+			inflate = &m_pairMode[0];
+		} else if (modeA != NULL || modeB != NULL) {
+			inflate = &(modeA != NULL ? *modeA : *modeB)[0];
+		} else {
+			inflate = m_set.inflation(m_clearance);
+		}
+		return !m_set.segmentHits(ax, ay, bx, by, inflate);
+	}
+
+	void relax(int u, int v, double cost, double gx, double gy) {
+		if (m_closed[v]) return;
+		double ng = m_g[u] + cost;
+		if (m_parent[v] >= 0 && ng >= m_g[v]) return;
+		m_g[v] = ng;
+		m_parent[v] = u;
+		double h = (v == (int)m_nodes.size() + 1) ? 0.0 : dist(m_nodes[v].x, m_nodes[v].y, gx, gy);
+		m_open.push_back(std::make_pair(ng + h, v));
+		std::push_heap(m_open.begin(), m_open.end(), std::greater<std::pair<double, int> >());
+	}
+
+	double nodeX(int v, double sx, double gx) const {
+		int n = (int)m_nodes.size();
+		return (v < n) ? m_nodes[v].x : (v == n) ? sx : gx;
+	}
+	double nodeY(int v, double sy, double gy) const {
+		int n = (int)m_nodes.size();
+		return (v < n) ? m_nodes[v].y : (v == n) ? sy : gy;
+	}
+
+	/* @brief  移動時間が最短の経路を探す (plan() で出発点・目的地から見える角を調べた後)
+	 * 状態は (角 v, 来た角 u) の組 (v * (n + 2) + u)。ヒューリスティックは目的地までの直線距離 / 進む速さ
+	 */
+	template <class Node>
+	bool planTime(double sx, double sy, double heading, double gx, double gy, std::vector<Node> &route) {
+		int n = (int)m_nodes.size(), N = n + 2, s = n, g = n + 1;
+		m_tg.assign(N * N, HUGE_VAL);
+		m_tparent.assign(N * N, -1);
+		m_tclosed.assign(N * N, 0);
+		std::vector<std::pair<double, int> > &open = m_open;
+		open.clear();
+		int start = s * N + s;
+		m_tg[start] = 0.0;
+		open.push_back(std::make_pair(dist(sx, sy, gx, gy) / m_drive, start));
+		int goal = -1;
+		while (!open.empty()) {
+			std::pop_heap(open.begin(), open.end(), std::greater<std::pair<double, int> >());
+			int st = open.back().second;
+			open.pop_back();
+			if (m_tclosed[st]) continue;
+			m_tclosed[st] = 1;
+			m_expanded++;
+			int u = st / N, from = st % N;
+			if (u == g) {
+				goal = st;
+				break;
+			}
+			double ux = nodeX(u, sx, gx), uy = nodeY(u, sy, gy);
+			// ここまで来た向き (出発点では向いている方向)
+			double in = (u == s) ? heading : atan2(uy - nodeY(from, sy, gy), ux - nodeX(from, sx, gx));
+			const std::vector<Edge> &adj = (u == s) ? m_startEdges : m_adj[u];
+			size_t m = adj.size() + ((u != s && m_goalCost[u] >= 0.0) ? 1 : 0);
+			for (size_t k = 0; k < m; k++) {
+				int v = (k < adj.size()) ? adj[k].to : g;
+				double len = (k < adj.size()) ? adj[k].cost : m_goalCost[u];
+				int next = v * N + u;
+				if (m_tclosed[next]) continue;
+				double vx = nodeX(v, sx, gx), vy = nodeY(v, sy, gy);
+				double t = m_tg[st] + len / m_drive;
+				if (in != HUGE_VAL) t += turnAngle(in, atan2(vy - uy, vx - ux)) / m_turn;
+				if (t >= m_tg[next]) continue;
+				m_tg[next] = t;
+				m_tparent[next] = st;
+				open.push_back(std::make_pair(t + dist(vx, vy, gx, gy) / m_drive, next));
+				std::push_heap(open.begin(), open.end(), std::greater<std::pair<double, int> >());
+			}
+		}
+		if (goal < 0) return false;
+
+		for (int st = goal; st >= 0; st = m_tparent[st]) {
+			int v = st / N;
+			route.push_back(Node(nodeX(v, sx, gx), nodeY(v, sy, gy)));
+		}
+		std::reverse(route.begin(), route.end());
+		return true;
+	}
+
+	// 障害物が変わっていたら角と角どうしの辺を作り直す
+	void ensureGraph() {
+		if (!m_dirty) return;
+		// 角は少しだけ外に出す (隣の角へ辺の上をなぞる線分が内側を通らないように)
+		const double eps = 1e-3;
+		double r = m_clearance + eps;
+		m_nodes.clear();
+		for (int k = 0; k < m_set.size(); k++) {
+			for (int c = 0; c < m_set.vertexCount(k); c++) {
+				Point p;
+				m_set.offsetVertex(k, c, r, p.x, p.y);
+				// 他の障害物を膨らませた中にある角は使わない
+				bool ok = true;
+				for (int j = 0; j < m_set.size() && ok; j++) {
+					if (j != k && m_set.contains(j, p.x, p.y, m_clearance)) ok = false;
+				}
+				if (ok) m_nodes.push_back(p);
+			}
+		}
+		int n = (int)m_nodes.size();
+		m_adj.assign(n, std::vector<Edge>());
+		m_edges = 0;
+		for (int i = 0; i < n; i++) {
+			for (int j = i + 1; j < n; j++) {
+				const Point &a = m_nodes[i], &b = m_nodes[j];
+				if (!clear(a.x, a.y, b.x, b.y, NULL, NULL)) continue;
+				double d = dist(a.x, a.y, b.x, b.y);
+				m_adj[i].push_back(Edge(j, d));
+				m_adj[j].push_back(Edge(i, d));
+				m_edges++;
+			}
+		}
+		m_builds++;
+		m_dirty = false;
+	}
+
+	double m_clearance;
+	double m_drive, m_turn;		// 移動時間が最短の経路を探すときの速さ
+	std::vector<Rect> m_obs;		// 変わったかを調べるための写し
+	ObstacleSet m_set;				// 障害物の多角形 (見通しはここで調べる)
+	bool m_dirty;				// 障害物が変わった (グラフを作り直す)
+
+	std::vector<Point> m_nodes;				// 膨らませた長方形の角
+	std::vector<std::vector<Edge> > m_adj;	// 角どうしの見通しの良い辺
+	long m_builds;
+	int m_edges;
+
+	// 探索の作業用 (毎回確保しない)
+	std::vector<double> m_startMode, m_goalMode, m_pairMode;
+	std::vector<Edge> m_startEdges;
+	std::vector<double> m_goalCost;
+	std::vector<double> m_g;
+	std::vector<int> m_parent;
+	std::vector<char> m_closed;
+	std::vector<std::pair<double, int> > m_open;
+	std::vector<double> m_tg;		// planTime の (角, 来た角) ごとの時間
+	std::vector<int> m_tparent;
+	std::vector<char> m_tclosed;
+	long m_expanded;
+};
+
+#endif
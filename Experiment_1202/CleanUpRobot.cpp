@@ -9,6 +9,10 @@
 #include <map>
 #include <string>
 #include "Parameter.h"
+#include "MsgDispatch.h"
+#include "LayoutBatch.h"
+#include "AsyncLog.h"
+#include "TraceRecorder.h"
 
 using namespace std;
 
@@ -22,7 +26,15 @@ using namespace std;
 #define TRUCK_RADIUS 60
 #define ROTATE_ANG 0
 #define FIND_OBJ_BY_ID_MODE false
-#define UPDATE_INTERVAL 0.05
+#define UPDATE_INTERVAL 0.05	// onAction の最小の呼び出し間隔
+#define MAX_INTERVAL 1.0		// m_time を待っている間の最大の呼び出し間隔
+#define WAKE_MARGIN 0.001		// m_time ちょうどだと evt.time() > m_time にならないので少し後に起きる
+#define SETTLE_TIME 0.1			// 車輪を止めてから次の動作に移るまでの待ち時間(コールバック内では待たない)
+// 実験の記録 (TraceRecorder.h, OfflineSim/TraceDecode で読む)
+#define TRACE_FILENAME "trace.bin"
+#define TRACE_POSE_INTERVAL 0.5	// 位置を記録する間隔 [s]
+// サービスとの送受信の記録 (OfflineSim -p で再生して、送信メッセージを比べられる)
+#define CONVERSATION_FILENAME "conversation.txt"
 
 // ロボットの状態
 #define INIT_STATE 0			// 初期状態
@@ -42,20 +54,6 @@ using namespace std;
 #define RAD2DEG(RAD) ( (RAD) * 180.0 / (PI) )
 
 
-class Utility {
-public:
-	void AppendString2File(string msg, string _filename);
-};
-
-void Utility::AppendString2File(string msg, string _filename) {
-	char filename[256];
-	sprintf(filename, "%s", _filename.c_str());
-	
-	FILE *fw = fopen(filename, "a");
-	fprintf(fw, "%s\n", msg.c_str());
-	fclose(fw);
-	return;
-}
 
 class Entity
 {
@@ -87,12 +85,12 @@ Entity::Entity(string _type, int _id, string _name) {
 string Entity::ToString() {
 	char content[256];
 	sprintf(content, "%s %d %s %lf %lf %lf \n", type.c_str(), id, name.c_str(), x, y, z);
-	printf("entity ToString: %s \n", content);	
+	ALOG_DEBUG((ALOG_CONSOLE, "entity ToString: %s \n", content));	
 	return string(content);
 }
 
 void Entity::PrintToConsole() {
-	printf("entity: %s %d %s %lf %lf %lf \n", type.c_str(), id, name.c_str(), x, y, z);
+	ALOG_DEBUG((ALOG_CONSOLE, "entity: %s %d %s %lf %lf %lf \n", type.c_str(), id, name.c_str(), x, y, z));
 	return;
 }
 
@@ -118,7 +116,12 @@ public:
 	void onRecvMsg(RecvMsgEvent &evt); 
 	void onCollision(CollisionEvent &evt); 
 
-	char* sendSceneInfo(std::string header = "AskRandomRoute", int CamID = 1);
+	void sendSceneInfo(std::string header = "AskRandomRoute", int CamID = 1);
+	// 指令・送信は記録してから行う
+	void commandWheel(double left, double right);
+	void commandJoint(const char *name, double vel);
+	void sendToSrv(const std::string &msg);
+	void traceState();
 	void setCameraPosition(double angle, int camID);
 	void setRobotHeadingAngle(double angle);
 	void setRobotPosition(double x, double z);
@@ -142,6 +145,38 @@ public:
 	double goToObj(Vector3d pos, double vel, double range, double now);
 	void UpdatePosition(Entity entity);
 
+	/* @brief  車輪を止め、SETTLE_TIME 後に次の状態に移る
+	* @param  nextState 止まった後の状態
+	* @param  now       現在時間
+	*/
+	void stopAndSettle(int nextState, double now);
+
+	/* @brief  onAction の戻り値を求める。m_time を待っている状態なら m_time まで起こさない
+	* @param  now 現在時間
+	* @return 次に onAction が呼ばれるまでの間隔
+	*/
+	double nextInterval(double now);
+
+	// メッセージごとの処理 (s_commands から呼ばれる)
+	void onMsgReset(const MsgArgs &args);
+	void onMsgWireFormat(const MsgArgs &args);
+	void onMsgStartSetPosition(const MsgArgs &args);
+	void onMsgSetEntityPosition(const MsgArgs &args);
+	void onMsgSetEntityPositions(const MsgArgs &args);
+	void onMsgFinishSetPosition(const MsgArgs &args);
+	void onMsgRandomRouteStart(const MsgArgs &args);
+	void onMsgRandomRouteArrived(const MsgArgs &args);
+	void onMsgRandomRoute(const MsgArgs &args);
+	void onMsgGoForwardVelocity(const MsgArgs &args);
+	void onMsgRotateVelocity(const MsgArgs &args);
+	void onMsgStop(const MsgArgs &args);
+	void onMsgCamID(const MsgArgs &args);
+	void onMsgCaptureData(const MsgArgs &args);
+	void onMsgCameraAngle(const MsgArgs &args);
+	void onMsgRobotAngle(const MsgArgs &args);
+	void onMsgRotateDir(const MsgArgs &args);
+	void onMsgRobotPosition(const MsgArgs &args);
+
 private:
 	RobotObj *m_my;
 
@@ -204,6 +239,13 @@ private:
 
 	// 移動終了時間
 	double m_time;
+	// 最後に onAction が呼ばれた時間(onRecvMsg では時間が分からないため)
+	double m_now;
+
+	// 実験の記録
+	TraceRecorder m_trace;
+	int m_tracedState;			// 最後に記録した m_state
+	double m_lastPoseTrace;
 
 	// 初期位置
 	Vector3d m_inipos;
@@ -221,15 +263,46 @@ private:
 	double m_range;
 	double m_lookObjFlg;
 
-	Utility	m_util;
+	// 受信メッセージの振り分け
+	typedef MsgDispatcher<MyController> Dispatcher;
+	static const Dispatcher::Command s_commands[];
+	static const int s_commandNum;
+	Dispatcher m_dispatcher;
+	// 送信するメッセージの形式 (既定はテキスト)
+	MsgWire m_wire;
 };  
 
 
+void MyController::commandWheel(double left, double right) {
+	m_trace.wheel(m_now, left, right);
+	m_my->setWheelVelocity(left, right);
+}
+
+void MyController::commandJoint(const char *name, double vel) {
+	m_trace.joint(m_now, name, vel);
+	m_my->setJointVelocity(name, vel, 0.0);
+}
+
+void MyController::sendToSrv(const std::string &msg) {
+	m_trace.send(m_now, msg.c_str());
+	AsyncLog::instance().print(ALOG_CONVERSATION, "%.3lf > RecogTrash %s\n", m_now, msg.c_str());
+	m_srv->sendMsgToSrv(msg);
+}
+
+// m_state が変わっていたら記録する (状態は番号で、名前は番号の文字列)
+void MyController::traceState() {
+	if (m_state == m_tracedState) return;
+	char name[16];
+	sprintf(name, "%d", m_state);
+	m_trace.state(m_now, m_tracedState, m_state, name);
+	m_tracedState = m_state;
+}
+
 void MyController::setCameraPosition(double angle, int camID) {
 	double xDir = sin(DEG2RAD(angle));
 	double zDir = cos(DEG2RAD(angle));
 	m_my->setCamDir(Vector3d(xDir, 0.0, zDir), camID);
-	printf("camera Dir converted \n");
+	ALOG_DEBUG((ALOG_CONSOLE, "camera Dir converted \n"));
 	return;
 }
 
@@ -247,9 +320,20 @@ void MyController::setRobotPosition(double x, double z) {
 	return;
 }
 
-char* MyController::sendSceneInfo(std::string header, int camID) {
+// Start と AskRandomRoute は引数が同じ
+template <class T>
+static T makeSceneMsg(double x, double z, double theta, const Vector3d &campos, const Vector3d &cdir)
+{
+	T msg;
+	msg.x = x; msg.z = z; msg.theta = theta;
+	msg.camX = campos.x(); msg.camY = campos.y(); msg.camZ = campos.z();
+	msg.dirX = cdir.x(); msg.dirY = cdir.y(); msg.dirZ = cdir.z();
+	return msg;
+}
+
+void MyController::sendSceneInfo(std::string header, int camID) {
 	
-	m_my->setWheelVelocity(0.0, 0.0);		
+	commandWheel(0.0, 0.0);		
 	Vector3d myPos;
 	m_my->getPosition(myPos);
 	double x = myPos.x();
@@ -284,18 +368,22 @@ char* MyController::sendSceneInfo(std::string header, int camID) {
 	Vector3d cdir;
 	m_my->getCamDir(cdir, camID);
 
-	char *replyMsg = new char[1024];
-	sprintf(replyMsg, "%s %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf %6.1lf", 
-						header.c_str(), x, z, theta, campos.x(), campos.y(), campos.z(), cdir.x(), cdir.y(), cdir.z());
-	printf("%s \n", replyMsg);
-
-	m_srv->sendMsgToSrv(replyMsg);
-	printf("make sleep\n");
-	usleep(100000);	//0.1second
+	std::string replyMsg, replyText;
+	if (header == StartMsg::header()) {
+		StartMsg msg = makeSceneMsg<StartMsg>(x, z, theta, campos, cdir);
+		replyMsg = m_wire.encode(msg);
+		replyText = m_wire.text(msg);
+	} else {
+		AskRandomRouteMsg msg = makeSceneMsg<AskRandomRouteMsg>(x, z, theta, campos, cdir);
+		replyMsg = m_wire.encode(msg);
+		replyText = m_wire.text(msg);
+	}
+	ALOG_INFO((ALOG_CONSOLE, "%s \n", replyText.c_str()));
 
-	m_util.AppendString2File(string(replyMsg), REPLY_MESS_FILENAME);
+	sendToSrv(replyMsg);
 
-	return replyMsg;
+	// バイナリで送った場合もファイルにはテキストで残す
+	asyncLogLine(ALOG_REPLY, replyText);
 }
 
 
@@ -303,6 +391,11 @@ void MyController::onInit(InitEvent &evt)
 {  
 	m_my = getRobotObj(myname());
 
+	// 送受信メッセージの記録 (書き込みは AsyncLog のスレッドで行う)
+	AsyncLog::instance().open(ALOG_REPLY, REPLY_MESS_FILENAME);
+	AsyncLog::instance().open(ALOG_RECV, RECV_MESS_FILENAME);
+	AsyncLog::instance().open(ALOG_LOG, LOG_FILENAME);
+
 	// 初期位置取得
 	m_my->getPosition(m_inipos);
 
@@ -316,6 +409,7 @@ void MyController::onInit(InitEvent &evt)
 	m_distance = 10.0;
 
 	m_time = 0.0;
+	m_now = 0.0;
 
 	// 車輪の半径と車輪間距離設定
 	m_my->setWheel(m_radius, m_distance);
@@ -336,12 +430,30 @@ void MyController::onInit(InitEvent &evt)
 	m_sended = false;
 	m_executed = false;
 
+	m_dispatcher.init(this, s_commands, s_commandNum);
+
+	m_tracedState = m_state;
+	m_lastPoseTrace = -TRACE_POSE_INTERVAL;
+	AsyncLog::instance().open(ALOG_CONVERSATION, CONVERSATION_FILENAME, false);
+	if (!m_trace.open(TRACE_FILENAME)) {
+		ALOG_ERR((ALOG_CONSOLE, "cannot open %s \n", TRACE_FILENAME));
+	}
 }  
   
 
 
 double MyController::onAction(ActionEvent &evt) 
 {
+	m_now = evt.time();
+	// onRecvMsg で変わった状態を記録する
+	traceState();
+	if (m_trace.isOpen() && m_now - m_lastPoseTrace >= TRACE_POSE_INTERVAL) {
+		Vector3d myPos;
+		m_my->getPosition(myPos);
+		m_trace.pose(m_now, myPos.x(), myPos.z(), calcHeadingAngle());
+		m_lastPoseTrace = m_now;
+	}
+
 	//if(evt.time() < m_time) printf("state: %d \n", m_state);
 	switch(m_state) {
 		// 初期状態
@@ -354,8 +466,8 @@ double MyController::onAction(ActionEvent &evt)
 				}
 			} else if(m_srv != NULL && m_executed == false){  
 				//rotate toward upper
-				m_my->setJointVelocity("LARM_JOINT4", -m_jvel, 0.0);
-				m_my->setJointVelocity("RARM_JOINT4", -m_jvel, 0.0);
+				commandJoint("LARM_JOINT4", -m_jvel);
+				commandJoint("RARM_JOINT4", -m_jvel);
 				// 50°回転
 				m_time = DEG2RAD(ROTATE_ANG) / m_jvel + evt.time();
 				m_state = 5;
@@ -366,10 +478,10 @@ double MyController::onAction(ActionEvent &evt)
 
 		case 5: {
 			if(evt.time() > m_time && m_executed == false) {
-				m_my->setJointVelocity("LARM_JOINT4", 0.0, 0.0);
-				m_my->setJointVelocity("RARM_JOINT4", 0.0, 0.0);
+				commandJoint("LARM_JOINT4", 0.0);
+				commandJoint("RARM_JOINT4", 0.0);
 				sendSceneInfo("Start");				
-				printf("Started! \n");
+				ALOG_INFO((ALOG_CONSOLE, "Started! \n"));
 				m_executed = true;
 			}
 			break;
@@ -396,21 +508,26 @@ double MyController::onAction(ActionEvent &evt)
 	  	}
 
 		case 807: {
+			// 回転中
 			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);
-				printf("make sleep\n");
-				usleep(100000);	//0.1second			
-	
-				printf("移動先 x: %lf, z: %lf \n", nextPos.x(), nextPos.z());
+				stopAndSettle(808, evt.time());
+			}
+			break;
+		}
+
+		case 808: {
+			// 回転後、止まるのを待ってから移動を開始する
+			if(evt.time() > m_time && m_executed == false) {
+				ALOG_DEBUG((ALOG_CONSOLE, "移動先 x: %lf, z: %lf \n", nextPos.x(), nextPos.z()));
 				
 				if (!TELEPORT) {
 					m_time = goToObj(nextPos, m_vel*4, m_range, evt.time());
 				
 					if (m_lookObjFlg == 1.0) {
-						printf("looking to Obj \n");				
+						ALOG_DEBUG((ALOG_CONSOLE, "looking to Obj \n"));				
 						m_state = 810;
 					} else {
-						printf("go to next node \n");				
+						ALOG_DEBUG((ALOG_CONSOLE, "go to next node \n"));				
 						m_state = 815;
 					}
 				} else {	// 瞬間移動
@@ -426,10 +543,14 @@ double MyController::onAction(ActionEvent &evt)
 		case 810: {
 			// 送られた座標に移動中
 			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);
-				printf("make sleep\n");
-				usleep(100000);	//0.1second
+				stopAndSettle(811, evt.time());
+			}
+			break;
+		}
 
+		case 811: {
+			// 止まった後、見るべき方向に回転する
+			if(evt.time() > m_time && m_executed == false) {
 				m_time = rotateTowardObj(m_lookingPos, m_rotateVel, evt.time());
 				m_executed = false;
 				m_state = 815;
@@ -440,12 +561,16 @@ double MyController::onAction(ActionEvent &evt)
 		case 815: {
 			// 送られた座標に移動中
 			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);
-				printf("make sleep\n");
-				usleep(100000);	//0.1second
-				
+				stopAndSettle(816, evt.time());
+			}
+			break;
+		}
+
+		case 816: {
+			// 止まってからシーン情報を送る
+			if(evt.time() > m_time && m_executed == false) {
 				sendSceneInfo();
-				printf("sent data to SIGViewer \n");				
+				ALOG_DEBUG((ALOG_CONSOLE, "sent data to SIGViewer \n"));				
 				m_executed = true;
 			}
 			break;
@@ -462,11 +587,8 @@ double MyController::onAction(ActionEvent &evt)
 		case 921: {
 			// ロボットが回転中
 			if(evt.time() > m_time && m_executed == false) {
-				m_my->setWheelVelocity(0.0, 0.0);
-				printf("make sleep\n");
-				usleep(100000);	//0.1second
-
-				m_executed = false;
+				commandWheel(0.0, 0.0);
+				m_executed = true;
 			}
 			break;
 		}
@@ -477,205 +599,304 @@ double MyController::onAction(ActionEvent &evt)
 
 	}
 
-	return UPDATE_INTERVAL;
+	traceState();
+	return nextInterval(evt.time());
 }  
 
 
+double MyController::nextInterval(double now)
+{
+	switch(m_state) {
+		// evt.time() > m_time && m_executed == false で待っている状態
+		case 5:
+		case 800:
+		case 805:
+		case 807:
+		case 808:
+		case 810:
+		case 811:
+		case 815:
+		case 816:
+		case 921: {
+			if (m_executed == false && m_time > now) {
+				double interval = m_time - now + WAKE_MARGIN;
+				if (interval < UPDATE_INTERVAL) interval = UPDATE_INTERVAL;
+				if (interval > MAX_INTERVAL) interval = MAX_INTERVAL;
+				return interval;
+			}
+			break;
+		}
+
+		default: {
+			break;
+		}
+	}
+
+	return UPDATE_INTERVAL;
+}
+
+
 
 
 void MyController::onRecvMsg(RecvMsgEvent &evt)
 {  
 	// 送信者取得
 	std::string sender = evt.getSender();
-	std::cout << "sender: " << sender << std::endl;
-
-	char *all_msg = (char*)evt.getMsg();		
-	printf("all_msg: %s \n", all_msg);
-
-	// debug
-	char all_msg_bak[256];
-	sprintf(all_msg_bak, "%s", all_msg);
-	printf("___all_msg_bak: %s\n", all_msg_bak);
-
-	char *delim = (char *)(" ");
-	char *ctx;
-	char *header = strtok_r(all_msg, delim, &ctx);
-	printf("header: %s\n", header);
-
-	if (strcmp(header, "RESET") == 0) {
-		printf("Received RESET \n");
-		setRobotPosition(0, -50);	
-		setRobotHeadingAngle(0);
-		setCameraPosition(0, 3);
-		printf("Reseted RobotPosition \n");
-		//char* replyMsg = sendSceneInfo();
-		sendSceneInfo("Start");
-		m_executed = true;
+	ALOG_DEBUG((ALOG_CONSOLE, "sender: %s \n", sender.c_str()));
+
+	const char *all_msg = evt.getMsg();		
+	ALOG_DEBUG((ALOG_CONSOLE, "all_msg: %s \n", all_msg));
+	m_trace.recv(m_now, sender.c_str(), all_msg);
+	AsyncLog::instance().print(ALOG_CONVERSATION, "%.3lf < %s %s\n", m_now, sender.c_str(), all_msg);
+
+	// ヘッダでハンドラを引いて呼ぶ (送信者が違うものは無視する)
+	Dispatcher::Result result = m_dispatcher.dispatch(sender.c_str(), all_msg);
+	if (result == Dispatcher::MSG_UNKNOWN) {
+		ALOG_ERR((ALOG_CONSOLE, "unknown message: %s \n", all_msg));
+	}
+}  
+
+
+void MyController::onMsgReset(const MsgArgs &args)
+{
+	ALOG_DEBUG((ALOG_CONSOLE, "Received RESET \n"));
+	setRobotPosition(0, -50);	
+	setRobotHeadingAngle(0);
+	setCameraPosition(0, 3);
+	ALOG_DEBUG((ALOG_CONSOLE, "Reseted RobotPosition \n"));
+	sendSceneInfo("Start");
+	m_executed = true;
+}
+
+// 送信する形式の切り替え "WireFormat text|binary" (知らない形式ならテキストのまま)
+void MyController::onMsgWireFormat(const MsgArgs &args)
+{
+	WireFormatMsg in;
+	msgRead(args, in);
+	if (!m_wire.setFormat(in.format)) {
+		ALOG_ERR((ALOG_CONSOLE, "unknown wire format: %s \n", in.format.c_str()));
+	}
+	// 返事はどちらの形式でも読めるようにテキストで送る
+	WireFormatMsg msg;
+	msg.format = m_wire.formatName();
+	ALOG_INFO((ALOG_CONSOLE, "%s \n", m_wire.text(msg).c_str()));
+	if (m_srv != NULL) sendToSrv(m_wire.text(msg));
+}
+
+void MyController::onMsgStartSetPosition(const MsgArgs &args)
+{
+	sendToSrv(REQ_ENTITY_POS_MSG);	
+}
+
+// "SetEntityPosition type id name x y z"
+void MyController::onMsgSetEntityPosition(const MsgArgs &args)
+{
+	SetEntityPositionMsg in;
+	msgRead(args, in);
+	// メッセージを解析して、エンティティの位置をセットする
+	Entity entity(in.type, in.id, in.name);
+	entity.SetPosition(in.x, in.y, in.z);
+	entity.PrintToConsole();
+
+	// 移動させる
+	UpdatePosition(entity);
+	sendToSrv(REQ_ENTITY_POS_MSG);
+}
+
+// "SetEntityPositions n type id name x y z ..." まとめて移動させる (LayoutBatch.h)
+void MyController::onMsgSetEntityPositions(const MsgArgs &args)
+{
+	std::vector<Entity> entities;
+	if (layoutParseEntities(args.rest(1), args.i(0), entities) < 0) {
+		// 壊れたまとめは1個も動かさず、続きも要求しない
+		ALOG_ERR((ALOG_CONSOLE, "broken %s: %s \n", SET_ENTITIES_POS_MSG, args.msg()));
 		return;
 	}
+	for (int i = 0; i < entities.size(); i++) {
+		UpdatePosition(entities[i]);
+	}
+	sendToSrv(REQ_ENTITY_POS_MSG);
+}
 
+void MyController::onMsgFinishSetPosition(const MsgArgs &args)
+{
+	sendSceneInfo();
+}
 
-	// 送信者がゴミ認識サービスの場合
-	if(sender == "RecogTrash") {
-		if (strcmp(header, START_SET_POS_MSG) == 0) {			
-			m_srv->sendMsgToSrv(REQ_ENTITY_POS_MSG);	
-			return;
-		}
+void MyController::onMsgRandomRouteStart(const MsgArgs &args)
+{
+	// 受信メッセージの記録
+	asyncLogLine(ALOG_RECV, args.msg());
 
-		if (strcmp(header, SET_ENTITY_POS_MSG) == 0) {
-			// メッセージを解析して、エンティティの位置をセットする
-			printf("メッセージの未解析部分 :%s \n", ctx);
-			
-			Entity entity ;						
-			entity.PrintToConsole();
-			entity.GetEntityInfo(ctx);
-
-			// 移動させる
-			UpdatePosition(entity);
-			m_srv->sendMsgToSrv(REQ_ENTITY_POS_MSG);
-			return;
-		}
+	m_state = 800;
+	m_executed = false;
+}
 
-		if (strcmp(header, FIN_SET_POS_MSG) == 0) {			
-			sendSceneInfo();
-			return;
-		}
+void MyController::onMsgRandomRouteArrived(const MsgArgs &args)
+{
+	m_state = 800;
+	m_executed = false;
+}
 
-		double x = 0, y = 0, z = 0; // range = 0;
+// "RandomRoute x z range lookX lookZ lookFlg"
+void MyController::onMsgRandomRoute(const MsgArgs &args)
+{
+	RandomRouteMsg in;
+	msgRead(args, in);
+	double x = in.x;
+	double z = in.z;
+	m_range = in.range;	
+	nextPos.set(x, 0, z);
+
+	double lookingX = in.lookX;
+	double lookingZ = in.lookZ;
+	m_lookingPos.set(lookingX, 0, lookingZ);
+
+	m_lookObjFlg = in.lookFlg;
+	ALOG_DEBUG((ALOG_CONSOLE, "m_lookObjFlg: %lf \n", m_lookObjFlg));
+
+	if (TELEPORT) {
+		setRobotPosition(x, z);
+		double disX = lookingX - x;
+		double disZ = lookingZ - z;
+		double angle = atan2(disX, disZ);
+		angle = RAD2DEG(angle);
+		setRobotHeadingAngle(angle);
+		// 移動が反映されてからシーン情報を送る(状態816)
+		m_time = m_now + SETTLE_TIME;
+		m_state = 816;
+	} else {
+		m_state = 805;
+	}
+	m_executed = false;
+}
 
-		if(strcmp(header, "RandomRouteStart") == 0) {
-			// debug
-			printf("append msg 2 file\n");
-			m_util.AppendString2File(string(all_msg_bak), RECV_MESS_FILENAME);
+void MyController::onMsgGoForwardVelocity(const MsgArgs &args)
+{
+	GoForwardVelocityMsg in;
+	msgRead(args, in);
+	double wheelVel = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "GoForwardVelocity coef: %lf \n", wheelVel));
+	wheelVel *= m_vel;
+	commandWheel(wheelVel * 10., wheelVel * 10.);			
+}
 
-			m_state = 800;
-			m_executed = false;
-			return;
-		}
+void MyController::onMsgRotateVelocity(const MsgArgs &args)
+{
+	RotateVelocityMsg in;
+	msgRead(args, in);
+	double wheelVel = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "RotateVelocity coef: %lf \n", wheelVel));
+	wheelVel *= m_vel;
+	commandWheel(-wheelVel, wheelVel);				
+}
 
-		if(strcmp(header, "RandomRouteArrived") == 0) {
-			//printf("onRecv RandomRouteArrived \n");
-			m_state = 800;
-			m_executed = false;
-			return;
-		}
+void MyController::onMsgStop(const MsgArgs &args)
+{
+	ALOG_DEBUG((ALOG_CONSOLE, "Stop joyStick \n"));
+	commandWheel(0.0, 0.0);				
+	sendSceneInfo();			
+}
 
-		if(strcmp(header, "RandomRoute") == 0) {
-			x = atof(strtok_r(NULL, delim, &ctx));			
-			z = atof(strtok_r(NULL, delim, &ctx));	
-			m_range = atof(strtok_r(NULL, delim, &ctx));	
-			nextPos.set(x, y, z);
+void MyController::onMsgCamID(const MsgArgs &args)
+{
+	CamIDMsg in;
+	msgRead(args, in);
+	ALOG_DEBUG((ALOG_CONSOLE, "Setting CameraID \n"));
+	m_CamID = in.camID;
+}
 
-			double lookingX = atof(strtok_r(NULL, delim, &ctx));
-			double lookingZ = atof(strtok_r(NULL, delim, &ctx));
-			m_lookingPos.set(lookingX, 0, lookingZ);
+// "CaptureData x z angle"
+void MyController::onMsgCaptureData(const MsgArgs &args)
+{
+	CaptureDataMsg in;
+	msgRead(args, in);
+	ALOG_DEBUG((ALOG_CONSOLE, "SetRobotPosition \n"));
+	setRobotPosition(in.x, in.z);
+	double angle = in.angle;
+	ALOG_DEBUG((ALOG_CONSOLE, "setRobotHeadingAngle: %lf \n", angle));
+	setRobotHeadingAngle(angle);
+	sendSceneInfo();
+	m_executed = true;
+}
 
-			m_lookObjFlg = atof(strtok_r(NULL, delim, &ctx));
-			printf("m_lookObjFlg: %lf \n", m_lookObjFlg);
-	
-			if (TELEPORT) {
-				setRobotPosition(x, z);
-				double disX = lookingX - x;
-				double disZ = lookingZ - z;
-				double angle = atan2(disX, disZ);
-				angle = RAD2DEG(angle);
-				setRobotHeadingAngle(angle);
-				sendSceneInfo();					
-			} else {
-				m_state = 805;
-			}
-			m_executed = false;
-			return;
-		}
+// SIGViewer から
+void MyController::onMsgCameraAngle(const MsgArgs &args)
+{
+	CameraAngleMsg in;
+	msgRead(args, in);
+	double angle = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "CameraAngle: %lf \n", angle));
+	setCameraPosition(angle, 3);
+	sendSceneInfo();
+	m_executed = true;
+}
 
-		if(strcmp(header, "GoForwardVelocity") == 0) {
-			double wheelVel = atof(strtok_r(NULL, delim, &ctx));
-			printf("GoForwardVelocity coef: %lf \n", wheelVel);
-			wheelVel *= m_vel;
-			m_my->setWheelVelocity(wheelVel * 10., wheelVel * 10.);			
-			//sendSceneInfo();				
-			return;
-		}
+void MyController::onMsgRobotAngle(const MsgArgs &args)
+{
+	RobotAngleMsg in;
+	msgRead(args, in);
+	ALOG_DEBUG((ALOG_CONSOLE, "rorate robor start \n"));
+	double angle = in.value;
+	ALOG_DEBUG((ALOG_CONSOLE, "RobotHeadingAngle: %lf \n", angle));
+	setRobotHeadingAngle(angle);
+	sendSceneInfo();
+	m_executed = true;
+}
 
-		if(strcmp(header, "RotateVelocity") == 0) {
-			double wheelVel = atof(strtok_r(NULL, delim, &ctx));
-			printf("RotateVelocity coef: %lf \n", wheelVel);
-			wheelVel *= m_vel;
-			m_my->setWheelVelocity(-wheelVel, wheelVel);				
-			//sendSceneInfo();				
-			return;
-		}
+// "RotateDir x z"
+void MyController::onMsgRotateDir(const MsgArgs &args)
+{
+	RotateDirMsg in;
+	msgRead(args, in);
+	// 次に移動する座標を位置を取り出す			
+	nextPos.set(in.x, 0, in.z);
+	ALOG_DEBUG((ALOG_CONSOLE, "RotateDir %lf %lf \n", nextPos.x(), nextPos.z()));		
+	// ロボットのステートを更新
+	m_state = 920;
+	m_executed = false;
+}
 
-		if(strcmp(header, "Stop") == 0) {
-			printf("Stop joyStick \n");
-			m_my->setWheelVelocity(0.0, 0.0);				
-			sendSceneInfo();			
-			return;
-		}
+// "RobotPosition x z"
+void MyController::onMsgRobotPosition(const MsgArgs &args)
+{
+	RobotPositionMsg in;
+	msgRead(args, in);
+	setRobotPosition(in.x, in.z);
+}
 
-		if (strcmp(header, "CamID") == 0) {
-			printf("Setting CameraID \n");
-			m_CamID = atoi(strtok_r(NULL, delim, &ctx));
-			return;
-		}
 
-		if (strcmp(header, "CaptureData") == 0) {
-			printf("SetRobotPosition \n");
-			double x = atof(strtok_r(NULL, delim, &ctx));		
-			double z = atof(strtok_r(NULL, delim, &ctx));
-			setRobotPosition(x, z);
-			double angle = atof(strtok_r(NULL, delim, &ctx));
-			printf("setRobotHeadingAngle: %lf \n", angle);
-			setRobotHeadingAngle(angle);
-			char* replyMsg = sendSceneInfo();
-			//m_srv->sendMsgToSrv(replyMsg);
-			m_executed = true;
-			return;			
-		} 
-
-	} else if (sender == "SIGViewer") {
-		printf("mess from SIGViewer \n");
-
-		if(strcmp(header, "CameraAngle") == 0) {
-			double angle = atof(strtok_r(NULL, delim, &ctx));
-			printf("CameraAngle: %lf \n", angle);
-			setCameraPosition(angle, 3);
-			char* replyMsg = sendSceneInfo();
-			m_executed = true;
-			return;
-		} else if (strcmp(header, "RobotAngle") == 0) {
-			printf("rorate robor start \n");
-			double angle = atof(strtok_r(NULL, delim, &ctx));
-			printf("RobotHeadingAngle: %lf \n", angle);
-			setRobotHeadingAngle(angle);
-			char* replyMsg = sendSceneInfo();
-			//m_srv->sendMsgToSrv(replyMsg);
-			m_executed = true;
-			return;			
-		} else if (strcmp(header, "RotateDir") == 0) {
-			// 次に移動する座標を位置を取り出す			
-			double x = atof(strtok_r(NULL, delim, &ctx));
-			double z = atof(strtok_r(NULL, delim, &ctx));
-			nextPos.set(x, 0, z);
-
-			printf("RotateDir %lf %lf \n", nextPos.x(), nextPos.z());		
-			// ロボットのステートを更新
-			m_state = 920;
-			m_executed = false;
-			return;
-		} else if(strcmp(header, "RobotPosition") == 0) {
-			double x = atof(strtok_r(NULL, delim, &ctx));		
-			double z = atof(strtok_r(NULL, delim, &ctx));
-			setRobotPosition(x, z);
-			return;
-		}
-	}
-}  
+// メッセージの表
+//   ヘッダ, 送信者(NULL は誰でも), 引数のスキーマ, ハンドラ (MSG_COMMAND はヘッダと引数のスキーマを MsgSchema.h から取る)
+const MyController::Dispatcher::Command MyController::s_commands[] = {
+	MSG_COMMAND(Reset,              NULL,         &MyController::onMsgReset),
+	MSG_COMMAND(WireFormat,         NULL,         &MyController::onMsgWireFormat),
+
+	MSG_COMMAND(StartSetPosition,   "RecogTrash", &MyController::onMsgStartSetPosition),
+	MSG_COMMAND(SetEntityPosition,  "RecogTrash", &MyController::onMsgSetEntityPosition),
+	{ SET_ENTITIES_POS_MSG, "RecogTrash", "i*",     &MyController::onMsgSetEntityPositions },
+	MSG_COMMAND(FinishSetPosition,  "RecogTrash", &MyController::onMsgFinishSetPosition),
+	MSG_COMMAND(RandomRouteStart,   "RecogTrash", &MyController::onMsgRandomRouteStart),
+	MSG_COMMAND(RandomRouteArrived, "RecogTrash", &MyController::onMsgRandomRouteArrived),
+	MSG_COMMAND(RandomRoute,        "RecogTrash", &MyController::onMsgRandomRoute),
+	MSG_COMMAND(GoForwardVelocity,  "RecogTrash", &MyController::onMsgGoForwardVelocity),
+	MSG_COMMAND(RotateVelocity,     "RecogTrash", &MyController::onMsgRotateVelocity),
+	MSG_COMMAND(Stop,               "RecogTrash", &MyController::onMsgStop),
+	MSG_COMMAND(CamID,              "RecogTrash", &MyController::onMsgCamID),
+	MSG_COMMAND(CaptureData,        "RecogTrash", &MyController::onMsgCaptureData),
+
+	MSG_COMMAND(CameraAngle,        "SIGViewer",  &MyController::onMsgCameraAngle),
+	MSG_COMMAND(RobotAngle,         "SIGViewer",  &MyController::onMsgRobotAngle),
+	MSG_COMMAND(RotateDir,          "SIGViewer",  &MyController::onMsgRotateDir),
+	MSG_COMMAND(RobotPosition,      "SIGViewer",  &MyController::onMsgRobotPosition),
+};
+const int MyController::s_commandNum = sizeof(MyController::s_commands) / sizeof(MyController::s_commands[0]);
 
 void MyController::UpdatePosition(Entity entity) {
 	SimObj *simObj = getObj(entity.name.c_str());
 	Vector3d pos(entity.x, entity.y, entity.z);
-	printf("name: %s, pos: %lf %lf %lf \n", entity.name.c_str(), pos.x(), pos.y(), pos.z());
+	ALOG_DEBUG((ALOG_CONSOLE, "name: %s, pos: %lf %lf %lf \n", entity.name.c_str(), pos.x(), pos.y(), pos.z()));
+	ALOG_INFO((ALOG_LOG, "%s %s %d %s %lf %lf %lf \n", SET_ENTITY_POS_MSG, entity.type.c_str(), entity.id, entity.name.c_str(), pos.x(), pos.y(), pos.z()));
 	simObj->setPosition(pos);
 	return;
 }
@@ -684,6 +905,16 @@ void MyController::UpdatePosition(Entity entity) {
 void MyController::onCollision(CollisionEvent &evt) { }
 
 
+void MyController::stopAndSettle(int nextState, double now)
+{
+	commandWheel(0.0, 0.0);
+	m_time = now + SETTLE_TIME;
+	m_state = nextState;
+	m_executed = false;
+	return;
+}
+
+
 double MyController::calcHeadingAngle()
 {
 	// 自分の回転を得る
@@ -721,14 +952,14 @@ double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
 	// 近すぎるなら，回転なし
 	double dis = tmpp.x() * tmpp.x() + tmpp.z() * tmpp.z();
 	if (dis < 1.0) {
-		printf("近すぎる回転手なくても良い\n");		
+		ALOG_DEBUG((ALOG_CONSOLE, "近すぎる回転手なくても良い\n"));		
 		return 0.0;
 	}	
 
 	// 自分の回転を得る
 	Rotation myRot;
 	m_my->getRotation(myRot);
-	printf("ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z());
+	ALOG_DEBUG((ALOG_CONSOLE, "ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z()));
 	
 	// エンティティの初期方向
 	Vector3d iniVec(0.0, 0.0, 1.0);
@@ -743,7 +974,7 @@ double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
 		theta = -1*theta;
 	}
 
-	printf("ロボットが向いている角度 current theta: %lf(deg) \n",  theta * 180 / PI);
+	ALOG_DEBUG((ALOG_CONSOLE, "ロボットが向いている角度 current theta: %lf(deg) \n",  theta * 180 / PI));
 	
 	// z方向からの角度
 	double tmp = tmpp.angle(Vector3d(0.0, 0.0, 1.0));
@@ -774,26 +1005,23 @@ double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
 	} else {
 		// 回転すべき円周距離
 		double distance = m_distance*PI*fabs(targetAngle)/(2*PI);
-		printf("distance: %lf \n", distance);	  
+		ALOG_DEBUG((ALOG_CONSOLE, "distance: %lf \n", distance));	  
 
 		// 車輪の半径から移動速度を得る
 		double vel = m_radius*velocity;
-		printf("radius: %lf, velocity: %lf, vel: %lf \n", m_radius, velocity, vel);		
+		ALOG_DEBUG((ALOG_CONSOLE, "radius: %lf, velocity: %lf, vel: %lf \n", m_radius, velocity, vel));		
 
 		// 回転時間(u秒)
 		double time = distance / vel;
-		printf("rotateTime: %lf = dis: %lf / vel: %lf\n", time, distance, vel);
+		ALOG_DEBUG((ALOG_CONSOLE, "rotateTime: %lf = dis: %lf / vel: %lf\n", time, distance, vel));
 		
 		// 車輪回転開始
 		if (targetAngle > 0.0) {
-			 m_my->setWheelVelocity(velocity, -velocity);
+			 commandWheel(velocity, -velocity);
 		} else {
-			m_my->setWheelVelocity(-velocity, velocity);
+			commandWheel(-velocity, velocity);
 		}
 
-		printf("make sleep\n");
-		usleep(100000);	//0.1second
-
 		return now + time;
 	}
 }
@@ -805,11 +1033,11 @@ double MyController::rotateTowardObj(Vector3d pos, double velocity, double now)
 // object まで移動
 double MyController::goToObj(Vector3d nextPos, double velocity, double range, double now)
 {
-	printf("goToObj関数内　goToObj %lf %lf %lf \n", nextPos.x(), nextPos.y(), nextPos.z());	
+	ALOG_DEBUG((ALOG_CONSOLE, "goToObj関数内　goToObj %lf %lf %lf \n", nextPos.x(), nextPos.y(), nextPos.z()));	
   	// 自分の位置の取得
   	Vector3d myPos;
  	m_my->getPosition(myPos);
-	printf("goToObj関数内 ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z()); 
+	ALOG_DEBUG((ALOG_CONSOLE, "goToObj関数内 ロボットの現在位置: x: %lf, z %lf \n", myPos.x(), myPos.z())); 
 
 	// 自分の位置からターゲットを結ぶベクトル
 	Vector3d pos = nextPos;
@@ -820,21 +1048,19 @@ double MyController::goToObj(Vector3d nextPos, double velocity, double range, do
 
 	// 距離計算
 	double distance = pos.length() - range;
-	printf("gotoObj distance: %lf, range: %lf\n", distance, range);
+	ALOG_DEBUG((ALOG_CONSOLE, "gotoObj distance: %lf, range: %lf\n", distance, range));
 
 	// 車輪の半径から移動速度を得る
 	double vel = m_radius*velocity;
-	printf("radius: %lf, velocity: %lf, vel: %lf \n", m_radius, velocity, vel);
+	ALOG_DEBUG((ALOG_CONSOLE, "radius: %lf, velocity: %lf, vel: %lf \n", m_radius, velocity, vel));
 
 	// 移動開始
-	m_my->setWheelVelocity(velocity, velocity);
-	printf("make sleep\n");
-	usleep(100000);	//0.1second
-	printf("setVelocity: %lf %lf \n", velocity, velocity);
+	commandWheel(velocity, velocity);
+	ALOG_DEBUG((ALOG_CONSOLE, "setVelocity: %lf %lf \n", velocity, velocity));
 
 	// 到着時間取得
 	double time = distance / vel;
-	printf("goToObj time: %lf \n", time);
+	ALOG_DEBUG((ALOG_CONSOLE, "goToObj time: %lf \n", time));
 
 	return now + time;
 }
@@ -4,6 +4,7 @@
 #include <string>
 #include <algorithm>
 #include "Parameter.h"
+#include "../Common/LayoutBatch.h"
 
 using namespace std;
 
@@ -328,6 +329,14 @@ void MyController::onRecvMsg(RecvMsgEvent &evt)
 		return;
 	}
 
+	// まとめて返す "AskEntityPositions [first]" (LayoutBatch.h)
+	if (strcmp(header, ASK_ENTITIES_POS_MSG) == 0) {
+		char *arg = strtok_r(NULL, delim, &ctx);
+		int first = (arg != NULL) ? atoi(arg) : 0;
+		m_srv->sendMsgToSrv(layoutAnswerMsg(m_entities, first));
+		return;
+	}
+
 	if (strcmp(header, START_SET_POS_MSG) == 0) {			
 		m_srv->sendMsgToSrv(REQ_ENTITY_POS_MSG);	
 		return;
@@ -348,6 +357,23 @@ void MyController::onRecvMsg(RecvMsgEvent &evt)
 		return;
 	}
 
+	// まとめて移動させる "SetEntityPositions n type id name x y z ..."
+	if (strcmp(header, SET_ENTITIES_POS_MSG) == 0) {
+		char *arg = strtok_r(NULL, delim, &ctx);
+		int num = (arg != NULL) ? atoi(arg) : 0;
+		vector<Entity> entities;
+		if (layoutParseEntities(ctx, num, entities) < 0) {
+			// 壊れたまとめは1個も動かさず、続きも要求しない
+			printf("broken %s \n", SET_ENTITIES_POS_MSG);
+			return;
+		}
+		for (int i = 0; i < entities.size(); i++) {
+			UpdatePosition(entities[i]);
+		}
+		m_srv->sendMsgToSrv(REQ_ENTITY_POS_MSG);
+		return;
+	}
+
 	if (strcmp(header, FIN_SET_POS_MSG) == 0) {			
 		m_srv->sendMsgToSrv(FIN_SET_POS_MSG);
 		return;
@@ -0,0 +1,166 @@
+// SIGVerse Controller API のスタンドイン (OfflineSim 用)
+// sigserver 無しでコントローラ(.so)をそのままビルド・実行するためのヘッダ
+// 実装は OfflineSim.cpp 側にあり、実行ファイルから .so にシンボルを公開する(-rdynamic)
+#ifndef _OFFLINE_SIM_CONTROLLER_H_
+#define _OFFLINE_SIM_CONTROLLER_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace offsim {
+	class World;
+}
+
+class Vector3d {
+public:
+	Vector3d() : m_x(0.0), m_y(0.0), m_z(0.0) {}
+	Vector3d(double x, double y, double z) : m_x(x), m_y(y), m_z(z) {}
+
+	double x() const { return m_x; }
+	double y() const { return m_y; }
+	double z() const { return m_z; }
+	void x(double v) { m_x = v; }
+	void y(double v) { m_y = v; }
+	void z(double v) { m_z = v; }
+	void set(double x, double y, double z) { m_x = x; m_y = y; m_z = z; }
+
+	Vector3d &operator+=(const Vector3d &v) { m_x += v.m_x; m_y += v.m_y; m_z += v.m_z; return *this; }
+	Vector3d &operator-=(const Vector3d &v) { m_x -= v.m_x; m_y -= v.m_y; m_z -= v.m_z; return *this; }
+	Vector3d &operator*=(double a) { m_x *= a; m_y *= a; m_z *= a; return *this; }
+
+	double length() const { return sqrt(m_x * m_x + m_y * m_y + m_z * m_z); }
+
+	// SIGVerse と同じく2ベクトルのなす角の cos を返す
+	double angle(const Vector3d &v) const {
+		double l = length() * v.length();
+		if (l == 0.0) return 1.0;
+		return (m_x * v.m_x + m_y * v.m_y + m_z * v.m_z) / l;
+	}
+
+private:
+	double m_x;
+	double m_y;
+	double m_z;
+};
+
+class Rotation {
+public:
+	Rotation() : m_qw(1.0), m_qx(0.0), m_qy(0.0), m_qz(0.0) {}
+	Rotation(double qw, double qx, double qy, double qz) : m_qw(qw), m_qx(qx), m_qy(qy), m_qz(qz) {}
+
+	double qw() const { return m_qw; }
+	double qx() const { return m_qx; }
+	double qy() const { return m_qy; }
+	double qz() const { return m_qz; }
+	void setQuaternion(double qw, double qx, double qy, double qz) { m_qw = qw; m_qx = qx; m_qy = qy; m_qz = qz; }
+
+private:
+	double m_qw;
+	double m_qx;
+	double m_qy;
+	double m_qz;
+};
+
+// エンティティのパーツ(手先リンクなど)
+class CParts {
+public:
+	CParts(offsim::World *world, int body, std::string name);
+
+	const char *name() { return m_name.c_str(); }
+	bool getPosition(Vector3d &pos);
+	bool graspObj(std::string name);
+	void releaseObj();
+
+private:
+	offsim::World *m_world;
+	int m_body;
+	std::string m_name;
+};
+
+class SimObj {
+public:
+	SimObj(offsim::World *world, int body);
+	virtual ~SimObj() {}
+
+	const char *name();
+	void getPosition(Vector3d &pos);
+	void setPosition(const Vector3d &pos);
+	void setPosition(double x, double y, double z);
+	void getRotation(Rotation &rot);
+	void setAxisAndAngle(double ax, double ay, double az, double angle);
+	bool getIsGrasped();
+	CParts *getParts(const char *name);
+
+protected:
+	offsim::World *m_world;
+	int m_body;
+};
+
+class RobotObj : public SimObj {
+public:
+	RobotObj(offsim::World *world, int body) : SimObj(world, body) {}
+
+	void setWheel(double radius, double distance);
+	void setWheelVelocity(double left, double right);
+	void setJointVelocity(const char *joint, double vel, double max);
+	double getJointAngle(const char *joint);
+
+	bool getCamPos(Vector3d &pos, int camID = 1);
+	bool getCamDir(Vector3d &dir, int camID = 1);
+	bool setCamDir(Vector3d dir, int camID = 1);
+	std::string getCameraLinkName(int camID = 1);
+};
+
+// サービスへの接続
+class BaseService {
+public:
+	BaseService(offsim::World *world, int service) : m_world(world), m_service(service) {}
+
+	bool sendMsgToSrv(std::string msg);
+
+private:
+	offsim::World *m_world;
+	int m_service;
+};
+
+class InitEvent;
+class ActionEvent;
+class RecvMsgEvent;
+class CollisionEvent;
+
+class Controller {
+public:
+	Controller();
+	virtual ~Controller() {}
+
+	virtual void onInit(InitEvent &evt) {}
+	virtual double onAction(ActionEvent &evt) { return 1.0; }
+	virtual void onRecvMsg(RecvMsgEvent &evt) {}
+	virtual void onCollision(CollisionEvent &evt) {}
+
+	const char *myname();
+	SimObj *getObj(const char *name);
+	RobotObj *getRobotObj(const char *name);
+	void getAllEntities(std::vector<std::string> &v);
+
+	bool checkService(std::string name);
+	BaseService *connectToService(std::string name);
+	void broadcastMsgToSrv(std::string msg);
+	void sendMsg(std::string to, std::string msg);
+
+	// OfflineSim 専用: コントローラを担当エンティティに結びつける
+	void attachWorld(offsim::World *world, std::string name);
+
+private:
+	offsim::World *m_world;
+	std::string m_myname;
+};
+
+#endif
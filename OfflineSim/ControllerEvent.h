@@ -0,0 +1,50 @@
+// SIGVerse ControllerEvent のスタンドイン (OfflineSim 用)
+#ifndef _OFFLINE_SIM_CONTROLLER_EVENT_H_
+#define _OFFLINE_SIM_CONTROLLER_EVENT_H_
+
+#include "Controller.h"
+
+class InitEvent {
+};
+
+class ActionEvent {
+public:
+	ActionEvent(double t) : m_time(t) {}
+	double time() { return m_time; }
+
+private:
+	double m_time;
+};
+
+class RecvMsgEvent {
+public:
+	RecvMsgEvent(std::string sender, std::string msg) : m_sender(sender) {
+		// コントローラ側で strtok_r により書き換えられるため、書き込み可能なバッファで渡す
+		m_buf.assign(msg.begin(), msg.end());
+		m_buf.push_back('\0');
+	}
+	const char *getSender() { return m_sender.c_str(); }
+	const char *getMsg() { return &m_buf[0]; }
+
+private:
+	std::string m_sender;
+	std::vector<char> m_buf;
+};
+
+class CollisionEvent {
+public:
+	typedef std::vector<std::string> WithC;
+
+	CollisionEvent(WithC with, WithC myParts, WithC withParts)
+		: m_with(with), m_myParts(myParts), m_withParts(withParts) {}
+	const WithC &getWith() { return m_with; }
+	const WithC &getMyParts() { return m_myParts; }
+	const WithC &getWithParts() { return m_withParts; }
+
+private:
+	WithC m_with;
+	WithC m_myParts;
+	WithC m_withParts;
+};
+
+#endif
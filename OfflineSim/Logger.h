@@ -0,0 +1,11 @@
+// SIGVerse Logger のスタンドイン (OfflineSim 用)
+#ifndef _OFFLINE_SIM_LOGGER_H_
+#define _OFFLINE_SIM_LOGGER_H_
+
+#include <stdio.h>
+
+#define LOG_MSG(ARGS)		do { printf ARGS; printf("\n"); } while (0)
+#define LOG_ERR(ARGS)		do { printf("ERR: "); printf ARGS; printf("\n"); } while (0)
+#define LOG_DEBUG1(ARGS)	do { } while (0)
+
+#endif
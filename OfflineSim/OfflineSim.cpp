@@ -0,0 +1,970 @@
+// OfflineSim: sigserver 無しでコントローラ(.so)を最大速度で動かすスタンドイン実行環境
+//
+// 使い方
+// $ ./OfflineSim [-q] [-r] [-t 最大シミュレーション時間] [-o 送受信ログ] CleanUpRobot1126.so Scenario/Cleanup1126.txt
+// $ ./OfflineSim -q -p 送受信ログ CleanUpRobot1126.so Scenario/Cleanup1126.txt   (記録の再生・比較)
+//
+// ・createController() で .so からコントローラを生成し、onInit/onAction/onRecvMsg/onCollision を呼ぶ
+// ・車輪ロボットは運動学だけで動かす(差動二輪、円弧で解析的に積分)
+// ・サービス(RecogTrash, SIGViewer など)はシナリオファイルのスクリプトで応答する
+// ・時間はイベント駆動で進めるので、実時間を待たずに CPU の速さで実行される
+// ・終了コード: 0 シナリオどおり、2 シナリオが最後まで進まなかった、3 スクリプトに無いメッセージを送った (再生では記録と合わなかった)
+#include "ControllerEvent.h"
+#include "Controller.h"
+#include <dlfcn.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include "MsgSchema.h"
+
+#define PI 3.1415926535
+
+// 手先(RARM_LINK7)のロボット座標系での位置 [cm]
+#define HAND_SIDE		-16.5
+#define HAND_FORWARD	30.0
+#define HAND_HEIGHT		25.0
+
+namespace offsim {
+
+// ロボット・物体を区別せず一つの構造体で扱う
+struct Body {
+	std::string name;
+	bool robot;
+	bool graspable;
+	double x, y, z;
+	// y軸回りの回転 [rad]
+	double yaw;
+	// 車輪半径、車輪間距離、左右の車輪角速度
+	double radius, distance;
+	double wl, wr;
+	std::map<std::string, double> jointVel;
+	std::map<std::string, double> jointAngle;
+	std::string camLink[4];
+	Vector3d camPos[4];
+	Vector3d camDir[4];
+	// 掴んでいるエンティティ、掴まれているロボット (-1: なし)
+	int grasped;
+	int holder;
+	SimObj *obj;
+	std::map<std::string, CParts*> parts;
+
+	Body() : robot(false), graspable(true), x(0), y(0), z(0), yaw(0),
+		radius(10.0), distance(10.0), wl(0), wr(0), grasped(-1), holder(-1), obj(NULL) {
+		for (int i = 0; i < 4; i++) {
+			camLink[i] = "WAIST_LINK0";
+			camPos[i].set(0.0, 70.0, 10.0);
+			camDir[i].set(0.0, 0.0, 1.0);
+		}
+	}
+};
+
+// サービスのスクリプトの1行
+enum { STEP_EXPECT, STEP_SEND, STEP_WAIT, STEP_FINISH };
+struct Step {
+	int type;
+	double delay;
+	std::string text;
+};
+
+struct Service {
+	std::string name;
+	std::vector<Step> steps;
+	int pc;
+	// スクリプトの実行位置の時刻
+	double cursor;
+	BaseService *conn;
+	int unmatched;
+};
+
+// コントローラ宛ての配送待ちメッセージ
+struct Message {
+	double time;
+	long seq;
+	std::string sender;
+	std::string msg;
+};
+
+// 再生モード(-p)で、コントローラが送るはずのメッセージ
+struct Expected {
+	double time;
+	std::string peer;
+	std::string msg;
+};
+
+struct Replay {
+	bool enabled;
+	std::vector<Expected> expected;
+	size_t pos;
+	long matched, mismatched, extra;
+	double maxDrift;
+	std::vector<std::string> diffs;
+};
+
+struct Stats {
+	long onAction, onRecvMsg, onCollision;
+	long sent, recv;
+	long getObj, getPosition, getRotation;
+	long sleeps;
+	double sleepSec;
+};
+
+class World {
+public:
+	World();
+
+	bool loadScenario(const std::string &path);
+	bool loadWorldXml(const std::string &path);
+	bool loadConversation(const std::string &path);
+
+	int find(const std::string &name);
+	int addBody(const std::string &name);
+	int findService(const std::string &name);
+
+	void start();
+	void advance(double t);
+	void handPos(const Body &b, double &hx, double &hy, double &hz);
+	void checkContacts(std::vector<CollisionEvent> &events);
+	double nextMessageTime();
+	Message popMessage();
+	void toService(int idx, const std::string &msg);
+	void runService(Service &srv);
+	bool finished();
+	void transcript(char dir, const std::string &peer, const std::string &msg);
+
+public:
+	std::vector<Body> bodies;
+	std::map<std::string, int> index;
+	std::vector<Service> services;
+	std::vector<Message> inbox;
+	std::set<std::pair<int, int> > contacts;
+
+	std::string robotName;
+	double now;
+	double graspRadius;
+	double minInterval;
+	double finishAt;
+	long seq;
+	FILE *log;
+	Stats stats;
+	Replay replay;
+};
+
+World *g_world = NULL;
+bool g_realSleep = false;
+
+World::World() : robotName("robot_000"), now(0.0), graspRadius(15.0), minInterval(0.001),
+	finishAt(-1.0), seq(0), log(NULL) {
+	memset(&stats, 0, sizeof(stats));
+	replay.enabled = false;
+	replay.pos = 0;
+	replay.matched = replay.mismatched = replay.extra = 0;
+	replay.maxDrift = 0.0;
+}
+
+int World::find(const std::string &name) {
+	std::map<std::string, int>::iterator it = index.find(name);
+	if (it == index.end()) return -1;
+	return it->second;
+}
+
+int World::addBody(const std::string &name) {
+	int idx = find(name);
+	if (idx >= 0) return idx;
+	Body b;
+	b.name = name;
+	bodies.push_back(b);
+	idx = bodies.size() - 1;
+	index[name] = idx;
+	return idx;
+}
+
+int World::findService(const std::string &name) {
+	for (int i = 0; i < services.size(); i++) {
+		if (services[i].name == name) return i;
+	}
+	return -1;
+}
+
+// "name="value"" 形式の属性値を取り出す
+static bool getXmlAttr(const std::string &tag, const char *attr, std::string &value) {
+	std::string key = std::string(attr) + "=\"";
+	size_t p = tag.find(key);
+	while (p != std::string::npos && p > 0 && !isspace(tag[p - 1])) {
+		p = tag.find(key, p + 1);
+	}
+	if (p == std::string::npos) return false;
+	p += key.size();
+	size_t e = tag.find('"', p);
+	if (e == std::string::npos) return false;
+	value = tag.substr(p, e - p);
+	return true;
+}
+
+// SIGVerse のワールドファイルから instanciate されたエンティティの名前・位置・カメラを読む
+bool World::loadWorldXml(const std::string &path) {
+	std::ifstream ifs(path.c_str());
+	if (!ifs) {
+		fprintf(stderr, "OfflineSim: cannot open world file %s \n", path.c_str());
+		return false;
+	}
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	std::string xml = ss.str();
+
+	// コメントを取り除く
+	size_t c;
+	while ((c = xml.find("<!--")) != std::string::npos) {
+		size_t e = xml.find("-->", c);
+		xml.erase(c, e == std::string::npos ? std::string::npos : e + 3 - c);
+	}
+
+	size_t p = 0;
+	while ((p = xml.find("<instanciate", p)) != std::string::npos) {
+		size_t e = xml.find("</instanciate>", p);
+		if (e == std::string::npos) break;
+		std::string block = xml.substr(p, e - p);
+		p = e;
+
+		std::string head = block.substr(0, block.find('>'));
+		std::string type;
+		getXmlAttr(head, "type", type);
+
+		std::map<std::string, std::string> attrs;
+		size_t a = 0;
+		while ((a = block.find("<set-attr-value", a)) != std::string::npos) {
+			std::string tag = block.substr(a, block.find('>', a) - a);
+			std::string name, value;
+			if (getXmlAttr(tag, "name", name) && getXmlAttr(tag, "value", value)) {
+				attrs[name] = value;
+			}
+			a += tag.size();
+		}
+		if (attrs.find("name") == attrs.end()) continue;
+
+		int idx = addBody(attrs["name"]);
+		Body &b = bodies[idx];
+		b.robot = (type == "Robot");
+		b.x = atof(attrs["x"].c_str());
+		b.y = atof(attrs["y"].c_str());
+		b.z = atof(attrs["z"].c_str());
+		if (attrs.find("qw") != attrs.end() && attrs.find("qy") != attrs.end()) {
+			b.yaw = 2 * atan2(atof(attrs["qy"].c_str()), atof(attrs["qw"].c_str()));
+		}
+
+		size_t cpos = 0;
+		while ((cpos = block.find("<camera", cpos)) != std::string::npos) {
+			std::string tag = block.substr(cpos, block.find('>', cpos) - cpos);
+			std::string id, link, dir, pos;
+			cpos += tag.size();
+			if (!getXmlAttr(tag, "id", id)) continue;
+			int camID = atoi(id.c_str());
+			if (camID < 0 || camID > 3) continue;
+			double vx, vy, vz;
+			if (getXmlAttr(tag, "link", link)) b.camLink[camID] = link;
+			if (getXmlAttr(tag, "direction", dir) && sscanf(dir.c_str(), "%lf %lf %lf", &vx, &vy, &vz) == 3) {
+				b.camDir[camID].set(vx, vy, vz);
+			}
+			if (getXmlAttr(tag, "position", pos) && sscanf(pos.c_str(), "%lf %lf %lf", &vx, &vy, &vz) == 3) {
+				b.camPos[camID].set(vx, vy, vz);
+			}
+		}
+	}
+	return true;
+}
+
+bool World::loadScenario(const std::string &path) {
+	std::ifstream ifs(path.c_str());
+	if (!ifs) {
+		fprintf(stderr, "OfflineSim: cannot open scenario %s \n", path.c_str());
+		return false;
+	}
+	std::string dir = "";
+	if (path.rfind('/') != std::string::npos) {
+		dir = path.substr(0, path.rfind('/') + 1);
+	}
+
+	// repeat ブロック: (開始位置, 回数)
+	std::vector<std::pair<int, int> > repeats;
+	Service *srv = NULL;
+	std::string line;
+	int lineNo = 0;
+
+	while (std::getline(ifs, line)) {
+		lineNo++;
+		if (line.find('#') != std::string::npos) line.erase(line.find('#'));
+		std::istringstream is(line);
+		std::string cmd;
+		if (!(is >> cmd)) continue;
+
+		if (cmd == "world") {
+			std::string xml;
+			is >> xml;
+			if (!loadWorldXml(xml[0] == '/' ? xml : dir + xml)) return false;
+		} else if (cmd == "robot") {
+			is >> robotName;
+		} else if (cmd == "entity") {
+			std::string name;
+			double x = 0, y = 0, z = 0, yaw = 0;
+			is >> name >> x >> y >> z >> yaw;
+			Body &b = bodies[addBody(name)];
+			b.x = x; b.y = y; b.z = z; b.yaw = yaw * PI / 180.0;
+		} else if (cmd == "static") {
+			std::string name;
+			while (is >> name) bodies[addBody(name)].graspable = false;
+		} else if (cmd == "grasp_radius") {
+			is >> graspRadius;
+		} else if (cmd == "min_interval") {
+			is >> minInterval;
+		} else if (cmd == "service") {
+			Service s;
+			is >> s.name;
+			s.pc = 0;
+			s.cursor = 0.0;
+			s.conn = NULL;
+			s.unmatched = 0;
+			services.push_back(s);
+			srv = &services.back();
+			repeats.clear();
+		} else if (srv == NULL) {
+			fprintf(stderr, "%s:%d: '%s' must follow a service line \n", path.c_str(), lineNo, cmd.c_str());
+			return false;
+		} else if (cmd == "repeat") {
+			int n = 1;
+			is >> n;
+			repeats.push_back(std::make_pair((int)srv->steps.size(), n));
+		} else if (cmd == "end") {
+			if (repeats.empty()) {
+				fprintf(stderr, "%s:%d: 'end' without 'repeat' \n", path.c_str(), lineNo);
+				return false;
+			}
+			std::vector<Step> body(srv->steps.begin() + repeats.back().first, srv->steps.end());
+			for (int i = 1; i < repeats.back().second; i++) {
+				srv->steps.insert(srv->steps.end(), body.begin(), body.end());
+			}
+			repeats.pop_back();
+		} else {
+			Step st;
+			st.delay = 0.0;
+			std::string rest;
+			if (cmd == "expect") {
+				st.type = STEP_EXPECT;
+				is >> st.text;
+			} else if (cmd == "send") {
+				st.type = STEP_SEND;
+				is >> st.delay;
+				std::getline(is, rest);
+				st.text = rest.substr(rest.find_first_not_of(" \t") == std::string::npos ? rest.size() : rest.find_first_not_of(" \t"));
+			} else if (cmd == "wait") {
+				st.type = STEP_WAIT;
+				is >> st.delay;
+			} else if (cmd == "finish") {
+				st.type = STEP_FINISH;
+				is >> st.delay;
+			} else {
+				fprintf(stderr, "%s:%d: unknown command '%s' \n", path.c_str(), lineNo, cmd.c_str());
+				return false;
+			}
+			srv->steps.push_back(st);
+		}
+	}
+
+	int r = addBody(robotName);
+	bodies[r].robot = true;
+	bodies[r].graspable = false;
+
+	for (int i = 0; i < bodies.size(); i++) {
+		if (bodies[i].robot) {
+			bodies[i].obj = new RobotObj(this, i);
+		} else {
+			bodies[i].obj = new SimObj(this, i);
+		}
+	}
+	return true;
+}
+
+// 送受信の記録("時刻 < 送信者 メッセージ" / "時刻 > 宛先 メッセージ")を読み込む
+// 受信はその時刻にコントローラに届け、送信は記録と突き合わせる。シナリオのサービスのスクリプトは使わない
+bool World::loadConversation(const std::string &path) {
+	std::ifstream in(path.c_str());
+	if (!in) {
+		fprintf(stderr, "OfflineSim: cannot open %s \n", path.c_str());
+		return false;
+	}
+	for (int i = 0; i < services.size(); i++) {
+		services[i].steps.clear();
+		services[i].pc = 0;
+	}
+	inbox.clear();
+	replay.enabled = true;
+
+	double last = 0.0;
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(in, line)) {
+		lineNo++;
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream is(line);
+		double t;
+		std::string dir, peer;
+		if (!(is >> t >> dir >> peer) || (dir != "<" && dir != ">")) {
+			fprintf(stderr, "%s:%d: broken line \n", path.c_str(), lineNo);
+			return false;
+		}
+		std::string rest;
+		std::getline(is, rest);
+		if (!rest.empty() && rest[0] == ' ') rest.erase(0, 1);
+		if (dir == "<") {
+			Message m;
+			m.time = t;
+			m.seq = seq++;
+			m.sender = peer;
+			m.msg = rest;
+			inbox.push_back(m);
+		} else {
+			Expected e;
+			e.time = t;
+			e.peer = peer;
+			e.msg = rest;
+			replay.expected.push_back(e);
+			// 記録にある宛先はサービスとして接続できるようにする
+			if (findService(peer) < 0) {
+				Service srv;
+				srv.name = peer;
+				srv.pc = 0;
+				srv.cursor = 0.0;
+				srv.conn = NULL;
+				srv.unmatched = 0;
+				services.push_back(srv);
+			}
+		}
+		if (t > last) last = t;
+	}
+	finishAt = last + 1.0;
+	return true;
+}
+
+void World::start() {
+	for (int i = 0; i < services.size(); i++) {
+		runService(services[i]);
+	}
+}
+
+// スクリプトを次の expect まで進める
+void World::runService(Service &srv) {
+	while (srv.pc < srv.steps.size()) {
+		Step &st = srv.steps[srv.pc];
+		if (st.type == STEP_EXPECT) {
+			return;
+		} else if (st.type == STEP_SEND) {
+			srv.cursor += st.delay;
+			Message m;
+			m.time = srv.cursor;
+			m.seq = seq++;
+			m.sender = srv.name;
+			m.msg = st.text;
+			inbox.push_back(m);
+		} else if (st.type == STEP_WAIT) {
+			srv.cursor += st.delay;
+		} else if (st.type == STEP_FINISH) {
+			finishAt = srv.cursor + st.delay;
+			srv.pc = srv.steps.size();
+			return;
+		}
+		srv.pc++;
+	}
+}
+
+void World::toService(int idx, const std::string &msg) {
+	Service &srv = services[idx];
+	stats.sent++;
+	transcript('>', srv.name, msg);
+
+	// 再生モードでは記録と突き合わせるだけ
+	if (replay.enabled) {
+		char buf[64];
+		if (replay.pos >= replay.expected.size()) {
+			replay.extra++;
+			sprintf(buf, "%.3lf", now);
+			if (replay.diffs.size() < 10) replay.diffs.push_back(std::string(buf) + " extra: " + srv.name + " " + msg);
+			return;
+		}
+		const Expected &e = replay.expected[replay.pos++];
+		if (e.peer == srv.name && e.msg == msg) {
+			replay.matched++;
+			double drift = fabs(now - e.time);
+			if (drift > replay.maxDrift) replay.maxDrift = drift;
+		} else {
+			replay.mismatched++;
+			sprintf(buf, "%.3lf", e.time);
+			if (replay.diffs.size() < 10) {
+				replay.diffs.push_back(std::string(buf) + " expected: " + e.peer + " " + e.msg);
+				sprintf(buf, "%.3lf", now);
+				replay.diffs.push_back(std::string(buf) + "      got: " + srv.name + " " + msg);
+			}
+		}
+		return;
+	}
+
+	// バイナリ形式 (MsgSchema.h) のメッセージはヘッダだけ decode して照合する
+	std::string header = msg.substr(0, msg.find(' '));
+	if (!msg.empty() && msg[0] == MSG_BINARY_MARK) {
+		MsgArgs args;
+		if (msgDecodeBinary(srv.name.c_str(), msg.c_str(), args)) header = args.header();
+	}
+	if (srv.pc < srv.steps.size() && srv.steps[srv.pc].type == STEP_EXPECT && srv.steps[srv.pc].text == header) {
+		srv.pc++;
+		srv.cursor = now;
+		runService(srv);
+	} else {
+		srv.unmatched++;
+	}
+}
+
+double World::nextMessageTime() {
+	double t = 1e100;
+	for (int i = 0; i < inbox.size(); i++) {
+		if (inbox[i].time < t) t = inbox[i].time;
+	}
+	return t;
+}
+
+Message World::popMessage() {
+	int best = 0;
+	for (int i = 1; i < inbox.size(); i++) {
+		if (inbox[i].time < inbox[best].time ||
+			(inbox[i].time == inbox[best].time && inbox[i].seq < inbox[best].seq)) {
+			best = i;
+		}
+	}
+	Message m = inbox[best];
+	inbox.erase(inbox.begin() + best);
+	return m;
+}
+
+bool World::finished() {
+	return finishAt >= 0.0 && now >= finishAt;
+}
+
+void World::transcript(char dir, const std::string &peer, const std::string &msg) {
+	if (log) fprintf(log, "%.3lf %c %s %s\n", now, dir, peer.c_str(), msg.c_str());
+}
+
+void World::handPos(const Body &b, double &hx, double &hy, double &hz) {
+	hx = b.x + HAND_SIDE * cos(b.yaw) + HAND_FORWARD * sin(b.yaw);
+	hy = b.y + HAND_HEIGHT;
+	hz = b.z - HAND_SIDE * sin(b.yaw) + HAND_FORWARD * cos(b.yaw);
+}
+
+// 時刻 t まで運動学で進める(車輪速度は区間内で一定なので円弧で解析的に積分)
+void World::advance(double t) {
+	double dt = t - now;
+	if (dt <= 0.0) return;
+
+	for (int i = 0; i < bodies.size(); i++) {
+		Body &b = bodies[i];
+		if (!b.robot) continue;
+
+		double v = b.radius * (b.wl + b.wr) / 2.0;
+		double w = b.radius * (b.wr - b.wl) / b.distance;
+		if (fabs(w) < 1e-12) {
+			b.x += v * sin(b.yaw) * dt;
+			b.z += v * cos(b.yaw) * dt;
+		} else {
+			double yaw1 = b.yaw + w * dt;
+			b.x += v / w * (cos(b.yaw) - cos(yaw1));
+			b.z += v / w * (sin(yaw1) - sin(b.yaw));
+			b.yaw = atan2(sin(yaw1), cos(yaw1));
+		}
+
+		std::map<std::string, double>::iterator it;
+		for (it = b.jointVel.begin(); it != b.jointVel.end(); it++) {
+			b.jointAngle[it->first] += it->second * dt;
+		}
+
+		if (b.grasped >= 0) {
+			Body &g = bodies[b.grasped];
+			handPos(b, g.x, g.y, g.z);
+		}
+	}
+	now = t;
+}
+
+// 手先が物体に触れ始めたら衝突イベントを作る(SIGVerse と同様、触れている間は繰り返さない)
+void World::checkContacts(std::vector<CollisionEvent> &events) {
+	if (graspRadius <= 0.0) return;
+
+	for (int i = 0; i < bodies.size(); i++) {
+		Body &b = bodies[i];
+		if (!b.robot) continue;
+		double hx, hy, hz;
+		handPos(b, hx, hy, hz);
+
+		for (int j = 0; j < bodies.size(); j++) {
+			Body &o = bodies[j];
+			if (!o.graspable || o.holder >= 0) continue;
+			double dx = o.x - hx;
+			double dz = o.z - hz;
+			bool touch = dx * dx + dz * dz < graspRadius * graspRadius;
+			std::pair<int, int> key(i, j);
+			if (touch && contacts.find(key) == contacts.end()) {
+				contacts.insert(key);
+				CollisionEvent::WithC with(1, o.name), myParts(1, "RARM_LINK7"), withParts(1, "main");
+				events.push_back(CollisionEvent(with, myParts, withParts));
+			} else if (!touch) {
+				contacts.erase(key);
+			}
+		}
+	}
+}
+
+}	// namespace offsim
+
+using offsim::World;
+using offsim::g_world;
+using offsim::g_realSleep;
+
+////////////////////////////////////////////////////////////
+// SIGVerse API の実装
+////////////////////////////////////////////////////////////
+
+CParts::CParts(offsim::World *world, int body, std::string name) : m_world(world), m_body(body), m_name(name) {}
+
+bool CParts::getPosition(Vector3d &pos) {
+	offsim::Body &b = m_world->bodies[m_body];
+	m_world->stats.getPosition++;
+	if (m_name == "RARM_LINK7") {
+		double hx, hy, hz;
+		m_world->handPos(b, hx, hy, hz);
+		pos.set(hx, hy, hz);
+	} else {
+		pos.set(b.x, b.y, b.z);
+	}
+	return true;
+}
+
+bool CParts::graspObj(std::string name) {
+	offsim::Body &b = m_world->bodies[m_body];
+	int idx = m_world->find(name);
+	if (idx < 0 || b.grasped >= 0 || m_world->bodies[idx].holder >= 0) return false;
+	b.grasped = idx;
+	m_world->bodies[idx].holder = m_body;
+	return true;
+}
+
+void CParts::releaseObj() {
+	offsim::Body &b = m_world->bodies[m_body];
+	if (b.grasped < 0) return;
+	m_world->bodies[b.grasped].holder = -1;
+	b.grasped = -1;
+}
+
+SimObj::SimObj(offsim::World *world, int body) : m_world(world), m_body(body) {}
+
+const char *SimObj::name() {
+	return m_world->bodies[m_body].name.c_str();
+}
+
+void SimObj::getPosition(Vector3d &pos) {
+	offsim::Body &b = m_world->bodies[m_body];
+	m_world->stats.getPosition++;
+	pos.set(b.x, b.y, b.z);
+}
+
+void SimObj::setPosition(const Vector3d &pos) {
+	setPosition(pos.x(), pos.y(), pos.z());
+}
+
+void SimObj::setPosition(double x, double y, double z) {
+	offsim::Body &b = m_world->bodies[m_body];
+	b.x = x; b.y = y; b.z = z;
+}
+
+void SimObj::getRotation(Rotation &rot) {
+	offsim::Body &b = m_world->bodies[m_body];
+	m_world->stats.getRotation++;
+	rot.setQuaternion(cos(b.yaw / 2), 0.0, sin(b.yaw / 2), 0.0);
+}
+
+void SimObj::setAxisAndAngle(double ax, double ay, double az, double angle) {
+	// y軸回りの回転のみ扱う
+	offsim::Body &b = m_world->bodies[m_body];
+	b.yaw = ay < 0 ? -angle : angle;
+	b.yaw = atan2(sin(b.yaw), cos(b.yaw));
+}
+
+bool SimObj::getIsGrasped() {
+	return m_world->bodies[m_body].holder >= 0;
+}
+
+CParts *SimObj::getParts(const char *name) {
+	offsim::Body &b = m_world->bodies[m_body];
+	std::map<std::string, CParts*>::iterator it = b.parts.find(name);
+	if (it != b.parts.end()) return it->second;
+	CParts *parts = new CParts(m_world, m_body, name);
+	b.parts[name] = parts;
+	return parts;
+}
+
+void RobotObj::setWheel(double radius, double distance) {
+	offsim::Body &b = m_world->bodies[m_body];
+	b.radius = radius;
+	b.distance = distance;
+}
+
+void RobotObj::setWheelVelocity(double left, double right) {
+	offsim::Body &b = m_world->bodies[m_body];
+	b.wl = left;
+	b.wr = right;
+}
+
+void RobotObj::setJointVelocity(const char *joint, double vel, double max) {
+	m_world->bodies[m_body].jointVel[joint] = vel;
+}
+
+double RobotObj::getJointAngle(const char *joint) {
+	return m_world->bodies[m_body].jointAngle[joint];
+}
+
+bool RobotObj::getCamPos(Vector3d &pos, int camID) {
+	if (camID < 0 || camID > 3) return false;
+	pos = m_world->bodies[m_body].camPos[camID];
+	return true;
+}
+
+bool RobotObj::getCamDir(Vector3d &dir, int camID) {
+	if (camID < 0 || camID > 3) return false;
+	dir = m_world->bodies[m_body].camDir[camID];
+	return true;
+}
+
+bool RobotObj::setCamDir(Vector3d dir, int camID) {
+	if (camID < 0 || camID > 3) return false;
+	m_world->bodies[m_body].camDir[camID] = dir;
+	return true;
+}
+
+std::string RobotObj::getCameraLinkName(int camID) {
+	if (camID < 0 || camID > 3) return "";
+	return m_world->bodies[m_body].camLink[camID];
+}
+
+bool BaseService::sendMsgToSrv(std::string msg) {
+	m_world->toService(m_service, msg);
+	return true;
+}
+
+Controller::Controller() : m_world(NULL) {}
+
+void Controller::attachWorld(offsim::World *world, std::string name) {
+	m_world = world;
+	m_myname = name;
+}
+
+const char *Controller::myname() {
+	return m_myname.c_str();
+}
+
+SimObj *Controller::getObj(const char *name) {
+	m_world->stats.getObj++;
+	int idx = m_world->find(name);
+	if (idx < 0) return NULL;
+	return m_world->bodies[idx].obj;
+}
+
+RobotObj *Controller::getRobotObj(const char *name) {
+	m_world->stats.getObj++;
+	int idx = m_world->find(name);
+	if (idx < 0 || !m_world->bodies[idx].robot) return NULL;
+	return (RobotObj *)m_world->bodies[idx].obj;
+}
+
+void Controller::getAllEntities(std::vector<std::string> &v) {
+	v.clear();
+	for (int i = 0; i < m_world->bodies.size(); i++) {
+		v.push_back(m_world->bodies[i].name);
+	}
+}
+
+bool Controller::checkService(std::string name) {
+	return m_world->findService(name) >= 0;
+}
+
+BaseService *Controller::connectToService(std::string name) {
+	int idx = m_world->findService(name);
+	if (idx < 0) return NULL;
+	offsim::Service &srv = m_world->services[idx];
+	if (srv.conn == NULL) srv.conn = new BaseService(m_world, idx);
+	return srv.conn;
+}
+
+void Controller::broadcastMsgToSrv(std::string msg) {
+	for (int i = 0; i < m_world->services.size(); i++) {
+		m_world->toService(i, msg);
+	}
+}
+
+void Controller::sendMsg(std::string to, std::string msg) {
+	int idx = m_world->findService(to);
+	if (idx >= 0) m_world->toService(idx, msg);
+}
+
+// コールバック内の sleep/usleep を横取りし、シミュレーション時間だけを進める(-r で実際に待つ)
+extern "C" int usleep(useconds_t usec) {
+	if (g_world) {
+		g_world->stats.sleeps++;
+		g_world->stats.sleepSec += usec / 1e6;
+	}
+	if (g_realSleep) {
+		struct timespec ts = { (time_t)(usec / 1000000), (long)(usec % 1000000) * 1000 };
+		nanosleep(&ts, NULL);
+	}
+	return 0;
+}
+
+extern "C" unsigned int sleep(unsigned int sec) {
+	usleep(sec * 1000000);
+	return 0;
+}
+
+static double wallTime() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: OfflineSim [-q] [-r] [-t maxSimTime] [-o transcript] [-p transcript] controller.so scenario.txt \n");
+	fprintf(stderr, "  -q  controller の標準出力を捨てる \n");
+	fprintf(stderr, "  -r  コールバック内の sleep/usleep を実際に待つ \n");
+	fprintf(stderr, "  -t  シミュレーション時間の上限 [s] (default 3600) \n");
+	fprintf(stderr, "  -o  送受信メッセージを時刻付きで書き出す \n");
+	fprintf(stderr, "  -p  記録した送受信メッセージを再生し、送信メッセージを記録と比べる (シナリオは world/robot だけ使う) \n");
+}
+
+int main(int argc, char **argv) {
+	bool quiet = false;
+	double maxTime = 3600.0;
+	const char *logFile = NULL;
+	const char *replayFile = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "qrt:o:p:")) != -1) {
+		switch (opt) {
+			case 'q': quiet = true; break;
+			case 'r': g_realSleep = true; break;
+			case 't': maxTime = atof(optarg); break;
+			case 'o': logFile = optarg; break;
+			case 'p': replayFile = optarg; break;
+			default: usage(); return 1;
+		}
+	}
+	if (argc - optind != 2) {
+		usage();
+		return 1;
+	}
+
+	World world;
+	if (!world.loadScenario(argv[optind + 1])) return 1;
+	if (replayFile && !world.loadConversation(replayFile)) return 1;
+
+	void *handle = dlopen(argv[optind], RTLD_NOW);
+	if (handle == NULL) {
+		fprintf(stderr, "OfflineSim: %s \n", dlerror());
+		return 1;
+	}
+	typedef Controller *(*CreateFunc)();
+	CreateFunc create = (CreateFunc)dlsym(handle, "createController");
+	if (create == NULL) {
+		fprintf(stderr, "OfflineSim: createController not found in %s \n", argv[optind]);
+		return 1;
+	}
+
+	if (logFile) {
+		world.log = fopen(logFile, "w");
+		if (world.log == NULL) {
+			fprintf(stderr, "OfflineSim: cannot open %s \n", logFile);
+			return 1;
+		}
+	}
+	if (quiet) {
+		if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+	}
+
+	g_world = &world;
+	Controller *ctrl = create();
+	ctrl->attachWorld(&world, world.robotName);
+
+	double wallStart = wallTime();
+	InitEvent initEvt;
+	ctrl->onInit(initEvt);
+	world.start();
+
+	double nextAction = 0.0;
+	while (!world.finished()) {
+		double tMsg = world.nextMessageTime();
+		double t = tMsg < nextAction ? tMsg : nextAction;
+		if (t > maxTime) break;
+		world.advance(t);
+
+		std::vector<CollisionEvent> collisions;
+		world.checkContacts(collisions);
+		for (int i = 0; i < collisions.size(); i++) {
+			world.stats.onCollision++;
+			ctrl->onCollision(collisions[i]);
+		}
+
+		if (tMsg <= nextAction) {
+			offsim::Message m = world.popMessage();
+			world.stats.recv++;
+			world.transcript('<', m.sender, m.msg);
+			RecvMsgEvent evt(m.sender, m.msg);
+			world.stats.onRecvMsg++;
+			ctrl->onRecvMsg(evt);
+		} else {
+			ActionEvent evt(t);
+			world.stats.onAction++;
+			double interval = ctrl->onAction(evt);
+			nextAction = t + (interval > world.minInterval ? interval : world.minInterval);
+		}
+	}
+	double wall = wallTime() - wallStart;
+	fflush(stdout);
+
+	offsim::Body &r = world.bodies[world.find(world.robotName)];
+	fprintf(stderr, "OfflineSim: %s \n", argv[optind]);
+	fprintf(stderr, "  sim time     %10.3lf s  wall %.4lf s  (x%.0lf) \n", world.now, wall, wall > 0 ? world.now / wall : 0.0);
+	fprintf(stderr, "  callbacks    onAction %ld  onRecvMsg %ld  onCollision %ld \n",
+		world.stats.onAction, world.stats.onRecvMsg, world.stats.onCollision);
+	fprintf(stderr, "  messages     sent %ld  recv %ld \n", world.stats.sent, world.stats.recv);
+	fprintf(stderr, "  api calls    getObj %ld  getPosition %ld  getRotation %ld \n",
+		world.stats.getObj, world.stats.getPosition, world.stats.getRotation);
+	fprintf(stderr, "  sleeps       %ld calls, %.2lf s %s \n", world.stats.sleeps, world.stats.sleepSec,
+		g_realSleep ? "waited" : "skipped");
+	fprintf(stderr, "  robot        x %.1lf z %.1lf heading %.1lf deg \n", r.x, r.z, r.yaw * 180.0 / PI);
+	if (world.replay.enabled) {
+		offsim::Replay &rp = world.replay;
+		long missing = (long)(rp.expected.size() - rp.pos);
+		fprintf(stderr, "  replay       matched %ld  mismatched %ld  extra %ld  missing %ld  max drift %.3lf s \n",
+			rp.matched, rp.mismatched, rp.extra, missing, rp.maxDrift);
+		for (int i = 0; i < rp.diffs.size(); i++) fprintf(stderr, "    %s \n", rp.diffs[i].c_str());
+		if (world.log) fclose(world.log);
+		delete ctrl;
+		if (!world.finished()) return 2;
+		return (rp.mismatched || rp.extra || missing) ? 3 : 0;
+	}
+	int unmatched = 0;
+	for (int i = 0; i < world.services.size(); i++) {
+		offsim::Service &s = world.services[i];
+		fprintf(stderr, "  service      %s step %d/%d unmatched %d \n", s.name.c_str(), s.pc, (int)s.steps.size(), s.unmatched);
+		unmatched += s.unmatched;
+	}
+	if (world.log) fclose(world.log);
+
+	delete ctrl;
+	if (!world.finished()) return 2;
+	// スクリプトに無いメッセージを送ったら、再生で合わなかったときと同じく失敗にする
+	return unmatched ? 3 : 0;
+}
@@ -0,0 +1,701 @@
+// RouteBench: 経路計画 (Common の GridPlanner.h・VisibilityPlanner.h・RouteTable.h・DStarLite.h) と calcFullRoute (CleanUp_0605/CleanUpRobot0614.cpp) の経路を比べる
+//
+// 使い方
+// $ ./RouteBench [-n 問い合わせ回数] [-s 乱数の種] [-c 升目の大きさ] [カタログ ...]
+//
+// ・部屋の配置ごとに、障害物の外からランダムに出発点・目的地を選び、それぞれの方法で経路を求める
+//   配置は CleanUpRobot0614 のカタログ (CleanUp_0605/CleanUpRobot0614.catalog) の7個と、
+//   引数のカタログ (既定は Room0928_ObjDetect.catalog) の占有範囲
+// ・計画にかかる時間 (setup は障害物を置いて最初の1回。格子を塗る・グラフを作る時間)、経路の長さ、
+//   障害物(膨らませる前)を横切った経路の割合、見つからなかった回数、探索で取り出した升目・頂点の数を出す
+// ・RouteTable は、出発点のうち ANCHOR_NUM 個をアンカーにして、アンカーどうしの問い合わせを表から引く
+//   (setup は表を作る時間。経路の長さは他と問い合わせが違うので比べられない)
+// ・障害物が1個動いたときの計画し直し (配置名の後に "moved" と出す行)
+//   問い合わせの 1/4 の回数、経路を求めてから、ロボットが最初の区間を 30% 進み、障害物を1個 20〜40cm 動かして計画し直す
+//   DStarLite で前の探索を直す (D* repair)・DStarLite で最初から探す (D* fresh)・GridPlanner で格子を塗り直して探す (grid A*) を比べる
+//   D* repair が最初から探したときと違う費用の経路を返したら失敗にする
+// ・time は CleanUpRobot1126 の動き (角ごとに rotateTowardObj で回ってから goToObj で進む) で見積もった移動時間
+//   進む速さ DRIVE_SPEED、回転の速さ TURN_SPEED。出発点で向いている方向は問い合わせごとにランダムに選ぶ
+//   "vis time" は VisibilityPlanner::setSpeed で移動時間が最短の経路を探した行 (向いている方向も与える)
+//   配置ごとに、長さが最短の経路 (visibility) との差を EPISODE_LEGS 区間の1回の掃除で予想して出す
+// ・pts は経路の点の数 (出発点・目的地を含む)。点ごとにロボットは止まって回転する
+//   "calcFull sc" は calcFullRoute の経路を VisibilityPlanner::shortcut で減らした行 (plan は shortcut にかかった時間)
+// ・"grid wide" は GridPlanner::setCorridor で狭いところの費用を高くした行。配置ごとに、
+//   経路の上で障害物までの距離 (ClearanceMap で引く) の平均を grid A* と比べて出す
+// ・ClearanceMap で障害物を1個動かしたとき、動いた範囲だけ直す (update) のと全部作り直す (rebuild) のにかかる時間を比べる
+//   直した値が作り直した値と違ったら失敗にする
+// ・calcFullRoute 以外の経路が障害物を横切ったら失敗にする
+// ・VisibilityPlanner::shortcut で、間の点どうしを結んだ線分が障害物に TRUCK_RADIUS より近づいたら失敗にする
+//   (箱1個を TRUCK_RADIUS より離れて回る決まった経路で調べる。近づいてよいのは出発点・目的地から出る線分だけ)
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "ClearanceMap.h"
+#include "DStarLite.h"
+#include "EntityCatalog.h"
+#include "GridPlanner.h"
+#include "RouteTable.h"
+#include "VisibilityPlanner.h"
+
+#define TRUCK_RADIUS 60
+#define MARGIN       20.0	// 出発点・目的地は障害物からこれだけ離す
+#define ROOM_PAD     100.0	// 障害物の外側に取る範囲
+#define ANCHOR_NUM   8		// RouteTable のアンカーの数 (初期位置・ゴミ3個・ゴミ箱4個くらい)
+#define DRIVE_SPEED  40.0	// CleanUpRobot1126 の goToObj の速さ (m_radius * m_vel * 4) [cm/s]
+#define TURN_SPEED   2.0	// rotateTowardObj の回転の速さ (2 * m_radius * m_rotateVel / m_distance) [rad/s]
+#define EPISODE_LEGS 6		// 1回の掃除の区間の数 (ゴミ3個を拾ってゴミ箱に入れる)
+#define CORRIDOR     (2.0 * TRUCK_RADIUS)	// grid wide: 障害物からこれより近い升目の費用を高くする
+#define CORRIDOR_WEIGHT 1.0
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double frand()
+{
+	return (double)rand() / RAND_MAX;
+}
+
+////////////////////////////////////////////////////////////
+// CleanUpRobot0614.cpp の Node2D / Obstacle / calcRoute / calcFullRoute (printf を除いてそのまま。範囲外の読み出しだけ直した)
+
+class Node2D {
+public:
+	double x;
+	double y;
+	Node2D(double x, double y) {
+		this->x = x;
+		this->y = y;
+	};
+	void setPosition(double x, double y) {
+		this->x = x;
+		this->y = y;
+	};
+};
+
+class Obstacle {
+public:
+	double x;
+	double y;
+	double width;
+	double height;
+	double x_min;
+	double x_max;
+	double y_min;
+	double y_max;
+
+	Obstacle() {
+	};
+	Obstacle(double x, double y, double width, double height) {
+		setPosition(x, y, width, height);
+	};
+	void setPosition(double x, double y, double width, double height) {
+		this->x = x;
+		this->y = y;
+		this->width = width;
+		this->height = height;
+		this->x_min = x - width / 2;
+		this->x_max = x + width / 2;
+		this->y_min = y - height / 2;
+		this->y_max = y + height / 2;
+	};
+};
+
+static int getPointPositionIndex(Node2D pos, Obstacle obs)
+{
+	int posIdx = 3;
+	if (pos.x > obs.x_max) {
+		if (pos.y > obs.y_max) posIdx = 0;
+		else if (pos.y <= obs.y_max && pos.y > obs.y_min) posIdx = 1;
+		else if (pos.y <= obs.y_min) posIdx = 2;
+	} else if (pos.x <= obs.x_max && pos.x > obs.x_min) {
+		if (pos.y >= obs.y_max) posIdx = 7;
+		else if (pos.y <= obs.y_min) posIdx = 3;
+	} else if (pos.x <= obs.x_min) {
+		if (pos.y > obs.y_max) posIdx = 6;
+		else if (pos.y <= obs.y_max && pos.y > obs.y_min) posIdx = 5;
+		else if (pos.y <= obs.y_min) posIdx = 4;
+	}
+	return posIdx;
+}
+
+static std::vector<Node2D> calcRoute(Node2D startPos, Node2D goalPos, Obstacle obs)
+{
+	std::vector<Node2D> route;
+	route.push_back(startPos);
+	route.push_back(goalPos);
+
+	int startIdx = getPointPositionIndex(startPos, obs);
+	int goalIdx = getPointPositionIndex(goalPos, obs);
+	int step = 0;
+	if (startIdx == goalIdx) {
+		return route;
+	} else if (startIdx < goalIdx) {
+		step = 1;
+	} else if (startIdx > goalIdx) {
+		step = -1;
+	}
+
+	Node2D supplyNode(goalPos.x, goalPos.y);
+	while (startIdx != goalIdx) {
+		startIdx += step;
+		int i = startIdx;
+		if (i == 0) {
+			supplyNode.setPosition(obs.x + obs.width / 2 + TRUCK_RADIUS, obs.y + obs.height / 2 + TRUCK_RADIUS);
+			if (goalPos.x >= supplyNode.x && goalPos.y >= supplyNode.y) {
+				if (startIdx == goalIdx) break;
+			} else {
+				route.insert(route.begin() + route.size() - 1, supplyNode);
+			}
+		} else if (i == 2) {
+			supplyNode.setPosition(obs.x + obs.width / 2 + TRUCK_RADIUS, obs.y - obs.height / 2 - TRUCK_RADIUS);
+			if (goalPos.x >= supplyNode.x && goalPos.y <= supplyNode.y) {
+				if (startIdx == goalIdx) break;
+			} else {
+				route.insert(route.begin() + route.size() - 1, supplyNode);
+			}
+		} else if (i == 4) {
+			supplyNode.setPosition(obs.x - obs.width / 2 - TRUCK_RADIUS, obs.y - obs.height / 2 - TRUCK_RADIUS);
+			if (goalPos.x <= supplyNode.x && goalPos.y <= supplyNode.y) {
+				if (startIdx == goalIdx) break;
+			} else {
+				route.insert(route.begin() + route.size() - 1, supplyNode);
+			}
+		} else if (i == 6) {
+			supplyNode.setPosition(obs.x - obs.width / 2 - TRUCK_RADIUS, obs.y + obs.height / 2 + TRUCK_RADIUS);
+			if (goalPos.x <= supplyNode.x && goalPos.y >= supplyNode.y) {
+				if (startIdx == goalIdx) break;
+			} else {
+				route.insert(route.begin() + route.size() - 1, supplyNode);
+			}
+		}
+	}
+	return route;
+}
+
+static std::vector<Node2D> calcFullRoute(Node2D startPos, Node2D goalPos, std::vector<Obstacle> roomObs)
+{
+	std::vector<Node2D> route;
+	if (roomObs.size() > 0) {
+		route = calcRoute(startPos, goalPos, roomObs[0]);
+	}
+	for (int i = 1; i < 2 && i < (int)roomObs.size(); i++) {
+		for (int j = 0; j < (int)route.size() - 1; j++) {
+			std::vector<Node2D> subRoute = calcRoute(route[j], route[j + 1], roomObs[i]);
+			if (subRoute.size() > 2) {
+				for (int k = 1; k < (int)subRoute.size() - 1; k++) {
+					route.insert(route.begin() + j + 1, subRoute[k]);
+					j++;
+				}
+			}
+			if (subRoute.size() > 2) {
+				// 元のコードは i を roomObs.size() にした後も j のループを続け、roomObs[i] を範囲外で読む ("break here")
+				i = roomObs.size();
+				break;
+			}
+		}
+	}
+	if (route.size() > 10) {
+		route = calcRoute(startPos, goalPos, roomObs[0]);
+	}
+	return route;
+}
+
+////////////////////////////////////////////////////////////
+
+// 線分が長方形(膨らませる前)の内側を通るか
+static bool segmentHits(const Node2D &a, const Node2D &b, const Obstacle &o)
+{
+	double t0 = 0.0, t1 = 1.0;
+	double d[2] = { b.x - a.x, b.y - a.y };
+	double p0[2] = { a.x, a.y };
+	double lo[2] = { o.x_min, o.y_min }, hi[2] = { o.x_max, o.y_max };
+	for (int k = 0; k < 2; k++) {
+		if (d[k] == 0.0) {
+			if (p0[k] <= lo[k] || p0[k] >= hi[k]) return false;
+			continue;
+		}
+		double u0 = (lo[k] - p0[k]) / d[k], u1 = (hi[k] - p0[k]) / d[k];
+		if (u0 > u1) std::swap(u0, u1);
+		t0 = std::max(t0, u0);
+		t1 = std::min(t1, u1);
+		if (t0 >= t1) return false;
+	}
+	return true;
+}
+
+static bool routeHits(const std::vector<Node2D> &route, const std::vector<Obstacle> &obs)
+{
+	for (size_t i = 1; i < route.size(); i++) {
+		for (size_t k = 0; k < obs.size(); k++) {
+			if (segmentHits(route[i - 1], route[i], obs[k])) return true;
+		}
+	}
+	return false;
+}
+
+// 線分から長方形(膨らませる前)までの一番近い距離 (線分の上を 0.5cm ごとに調べる)
+static double segmentDistance(const Node2D &a, const Node2D &b, const Obstacle &o)
+{
+	double len = sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+	int n = std::max((int)ceil(len / 0.5), 1);
+	double best = HUGE_VAL;
+	for (int i = 0; i <= n; i++) {
+		double x = a.x + (b.x - a.x) * i / n, y = a.y + (b.y - a.y) * i / n;
+		double dx = std::max(0.0, std::max(o.x_min - x, x - o.x_max));
+		double dy = std::max(0.0, std::max(o.y_min - y, y - o.y_max));
+		best = std::min(best, sqrt(dx * dx + dy * dy));
+	}
+	return best;
+}
+
+// shortcut が間の点どうしを膨らませた障害物で調べているか。@return 近づきすぎたら 1
+static int checkShortcut()
+{
+	Obstacle box(0, 0, 100, 100);
+	VisibilityPlanner sight(TRUCK_RADIUS);
+	sight.setObstacle(0, box.x, box.y, box.width, box.height);
+	std::vector<Node2D> route;
+	route.push_back(Node2D(-200, 0));
+	route.push_back(Node2D(-100, -100));
+	route.push_back(Node2D(0, -200));
+	route.push_back(Node2D(200, -100));
+	route.push_back(Node2D(300, 0));
+	double before = HUGE_VAL, after = HUGE_VAL;
+	for (size_t i = 1; i < route.size(); i++) before = std::min(before, segmentDistance(route[i - 1], route[i], box));
+	sight.shortcut(route);
+	for (size_t i = 1; i < route.size(); i++) after = std::min(after, segmentDistance(route[i - 1], route[i], box));
+	printf("%-28s shortcut %d points, clearance %.1lf cm -> %.1lf cm \n", "one box", (int)route.size(), before, after);
+	if (after < TRUCK_RADIUS - 0.5) {
+		printf("COLLISION: shortcut cut between interior points closer than %d cm \n", TRUCK_RADIUS);
+		return 1;
+	}
+	return 0;
+}
+
+struct Layout {
+	std::string name;
+	std::vector<Obstacle> obs;
+};
+
+// カタログの占有範囲を障害物にする (EntityRegistry の getObj は使わない)
+class CatalogOwner {
+public:
+	class SimObj *getObj(const char *) { return NULL; }
+};
+
+static bool loadLayout(const char *path, Layout &layout)
+{
+	EntityRegistry<CatalogOwner> reg;
+	CatalogOwner owner;
+	reg.init(&owner);
+	std::string err;
+	if (!loadEntityCatalog(path, reg, err)) {
+		fprintf(stderr, "%s \n", err.c_str());
+		return false;
+	}
+	layout.name = path;
+	if (layout.name.rfind('/') != std::string::npos) layout.name = layout.name.substr(layout.name.rfind('/') + 1);
+	for (int id = 0; id < reg.size(); id++) {
+		if (!reg.hasFootprint(id)) continue;
+		layout.obs.push_back(Obstacle(reg.footprintX(id), reg.footprintZ(id), reg.footprintWidth(id), reg.footprintDepth(id)));
+	}
+	return !layout.obs.empty();
+}
+
+static bool freePoint(const std::vector<Obstacle> &obs, double x, double y)
+{
+	for (size_t k = 0; k < obs.size(); k++) {
+		if (x > obs[k].x_min - MARGIN && x < obs[k].x_max + MARGIN && y > obs[k].y_min - MARGIN && y < obs[k].y_max + MARGIN) return false;
+	}
+	return true;
+}
+
+struct Result {
+	double setupUs, planUs, len, time, clear;
+	int hit, fail;
+	long expanded, points;
+	Result() : setupUs(0.0), planUs(0.0), len(0.0), time(0.0), clear(0.0), hit(0), fail(0), expanded(0), points(0) {}
+};
+
+// 経路を進む時間の見積もり (heading は出発点で向いている方向。HUGE_VAL なら最初の回転は含めない)
+static double routeTime(const std::vector<Node2D> &route, double heading)
+{
+	return VisibilityPlanner::travelTime(route, DRIVE_SPEED, TURN_SPEED, heading);
+}
+
+// 向いている方向を使える経路計画には渡す
+static bool planRoute(GridPlanner &planner, const Node2D &s, double, const Node2D &g, std::vector<Node2D> &route)
+{
+	return planner.plan(s.x, s.y, g.x, g.y, route);
+}
+static bool planRoute(VisibilityPlanner &planner, const Node2D &s, double heading, const Node2D &g, std::vector<Node2D> &route)
+{
+	return planner.plan(s.x, s.y, heading, g.x, g.y, route);
+}
+
+// 経路の上で障害物までの距離の平均 (長さで平均する。CORRIDOR より遠いところは CORRIDOR とみなす)
+static double meanClearance(ClearanceMap &map, const std::vector<Node2D> &route)
+{
+	double sum = 0.0, len = 0.0, step = map.cellSize() * 0.5;
+	for (size_t i = 1; i < route.size(); i++) {
+		double dx = route[i].x - route[i - 1].x, dy = route[i].y - route[i - 1].y;
+		double l = sqrt(dx * dx + dy * dy);
+		int n = (int)ceil(l / step);
+		for (int k = 0; k < n; k++) {
+			double t = (k + 0.5) / n;
+			sum += std::min(map.distance(route[i - 1].x + dx * t, route[i - 1].y + dy * t), (double)CORRIDOR) * l / n;
+		}
+		len += l;
+	}
+	return len > 0.0 ? sum / len : CORRIDOR;
+}
+
+// 障害物を置いて最初の1回を setup として測り、同じ問い合わせを順に解く
+// 時間は経路の確認(routeHits)も含むが、どの方法も同じ。clearance を渡すと、経路の上で障害物までの距離の平均も足す (時間には含めない)
+template <class Planner>
+static Result runPlanner(Planner &planner, const std::vector<Obstacle> &obs,
+                         const std::vector<Node2D> &starts, const std::vector<double> &headings, const std::vector<Node2D> &goals,
+                         ClearanceMap *clearance = NULL)
+{
+	Result res;
+	std::vector<Node2D> route;
+	double t0 = nowNs();
+	for (size_t k = 0; k < obs.size(); k++) planner.setObstacle((int)k, obs[k].x, obs[k].y, obs[k].width, obs[k].height);
+	planner.plan(starts[0].x, starts[0].y, goals[0].x, goals[0].y, route);
+	double t1 = nowNs();
+	res.setupUs = (t1 - t0) / 1000.0;
+	for (size_t i = 0; i < starts.size(); i++) {
+		if (!planRoute(planner, starts[i], headings[i], goals[i], route)) {
+			res.fail++;
+			continue;
+		}
+		res.expanded += planner.expanded();
+		res.len += GridPlanner::routeLength(route);
+		res.time += routeTime(route, headings[i]);
+		res.points += route.size();
+		if (routeHits(route, obs)) res.hit++;
+		if (clearance != NULL) {
+			double t2 = nowNs();
+			res.clear += meanClearance(*clearance, route);
+			t1 += nowNs() - t2;
+		}
+	}
+	res.planUs = (nowNs() - t1) / starts.size() / 1000.0;
+	return res;
+}
+
+// アンカーどうしの経路を表から引く (lookup は今の位置がアンカーなので表の経路をそのまま返す)
+static Result runTable(const std::vector<Obstacle> &obs, const std::vector<Node2D> &starts, const std::vector<double> &headings, int queries)
+{
+	Result res;
+	RouteTable table(TRUCK_RADIUS);
+	table.setSpeed(DRIVE_SPEED, TURN_SPEED);
+	std::vector<Node2D> route;
+	double t0 = nowNs();
+	for (size_t k = 0; k < obs.size(); k++) table.setObstacle((int)k, obs[k].x, obs[k].y, obs[k].width, obs[k].height);
+	for (int a = 0; a < ANCHOR_NUM; a++) table.setAnchor(a, starts[a].x, starts[a].y);
+	table.update();
+	double t1 = nowNs();
+	res.setupUs = (t1 - t0) / 1000.0;
+	for (int i = 0; i < queries; i++) {
+		int from = i % ANCHOR_NUM, to = (from + 1 + (i / ANCHOR_NUM) % (ANCHOR_NUM - 1)) % ANCHOR_NUM;
+		const RoutePoint &p = table.anchor(from);
+		if (!table.lookup(p.x, p.y, headings[i], to, 1.0, route)) {
+			res.fail++;
+			continue;
+		}
+		res.len += GridPlanner::routeLength(route);
+		res.time += routeTime(route, headings[i]);
+		res.points += route.size();
+		if (routeHits(route, obs)) res.hit++;
+	}
+	res.planUs = (nowNs() - t1) / queries / 1000.0;
+	res.expanded = 0;
+	return res;
+}
+
+// 障害物を1個動かして計画し直す (repair / fresh / grid の順に結果を返す)
+// @return D* repair と D* fresh の費用が違った回数
+static int runMoving(const std::vector<Obstacle> &obs, const std::vector<Node2D> &starts, const std::vector<Node2D> &goals,
+                     int moves, double cell, Result res[3])
+{
+	DStarLite repair(cell, TRUCK_RADIUS), fresh(cell, TRUCK_RADIUS);
+	GridPlanner grid(cell, TRUCK_RADIUS);
+	std::vector<Node2D> route;
+	std::vector<Obstacle> moved = obs;
+	double us[3] = { 0.0, 0.0, 0.0 };
+	int mismatch = 0, done = 0;
+	for (int i = 0; done < moves && i < (int)starts.size(); i++) {
+		// 動かす前の経路 (測らない)
+		for (size_t k = 0; k < obs.size(); k++) repair.setObstacle((int)k, obs[k].x, obs[k].y, obs[k].width, obs[k].height);
+		if (!repair.plan(starts[i].x, starts[i].y, goals[i].x, goals[i].y, route) || route.size() < 2) continue;
+		Node2D start(route[0].x + (route[1].x - route[0].x) * 0.3, route[0].y + (route[1].y - route[0].y) * 0.3);
+		int k = i % (int)obs.size();
+		double dist = 20.0 + frand() * 20.0, dir = frand() * 2 * M_PI;
+		moved[k].setPosition(obs[k].x + dist * cos(dir), obs[k].y + dist * sin(dir), obs[k].width, obs[k].height);
+		if (freePoint(moved, start.x, start.y) && freePoint(moved, goals[i].x, goals[i].y)) {
+			double t0 = nowNs();
+			repair.setObstacle(k, moved[k].x, moved[k].y, moved[k].width, moved[k].height);
+			bool ok = repair.plan(start.x, start.y, goals[i].x, goals[i].y, route);
+			us[0] += nowNs() - t0;
+			if (!ok) res[0].fail++;
+			else {
+				res[0].expanded += repair.expanded();
+				res[0].len += GridPlanner::routeLength(route);
+				res[0].time += routeTime(route, HUGE_VAL);
+				res[0].points += route.size();
+				if (routeHits(route, moved)) res[0].hit++;
+			}
+
+			t0 = nowNs();
+			for (size_t j = 0; j < moved.size(); j++) fresh.setObstacle((int)j, moved[j].x, moved[j].y, moved[j].width, moved[j].height);
+			fresh.reset();
+			bool okFresh = fresh.plan(start.x, start.y, goals[i].x, goals[i].y, route);
+			us[1] += nowNs() - t0;
+			if (!okFresh) res[1].fail++;
+			else {
+				res[1].expanded += fresh.expanded();
+				res[1].len += GridPlanner::routeLength(route);
+				res[1].time += routeTime(route, HUGE_VAL);
+				res[1].points += route.size();
+				if (routeHits(route, moved)) res[1].hit++;
+			}
+			if (ok != okFresh || (ok && fabs(repair.pathCost() - fresh.pathCost()) > 1e-6 * fresh.pathCost())) mismatch++;
+
+			t0 = nowNs();
+			for (size_t j = 0; j < moved.size(); j++) grid.setObstacle((int)j, moved[j].x, moved[j].y, moved[j].width, moved[j].height);
+			ok = grid.plan(start.x, start.y, goals[i].x, goals[i].y, route);
+			us[2] += nowNs() - t0;
+			if (!ok) res[2].fail++;
+			else {
+				res[2].expanded += grid.expanded();
+				res[2].len += GridPlanner::routeLength(route);
+				res[2].time += routeTime(route, HUGE_VAL);
+				res[2].points += route.size();
+				if (routeHits(route, moved)) res[2].hit++;
+			}
+			done++;
+		}
+		moved[k] = obs[k];
+	}
+	for (int p = 0; p < 3; p++) res[p].planUs = done > 0 ? us[p] / done / 1000.0 : 0.0;
+	return mismatch;
+}
+
+// ClearanceMap で障害物を1個ずつ動かし、動いた範囲だけ直す時間と全部作り直す時間を比べる
+// @return 直した値が作り直した値と違った升目の数
+static int runClearance(const Layout &layout, int moves, double cell)
+{
+	const std::vector<Obstacle> &obs = layout.obs;
+	double xmin = 1e9, xmax = -1e9, ymin = 1e9, ymax = -1e9;
+	for (size_t k = 0; k < obs.size(); k++) {
+		xmin = std::min(xmin, obs[k].x_min);
+		xmax = std::max(xmax, obs[k].x_max);
+		ymin = std::min(ymin, obs[k].y_min);
+		ymax = std::max(ymax, obs[k].y_max);
+	}
+	xmin -= ROOM_PAD; xmax += ROOM_PAD; ymin -= ROOM_PAD; ymax += ROOM_PAD;
+	ClearanceMap map(cell), fresh(cell);
+	map.setBounds(xmin, ymin, xmax, ymax);
+	std::vector<Obstacle> moved = obs;
+	for (size_t k = 0; k < obs.size(); k++) map.setObstacle((int)k, obs[k].x, obs[k].y, obs[k].width, obs[k].height);
+	double t0 = nowNs();
+	map.update();
+	double buildUs = (nowNs() - t0) / 1000.0, updateNs = 0.0, rebuildNs = 0.0;
+	long cells = 0;
+	int mismatch = 0;
+	for (int i = 0; i < moves; i++) {
+		int k = i % (int)obs.size();
+		double dist = 20.0 + frand() * 20.0, dir = frand() * 2 * M_PI;
+		moved[k].setPosition(obs[k].x + dist * cos(dir), obs[k].y + dist * sin(dir), obs[k].width, obs[k].height);
+		long before = map.cellsUpdated();
+		t0 = nowNs();
+		map.setObstacle(k, moved[k].x, moved[k].y, moved[k].width, moved[k].height);
+		map.update();
+		updateNs += nowNs() - t0;
+		cells += map.cellsUpdated() - before;
+
+		t0 = nowNs();
+		fresh = ClearanceMap(cell);
+		fresh.setBounds(xmin, ymin, xmax, ymax);
+		for (size_t j = 0; j < moved.size(); j++) fresh.setObstacle((int)j, moved[j].x, moved[j].y, moved[j].width, moved[j].height);
+		fresh.update();
+		rebuildNs += nowNs() - t0;
+		for (double y = ymin + cell / 2; y < ymax; y += cell) {
+			for (double x = xmin + cell / 2; x < xmax; x += cell) {
+				if (map.distance(x, y) != fresh.distance(x, y)) mismatch++;
+			}
+		}
+		// 元に戻す (測らない)
+		moved[k] = obs[k];
+		map.setObstacle(k, obs[k].x, obs[k].y, obs[k].width, obs[k].height);
+		map.update();
+	}
+	int n = map.gridWidth() * map.gridHeight();
+	printf("%-28s clearance map %dx%d cells: build %.1lf us, moved update %.1lf us (%.0lf%% of cells) vs rebuild %.1lf us \n",
+		layout.name.c_str(), map.gridWidth(), map.gridHeight(), buildUs, updateNs / moves / 1000.0,
+		100.0 * cells / moves / (2.0 * n), rebuildNs / moves / 1000.0);
+	return mismatch;
+}
+
+// @return 障害物を横切った経路の数
+static int printResult(const Layout &layout, const char *planner, const Result &res, int queries)
+{
+	int ok = queries - res.fail;
+	printf("%-28s %4d | %-11s | %10.1lf %10.2lf | %9.1lf %5.1lf %8.2lf | %7.1lf%% | %6d %9.1lf \n",
+		layout.name.c_str(), (int)layout.obs.size(), planner, res.setupUs, res.planUs,
+		ok > 0 ? res.len / ok : 0.0, ok > 0 ? (double)res.points / ok : 0.0, ok > 0 ? res.time / ok : 0.0,
+		100.0 * res.hit / queries, res.fail, ok > 0 ? (double)res.expanded / ok : 0.0);
+	return res.hit;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: RouteBench [-n queries] [-s seed] [-c cell] [catalog ...] \n");
+}
+
+int main(int argc, char **argv)
+{
+	int queries = 2000;
+	unsigned int seed = 1;
+	double cell = 5.0;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:c:")) != -1) {
+		switch (opt) {
+			case 'n': queries = atoi(optarg); break;
+			case 's': seed = (unsigned int)atoi(optarg); break;
+			case 'c': cell = atof(optarg); break;
+			default: usage(); return 1;
+		}
+	}
+	if (queries < ANCHOR_NUM) queries = ANCHOR_NUM;
+
+	std::vector<Layout> layouts;
+	Layout l0614;
+	if (loadLayout("../CleanUp_0605/CleanUpRobot0614.catalog", l0614)) layouts.push_back(l0614);
+	if (optind == argc) {
+		Layout l;
+		if (loadLayout("../CleanUp_0918/Room0928_ObjDetect.catalog", l)) layouts.push_back(l);
+	}
+	for (int i = optind; i < argc; i++) {
+		Layout l;
+		if (!loadLayout(argv[i], l)) return 1;
+		layouts.push_back(l);
+	}
+
+	int errors = 0;
+	printf("%-28s %4s | %-11s | %10s %10s | %9s %5s %8s | %8s | %6s %9s \n",
+		"layout", "obs", "planner", "setup [us]", "plan [us]", "len", "pts", "time [s]", "hit", "ng", "expanded");
+	for (size_t li = 0; li < layouts.size(); li++) {
+		const Layout &layout = layouts[li];
+		const std::vector<Obstacle> &obs = layout.obs;
+		double xmin = 1e9, xmax = -1e9, ymin = 1e9, ymax = -1e9;
+		for (size_t k = 0; k < obs.size(); k++) {
+			xmin = std::min(xmin, obs[k].x_min);
+			xmax = std::max(xmax, obs[k].x_max);
+			ymin = std::min(ymin, obs[k].y_min);
+			ymax = std::max(ymax, obs[k].y_max);
+		}
+		xmin -= ROOM_PAD; xmax += ROOM_PAD; ymin -= ROOM_PAD; ymax += ROOM_PAD;
+
+		srand(seed);
+		std::vector<Node2D> starts, goals;
+		while ((int)starts.size() < queries) {
+			double sx = xmin + frand() * (xmax - xmin), sy = ymin + frand() * (ymax - ymin);
+			double gx = xmin + frand() * (xmax - xmin), gy = ymin + frand() * (ymax - ymin);
+			if (!freePoint(obs, sx, sy) || !freePoint(obs, gx, gy)) continue;
+			starts.push_back(Node2D(sx, sy));
+			goals.push_back(Node2D(gx, gy));
+		}
+		std::vector<double> headings;
+		for (int i = 0; i < queries; i++) headings.push_back((frand() * 2 - 1) * M_PI);
+
+		Result full, shortened;
+		VisibilityPlanner sight(TRUCK_RADIUS);
+		for (size_t k = 0; k < obs.size(); k++) sight.setObstacle((int)k, obs[k].x, obs[k].y, obs[k].width, obs[k].height);
+		double t0 = nowNs(), shortNs = 0.0;
+		for (int i = 0; i < queries; i++) {
+			std::vector<Node2D> r = calcFullRoute(starts[i], goals[i], obs);
+			full.len += GridPlanner::routeLength(r);
+			full.time += routeTime(r, headings[i]);
+			full.points += r.size();
+			if (routeHits(r, obs)) full.hit++;
+			double t1 = nowNs();
+			sight.shortcut(r);
+			shortNs += nowNs() - t1;
+			shortened.len += GridPlanner::routeLength(r);
+			shortened.time += routeTime(r, headings[i]);
+			shortened.points += r.size();
+			if (routeHits(r, obs)) shortened.hit++;
+		}
+		full.planUs = (nowNs() - t0 - shortNs) / queries / 1000.0;
+		shortened.planUs = shortNs / queries / 1000.0;
+		printResult(layout, "calcFull", full, queries);
+		printResult(layout, "calcFull sc", shortened, queries);
+
+		ClearanceMap clearance(cell);
+		for (size_t k = 0; k < obs.size(); k++) clearance.setObstacle((int)k, obs[k].x, obs[k].y, obs[k].width, obs[k].height);
+		GridPlanner grid(cell, TRUCK_RADIUS);
+		Result narrow = runPlanner(grid, obs, starts, headings, goals, &clearance);
+		errors += printResult(layout, "grid A*", narrow, queries);
+		GridPlanner gridWide(cell, TRUCK_RADIUS);
+		gridWide.setCorridor(CORRIDOR, CORRIDOR_WEIGHT);
+		Result wide = runPlanner(gridWide, obs, starts, headings, goals, &clearance);
+		errors += printResult(layout, "grid wide", wide, queries);
+		VisibilityPlanner vis(TRUCK_RADIUS);
+		Result shortest = runPlanner(vis, obs, starts, headings, goals);
+		errors += printResult(layout, "visibility", shortest, queries);
+		VisibilityPlanner visTime(TRUCK_RADIUS);
+		visTime.setSpeed(DRIVE_SPEED, TURN_SPEED);
+		Result fastest = runPlanner(visTime, obs, starts, headings, goals);
+		errors += printResult(layout, "vis time", fastest, queries);
+		errors += printResult(layout, "table", runTable(obs, starts, headings, queries), queries);
+		if (fastest.time > shortest.time + 1e-6) {
+			printf("SLOWER: time-optimal routes take longer than the shortest routes \n");
+			errors++;
+		}
+		printf("%-28s shortcut calcFull %.2lf -> %.2lf points, %.2lf s -> %.2lf s per route \n", layout.name.c_str(),
+			(double)full.points / queries, (double)shortened.points / queries, full.time / queries, shortened.time / queries);
+		printf("%-28s clearance grid A* %.1lf cm -> grid wide %.1lf cm (mean along the route, capped at %.0lf cm), length %+.1lf%% \n", layout.name.c_str(),
+			narrow.clear / (queries - narrow.fail), wide.clear / (queries - wide.fail), (double)CORRIDOR,
+			100.0 * (wide.len / (queries - wide.fail) - narrow.len / (queries - narrow.fail)) / (narrow.len / (queries - narrow.fail)));
+		double leg0 = shortest.time / (queries - shortest.fail), leg1 = fastest.time / (queries - fastest.fail);
+		printf("%-28s episode (%d legs) %.1lf s -> %.1lf s, saves %.1lf s (%.1lf%%) \n", layout.name.c_str(), EPISODE_LEGS,
+			leg0 * EPISODE_LEGS, leg1 * EPISODE_LEGS, (leg0 - leg1) * EPISODE_LEGS, 100.0 * (leg0 - leg1) / leg0);
+
+		Layout movedLayout = layout;
+		movedLayout.name += " moved";
+		Result res[3];
+		int moves = std::max(queries / 4, 1);
+		int mismatch = runMoving(obs, starts, goals, moves, cell, res);
+		errors += printResult(movedLayout, "D* repair", res[0], moves);
+		errors += printResult(movedLayout, "D* fresh", res[1], moves);
+		errors += printResult(movedLayout, "grid A*", res[2], moves);
+		if (mismatch > 0) {
+			printf("MISMATCH: %d repaired routes differ in cost from a fresh search \n", mismatch);
+			errors += mismatch;
+		}
+		mismatch = runClearance(layout, moves, cell);
+		if (mismatch > 0) {
+			printf("MISMATCH: %d clearance cells differ after an incremental update \n", mismatch);
+			errors += mismatch;
+		}
+	}
+
+	errors += checkShortcut();
+
+	if (errors > 0) {
+		printf("COLLISION: %d routes cross an obstacle \n", errors);
+		return 1;
+	}
+	printf("no planned route crosses an obstacle \n");
+	return 0;
+}
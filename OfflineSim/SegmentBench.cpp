@@ -0,0 +1,268 @@
+// SegmentBench: ObstacleSet.h の線分と障害物の判定 (SoA でまとめて調べる) と、障害物を1つずつ調べる場合の時間を比べる
+//
+// 使い方
+// $ ./SegmentBench [-n 線分の数] [-s 乱数の種]
+//
+// ・障害物の数 8, 32, 128 ごとに、部屋(1000 × 1000)の中にランダムな向きの長方形と凸多角形(5〜8角形)を置く
+// ・ランダムな線分を、ロボットの半径だけ膨らませたすべての障害物で調べる
+//     sat      障害物ごとに分離軸 (辺の法線と線分の法線に射影して重なるか) で調べる。結果を確かめるための基準
+//     clip     障害物ごとに半平面で切る (構造体の配列。通らないと分かった障害物はそこで止める)
+//     mask     ObstacleSet::segmentMask (すべての障害物を1回で)
+//     any      どれかの障害物を通るか。clip を1つずつ / ObstacleSet::segmentHits
+//     route    5本の線分の経路が通れるか。clip を1つずつ / ObstacleSet::routeHits
+// ・mask は sat と、any・route は clip と結果が同じことを確かめる (違えば失敗する)
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "ObstacleSet.h"
+
+#define ROOM_SIZE    1000.0
+#define CLEARANCE    25.0
+#define ROUTE_LEGS   5
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double frand()
+{
+	return (double)rand() / RAND_MAX;
+}
+
+struct Point {
+	double x, y;
+	Point(double x = 0.0, double y = 0.0) : x(x), y(y) {}
+};
+
+// 膨らませた障害物 (構造体の配列。1つずつ調べる方で使う)
+struct Poly {
+	int n;
+	double vx[ObstacleSet::MAX_EDGES], vy[ObstacleSet::MAX_EDGES];
+	double nx[ObstacleSet::MAX_EDGES], ny[ObstacleSet::MAX_EDGES], d[ObstacleSet::MAX_EDGES];
+};
+
+// ObstacleSet の頂点を r だけ膨らませて、辺の法線を自分で求め直す
+static Poly inflated(const ObstacleSet &set, int i, double r)
+{
+	Poly p;
+	p.n = set.vertexCount(i);
+	for (int j = 0; j < p.n; j++) set.offsetVertex(i, j, r, p.vx[j], p.vy[j]);
+	for (int j = 0; j < p.n; j++) {
+		int k = (j + 1) % p.n;
+		double ex = p.vx[k] - p.vx[j], ey = p.vy[k] - p.vy[j];
+		double len = sqrt(ex * ex + ey * ey);
+		p.nx[j] = ey / len;
+		p.ny[j] = -ex / len;
+		p.d[j] = p.nx[j] * p.vx[j] + p.ny[j] * p.vy[j];
+	}
+	return p;
+}
+
+// 分離軸: 線分と多角形を軸に射影して、区間が重ならない (触れるだけも含む) 軸があれば通らない
+static bool satHits(const Poly &p, double ax, double ay, double bx, double by)
+{
+	double axes[ObstacleSet::MAX_EDGES + 1][2];
+	int m = 0;
+	for (int j = 0; j < p.n; j++, m++) {
+		axes[m][0] = p.nx[j];
+		axes[m][1] = p.ny[j];
+	}
+	// 長さ 0 の線分 (部屋の角で止まった点) は点として調べる
+	if (ax != bx || ay != by) {
+		axes[m][0] = -(by - ay);
+		axes[m][1] = bx - ax;
+		m++;
+	}
+	for (int k = 0; k < m; k++) {
+		double ux = axes[k][0], uy = axes[k][1];
+		double s0 = ux * ax + uy * ay, s1 = ux * bx + uy * by;
+		double slo = std::min(s0, s1), shi = std::max(s0, s1);
+		double plo = HUGE_VAL, phi = -HUGE_VAL;
+		for (int j = 0; j < p.n; j++) {
+			double v = ux * p.vx[j] + uy * p.vy[j];
+			plo = std::min(plo, v);
+			phi = std::max(phi, v);
+		}
+		if (shi <= plo || phi <= slo) return false;
+	}
+	return true;
+}
+
+// 半平面で切る (VisibilityPlanner がこれまで長方形で調べていたのと同じく、区間が空になった所で止める)
+static bool clipHits(const Poly &p, double ax, double ay, double bx, double by)
+{
+	double t0 = 0.0, t1 = 1.0;
+	double dx = bx - ax, dy = by - ay;
+	for (int j = 0; j < p.n; j++) {
+		double num = p.d[j] - (p.nx[j] * ax + p.ny[j] * ay);
+		double den = p.nx[j] * dx + p.ny[j] * dy;
+		if (den == 0.0) {
+			if (num <= 0.0) return false;
+			continue;
+		}
+		double t = num / den;
+		if (den < 0.0) t0 = std::max(t0, t);
+		else t1 = std::min(t1, t);
+		if (t0 >= t1) return false;
+	}
+	return true;
+}
+
+static bool clipAny(const std::vector<Poly> &polys, double ax, double ay, double bx, double by)
+{
+	for (size_t i = 0; i < polys.size(); i++) {
+		if (clipHits(polys[i], ax, ay, bx, by)) return true;
+	}
+	return false;
+}
+
+static int clipRoute(const std::vector<Poly> &polys, const Point *route)
+{
+	for (int k = 0; k < ROUTE_LEGS; k++) {
+		if (clipAny(polys, route[k].x, route[k].y, route[k + 1].x, route[k + 1].y)) return k;
+	}
+	return -1;
+}
+
+// ランダムな障害物 (3つに1つは凸多角形、他は向きのある長方形)
+static void randomObstacles(ObstacleSet &set, int n)
+{
+	set.clear();
+	for (int i = 0; i < n; i++) {
+		double x = (frand() - 0.5) * ROOM_SIZE, y = (frand() - 0.5) * ROOM_SIZE;
+		if (i % 3 == 2) {
+			int m = 5 + rand() % 4;
+			double xs[ObstacleSet::MAX_EDGES], ys[ObstacleSet::MAX_EDGES];
+			double rx = 20.0 + frand() * 40.0, ry = 20.0 + frand() * 40.0, a0 = frand() * 2 * M_PI;
+			for (int k = 0; k < m; k++) {
+				double a = a0 + 2 * M_PI * k / m;
+				xs[k] = x + rx * cos(a);
+				ys[k] = y + ry * sin(a);
+			}
+			set.setPolygon(i, xs, ys, m);
+		} else {
+			set.setBox(i, x, y, 30.0 + frand() * 100.0, 20.0 + frand() * 60.0, frand() * M_PI);
+		}
+	}
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: SegmentBench [-n segments] [-s seed] \n");
+}
+
+int main(int argc, char **argv)
+{
+	int segments = 20000;
+	unsigned int seed = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+			case 'n': segments = atoi(optarg); break;
+			case 's': seed = (unsigned int)atoi(optarg); break;
+			default: usage(); return 1;
+		}
+	}
+	if (segments < ROUTE_LEGS) segments = ROUTE_LEGS;
+
+	const int sizes[] = { 8, 32, 128 };
+	int errors = 0;
+	printf("%9s %5s | %9s %9s %9s %6s | %9s %9s %6s | %9s %9s %6s | %6s \n",
+		"obstacles", "slots", "sat", "clip", "mask", "x", "clip any", "any", "x", "clip rt", "route", "x", "hit");
+	printf("%9s %5s | %9s %9s %9s %6s | %9s %9s %6s | %9s %9s %6s | %6s \n",
+		"", "", "[ns]", "[ns]", "[ns]", "", "[ns]", "[ns]", "", "[ns]", "[ns]", "", "[%]");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		int n = sizes[s];
+		srand(seed);
+		ObstacleSet set;
+		randomObstacles(set, n);
+		std::vector<Poly> polys;
+		for (int i = 0; i < n; i++) polys.push_back(inflated(set, i, CLEARANCE));
+
+		// 線分は 300 以下の長さ (部屋の中を少しずつ進む経路の1区間くらい)。続けて並べたものを経路にする
+		std::vector<Point> pts;
+		Point p((frand() - 0.5) * ROOM_SIZE, (frand() - 0.5) * ROOM_SIZE);
+		pts.push_back(p);
+		for (int i = 0; i < segments; i++) {
+			double a = frand() * 2 * M_PI, len = frand() * 300.0;
+			p.x = std::max(-ROOM_SIZE / 2, std::min(ROOM_SIZE / 2, p.x + len * cos(a)));
+			p.y = std::max(-ROOM_SIZE / 2, std::min(ROOM_SIZE / 2, p.y + len * sin(a)));
+			pts.push_back(p);
+		}
+		int routes = segments / ROUTE_LEGS;
+
+		// 結果を比べる
+		const double *inf = set.inflation(CLEARANCE);
+		std::vector<char> mask(set.stride());
+		long hits = 0;
+		for (int i = 0; i < segments; i++) {
+			const Point &a = pts[i], &b = pts[i + 1];
+			set.segmentMask(a.x, a.y, b.x, b.y, inf, &mask[0]);
+			bool any = false;
+			for (int k = 0; k < n; k++) {
+				bool sat = satHits(polys[k], a.x, a.y, b.x, b.y);
+				if (sat != (bool)mask[k]) errors++;
+				any = any || sat;
+			}
+			for (int k = n; k < set.stride(); k++) {
+				if (mask[k]) errors++;
+			}
+			if (any != set.segmentHits(a.x, a.y, b.x, b.y, inf)) errors++;
+			if (any != clipAny(polys, a.x, a.y, b.x, b.y)) errors++;
+			if (any) hits++;
+		}
+		std::vector<Point> route(ROUTE_LEGS + 1);
+		for (int i = 0; i < routes; i++) {
+			route.assign(pts.begin() + i * ROUTE_LEGS, pts.begin() + i * ROUTE_LEGS + ROUTE_LEGS + 1);
+			if (clipRoute(polys, &pts[i * ROUTE_LEGS]) != set.routeHits(route, CLEARANCE)) errors++;
+		}
+
+		long sink = 0;
+		double t0 = nowNs();
+		for (int i = 0; i < segments; i++) {
+			for (int k = 0; k < n; k++) sink += satHits(polys[k], pts[i].x, pts[i].y, pts[i + 1].x, pts[i + 1].y);
+		}
+		double t1 = nowNs();
+		for (int i = 0; i < segments; i++) {
+			for (int k = 0; k < n; k++) sink += clipHits(polys[k], pts[i].x, pts[i].y, pts[i + 1].x, pts[i + 1].y);
+		}
+		double t2 = nowNs();
+		for (int i = 0; i < segments; i++) {
+			set.segmentMask(pts[i].x, pts[i].y, pts[i + 1].x, pts[i + 1].y, inf, &mask[0]);
+			sink += mask[i % n];
+		}
+		double t3 = nowNs();
+		for (int i = 0; i < segments; i++) sink += clipAny(polys, pts[i].x, pts[i].y, pts[i + 1].x, pts[i + 1].y);
+		double t4 = nowNs();
+		for (int i = 0; i < segments; i++) sink += set.segmentHits(pts[i].x, pts[i].y, pts[i + 1].x, pts[i + 1].y, inf);
+		double t5 = nowNs();
+		for (int i = 0; i < routes; i++) sink += clipRoute(polys, &pts[i * ROUTE_LEGS]);
+		double t6 = nowNs();
+		for (int i = 0; i < routes; i++) {
+			route.assign(pts.begin() + i * ROUTE_LEGS, pts.begin() + i * ROUTE_LEGS + ROUTE_LEGS + 1);
+			sink += set.routeHits(route, CLEARANCE);
+		}
+		double t7 = nowNs();
+
+		double sat = (t1 - t0) / segments, clip = (t2 - t1) / segments, mk = (t3 - t2) / segments;
+		double ca = (t4 - t3) / segments, any = (t5 - t4) / segments;
+		double cr = (t6 - t5) / routes, rt = (t7 - t6) / routes;
+		printf("%9d %5d | %9.1lf %9.1lf %9.1lf %6.2lf | %9.1lf %9.1lf %6.2lf | %9.1lf %9.1lf %6.2lf | %6.1lf \n",
+			n, set.slots(), sat, clip, mk, clip / mk, ca, any, ca / any, cr, rt, cr / rt, 100.0 * hits / segments);
+		if (sink == 42) printf(" \n");	// 最適化で消されないように
+	}
+
+	if (errors > 0) {
+		printf("MISMATCH: %d results differ from the per-obstacle tests \n", errors);
+		return 1;
+	}
+	printf("all results match the per-obstacle tests \n");
+	return 0;
+}
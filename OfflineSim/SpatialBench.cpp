@@ -0,0 +1,213 @@
+// SpatialBench: SpatialIndex.h と線形探索(recognizeNearestTrash と同じ走査)の問い合わせ時間を比べる
+//
+// 使い方
+// $ ./SpatialBench [-q 問い合わせ回数] [-s 乱数の種]
+//
+// ・点の数 10, 100, 1000, 10000 ごとに、部屋(1000 × 1000)の中にランダムに置く
+// ・nearest / nearestK(5) / radius(100) を同じ問い合わせ点で両方に問い合わせ、結果が同じことを確かめる
+// ・拾っていく(点を1つずつ外しながら一番近い点を探す)場合の時間も測る
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "SpatialIndex.h"
+
+#define ROOM_SIZE 1000.0
+#define KNN_K     5
+#define RADIUS    100.0
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double frand()
+{
+	return (double)rand() / RAND_MAX;
+}
+
+struct Points {
+	std::vector<double> x, z;
+	std::vector<char> alive;
+};
+
+static double dist2(const Points &p, int i, double x, double z)
+{
+	return (p.x[i] - x) * (p.x[i] - x) + (p.z[i] - z) * (p.z[i] - z);
+}
+
+// 線形探索 (同じ距離なら番号の小さい方)
+static int scanNearest(const Points &p, double x, double z)
+{
+	int best = -1;
+	double bestD = 0.0;
+	for (int i = 0; i < (int)p.x.size(); i++) {
+		if (!p.alive[i]) continue;
+		double d = dist2(p, i, x, z);
+		if (best < 0 || d < bestD) {
+			best = i;
+			bestD = d;
+		}
+	}
+	return best;
+}
+
+static void scanSorted(const Points &p, double x, double z, std::vector<std::pair<double, int> > &out)
+{
+	out.clear();
+	for (int i = 0; i < (int)p.x.size(); i++) {
+		if (p.alive[i]) out.push_back(std::make_pair(dist2(p, i, x, z), i));
+	}
+}
+
+static void scanKnn(const Points &p, double x, double z, int k, std::vector<int> &ids)
+{
+	std::vector<std::pair<double, int> > all;
+	scanSorted(p, x, z, all);
+	if (k > (int)all.size()) k = (int)all.size();
+	std::partial_sort(all.begin(), all.begin() + k, all.end());
+	ids.clear();
+	for (int i = 0; i < k; i++) ids.push_back(all[i].second);
+}
+
+static void scanRadius(const Points &p, double x, double z, double r, std::vector<int> &ids)
+{
+	std::vector<std::pair<double, int> > all;
+	ids.clear();
+	for (int i = 0; i < (int)p.x.size(); i++) {
+		if (!p.alive[i]) continue;
+		double d = dist2(p, i, x, z);
+		if (d <= r * r) all.push_back(std::make_pair(d, i));
+	}
+	std::sort(all.begin(), all.end());
+	for (size_t i = 0; i < all.size(); i++) ids.push_back(all[i].second);
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: SpatialBench [-q queries] [-s seed] \n");
+}
+
+int main(int argc, char **argv)
+{
+	int queries = 20000;
+	unsigned int seed = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "q:s:")) != -1) {
+		switch (opt) {
+			case 'q': queries = atoi(optarg); break;
+			case 's': seed = (unsigned int)atoi(optarg); break;
+			default: usage(); return 1;
+		}
+	}
+	if (queries < 1) queries = 1;
+
+	const int sizes[] = { 10, 100, 1000, 10000 };
+	int errors = 0;
+	printf("%8s %8s | %10s %10s %7s | %10s %10s %7s | %10s %10s %7s | %10s %10s \n",
+		"objects", "cell", "scan nn", "grid nn", "x", "scan knn", "grid knn", "x", "scan rad", "grid rad", "x",
+		"scan pick", "grid pick");
+	printf("%8s %8s | %10s %10s %7s | %10s %10s %7s | %10s %10s %7s | %10s %10s \n",
+		"", "", "[ns]", "[ns]", "", "[ns]", "[ns]", "", "[ns]", "[ns]", "", "[us]", "[us]");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		int n = sizes[s];
+		srand(seed);
+		Points p;
+		for (int i = 0; i < n; i++) {
+			p.x.push_back((frand() - 0.5) * ROOM_SIZE);
+			p.z.push_back((frand() - 0.5) * ROOM_SIZE);
+			p.alive.push_back(1);
+		}
+		SpatialIndex index(SpatialIndex::cellSizeFor(ROOM_SIZE, ROOM_SIZE, n));
+		for (int i = 0; i < n; i++) index.insert(i, p.x[i], p.z[i]);
+
+		std::vector<double> qx, qz;
+		for (int i = 0; i < queries; i++) {
+			qx.push_back((frand() - 0.5) * ROOM_SIZE);
+			qz.push_back((frand() - 0.5) * ROOM_SIZE);
+		}
+
+		// 結果を比べる
+		std::vector<int> a, b;
+		for (int i = 0; i < queries && i < 1000; i++) {
+			if (scanNearest(p, qx[i], qz[i]) != index.nearest(qx[i], qz[i])) errors++;
+			scanKnn(p, qx[i], qz[i], KNN_K, a);
+			index.nearestK(qx[i], qz[i], KNN_K, b);
+			if (a != b) errors++;
+			scanRadius(p, qx[i], qz[i], RADIUS, a);
+			index.radius(qx[i], qz[i], RADIUS, b);
+			if (a != b) errors++;
+		}
+
+		long sink = 0;
+		double t0 = nowNs();
+		for (int i = 0; i < queries; i++) sink += scanNearest(p, qx[i], qz[i]);
+		double t1 = nowNs();
+		for (int i = 0; i < queries; i++) sink += index.nearest(qx[i], qz[i]);
+		double t2 = nowNs();
+		for (int i = 0; i < queries; i++) { scanKnn(p, qx[i], qz[i], KNN_K, a); sink += a.size(); }
+		double t3 = nowNs();
+		for (int i = 0; i < queries; i++) sink += index.nearestK(qx[i], qz[i], KNN_K, b);
+		double t4 = nowNs();
+		for (int i = 0; i < queries; i++) { scanRadius(p, qx[i], qz[i], RADIUS, a); sink += a.size(); }
+		double t5 = nowNs();
+		for (int i = 0; i < queries; i++) sink += index.radius(qx[i], qz[i], RADIUS, b);
+		double t6 = nowNs();
+
+		// 全部拾うまで: 一番近い点を探して外す、を繰り返す (ロボットはその点に移動する)
+		double rx = 0.0, rz = 0.0;
+		double t7 = nowNs();
+		for (int i = 0; i < n; i++) {
+			int id = scanNearest(p, rx, rz);
+			p.alive[id] = 0;
+			rx = p.x[id];
+			rz = p.z[id];
+		}
+		double t8 = nowNs();
+		rx = 0.0;
+		rz = 0.0;
+		std::vector<int> order;
+		for (int i = 0; i < n; i++) {
+			int id = index.nearest(rx, rz);
+			index.remove(id);
+			rx = p.x[id];
+			rz = p.z[id];
+			order.push_back(id);
+		}
+		double t9 = nowNs();
+		// 拾った順も同じになるはず
+		std::fill(p.alive.begin(), p.alive.end(), 1);
+		rx = 0.0;
+		rz = 0.0;
+		for (int i = 0; i < n; i++) {
+			int id = scanNearest(p, rx, rz);
+			if (id != order[i]) {
+				errors++;
+				break;
+			}
+			p.alive[id] = 0;
+			rx = p.x[id];
+			rz = p.z[id];
+		}
+
+		double sn = (t1 - t0) / queries, gn = (t2 - t1) / queries;
+		double sk = (t3 - t2) / queries, gk = (t4 - t3) / queries;
+		double sr = (t5 - t4) / queries, gr = (t6 - t5) / queries;
+		printf("%8d %8.1lf | %10.1lf %10.1lf %7.1lf | %10.1lf %10.1lf %7.1lf | %10.1lf %10.1lf %7.1lf | %10.1lf %10.1lf \n",
+			n, index.cellSize(), sn, gn, sn / gn, sk, gk, sk / gk, sr, gr, sr / gr, (t8 - t7) / 1000.0, (t9 - t8) / 1000.0);
+		if (sink == 42) printf(" \n");	// 最適化で消されないように
+	}
+
+	if (errors > 0) {
+		printf("MISMATCH: %d queries differ from the linear scan \n", errors);
+		return 1;
+	}
+	printf("all results match the linear scan \n");
+	return 0;
+}
@@ -0,0 +1,233 @@
+// TraceDecode: TraceRecorder.h のトレースファイルを読む
+//
+// 使い方
+// $ ./TraceDecode [-c 出力.csv] [-q] trace.bin
+//   -c  全レコードを CSV で書き出す ("-" なら標準出力)
+//   -q  集計を表示しない
+//
+// 集計
+// ・レコードの種類ごとの数
+// ・メッセージの組ごとの時間 (シミュレーション時間と実時間)
+//     送信 -> 次の受信   サービスの応答時間 (例: AskRandomRoute -> RandomRoute)
+//     受信 -> 次の送信   コントローラの反応時間 (例: RandomRouteArrived -> AskRandomRoute)
+// ・状態ごとの滞在時間
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "TraceRecorder.h"
+#include "MsgSchema.h"
+
+static const char *typeName(int type)
+{
+	switch (type) {
+		case TRACE_STATE: return "state";
+		case TRACE_POSE:  return "pose";
+		case TRACE_SEND:  return "send";
+		case TRACE_RECV:  return "recv";
+		case TRACE_WHEEL: return "wheel";
+		case TRACE_JOINT: return "joint";
+		case TRACE_GRASP: return "grasp";
+		default:          return "?";
+	}
+}
+
+static std::string text(const TraceRecord &r)
+{
+	return std::string(r.text, r.textLen);
+}
+
+// メッセージのヘッダ (バイナリ形式は先頭の番号から引く。切り詰められていても読める)
+static std::string header(const TraceRecord &r)
+{
+	std::string t = text(r);
+	if (!t.empty() && t[0] == MSG_BINARY_MARK) {
+		unsigned char id[3];
+		if (t.size() >= 5 && msgBase64Decode(t.substr(1, 4).c_str(), id, 3) > 0 && msgHeader(id[0]) != NULL) {
+			return msgHeader(id[0]);
+		}
+		return "#?";
+	}
+	return t.substr(0, t.find(' '));
+}
+
+static void csvText(FILE *fp, const std::string &s)
+{
+	fputc('"', fp);
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"') fputc('"', fp);
+		fputc(s[i], fp);
+	}
+	fputc('"', fp);
+}
+
+static void writeCsv(FILE *fp, const std::vector<TraceRecord> &recs)
+{
+	fprintf(fp, "seq,type,sim,wall_ns,id,v0,v1,v2,v3,text,truncated\n");
+	for (size_t i = 0; i < recs.size(); i++) {
+		const TraceRecord &r = recs[i];
+		fprintf(fp, "%lu,%s,%.6lf,%llu,%u,%g,%g,%g,%g,", (unsigned long)i, typeName(r.type), r.sim,
+				(unsigned long long)r.wall, r.id, r.v[0], r.v[1], r.v[2], r.v[3]);
+		csvText(fp, text(r));
+		fprintf(fp, ",%d\n", r.fullLen > r.textLen ? 1 : 0);
+	}
+}
+
+struct Samples {
+	std::vector<double> sim;	// [ms]
+	std::vector<double> wall;	// [us]
+};
+
+static double percentile(std::vector<double> v, double p)
+{
+	if (v.empty()) return 0.0;
+	std::sort(v.begin(), v.end());
+	size_t i = (size_t)(p / 100.0 * (v.size() - 1) + 0.5);
+	return v[i];
+}
+
+static double mean(const std::vector<double> &v)
+{
+	if (v.empty()) return 0.0;
+	double s = 0.0;
+	for (size_t i = 0; i < v.size(); i++) s += v[i];
+	return s / v.size();
+}
+
+static void printPairs(const char *title, const std::map<std::string, Samples> &pairs)
+{
+	printf("---- %s ---- \n", title);
+	printf("%-44s %6s %10s %10s %10s %10s %10s \n", "pair", "count", "sim mean", "sim p50", "sim max", "wall p50", "wall p99");
+	printf("%-44s %6s %10s %10s %10s %10s %10s \n", "", "", "[ms]", "[ms]", "[ms]", "[us]", "[us]");
+	for (std::map<std::string, Samples>::const_iterator it = pairs.begin(); it != pairs.end(); it++) {
+		const Samples &s = it->second;
+		printf("%-44s %6lu %10.1lf %10.1lf %10.1lf %10.1lf %10.1lf \n", it->first.c_str(), (unsigned long)s.sim.size(),
+				mean(s.sim), percentile(s.sim, 50), percentile(s.sim, 100), percentile(s.wall, 50), percentile(s.wall, 99));
+	}
+}
+
+static void summary(const TraceFileHeader &h, const std::vector<TraceRecord> &recs)
+{
+	printf("==== trace: %llu records written, %lu kept (capacity %u) ==== \n",
+			(unsigned long long)h.head, (unsigned long)recs.size(), h.capacity);
+	if (recs.empty()) return;
+	printf("sim  %.3lf - %.3lf s \n", recs.front().sim, recs.back().sim);
+	printf("wall %.3lf ms \n", (recs.back().wall - recs.front().wall) / 1000000.0);
+
+	int count[TRACE_TYPE_NUM] = { 0 };
+	std::map<std::string, Samples> reply, react;
+	std::map<std::string, int> entries;
+	std::map<std::string, double> dwell;
+	const TraceRecord *lastSend = NULL;
+	const TraceRecord *lastRecv = NULL;
+	const TraceRecord *lastState = NULL;
+
+	for (size_t i = 0; i < recs.size(); i++) {
+		const TraceRecord &r = recs[i];
+		if (r.type < TRACE_TYPE_NUM) count[r.type]++;
+		if (r.type == TRACE_SEND) {
+			if (lastRecv != NULL) {
+				Samples &s = react[header(*lastRecv) + " -> " + header(r)];
+				s.sim.push_back((r.sim - lastRecv->sim) * 1000.0);
+				s.wall.push_back((r.wall - lastRecv->wall) / 1000.0);
+				lastRecv = NULL;
+			}
+			lastSend = &r;
+		} else if (r.type == TRACE_RECV) {
+			if (lastSend != NULL) {
+				Samples &s = reply[header(*lastSend) + " -> " + header(r)];
+				s.sim.push_back((r.sim - lastSend->sim) * 1000.0);
+				s.wall.push_back((r.wall - lastSend->wall) / 1000.0);
+				lastSend = NULL;
+			}
+			lastRecv = &r;
+		} else if (r.type == TRACE_STATE) {
+			if (lastState != NULL) dwell[text(*lastState)] += r.sim - lastState->sim;
+			entries[text(r)]++;
+			lastState = &r;
+		}
+	}
+	if (lastState != NULL) dwell[text(*lastState)] += recs.back().sim - lastState->sim;
+
+	printf("---- records ---- \n");
+	for (int t = 1; t < TRACE_TYPE_NUM; t++) {
+		printf("%-8s %8d \n", typeName(t), count[t]);
+	}
+	printPairs("send -> recv (service reply)", reply);
+	printPairs("recv -> send (controller reaction)", react);
+
+	printf("---- states ---- \n");
+	printf("%-16s %8s %10s \n", "state", "enter", "dwell[s]");
+	for (std::map<std::string, int>::const_iterator it = entries.begin(); it != entries.end(); it++) {
+		printf("%-16s %8d %10.2lf \n", it->first.c_str(), it->second, dwell[it->first]);
+	}
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: TraceDecode [-c out.csv] [-q] trace.bin \n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *csv = NULL;
+	bool quiet = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "c:q")) != -1) {
+		switch (opt) {
+			case 'c': csv = optarg; break;
+			case 'q': quiet = true; break;
+			default: usage(); return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		return 1;
+	}
+
+	FILE *fp = fopen(argv[optind], "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "TraceDecode: cannot open %s \n", argv[optind]);
+		return 1;
+	}
+	TraceFileHeader h;
+	if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, TRACE_MAGIC, 8) != 0 || h.recordSize != sizeof(TraceRecord)) {
+		fprintf(stderr, "TraceDecode: %s is not a trace file \n", argv[optind]);
+		fclose(fp);
+		return 1;
+	}
+	if (h.capacity == 0) {
+		// 0件のリングは TraceRecorder が作らない。壊れたヘッダとして扱う
+		fprintf(stderr, "TraceDecode: %s has no records (capacity 0) \n", argv[optind]);
+		fclose(fp);
+		return 1;
+	}
+
+	// リングの中で一番古いレコードから順に読む
+	std::vector<TraceRecord> ring(h.capacity);
+	size_t n = fread(&ring[0], sizeof(TraceRecord), h.capacity, fp);
+	fclose(fp);
+	uint64_t kept = h.head < h.capacity ? h.head : h.capacity;
+	if (n < kept) kept = n;
+	std::vector<TraceRecord> recs;
+	recs.reserve(kept);
+	for (uint64_t i = h.head - kept; i < h.head; i++) {
+		recs.push_back(ring[i % h.capacity]);
+	}
+
+	if (csv != NULL) {
+		FILE *out = strcmp(csv, "-") == 0 ? stdout : fopen(csv, "w");
+		if (out == NULL) {
+			fprintf(stderr, "TraceDecode: cannot open %s \n", csv);
+			return 1;
+		}
+		writeCsv(out, recs);
+		if (out != stdout) fclose(out);
+	}
+	if (!quiet) summary(h, recs);
+	return 0;
+}